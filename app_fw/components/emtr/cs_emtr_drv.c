@@ -6,6 +6,7 @@
  */
 
 #include "sdkconfig.h"
+#include <math.h>
 #include <esp_err.h>
 #include <esp_log.h>
 #include <driver/gpio.h>
@@ -99,12 +100,42 @@ typedef struct {
 
 #define EMTR_PRE_SAMPLE_SZ	(4)
 
+// Number of markers used by the P-square quantile estimator
+#define P2_NUM_MARKERS		(5)
+
+/**
+ * \brief P-square estimator for one quantile
+ *
+ * Tracks a quantile of a stream in constant memory (Jain & Chlamtac, 1985)
+ */
+typedef struct {
+	float		p;						// Quantile to estimate, 0..1
+	uint32_t	count;					// Number of samples applied
+	float		q[P2_NUM_MARKERS];		// Marker heights
+	int32_t		n[P2_NUM_MARKERS];		// Actual marker positions
+	float		np[P2_NUM_MARKERS];		// Desired marker positions
+} p2Est_t;
+
+typedef enum {
+	accQuant_p50 = 0,
+	accQuant_p95,
+	accQuant_p99,
+	accQuant_num
+} accQuant_t;
+
 typedef struct {
 	uint32_t	min;	// Minimum value read
 	uint32_t	max;	// Maximum value read
-	uint64_t	sum;
 	uint32_t	sampleCt;
+	float		mean;	// Running mean (Welford)
+	float		m2;		// Sum of squared differences from the mean
+	uint64_t	twSum;	// Sum of value x hold time (ms)
+	uint64_t	twStartMs;
+	uint64_t	twLastMs;
+	uint32_t	twLastValue;
+	p2Est_t		quant[accQuant_num];
 	uint32_t	preSample[EMTR_PRE_SAMPLE_SZ];
+	uint64_t	preSampleMs[EMTR_PRE_SAMPLE_SZ];
 	int			preSamplePut;
 	int			preSampleGet;
 	int			preSampleCt;
@@ -255,6 +286,12 @@ static void resetEmtrAccumulator(accum_t * eAvg, int value);
 
 static void resetEmtrAccumulators(accEnergy_t * eAccum);
 
+static void p2Init(p2Est_t * est, float p);
+
+static void p2Update(p2Est_t * est, float x);
+
+static uint32_t p2Result(p2Est_t * est);
+
 
 static void ctrlTask(void * params);
 
@@ -600,11 +637,35 @@ static void cpyAccum(csEmtrAvgEnergy_t * dst, accum_t * src)
 {
 	dst->min = src->min;
 	dst->max = src->max;
-	if (src->sampleCt > 0) {
-		dst->avg = (uint32_t)(src->sum / (uint64_t)src->sampleCt);
+
+	if (0 == src->sampleCt) {
+		dst->avg    = 0;
+		dst->twAvg  = 0;
+		dst->stdDev = 0;
+		dst->p50    = 0;
+		dst->p95    = 0;
+		dst->p99    = 0;
+		return;
+	}
+
+	dst->avg = (uint32_t)(src->mean + 0.5f);
+
+	uint64_t	spanMs = src->twLastMs - src->twStartMs;
+	if (spanMs > 0) {
+		dst->twAvg = (uint32_t)((src->twSum + spanMs / 2) / spanMs);
 	} else {
-		dst->avg = 0;
+		dst->twAvg = dst->avg;
 	}
+
+	if (src->sampleCt > 1) {
+		dst->stdDev = (uint32_t)(sqrtf(src->m2 / (float)(src->sampleCt - 1)) + 0.5f);
+	} else {
+		dst->stdDev = 0;
+	}
+
+	dst->p50 = p2Result(&src->quant[accQuant_p50]);
+	dst->p95 = p2Result(&src->quant[accQuant_p95]);
+	dst->p99 = p2Result(&src->quant[accQuant_p99]);
 }
 
 
@@ -1741,15 +1802,129 @@ static esp_err_t emtrRunModeSet(
 }
 
 
+static void p2Init(p2Est_t * est, float p)
+{
+	memset(est, 0, sizeof(*est));
+	est->p = p;
+}
+
+
+static void p2Update(p2Est_t * est, float x)
+{
+	int		i;
+	int		k;
+
+	if (est->count < P2_NUM_MARKERS) {
+		// Insertion sort the first samples into the marker heights
+		for (i = est->count; i > 0 && est->q[i - 1] > x; i--) {
+			est->q[i] = est->q[i - 1];
+		}
+		est->q[i] = x;
+
+		if (++est->count == P2_NUM_MARKERS) {
+			float	p = est->p;
+
+			for (i = 0; i < P2_NUM_MARKERS; i++) {
+				est->n[i] = i;
+			}
+			est->np[0] = 0.0f;
+			est->np[1] = 2.0f * p;
+			est->np[2] = 4.0f * p;
+			est->np[3] = 2.0f + 2.0f * p;
+			est->np[4] = 4.0f;
+		}
+		return;
+	}
+
+	est->count += 1;
+
+	// Find the cell containing the sample, extending the extremes if needed
+	if (x < est->q[0]) {
+		est->q[0] = x;
+		k = 0;
+	} else if (x >= est->q[4]) {
+		est->q[4] = x;
+		k = 3;
+	} else {
+		for (k = 0; k < 3 && x >= est->q[k + 1]; k++) {
+		}
+	}
+
+	// Shift the positions of the markers above the sample
+	for (i = k + 1; i < P2_NUM_MARKERS; i++) {
+		est->n[i] += 1;
+	}
+
+	// Advance the desired positions
+	est->np[1] += est->p / 2.0f;
+	est->np[2] += est->p;
+	est->np[3] += (1.0f + est->p) / 2.0f;
+	est->np[4] += 1.0f;
+
+	// Adjust the middle markers that have drifted from their desired positions
+	for (i = 1; i < 4; i++) {
+		float	d = est->np[i] - (float)est->n[i];
+
+		if ((d >= 1.0f && est->n[i + 1] - est->n[i] > 1) ||
+			(d <= -1.0f && est->n[i - 1] - est->n[i] < -1)) {
+			int		ds = (d > 0.0f) ? 1 : -1;
+			float	qi = est->q[i];
+			float	nLo = (float)(est->n[i] - est->n[i - 1]);
+			float	nHi = (float)(est->n[i + 1] - est->n[i]);
+			float	qp;
+
+			// Piecewise-parabolic prediction
+			qp = qi + (float)ds / (nLo + nHi) * (
+				(nLo + ds) * (est->q[i + 1] - qi) / nHi +
+				(nHi - ds) * (qi - est->q[i - 1]) / nLo
+			);
+
+			if (est->q[i - 1] < qp && qp < est->q[i + 1]) {
+				est->q[i] = qp;
+			} else {
+				// Fall back to linear prediction
+				est->q[i] = qi + (float)ds * (est->q[i + ds] - qi) /
+					(float)(est->n[i + ds] - est->n[i]);
+			}
+
+			est->n[i] += ds;
+		}
+	}
+}
+
+
+static uint32_t p2Result(p2Est_t * est)
+{
+	if (0 == est->count)
+		return 0;
+
+	if (est->count < P2_NUM_MARKERS) {
+		// Still holding the raw samples, in sorted order
+		int	idx = (int)(est->p * (float)(est->count - 1) + 0.5f);
+		return (uint32_t)(est->q[idx] + 0.5f);
+	}
+
+	return (uint32_t)(est->q[2] + 0.5f);
+}
+
+
 static void initEmtrAccumulator(accum_t *eAvg)
 {
 	// Reset min/max accumulators
 	eAvg->min = 0x7fffffff;
 	eAvg->max = 0;
 
-	// Initialize the average value accumulator
+	// Initialize the mean and variance
 	eAvg->sampleCt = 0;
-	eAvg->sum      = 0;
+	eAvg->mean     = 0.0f;
+	eAvg->m2       = 0.0f;
+
+	// Initialize the time-weighted mean
+	eAvg->twSum = 0;
+
+	p2Init(&eAvg->quant[accQuant_p50], 0.50f);
+	p2Init(&eAvg->quant[accQuant_p95], 0.95f);
+	p2Init(&eAvg->quant[accQuant_p99], 0.99f);
 
 	// Initialize the sample ring buffer
 	eAvg->preSampleCt  = 0;
@@ -1758,14 +1933,16 @@ static void initEmtrAccumulator(accum_t *eAvg)
 }
 
 
-static void updateEmtrAccumulator(accum_t * eAvg, int32_t newSample)
+static void updateEmtrAccumulator(accum_t * eAvg, int32_t newSample, uint64_t timeMs)
 {
 	// Wait for the sample ring buffer to be loaded before applying its contents
 	if (EMTR_PRE_SAMPLE_SZ == eAvg->preSampleCt) {
 		uint32_t	value;
+		uint64_t	valueMs;
 
 		// Read the oldest value from the ring buffer
-		value = eAvg->preSample[eAvg->preSampleGet];
+		value   = eAvg->preSample[eAvg->preSampleGet];
+		valueMs = eAvg->preSampleMs[eAvg->preSampleGet];
 		if (++eAvg->preSampleGet == EMTR_PRE_SAMPLE_SZ) {
 			eAvg->preSampleGet = 0;
 		}
@@ -1777,13 +1954,33 @@ static void updateEmtrAccumulator(accum_t * eAvg, int32_t newSample)
 		if (value > eAvg->max)
 			eAvg->max = value;
 
-		// Apply the value to the average accumulator
-		eAvg->sum += (uint64_t)value;
+		// Update the running mean and variance
+		float	delta;
+
 		eAvg->sampleCt += 1;
+		delta       = (float)value - eAvg->mean;
+		eAvg->mean += delta / (float)eAvg->sampleCt;
+		eAvg->m2   += delta * ((float)value - eAvg->mean);
+
+		// Each value holds until the next one, so a missed poll gives the
+		// previous value a longer weight rather than being ignored
+		if (1 == eAvg->sampleCt) {
+			eAvg->twStartMs = valueMs;
+		} else {
+			eAvg->twSum += (uint64_t)eAvg->twLastValue * (valueMs - eAvg->twLastMs);
+		}
+		eAvg->twLastValue = value;
+		eAvg->twLastMs    = valueMs;
+
+		int		i;
+		for (i = 0; i < accQuant_num; i++) {
+			p2Update(&eAvg->quant[i], (float)value);
+		}
 	}
 
 	// Add the newest sample to the ring buffer
-	eAvg->preSample[eAvg->preSamplePut] = newSample;
+	eAvg->preSample[eAvg->preSamplePut]   = newSample;
+	eAvg->preSampleMs[eAvg->preSamplePut] = timeMs;
 	if (++eAvg->preSamplePut == EMTR_PRE_SAMPLE_SZ) {
 		eAvg->preSamplePut = 0;
 	}
@@ -1806,18 +2003,19 @@ static void updateEmtrAccumulators(accEnergy_t * eAcc, csEmtrInstEnergy_t * inst
 		initEmtrAccumulator(&eAcc->dWatts);
 		initEmtrAccumulator(&eAcc->pFactor);
 	} else if (curTimeMs >= eAcc->holdOffMs) {
-		updateEmtrAccumulator(&eAcc->dVolts, inst->dVolts);
-		updateEmtrAccumulator(&eAcc->mAmps, inst->mAmps);
-		updateEmtrAccumulator(&eAcc->dWatts, inst->dWatts);
-		updateEmtrAccumulator(&eAcc->pFactor, inst->pFactor);
+		updateEmtrAccumulator(&eAcc->dVolts, inst->dVolts, curTimeMs);
+		updateEmtrAccumulator(&eAcc->mAmps, inst->mAmps, curTimeMs);
+		updateEmtrAccumulator(&eAcc->dWatts, inst->dWatts, curTimeMs);
+		updateEmtrAccumulator(&eAcc->pFactor, inst->pFactor, curTimeMs);
 	}
 }
 
 
 static void resetEmtrAccumulator(accum_t * eAvg, int32_t value)
 {
-	eAvg->min = value;
-	eAvg->max = value;
+	eAvg->min      = value;
+	eAvg->max      = value;
+	eAvg->sampleCt = 0;
 }
 
 
@@ -6,6 +6,7 @@
  */
 #include <esp_err.h>
 #include <esp_log.h>
+#include <xtensa/hal.h>
 
 #include "cs_common.h"
 #include "cs_packer.h"
@@ -38,10 +39,32 @@ typedef enum {
 	pwrSigState_recvData,
 	pwrSigState_cksum,
 	pwrSigState_discard,
+	pwrSigState_skip,
 	pwrSigState_recvTestResult,
 } pwrSigState_t;
 
-#define PWR_METRICS_HDR_SZ		(32)
+// SOP, 'S', payload length, check digit and EOP around the payload
+#define PWR_SIG_FRAME_OVERHEAD	(6)
+
+// UART events queued for the task
+#define PWR_SIG_EVT_QUEUE_SZ	(20)
+
+// Idle time, in symbols, after which received bytes are handed to the task
+// instead of waiting for the RX FIFO threshold
+#define PWR_SIG_RX_TOUT_SYMBOLS	(2)
+
+// Default number of signature buffers
+#define PWR_SIG_NUM_BUFS		(2)
+
+
+/**
+ * \brief One signature, owned by either the receiver or the consumer
+ */
+typedef struct {
+	pwrSigMeta_t		meta;
+	int					dataLen;
+	uint8_t				data[PWR_METRICS_HDR_SZ + PWR_SIG_MAX_SIG_SZ];
+} sigBuf_t;
 
 typedef enum {
 	pwrPayloadType_sig
@@ -53,6 +76,11 @@ typedef enum {
  */
 typedef struct {
 	pwrSigConf_t		conf;
+	QueueHandle_t		uartQueue;
+	QueueHandle_t		freeQueue;		// Buffers available to the receiver
+	QueueHandle_t		readyQueue;		// Buffers waiting for the consumer
+	sigBuf_t *			bufPool;
+	sigBuf_t *			cur;			// Buffer being filled, NULL if none
 	bool				isRunning;
 	pwrSigState_t		state;
 	uint8_t				cksum;
@@ -67,8 +95,10 @@ typedef struct {
 	int					hdrLen;
 	uint8_t				sigHdr[PWR_SIG_HDR_SZ];
 	int					sigLen;
-	uint8_t				sigBuf[PWR_METRICS_HDR_SZ + PWR_SIG_MAX_SIG_SZ];
+	int					skipLen;
 	uint32_t			sigCount;
+	uint32_t			frameCycles;
+	pwrSigStats_t		stats;
 } taskCtrl_t;
 
 
@@ -77,6 +107,8 @@ typedef struct {
 ////////////////////////////////////////////////////////////////////////////////
 static void pwrSigTask(void * params);
 
+static void pwrSigDeliverTask(void * params);
+
 
 ////////////////////////////////////////////////////////////////////////////////
 // Local variables
@@ -97,6 +129,29 @@ esp_err_t pwrSigInit(pwrSigConf_t* conf)
 
 	// Copy configuration
 	pCtrl->conf = *conf;
+	if (pCtrl->conf.numBufs <= 0) {
+		pCtrl->conf.numBufs = PWR_SIG_NUM_BUFS;
+	}
+	if (0 == pCtrl->conf.cbTaskPriority) {
+		pCtrl->conf.cbTaskPriority = pCtrl->conf.taskPriority > 1 ? pCtrl->conf.taskPriority - 1 : 1;
+	}
+
+	esp_err_t	status;
+	int			i;
+
+	// Set up the signature buffer pool, all buffers start out free
+	pCtrl->bufPool = calloc(pCtrl->conf.numBufs, sizeof(sigBuf_t));
+	pCtrl->freeQueue  = xQueueCreate(pCtrl->conf.numBufs, sizeof(sigBuf_t *));
+	pCtrl->readyQueue = xQueueCreate(pCtrl->conf.numBufs, sizeof(sigBuf_t *));
+	if (!pCtrl->bufPool || !pCtrl->freeQueue || !pCtrl->readyQueue) {
+		status = ESP_ERR_NO_MEM;
+		goto exitMem;
+	}
+
+	for (i = 0; i < pCtrl->conf.numBufs; i++) {
+		sigBuf_t *	buf = &pCtrl->bufPool[i];
+		xQueueSend(pCtrl->freeQueue, &buf, 0);
+	}
 
 	uart_config_t	uCfg = {
 		.baud_rate = pCtrl->conf.baudRate,
@@ -106,10 +161,8 @@ esp_err_t pwrSigInit(pwrSigConf_t* conf)
 		.flow_ctrl = UART_HW_FLOWCTRL_DISABLE
 	};
 
-	esp_err_t	status;
-
 	if ((status = uart_param_config(pCtrl->conf.port, &uCfg)) != ESP_OK) {
-		return status;
+		goto exitMem;
 	}
 
 	status = uart_set_pin(
@@ -120,17 +173,49 @@ esp_err_t pwrSigInit(pwrSigConf_t* conf)
 		UART_PIN_NO_CHANGE	// CTS not used
 	);
 	if (ESP_OK != status) {
-		return status;
+		goto exitMem;
 	}
 
-	int	rxBufSz = PWR_SIG_HDR_SZ + PWR_SIG_MAX_SIG_SZ;
-	status = uart_driver_install(pCtrl->conf.port, rxBufSz, 0, 0, NULL, 0);
+	// Default to holding one full signature
+	int	rxBufSz = pCtrl->conf.rxBufSz;
+	if (rxBufSz <= 0) {
+		rxBufSz = PWR_SIG_FRAME_OVERHEAD + PWR_SIG_HDR_SZ + PWR_SIG_MAX_SIG_SZ;
+	}
+	if (rxBufSz <= UART_FIFO_LEN) {
+		rxBufSz = UART_FIFO_LEN + 1;
+	}
+
+	status = uart_driver_install(
+		pCtrl->conf.port,
+		rxBufSz,
+		0,
+		PWR_SIG_EVT_QUEUE_SZ,
+		&pCtrl->uartQueue,
+		0
+	);
 	if (ESP_OK != status) {
-		return status;
+		goto exitMem;
+	}
+
+	// Wake the task as soon as the line goes idle
+	status = uart_set_rx_timeout(pCtrl->conf.port, PWR_SIG_RX_TOUT_SYMBOLS);
+	if (ESP_OK != status) {
+		uart_driver_delete(pCtrl->conf.port);
+		goto exitMem;
 	}
 
 	taskCtrl = pCtrl;
 	return ESP_OK;
+
+exitMem:
+	if (pCtrl->readyQueue)
+		vQueueDelete(pCtrl->readyQueue);
+	if (pCtrl->freeQueue)
+		vQueueDelete(pCtrl->freeQueue);
+	if (pCtrl->bufPool)
+		free(pCtrl->bufPool);
+	free(pCtrl);
+	return status;
 }
 
 
@@ -146,8 +231,22 @@ esp_err_t pwrSigStart(void)
 		return ESP_OK;
 	}
 
-	// Start the power signature read task
+	// Start the task handing signatures to the client
 	BaseType_t	xStatus;
+	xStatus = xTaskCreate(
+		pwrSigDeliverTask,
+		"pwrsigcb",
+		4000,
+		(void*)pCtrl,
+		pCtrl->conf.cbTaskPriority,
+		NULL
+	);
+	if (pdPASS != xStatus) {
+		ESP_LOGE(TAG, "Task create failed");
+		return ESP_FAIL;
+	}
+
+	// Start the power signature read task
 	xStatus = xTaskCreate(
 		pwrSigTask,
 		"pwrsig",
@@ -192,14 +291,40 @@ esp_err_t pwrSigCount(uint32_t * ret)
 }
 
 
+/**
+ * \brief Return the parser statistics since boot
+ *
+ * Throughput in bytes per second is byteCount * CPU clock / parseCycles
+ */
+esp_err_t pwrSigGetStats(pwrSigStats_t * ret)
+{
+	if (!ret) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	taskCtrl_t*	pCtrl = taskCtrl;
+	if (NULL == pCtrl) {
+		ESP_LOGE(TAG, "Driver not initialized");
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	*ret = pCtrl->stats;
+	ret->sigCount = pCtrl->sigCount;
+	ret->bufsFree = (uint32_t)uxQueueMessagesWaiting(pCtrl->freeQueue);
+	return ESP_OK;
+}
+
+
 const char* pwrSigReasonStr(pwrSigReason_t reason)
 {
 	switch (reason)
 	{
 	case pwrSigReason_on:
-		return "Off";
+		return "On";
 	case pwrSigReason_off:
 		return "Off";
+	case pwrSigReason_demand:
+		return "Demand";
 	default:
 		return "Undefined";
 	}
@@ -275,142 +400,98 @@ void pwrSigReadHex(int maxLen)
 }
 
 
-static uint32_t getInrushCurrent(taskCtrl_t * pwr)
-{
-	// Signature data begins after the header
-	uint8_t *	samp    = &pwr->sigBuf[PWR_METRICS_HDR_SZ];
-	// For each sample, two 16-bit signed values
-	//   bytes 1-0 == volts ADC value
-	//   bytes 3-2 == amps ADC value
-
-	float	iLo = 0.0;
-	float	iHi = 0.0;
-
-	int	i;
-	for (i = 0; i < pwr->meta.numSamples; i++, samp += 4) {
-
-		uint16_t	iADC = ((uint16_t)(samp[2]) << 8) + ((uint16_t)(samp[3]));
-		float		amps;
-
-		if (iADC < 0x8000) {
-			amps = (float)iADC / 327.68;
-		} else {
-			amps = -(float)(iADC ^ 0xFFFF) / 327.68;
-		}
-
-#if 0
-		uint16_t	vADC = ((uint16_t)(samp[0]) << 8) + ((uint16_t)(samp[1]));
-		float		volts;
-
-		if (vADC < 0x8000) {
-			volts = (float)vADC / 65.535;
-		} else {
-			volts = -(float)(vADC ^ 0xFFFF) / 65.535;
-		}
-
-		if (0 == i) {
-			gc_dbg("v_adc, volts, i_adc, amps");
-		}
-		gc_dbg("  0x%04x, %3.3f, 0x%04x, %3.3f", vADC, volts, iADC, amps);
-#endif
-
-		if (amps < iLo) {
-			iLo = amps;
-		} else if (amps > iHi) {
-			iHi = amps;
-		}
-	}
-
-	float	iPP  = iHi - iLo;
-	float	iRMS = (iPP / 2.0) * 0.7071;
-
-	// In-rush current is RMS value of the peak-to-peak current
-	return (uint32_t)(iRMS * 1000.0);
-}
-
-
 /**
  * \brief Unpack meta data from the power signature header
  *   offset  len
  *        0    1  Reason: 0 = pump off, 1 = pump on, 2 = demand
  *        1    4  Pump cycle count, 32-bit, big-endian
- *        5    4  Relay cycle count, 32-bit, big-endian
- *        9    4  Cycle run time, seconds, valid only on pump off
- *       13    2  Average amps, units of 0.001 amps, valid only on pump off
- *       15    2  Average volts, units of 0.1 volts, valid only on pump off
- *       17    1  Average power factor, valid only on pump off
- *       18    1  Temperature, degrees C, valid only on pump off
- *       19    4  Pump epoch, 32-bit, big-endian
- *       23    4  Pump run time, 32-bit, big-endian, valid only on pump off
- *       27    1  Water level 0..5
- *       28    1  GFCI -- Deprecated
- *       29    1  Sample resolution
- *                0 12.0 KHz
- *                1  6.0 KHz
- *                2  4.0 KHz
- *                3  3.0 KHz
- *                4  2.4 KHz
- *                5  2.0 KHz
+ *        5    4  Epoch, 32-bit, big-endian
+ *        9    4  Pump on time, seconds, 32-bit, big-endian
+ *       13    1  Water level 0..5
+ *       14    1  GFCI leak level 0..5
+ *
+ * The stream carries no sample resolution, the EMTR samples at 12 KHz
+ *
+ * \return ESP_OK Success
+ * \return ESP_ERR_INVALID_SIZE Header or signature length not valid
+ * \return ESP_ERR_INVALID_RESPONSE Header field out of range
  */
-static void pwrSigUnpackMeta(taskCtrl_t * pCtrl)
+static esp_err_t pwrSigUnpackMeta(taskCtrl_t * pCtrl)
 {
 	// Shorthand to the meta data structure
 	pwrSigMeta_t *	meta = &pCtrl->meta;
+	esp_err_t		status;
+	uint8_t			u8Temp;
 
-	csPacker_t	unpack;
-	csPackInit(&unpack, pCtrl->sigHdr, pCtrl->hdrLen);
+	if (PWR_SIG_HDR_SZ != pCtrl->hdrLen || 0 != pCtrl->sigLen % PWR_SIG_SMP_SZ) {
+		ESP_LOGE(TAG, "Bad signature size (header %d, data %d)", pCtrl->hdrLen, pCtrl->sigLen);
+		return ESP_ERR_INVALID_SIZE;
+	}
 
-	/* ToDo
+	memset(meta, 0, sizeof(*meta));
 
-	uint8_t	u8Temp;
+	csPacker_t	unpack;
+	csPackInit(&unpack, pCtrl->sigHdr, pCtrl->hdrLen);
 
 	// Reason code
 	csUnpackU8(&unpack, &u8Temp);
-	meta->reason = (wwPwrSigReason_t)u8Temp;
+	meta->reason = (pwrSigReason_t)u8Temp;
 	// Pump cycles
 	csUnpackBEU32(&unpack, &meta->pumpCycles);
-	// Relay cycles
-	csUnpackBEU32(&unpack, &meta->relayCycles);
-	// These are valid only on pump-off
-	if (wwPwrSigReason_pumpOff == meta->reason) {
-		// Cycle length
-		csUnpackBEU32(&unpack, &meta->cycleLength);
-		// Average amps
-		csUnpackBEU16(&unpack, &meta->mAmps);
-		// Average volts
-		csUnpackBEU16(&unpack, &meta->dVolts);
-		// Average power factor
-		csUnpackU8(&unpack, &meta->pFactor);
-		// Temperature
-		csUnpackU8(&unpack, &meta->temperature);
-	} else {
-		csUnpackSkip(&unpack, 10);
-
-		meta->cycleLength = 0;
-		meta->mAmps       = 0;
-		meta->dVolts      = 0;
-		meta->pFactor     = 0;
-		meta->temperature = 0;
-	}
-	// Total time powered
-	csUnpackBEU32(&unpack, &meta->timePowered);
-	// Total run time
+	// Epoch
+	csUnpackBEU32(&unpack, &meta->epoch);
+	// Pump on time
 	csUnpackBEU32(&unpack, &meta->timeRunning);
 	// Water level
 	csUnpackU8(&unpack, &meta->waterLevel);
-	// GFCI level -- deprecated
-	csUnpackSkip(&unpack, 1);
-	// Resolution
-	csUnpackU8(&unpack, &meta->resolution);
+	// GFCI leak level
+	csUnpackU8(&unpack, &meta->gfciLevel);
+
+	if ((status = csPackStatus(&unpack)) != ESP_OK) {
+		ESP_LOGE(TAG, "Error %d unpacking signature header", status);
+		return status;
+	}
+
+	if (u8Temp > pwrSigReason_demand || meta->waterLevel > PWR_SIG_MAX_LEVEL || meta->gfciLevel > PWR_SIG_MAX_LEVEL) {
+		ESP_LOGE(TAG, "Bad signature header (reason %u, water %u, GFCI %u)",
+			u8Temp, meta->waterLevel, meta->gfciLevel);
+		return ESP_ERR_INVALID_RESPONSE;
+	}
+
+	meta->resolution = 0;
 
 	// Derive the sample count from the size of the data
 	meta->numSamples = pCtrl->sigLen / PWR_SIG_SMP_SZ;
 
-	*/
+	// For "on" event, analyze the inrush current
+	if (pwrSigReason_on == meta->reason) {
+		// Signature data begins after the header
+		esp_err_t	status = pwrSigAnalyze(
+			&pCtrl->cur->data[PWR_METRICS_HDR_SZ],
+			meta->numSamples,
+			pwrSigSampleRate(meta->resolution),
+			PWR_SIG_KNL_MAINS_HZ,
+			&meta->inrush
+		);
+
+		if (ESP_OK == status) {
+			// In-rush current is the largest RMS current over one mains cycle
+			meta->mAmpsInrush = meta->inrush.mAmpsRmsMax;
+
+			status = pwrSigExtract(
+				&pCtrl->cur->data[PWR_METRICS_HDR_SZ],
+				meta->numSamples,
+				pwrSigSampleRate(meta->resolution),
+				PWR_SIG_KNL_MAINS_HZ,
+				&meta->inrush,
+				&meta->features
+			);
+		}
 
-	// For "on" event, determine inrush current
-	if (pwrSigReason_on == pCtrl->meta.reason) {
-		meta->mAmpsInrush = getInrushCurrent(pCtrl);
+		if (ESP_OK == status) {
+			// Identify what started from the built-in load library
+			pwrSigClassify(meta->features.fp, NULL, 0, &meta->load);
+		}
 	}
 
 #if 0
@@ -425,6 +506,11 @@ static void pwrSigUnpackMeta(taskCtrl_t * pCtrl)
 	gc_dbg("  Water level     : %u", meta->waterLevel);
 	if (pwrSigReason_on == meta->reason) {
 		gc_dbg("  Inrush amps     : %0.3f", (double)meta->mAmpsInrush/1000.0);
+		gc_dbg("  Peak amps       : %0.3f", (double)meta->inrush.mAmpsPeak/1000.0);
+		gc_dbg("  Settle uSec     : %u", meta->inrush.usSettle);
+		gc_dbg("  Inrush mJ       : %d", meta->inrush.mJoulesInrush);
+		gc_dbg("  THD permille    : %u", meta->features.thdPermille);
+		gc_dbg("  Load            : %s", pwrSigLoadStr(meta->load.load));
 	} else if (pwrSigReason_off == meta->reason) {
 		gc_dbg("  Cycle length    : %u", meta->cycleLength);
 		gc_dbg("  Average volts   : %0.2f", (double)meta->dVolts/10.0);
@@ -433,12 +519,247 @@ static void pwrSigUnpackMeta(taskCtrl_t * pCtrl)
 		gc_dbg("  Temperature     : %u", meta->temperature);
 	}
 #endif
+
+	return ESP_OK;
+}
+
+
+/**
+ * \brief Pack the metrics header in front of the signature samples
+ */
+static void pwrSigPackHdr(const pwrSigMeta_t * meta, uint8_t * buf)
+{
+	csPacker_t	pack;
+	csPackInitZ(&pack, buf, PWR_METRICS_HDR_SZ);
+
+	csPackU8(&pack, PWR_METRICS_HDR_VERSION);
+	csPackU8(&pack, (uint8_t)meta->reason);
+	csPackU8(&pack, meta->waterLevel);
+	csPackU8(&pack, meta->gfciLevel);
+	csPackBEU16(&pack, meta->numSamples);
+	csPackU8(&pack, meta->resolution);
+	csPackU8(&pack, PWR_SIG_SMP_SZ);
+	csPackBEU32(&pack, meta->pumpCycles);
+	csPackBEU32(&pack, meta->timePowered);
+	csPackBEU32(&pack, meta->timeRunning);
+	csPackBEU32(&pack, meta->epoch);
+	// The rest is reserved and was zeroed
+}
+
+
+/**
+ * \brief Decode the metrics header of a signature handed to the client
+ *
+ * Every field is checked before anything is returned, and the samples the
+ * header describes must fit in dataLen. The view refers to the samples in
+ * data, nothing is copied.
+ *
+ * \param [in] data Signature as passed to \ref pwrSigCallback_t
+ * \param [in] dataLen Length of data
+ * \param [out] hdr Header fields, may be NULL
+ * \param [out] view View of all samples, may be NULL
+ *
+ * \return ESP_OK Success
+ * \return ESP_ERR_INVALID_ARG NULL data
+ * \return ESP_ERR_INVALID_SIZE Too short for the header or the samples
+ * \return ESP_ERR_INVALID_VERSION Unknown header version
+ * \return ESP_ERR_INVALID_RESPONSE Header field out of range
+ */
+esp_err_t pwrSigDecode(
+	const uint8_t *	data,
+	int				dataLen,
+	pwrSigHdr_t *	hdr,
+	pwrSigView_t *	view
+)
+{
+	if (!data) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	if (dataLen < PWR_METRICS_HDR_SZ) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	pwrSigHdr_t	tmp;
+	uint8_t		u8Temp;
+
+	// The unpacker does not write to the array
+	csPacker_t	unpack;
+	csPackInit(&unpack, (uint8_t *)data, PWR_METRICS_HDR_SZ);
+
+	csUnpackU8(&unpack, &tmp.version);
+	csUnpackU8(&unpack, &u8Temp);
+	tmp.reason = (pwrSigReason_t)u8Temp;
+	csUnpackU8(&unpack, &tmp.waterLevel);
+	csUnpackU8(&unpack, &tmp.gfciLevel);
+	csUnpackBEU16(&unpack, &tmp.numSamples);
+	csUnpackU8(&unpack, &tmp.resolution);
+	csUnpackU8(&unpack, &tmp.sampleSz);
+	csUnpackBEU32(&unpack, &tmp.pumpCycles);
+	csUnpackBEU32(&unpack, &tmp.timePowered);
+	csUnpackBEU32(&unpack, &tmp.timeRunning);
+	csUnpackBEU32(&unpack, &tmp.epoch);
+
+	esp_err_t	status;
+	if ((status = csPackStatus(&unpack)) != ESP_OK) {
+		return status;
+	}
+
+	if (PWR_METRICS_HDR_VERSION != tmp.version) {
+		return ESP_ERR_INVALID_VERSION;
+	}
+
+	if (
+		u8Temp > pwrSigReason_demand ||
+		tmp.waterLevel > PWR_SIG_MAX_LEVEL ||
+		tmp.gfciLevel > PWR_SIG_MAX_LEVEL ||
+		tmp.resolution > PWR_SIG_MAX_RESOLUTION ||
+		PWR_SIG_SMP_SZ != tmp.sampleSz ||
+		tmp.numSamples > PWR_SIG_MAX_SAMPLES
+	) {
+		return ESP_ERR_INVALID_RESPONSE;
+	}
+
+	if (dataLen - PWR_METRICS_HDR_SZ < (int)tmp.numSamples * PWR_SIG_SMP_SZ) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	if (hdr) {
+		*hdr = tmp;
+	}
+
+	if (view) {
+		view->samp       = data + PWR_METRICS_HDR_SZ;
+		view->numSamples = tmp.numSamples;
+		view->stride     = PWR_SIG_SMP_SZ;
+		view->sampleRate = pwrSigSampleRate(tmp.resolution);
+	}
+
+	return ESP_OK;
+}
+
+
+/**
+ * \brief Make a view of part of another view
+ *
+ * Takes count samples starting at sample first, using every step'th
+ * sample. Decimating this way lowers the sample rate by step, with no
+ * filtering.
+ *
+ * \param [in] view View to take from
+ * \param [in] first First sample of view to use
+ * \param [in] count Samples in the new view, -1 for as many as fit
+ * \param [in] step Distance between used samples, 1 for every sample
+ * \param [out] ret New view
+ *
+ * \return ESP_OK Success
+ * \return ESP_ERR_INVALID_ARG Bad parameter
+ * \return ESP_ERR_INVALID_SIZE Range outside the view, or step too large
+ */
+esp_err_t pwrSigViewSub(
+	const pwrSigView_t *	view,
+	int						first,
+	int						count,
+	int						step,
+	pwrSigView_t *			ret
+)
+{
+	if (!view || !ret || first < 0 || step < 1 || count < -1 || view->stride < 1) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	if (first > view->numSamples) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	// Written so that no step, up to INT_MAX, overflows
+	int	remain = view->numSamples - first;
+	int	avail  = (remain > 0) ? 1 + (remain - 1) / step : 0;
+
+	if (count < 0) {
+		count = avail;
+	} else if (count > avail) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	if (step > INT_MAX / view->stride) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	ret->samp       = view->samp + (size_t)first * view->stride;
+	ret->numSamples = count;
+	ret->stride     = view->stride * step;
+	ret->sampleRate = view->sampleRate / (uint32_t)step;
+
+	return ESP_OK;
 }
 
 // EMTR message framing characters
 #define MSG_CHAR_SOP	((uint8_t)0x1B)
 #define MSG_CHAR_EOP	((uint8_t)0x0A)
 
+
+/**
+ * \brief Make sure the receiver has a buffer to fill
+ *
+ * A buffer left over from a frame that failed is used again.
+ *
+ * \return true A buffer is available in pCtrl->cur
+ * \return false All buffers are with the client
+ */
+static bool takeSigBuf(taskCtrl_t* pCtrl)
+{
+	if (pCtrl->cur) {
+		return true;
+	}
+
+	if (xQueueReceive(pCtrl->freeQueue, &pCtrl->cur, 0) != pdTRUE) {
+		pCtrl->cur = NULL;
+		return false;
+	}
+
+	int	inUse = pCtrl->conf.numBufs - (int)uxQueueMessagesWaiting(pCtrl->freeQueue);
+	if (inUse > pCtrl->stats.bufsInUseMax) {
+		pCtrl->stats.bufsInUseMax = inUse;
+	}
+
+	return true;
+}
+
+
+/**
+ * \brief XOR a block of bytes into a checksum, a word at a time
+ */
+static uint8_t xorBlock(uint8_t cksum, const uint8_t * data, int len)
+{
+	uint32_t	acc = 0;
+
+	// Bytes up to a word boundary
+	while (len > 0 && ((uintptr_t)data & 3) != 0) {
+		cksum ^= *data++;
+		len--;
+	}
+
+	// Whole words, the byte order does not matter to a XOR
+	const uint32_t *	word = (const uint32_t *)data;
+	for (; len >= 4; len -= 4) {
+		acc ^= *word++;
+	}
+
+	// Fold the word into a byte
+	acc ^= acc >> 16;
+	acc ^= acc >> 8;
+	cksum ^= (uint8_t)acc;
+
+	// Trailing bytes
+	data = (const uint8_t *)word;
+	while (len-- > 0) {
+		cksum ^= *data++;
+	}
+
+	return cksum;
+}
+
 /**
  * \brief Process received data from the EMTR power signature channel
  *
@@ -480,6 +801,8 @@ static void pwrSigUnpackMeta(taskCtrl_t * pCtrl)
 static void handlePwrData(taskCtrl_t* pCtrl, uint8_t * data, int len)
 {
 	uint64_t	curTimeMs = TIME_MS();
+	int			chunk;
+	uint8_t *	dest;
 
 	if (pwrSigState_idle != pCtrl->state) {
 		if (curTimeMs - pCtrl->startTimeMs >= 500) {
@@ -499,6 +822,7 @@ static void handlePwrData(taskCtrl_t* pCtrl, uint8_t * data, int len)
 				pCtrl->cksum       = 0;
 				pCtrl->state       = pwrSigState_sop;
 				pCtrl->startTimeMs = curTimeMs;
+				pCtrl->frameCycles = 0;
 			}
 			break;
 
@@ -539,6 +863,14 @@ static void handlePwrData(taskCtrl_t* pCtrl, uint8_t * data, int len)
 				case pwrPayloadType_sig:
 					// Set up to receive the power signature header
 					if (pCtrl->payloadLen > PWR_SIG_HDR_SZ) {
+						if (!takeSigBuf(pCtrl)) {
+							// The client still has all the buffers, skip the
+							// payload, check digit and EOP
+							pCtrl->stats.sigDropCount += 1;
+							pCtrl->skipLen = pCtrl->payloadLen + 1;
+							pCtrl->state   = pwrSigState_skip;
+							break;
+						}
 						pCtrl->hdrLen = 0;
 						pCtrl->state  = pwrSigState_recvHdr;
 					} else {
@@ -569,34 +901,64 @@ static void handlePwrData(taskCtrl_t* pCtrl, uint8_t * data, int len)
 				//ESP_LOGD(TAG, "Signature length = %d", pwr->sigLen);
 
 				pCtrl->rxLen = 0;
-				pCtrl->state = pwrSigState_recvData;
+				if (pCtrl->sigLen > PWR_SIG_MAX_SIG_SZ) {
+					ESP_LOGE(TAG, "Power signature buffer overflow");
+					pCtrl->state = pwrSigState_discard;
+				} else if (0 == pCtrl->sigLen) {
+					pCtrl->state = pwrSigState_cksum;
+				} else {
+					pCtrl->state = pwrSigState_recvData;
+				}
 			}
 			break;
 
 		case pwrSigState_recvData:
-			if (pCtrl->rxLen < sizeof(pCtrl->sigBuf)) {
-				// Update the checksum
-				pCtrl->cksum ^= *data;
+			// Take as much of the power data as is in this buffer in one go,
+			// reserving space for the metrics header
+			chunk = pCtrl->sigLen - pCtrl->rxLen;
+			if (chunk > len - i) {
+				chunk = len - i;
+			}
 
-				// Store the data, reserving space for the metrics header
-				pCtrl->sigBuf[PWR_METRICS_HDR_SZ + pCtrl->rxLen] = *data;
-				if (++pCtrl->rxLen == pCtrl->sigLen) {
-					// End of power data, the next byte is checksum
-					pCtrl->state = pwrSigState_cksum;
-				}
-			} else {
-				ESP_LOGE(TAG, "Power signature buffer overflow");
-				pCtrl->state = pwrSigState_discard;
+			dest = &pCtrl->cur->data[PWR_METRICS_HDR_SZ + pCtrl->rxLen];
+
+			memcpy(dest, data, chunk);
+			pCtrl->cksum  = xorBlock(pCtrl->cksum, dest, chunk);
+			pCtrl->rxLen += chunk;
+
+			if (pCtrl->rxLen == pCtrl->sigLen) {
+				// End of power data, the next byte is checksum
+				pCtrl->state = pwrSigState_cksum;
+			}
+
+			// The loop steps past the last byte taken
+			i    += chunk - 1;
+			data += chunk - 1;
+			break;
+
+		case pwrSigState_skip:
+			// Drop the rest of a frame there is no buffer for
+			chunk = pCtrl->skipLen;
+			if (chunk > len - i) {
+				chunk = len - i;
 			}
+
+			pCtrl->skipLen -= chunk;
+			if (0 == pCtrl->skipLen) {
+				pCtrl->state = pwrSigState_idle;
+			}
+
+			i    += chunk - 1;
+			data += chunk - 1;
 			break;
 
 		case pwrSigState_recvTestResult:
-			// Use sigBuf to receive the test result payload
-			if (pCtrl->rxLen < sizeof(pCtrl->sigBuf)) {
+			// Use the signature buffer to receive the test result payload
+			if (pCtrl->cur && pCtrl->rxLen < sizeof(pCtrl->cur->data)) {
 				// Update the checksum
 				pCtrl->cksum ^= *data;
 
-				pCtrl->sigBuf[pCtrl->rxLen] = *data;
+				pCtrl->cur->data[pCtrl->rxLen] = *data;
 				if (++pCtrl->rxLen == pCtrl->payloadLen) {
 					// End of data, the next byte is checksum
 					pCtrl->state = pwrSigState_cksum;
@@ -624,14 +986,22 @@ static void handlePwrData(taskCtrl_t* pCtrl, uint8_t * data, int len)
 				switch (pCtrl->payLoadType)
 				{
 				case pwrPayloadType_sig:
-					// Count number of successful signatures received
-					pCtrl->sigCount += 1;
 					// Unpack the meta data from the header
-					pwrSigUnpackMeta(pCtrl);
-					// Send the signature to the eagerly awaiting client
-					if (pCtrl->conf.cbFunc) {
-						pCtrl->conf.cbFunc(&pCtrl->meta, pCtrl->sigBuf, pCtrl->rxLen, pCtrl->conf.cbData);
+					if (pwrSigUnpackMeta(pCtrl) != ESP_OK) {
+						// Keep the buffer for the next frame
+						pCtrl->stats.hdrErrCount += 1;
+						break;
 					}
+					// Count number of successful signatures received
+					pCtrl->sigCount += 1;
+					pCtrl->stats.lastSigCycles = pCtrl->frameCycles;
+					// Hand the signature, behind its metrics header, to the
+					// client task
+					pwrSigPackHdr(&pCtrl->meta, pCtrl->cur->data);
+					pCtrl->cur->meta    = pCtrl->meta;
+					pCtrl->cur->dataLen = PWR_METRICS_HDR_SZ + pCtrl->rxLen;
+					xQueueSend(pCtrl->readyQueue, &pCtrl->cur, 0);
+					pCtrl->cur = NULL;
 					break;
 
 				default:
@@ -658,23 +1028,116 @@ static void handlePwrData(taskCtrl_t* pCtrl, uint8_t * data, int len)
 }
 
 
+/**
+ * \brief Read and parse everything in the UART receive buffer
+ */
+static void readPwrData(taskCtrl_t* pCtrl)
+{
+	int	rdLen;
+
+	while ((rdLen = uart_read_bytes(pCtrl->conf.port, pCtrl->recvBuf, sizeof(pCtrl->recvBuf), 0)) > 0) {
+		uint32_t	startCycles = xthal_get_ccount();
+
+		handlePwrData(pCtrl, pCtrl->recvBuf, rdLen);
+
+		uint32_t	cycles = xthal_get_ccount() - startCycles;
+
+		pCtrl->stats.byteCount   += (uint32_t)rdLen;
+		pCtrl->stats.parseCycles += cycles;
+		pCtrl->frameCycles       += cycles;
+	}
+}
+
+
+/**
+ * \brief Hand completed signatures to the client
+ *
+ * The client is called from this task so a slow client never holds up the
+ * receiver. The buffer goes back to the pool when the client returns.
+ */
+static void pwrSigDeliverTask(void * params)
+{
+	taskCtrl_t*	pCtrl = (taskCtrl_t*)params;
+	sigBuf_t *	buf;
+
+	while (1)
+	{
+		if (xQueueReceive(pCtrl->readyQueue, &buf, portMAX_DELAY) != pdTRUE) {
+			continue;
+		}
+
+		if (pCtrl->conf.cbFunc) {
+			pCtrl->conf.cbFunc(&buf->meta, buf->data, buf->dataLen, pCtrl->conf.cbData);
+		}
+		pCtrl->stats.deliverCount += 1;
+
+		xQueueSend(pCtrl->freeQueue, &buf, portMAX_DELAY);
+	}
+}
+
+
+/**
+ * \brief Discard received data after the UART lost some of it
+ */
+static void dropPwrData(taskCtrl_t* pCtrl)
+{
+	uart_flush_input(pCtrl->conf.port);
+	xQueueReset(pCtrl->uartQueue);
+
+	// Whatever frame was in progress is incomplete
+	pCtrl->state = pwrSigState_idle;
+}
+
+
 static void pwrSigTask(void * params)
 {
 	taskCtrl_t*	pCtrl  = (taskCtrl_t*)params;
+	uart_event_t	event;
 
 	pCtrl->state = pwrSigState_idle;
 
 	while (1)
 	{
-		CS_SLEEP_MS(20);
+		// Sleep until the UART driver has something to report
+		if (xQueueReceive(pCtrl->uartQueue, &event, portMAX_DELAY) != pdTRUE) {
+			continue;
+		}
+
 		pCtrl->curTimeMs = TIME_MS();
 		pCtrl->curTime = (uint32_t)(pCtrl->curTimeMs / 1000);
 
-		// Check for incoming from the data channel
-		int	rdLen;
-		do {
-			rdLen = uart_read_bytes(pCtrl->conf.port, pCtrl->recvBuf, sizeof(pCtrl->recvBuf), 0);
-			handlePwrData(pCtrl, pCtrl->recvBuf, rdLen);
-		} while (rdLen > 0);
+		switch (event.type)
+		{
+		case UART_DATA:
+			readPwrData(pCtrl);
+			break;
+
+		case UART_FIFO_OVF:
+			ESP_LOGE(TAG, "UART FIFO overflow");
+			pCtrl->stats.fifoOvfCount += 1;
+			dropPwrData(pCtrl);
+			break;
+
+		case UART_BUFFER_FULL:
+			ESP_LOGE(TAG, "UART receive buffer full");
+			pCtrl->stats.bufFullCount += 1;
+			dropPwrData(pCtrl);
+			break;
+
+		case UART_FRAME_ERR:
+			pCtrl->stats.frameErrCount += 1;
+			break;
+
+		case UART_PARITY_ERR:
+			pCtrl->stats.parityErrCount += 1;
+			break;
+
+		case UART_BREAK:
+			pCtrl->stats.breakCount += 1;
+			break;
+
+		default:
+			break;
+		}
 	}
 }
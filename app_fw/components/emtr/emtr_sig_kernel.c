@@ -0,0 +1,538 @@
+/*
+ * emtr_sig_kernel.c
+ *
+ *  Integer signal kernels for power signature analysis
+ *
+ *  Everything is computed from the raw ADC values with integer arithmetic,
+ *  the scale factors are folded into a single multiply and divide at the
+ *  end of each result.
+ */
+#include <string.h>
+#include <esp_err.h>
+
+#include "emtr_sig_kernel.h"
+
+
+// Each sample is two big-endian signed 16-bit ADC values, volts then amps
+#define SMP_SZ				(4)
+
+// Amps = ADC / 327.68, so mA = ADC * 10^5 / 2^15
+#define MA_NUM				(100000)
+#define MA_SHIFT			(15)
+
+// RMS mA squared = sumSq / n * (10^5 / 2^15)^2 = sumSq * 5^10 / (n * 2^20)
+#define RMS_SQ_NUM			(9765625)
+#define RMS_SQ_SHIFT		(20)
+
+// Volts = ADC / 65.535 and amps = ADC / 327.68, so
+// mJ = sum(vADC * iADC) * 10^8 / (65535 * 2^15 * rate)
+//    = sum(vADC * iADC) * 5^8 / (65535 * 2^7 * rate)
+#define MJ_NUM				(390625)
+#define MJ_DEN				((int64_t)65535 * 128)
+
+// Byte offsets of the ADC values in a sample
+#define SMP_VOLTS			(0)
+#define SMP_AMPS			(2)
+
+// Phase of a full cycle is 2^32, the sine table covers a quarter cycle
+// in 128 steps
+#define PHASE_QUARTER		(0x40000000)
+#define SIN_TBL_SHIFT		(23)
+
+
+// Quarter wave of sine, Q15
+static const int16_t	sinTbl[129] = {
+	    0,   402,   804,  1206,  1608,  2009,  2410,  2811,
+	 3212,  3612,  4011,  4410,  4808,  5205,  5602,  5998,
+	 6393,  6786,  7179,  7571,  7962,  8351,  8739,  9126,
+	 9512,  9896, 10278, 10659, 11039, 11417, 11793, 12167,
+	12539, 12910, 13279, 13645, 14010, 14372, 14732, 15090,
+	15446, 15800, 16151, 16499, 16846, 17189, 17530, 17869,
+	18204, 18537, 18868, 19195, 19519, 19841, 20159, 20475,
+	20787, 21096, 21403, 21705, 22005, 22301, 22594, 22884,
+	23170, 23452, 23731, 24007, 24279, 24547, 24811, 25072,
+	25329, 25582, 25832, 26077, 26319, 26556, 26790, 27019,
+	27245, 27466, 27683, 27896, 28105, 28310, 28510, 28706,
+	28898, 29085, 29268, 29447, 29621, 29791, 29956, 30117,
+	30273, 30424, 30571, 30714, 30852, 30985, 31113, 31237,
+	31356, 31470, 31580, 31685, 31785, 31880, 31971, 32057,
+	32137, 32213, 32285, 32351, 32412, 32469, 32521, 32567,
+	32609, 32646, 32678, 32705, 32728, 32745, 32757, 32765,
+	32767
+};
+
+
+// Built-in load library
+//   The entries are starting points taken from typical load behavior,
+//   refine them from captured signatures of installed loads
+static const pwrSigLoadRef_t	loadLib[] = {
+	//  load                   pf  thd   h3   h5   h7  crest inrush settle
+	{pwrSigLoad_heater,     {255,   5,   5,   3,   2,   91,   17,    0}},
+	{pwrSigLoad_pumpMotor,  {200,  12,  20,  10,   5,   93,   90,    8}},
+	{pwrSigLoad_compressor, {230,  20,  40,  15,   8,   96,  110,   20}},
+};
+
+
+/**
+ * \brief Integer square root, rounded down
+ */
+static uint32_t isqrt64(uint64_t x)
+{
+	uint64_t	res = 0;
+	uint64_t	bit = (uint64_t)1 << 62;
+
+	while (bit > x) {
+		bit >>= 2;
+	}
+
+	while (bit) {
+		if (x >= res + bit) {
+			x  -= res + bit;
+			res = (res >> 1) + bit;
+		} else {
+			res >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return (uint32_t)res;
+}
+
+
+/**
+ * \brief Analyze the current draw captured in a power signature
+ *
+ * A single pass over the samples finds the current peak and collects the
+ * sum of squared current and of instantaneous power for each mains cycle.
+ * The per-cycle sums then give the RMS current, the time the RMS current
+ * settled to within \ref PWR_SIG_KNL_SETTLE_PCT of the final cycle, and the
+ * energy delivered before that.
+ *
+ * \param [in] samp Signature samples
+ * \param [in] numSamples Number of samples
+ * \param [in] sampleRate Samples per second, see \ref pwrSigSampleRate
+ * \param [in] mainsHz Mains frequency, 0 for \ref PWR_SIG_KNL_MAINS_HZ
+ * \param [out] ret Results
+ *
+ * \return ESP_OK Success
+ * \return ESP_ERR_INVALID_ARG Bad parameter
+ */
+esp_err_t pwrSigAnalyze(
+	const uint8_t *		samp,
+	int					numSamples,
+	uint32_t			sampleRate,
+	uint32_t			mainsHz,
+	pwrSigAnalysis_t *	ret
+)
+{
+	if (!samp || !ret || numSamples <= 0 || 0 == sampleRate) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	if (0 == mainsHz) {
+		mainsHz = PWR_SIG_KNL_MAINS_HZ;
+	}
+
+	memset(ret, 0, sizeof(*ret));
+
+	// One RMS window per mains cycle
+	int	windowLen = (int)(sampleRate / mainsHz);
+	if (windowLen > PWR_SIG_KNL_MAX_WINDOW_LEN) {
+		windowLen = PWR_SIG_KNL_MAX_WINDOW_LEN;
+	}
+	if (windowLen > numSamples) {
+		windowLen = numSamples;
+	}
+	if (windowLen < 1) {
+		windowLen = 1;
+	}
+
+	uint64_t	winSumSq[PWR_SIG_KNL_MAX_WINDOWS];
+	int64_t		winEnergy[PWR_SIG_KNL_MAX_WINDOWS];
+	int			numWin = 0;
+	uint64_t	sumSq  = 0;
+	int64_t		energy = 0;
+	int			inWin  = 0;
+	uint32_t	peak   = 0;
+	int			peakIdx = 0;
+	int			i;
+
+	for (i = 0; i < numSamples && numWin < PWR_SIG_KNL_MAX_WINDOWS; i++, samp += SMP_SZ) {
+		int32_t		vAdc = (int16_t)(((uint16_t)samp[0] << 8) | samp[1]);
+		int32_t		iAdc = (int16_t)(((uint16_t)samp[2] << 8) | samp[3]);
+		uint32_t	mag  = (uint32_t)(iAdc < 0 ? -iAdc : iAdc);
+
+		if (mag > peak) {
+			peak    = mag;
+			peakIdx = i;
+		}
+
+		sumSq  += mag * mag;
+		energy += vAdc * iAdc;
+
+		if (++inWin == windowLen) {
+			winSumSq[numWin]  = sumSq;
+			winEnergy[numWin] = energy;
+			numWin += 1;
+
+			sumSq  = 0;
+			energy = 0;
+			inWin  = 0;
+		}
+	}
+
+	ret->mAmpsPeak  = (uint32_t)(((uint64_t)peak * MA_NUM) >> MA_SHIFT);
+	ret->usToPeak   = (uint32_t)((uint64_t)peakIdx * 1000000 / sampleRate);
+	ret->numWindows = (uint16_t)numWin;
+	ret->windowLen  = (uint16_t)windowLen;
+
+	// RMS current of each cycle
+	uint32_t	rms[PWR_SIG_KNL_MAX_WINDOWS];
+	uint64_t	rmsDen = (uint64_t)windowLen << RMS_SQ_SHIFT;
+
+	for (i = 0; i < numWin; i++) {
+		rms[i] = isqrt64(winSumSq[i] * RMS_SQ_NUM / rmsDen);
+		if (rms[i] > ret->mAmpsRmsMax) {
+			ret->mAmpsRmsMax = rms[i];
+		}
+	}
+
+	uint32_t	final = rms[numWin - 1];
+	uint32_t	band  = final * PWR_SIG_KNL_SETTLE_PCT / 100;
+	if (band < PWR_SIG_KNL_SETTLE_MIN_MA) {
+		band = PWR_SIG_KNL_SETTLE_MIN_MA;
+	}
+
+	ret->mAmpsRmsFinal = final;
+
+	// Walk back from the end while the cycles stay within the band
+	int	settle = numWin - 1;
+	while (settle > 0) {
+		uint32_t	r    = rms[settle - 1];
+		uint32_t	diff = (r > final) ? r - final : final - r;
+
+		if (diff > band) {
+			break;
+		}
+		settle -= 1;
+	}
+
+	ret->usSettle = (uint32_t)((uint64_t)settle * windowLen * 1000000 / sampleRate);
+
+	energy = 0;
+	for (i = 0; i < settle; i++) {
+		energy += winEnergy[i];
+	}
+	ret->mJoulesInrush = (int32_t)(energy * MJ_NUM / (MJ_DEN * (int64_t)sampleRate));
+
+	return ESP_OK;
+}
+
+
+const char* pwrSigLoadStr(pwrSigLoad_t load)
+{
+	switch (load)
+	{
+	case pwrSigLoad_pumpMotor:
+		return "Pump motor";
+	case pwrSigLoad_heater:
+		return "Heater";
+	case pwrSigLoad_compressor:
+		return "Compressor";
+	default:
+		return "Unknown";
+	}
+}
+
+
+/**
+ * \brief Sine of a phase angle, full cycle is 2^32, result is Q15
+ */
+static inline int32_t sinQ15(uint32_t phase)
+{
+	uint32_t	idx = (phase >> SIN_TBL_SHIFT) & 0x7F;
+
+	switch (phase >> 30)
+	{
+	case 0:
+		return sinTbl[idx];
+	case 1:
+		return sinTbl[128 - idx];
+	case 2:
+		return -sinTbl[idx];
+	default:
+		return -sinTbl[128 - idx];
+	}
+}
+
+
+/**
+ * \brief Correlate one ADC channel with one frequency
+ *
+ * \param [in] samp First sample
+ * \param [in] n Number of samples
+ * \param [in] offs Byte offset of the channel in a sample
+ * \param [in] step Phase step per sample
+ * \param [out] re Cosine term, ADC units times n / 2
+ * \param [out] im Sine term, ADC units times n / 2
+ */
+static void dftBin(
+	const uint8_t *	samp,
+	int				n,
+	int				offs,
+	uint32_t		step,
+	int64_t *		re,
+	int64_t *		im
+)
+{
+	int64_t		sumRe = 0;
+	int64_t		sumIm = 0;
+	uint32_t	phase = 0;
+	int			i;
+
+	samp += offs;
+	for (i = 0; i < n; i++, samp += SMP_SZ, phase += step) {
+		int32_t	x = (int16_t)(((uint16_t)samp[0] << 8) | samp[1]);
+
+		sumRe += x * sinQ15(phase + PHASE_QUARTER);
+		sumIm += x * sinQ15(phase);
+	}
+
+	*re = sumRe >> 15;
+	*im = sumIm >> 15;
+}
+
+
+/**
+ * \brief Largest span of samples, not over limit, holding a whole number
+ * of mains cycles
+ */
+static int cycleSpan(uint32_t sampleRate, uint32_t mainsHz, int limit)
+{
+	int			span = 0;
+	uint32_t	k;
+
+	for (k = 1; (uint64_t)k * sampleRate / mainsHz <= (uint32_t)limit; k++) {
+		if (0 == (k * sampleRate) % mainsHz) {
+			span = (int)(k * sampleRate / mainsHz);
+		}
+	}
+
+	return span;
+}
+
+
+static uint8_t clampU8(uint64_t val)
+{
+	return (val > 255) ? 255 : (uint8_t)val;
+}
+
+
+/**
+ * \brief Extract harmonic features and a load fingerprint from a signature
+ *
+ * The harmonics are measured by correlating the samples with each harmonic
+ * over a whole number of mains cycles, so every harmonic falls exactly on
+ * an analysis bin and there is no leakage between them. The span starts
+ * where the RMS current settled, or ends at the last sample if too little
+ * of the signature follows that.
+ *
+ * \param [in] samp Signature samples
+ * \param [in] numSamples Number of samples
+ * \param [in] sampleRate Samples per second, see \ref pwrSigSampleRate
+ * \param [in] mainsHz Mains frequency, 0 for \ref PWR_SIG_KNL_MAINS_HZ
+ * \param [in] analysis Results of \ref pwrSigAnalyze for the same samples
+ * \param [out] ret Results
+ *
+ * \return ESP_OK Success
+ * \return ESP_ERR_INVALID_ARG Bad parameter
+ * \return ESP_ERR_INVALID_SIZE Less than a mains cycle of samples
+ */
+esp_err_t pwrSigExtract(
+	const uint8_t *				samp,
+	int							numSamples,
+	uint32_t					sampleRate,
+	uint32_t					mainsHz,
+	const pwrSigAnalysis_t *	analysis,
+	pwrSigFeatures_t *			ret
+)
+{
+	if (!samp || !analysis || !ret || numSamples <= 0 || 0 == sampleRate) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	if (0 == mainsHz) {
+		mainsHz = PWR_SIG_KNL_MAINS_HZ;
+	}
+
+	memset(ret, 0, sizeof(*ret));
+
+	// Choose the span of whole cycles to analyze
+	int	start = (int)(((uint64_t)analysis->usSettle * sampleRate + 999999) / 1000000);
+	int	limit = numSamples - start;
+	int	n;
+
+	if (limit > PWR_SIG_KNL_MAX_DFT_LEN) {
+		limit = PWR_SIG_KNL_MAX_DFT_LEN;
+	}
+
+	n = (limit > 0) ? cycleSpan(sampleRate, mainsHz, limit) : 0;
+	if (0 == n) {
+		// Too little settled signature, use the tail
+		limit = (numSamples > PWR_SIG_KNL_MAX_DFT_LEN) ? PWR_SIG_KNL_MAX_DFT_LEN : numSamples;
+		n     = cycleSpan(sampleRate, mainsHz, limit);
+		if (0 == n) {
+			return ESP_ERR_INVALID_SIZE;
+		}
+		start = numSamples - n;
+	}
+
+	samp += start * SMP_SZ;
+	ret->numSamples = (uint16_t)n;
+
+	// Crest factor over the span
+	uint64_t	sumSq = 0;
+	uint32_t	peak  = 0;
+	int			i;
+
+	for (i = 0; i < n; i++) {
+		const uint8_t *	p    = samp + i * SMP_SZ + SMP_AMPS;
+		int32_t			iAdc = (int16_t)(((uint16_t)p[0] << 8) | p[1]);
+		uint32_t		mag  = (uint32_t)(iAdc < 0 ? -iAdc : iAdc);
+
+		if (mag > peak) {
+			peak = mag;
+		}
+		sumSq += mag * mag;
+	}
+
+	// RMS in ADC units, Q8
+	uint32_t	rmsQ8 = isqrt64((sumSq << 16) / (uint32_t)n);
+	if (rmsQ8 > 0) {
+		ret->crestX1000 = (uint16_t)(((uint64_t)peak * 1000 * 256) / rmsQ8);
+	}
+
+	// Harmonics of the current below the Nyquist frequency
+	uint32_t	mag[PWR_SIG_KNL_NUM_HARMONICS];
+	int64_t		iRe1 = 0;
+	int64_t		iIm1 = 0;
+	uint64_t	harmSq = 0;
+	int			h;
+
+	for (h = 1; h <= PWR_SIG_KNL_NUM_HARMONICS && 2 * h * mainsHz < sampleRate; h++) {
+		uint32_t	step = (uint32_t)((((uint64_t)h * mainsHz) << 32) / sampleRate);
+		int64_t		re;
+		int64_t		im;
+
+		dftBin(samp, n, SMP_AMPS, step, &re, &im);
+
+		// RMS is sqrt(2) * |X| / n
+		mag[h - 1] = isqrt64(2 * (uint64_t)(re * re + im * im));
+		ret->mAmpsHarm[h - 1] = (uint32_t)(((uint64_t)mag[h - 1] * MA_NUM) / ((uint64_t)n << MA_SHIFT));
+
+		if (1 == h) {
+			iRe1 = re;
+			iIm1 = im;
+		} else {
+			harmSq += (uint64_t)mag[h - 1] * mag[h - 1];
+		}
+	}
+	ret->numHarmonics = (uint16_t)(h - 1);
+
+	if (0 == ret->numHarmonics || 0 == mag[0]) {
+		// No fundamental, nothing more to measure
+		return ESP_OK;
+	}
+
+	ret->thdPermille = (uint16_t)(((uint64_t)isqrt64(harmSq) * 1000) / mag[0]);
+
+	// Displacement power factor from the phase of the fundamentals
+	int64_t		vRe1;
+	int64_t		vIm1;
+	uint32_t	step = (uint32_t)(((uint64_t)mainsHz << 32) / sampleRate);
+
+	dftBin(samp, n, SMP_VOLTS, step, &vRe1, &vIm1);
+
+	uint64_t	magV = isqrt64((uint64_t)(vRe1 * vRe1 + vIm1 * vIm1));
+	uint64_t	magI = isqrt64((uint64_t)(iRe1 * iRe1 + iIm1 * iIm1));
+
+	if (magV > 0 && magI > 0) {
+		int64_t	dot = vRe1 * iRe1 + vIm1 * iIm1;
+
+		ret->pFactorX1000 = (int16_t)((dot * 1000) / (int64_t)(magV * magI));
+	}
+
+	// Fingerprint
+	uint8_t *	fp = ret->fp;
+
+	fp[pwrSigFp_pFactor] = clampU8((uint64_t)(ret->pFactorX1000 < 0 ? -ret->pFactorX1000 : ret->pFactorX1000) * 255 / 1000);
+	fp[pwrSigFp_thd]     = clampU8(ret->thdPermille / 4);
+	fp[pwrSigFp_h3]      = (ret->numHarmonics >= 3) ? clampU8((uint64_t)mag[2] * 255 / mag[0]) : 0;
+	fp[pwrSigFp_h5]      = (ret->numHarmonics >= 5) ? clampU8((uint64_t)mag[4] * 255 / mag[0]) : 0;
+	fp[pwrSigFp_h7]      = (ret->numHarmonics >= 7) ? clampU8((uint64_t)mag[6] * 255 / mag[0]) : 0;
+	fp[pwrSigFp_crest]   = clampU8((uint64_t)ret->crestX1000 * 64 / 1000);
+
+	if (analysis->mAmpsRmsFinal > 0) {
+		fp[pwrSigFp_inrush] = clampU8((uint64_t)analysis->mAmpsRmsMax * 16 / analysis->mAmpsRmsFinal);
+	} else {
+		fp[pwrSigFp_inrush] = 255;
+	}
+
+	fp[pwrSigFp_settle] = clampU8((uint64_t)analysis->usSettle * mainsHz / 1000000);
+
+	return ESP_OK;
+}
+
+
+/**
+ * \brief Find the nearest load to a fingerprint
+ *
+ * \param [in] fp Fingerprint from \ref pwrSigExtract
+ * \param [in] lib Load library, NULL for the built-in library
+ * \param [in] libSz Entries in lib
+ * \param [out] ret Results
+ *
+ * \return ESP_OK Success
+ * \return ESP_ERR_INVALID_ARG Bad parameter
+ */
+esp_err_t pwrSigClassify(
+	const uint8_t *				fp,
+	const pwrSigLoadRef_t *		lib,
+	int							libSz,
+	pwrSigClass_t *				ret
+)
+{
+	if (!fp || !ret) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	if (!lib) {
+		lib   = loadLib;
+		libSz = sizeof(loadLib) / sizeof(loadLib[0]);
+	}
+
+	ret->load     = pwrSigLoad_unknown;
+	ret->distance = UINT32_MAX;
+
+	int	i;
+	for (i = 0; i < libSz; i++) {
+		uint32_t	dist = 0;
+		int			j;
+
+		for (j = 0; j < PWR_SIG_FP_LEN; j++) {
+			int32_t	d = (int32_t)fp[j] - (int32_t)lib[i].fp[j];
+			dist += (uint32_t)(d * d);
+		}
+
+		if (dist < ret->distance) {
+			ret->distance = dist;
+			ret->load     = lib[i].load;
+		}
+	}
+
+	if (ret->distance > PWR_SIG_KNL_CLASS_MAX_DIST) {
+		ret->load = pwrSigLoad_unknown;
+	}
+
+	return ESP_OK;
+}
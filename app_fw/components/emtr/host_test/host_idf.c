@@ -0,0 +1,196 @@
+/*
+ * host_idf.c
+ *
+ * Host versions of the IDF and FreeRTOS functions declared in host_idf.h
+ */
+
+#include <time.h>
+#include "host_idf.h"
+#include "host_test.h"
+
+
+bool	hostLogEnable;
+
+
+int64_t esp_timer_get_time(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+uint32_t xthal_get_ccount(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return (uint32_t)__builtin_ia32_rdtsc();
+#else
+	// Nanoseconds stand in for cycles
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+#endif
+}
+
+
+struct hostQueue_s {
+	uint8_t *	items;
+	int			len;
+	int			itemSz;
+	int			head;
+	int			count;
+};
+
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t itemSz)
+{
+	QueueHandle_t	queue = calloc(1, sizeof(*queue));
+
+	queue->items  = calloc(len, itemSz);
+	queue->len    = len;
+	queue->itemSz = itemSz;
+	return queue;
+}
+
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void * item, TickType_t wait)
+{
+	if (queue->count == queue->len)
+		return pdFALSE;
+
+	int	idx = (queue->head + queue->count) % queue->len;
+
+	memcpy(&queue->items[idx * queue->itemSz], item, queue->itemSz);
+	queue->count += 1;
+	return pdTRUE;
+}
+
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void * item, TickType_t wait)
+{
+	if (0 == queue->count)
+		return pdFALSE;
+
+	memcpy(item, &queue->items[queue->head * queue->itemSz], queue->itemSz);
+	queue->head   = (queue->head + 1) % queue->len;
+	queue->count -= 1;
+	return pdTRUE;
+}
+
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+	queue->head  = 0;
+	queue->count = 0;
+	return pdPASS;
+}
+
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+	return queue->count;
+}
+
+
+void vQueueDelete(QueueHandle_t queue)
+{
+	if (queue) {
+		free(queue->items);
+		free(queue);
+	}
+}
+
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+	return malloc(1);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t wait)
+{
+	return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex)
+{
+	return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t mutex)
+{
+	free(mutex);
+}
+
+
+BaseType_t xTaskCreate(
+	TaskFunction_t	func,
+	const char *	name,
+	uint32_t		stackSz,
+	void *			params,
+	UBaseType_t		prio,
+	TaskHandle_t *	ret
+)
+{
+	if (ret)
+		*ret = NULL;
+	return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+}
+
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t * conf)
+{
+	return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts)
+{
+	return ESP_OK;
+}
+
+esp_err_t uart_driver_install(uart_port_t port, int rxSz, int txSz, int queueSz, QueueHandle_t * queue, int flags)
+{
+	if (queue)
+		*queue = xQueueCreate(queueSz > 0 ? queueSz : 1, sizeof(uart_event_t));
+	return ESP_OK;
+}
+
+esp_err_t uart_driver_delete(uart_port_t port)
+{
+	return ESP_OK;
+}
+
+esp_err_t uart_set_rx_timeout(uart_port_t port, uint8_t symbols)
+{
+	return ESP_OK;
+}
+
+esp_err_t uart_flush_input(uart_port_t port)
+{
+	return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t port, uint8_t * buf, uint32_t len, TickType_t wait)
+{
+	return 0;
+}
+
+int uart_write_bytes(uart_port_t port, const char * data, size_t len)
+{
+	return (int)len;
+}
+
+
+int	hostTestChecks;
+int	hostTestFails;
+
+int hostTestResult(void)
+{
+	printf("%d checks, %d failed\n", hostTestChecks, hostTestFails);
+	return (0 == hostTestFails) ? 0 : 1;
+}
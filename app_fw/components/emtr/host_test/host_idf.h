@@ -0,0 +1,146 @@
+/*
+ * host_idf.h
+ *
+ * Just enough of ESP-IDF and FreeRTOS to build the emtr component sources
+ * on the development host, see Makefile. Included ahead of every source,
+ * the IDF headers themselves are empty.
+ */
+
+#ifndef HOST_TEST_HOST_IDF_H_
+#define HOST_TEST_HOST_IDF_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK						(0)
+#define ESP_FAIL					(-1)
+#define ESP_ERR_NO_MEM				(0x101)
+#define ESP_ERR_INVALID_ARG			(0x102)
+#define ESP_ERR_INVALID_STATE		(0x103)
+#define ESP_ERR_INVALID_SIZE		(0x104)
+#define ESP_ERR_NOT_FOUND			(0x105)
+#define ESP_ERR_NOT_SUPPORTED		(0x106)
+#define ESP_ERR_TIMEOUT				(0x107)
+#define ESP_ERR_INVALID_RESPONSE	(0x108)
+#define ESP_ERR_INVALID_CRC			(0x109)
+#define ESP_ERR_INVALID_VERSION		(0x10A)
+
+// Set host_idf.c hostLogEnable to see the driver's log
+extern bool	hostLogEnable;
+
+#define ESP_LOGE(tag, fmt, ...)		do { if (hostLogEnable) printf("E %s: " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGW(tag, fmt, ...)		do { if (hostLogEnable) printf("W %s: " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGI(tag, fmt, ...)		do { if (hostLogEnable) printf("I %s: " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGD(tag, fmt, ...)		do { if (hostLogEnable) printf("D %s: " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+
+int64_t esp_timer_get_time(void);
+
+// Cycle counter, the host's time stamp counter
+uint32_t xthal_get_ccount(void);
+
+
+//******************************************************************************
+// FreeRTOS, a single task on the host
+//******************************************************************************
+
+typedef uint32_t		TickType_t;
+typedef int				BaseType_t;
+typedef unsigned int	UBaseType_t;
+typedef void *			TaskHandle_t;
+typedef void *			SemaphoreHandle_t;
+typedef struct hostQueue_s *	QueueHandle_t;
+typedef void (* TaskFunction_t)(void * params);
+
+#define pdTRUE						(1)
+#define pdFALSE						(0)
+#define pdPASS						(1)
+#define pdFAIL						(0)
+#define portMAX_DELAY				(0xFFFFFFFF)
+#define pdMS_TO_TICKS(ms)			((TickType_t)(ms))
+
+// Queues copy items in and out, the wait is ignored
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t itemSz);
+BaseType_t xQueueSend(QueueHandle_t queue, const void * item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void * item, TickType_t wait);
+BaseType_t xQueueReset(QueueHandle_t queue);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+void vQueueDelete(QueueHandle_t queue);
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex);
+void vSemaphoreDelete(SemaphoreHandle_t mutex);
+
+// Tasks are not run, tests call the task functions directly
+BaseType_t xTaskCreate(
+	TaskFunction_t	func,
+	const char *	name,
+	uint32_t		stackSz,
+	void *			params,
+	UBaseType_t		prio,
+	TaskHandle_t *	ret
+);
+void vTaskDelay(TickType_t ticks);
+
+
+//******************************************************************************
+// UART and GPIO driver, nothing is received
+//******************************************************************************
+
+typedef int uart_port_t;
+typedef int gpio_num_t;
+
+typedef struct {
+	int		baud_rate;
+	int		data_bits;
+	int		parity;
+	int		stop_bits;
+	int		flow_ctrl;
+	int		rx_flow_ctrl_thresh;
+} uart_config_t;
+
+typedef enum {
+	UART_DATA,
+	UART_BREAK,
+	UART_BUFFER_FULL,
+	UART_FIFO_OVF,
+	UART_FRAME_ERR,
+	UART_PARITY_ERR,
+	UART_DATA_BREAK,
+	UART_PATTERN_DET,
+	UART_EVENT_MAX
+} uart_event_type_t;
+
+typedef struct {
+	uart_event_type_t	type;
+	size_t				size;
+	bool				timeout_flag;
+} uart_event_t;
+
+#define UART_NUM_0					(0)
+#define UART_NUM_1					(1)
+#define UART_NUM_2					(2)
+#define UART_DATA_8_BITS			(3)
+#define UART_PARITY_DISABLE			(0)
+#define UART_STOP_BITS_1			(1)
+#define UART_HW_FLOWCTRL_DISABLE	(0)
+#define UART_PIN_NO_CHANGE			(-1)
+#define UART_FIFO_LEN				(128)
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t * conf);
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts);
+esp_err_t uart_driver_install(uart_port_t port, int rxSz, int txSz, int queueSz, QueueHandle_t * queue, int flags);
+esp_err_t uart_driver_delete(uart_port_t port);
+esp_err_t uart_set_rx_timeout(uart_port_t port, uint8_t symbols);
+esp_err_t uart_flush_input(uart_port_t port);
+int uart_read_bytes(uart_port_t port, uint8_t * buf, uint32_t len, TickType_t wait);
+int uart_write_bytes(uart_port_t port, const char * data, size_t len);
+
+
+#endif /* HOST_TEST_HOST_IDF_H_ */
@@ -0,0 +1,31 @@
+/*
+ * host_test.h
+ *
+ * Checks for the host tests, a failure is reported and the test goes on
+ */
+
+#ifndef HOST_TEST_HOST_TEST_H_
+#define HOST_TEST_HOST_TEST_H_
+
+#include <stdio.h>
+
+extern int	hostTestChecks;
+extern int	hostTestFails;
+
+#define CHECK(_cond_)												\
+	do {															\
+		hostTestChecks += 1;										\
+		if (!(_cond_)) {											\
+			hostTestFails += 1;										\
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #_cond_);	\
+		}															\
+	} while (0)
+
+/**
+ * \brief Print the totals
+ *
+ * \return Exit status, 0 if every check passed
+ */
+int hostTestResult(void);
+
+#endif /* HOST_TEST_HOST_TEST_H_ */
@@ -0,0 +1 @@
+/* Host build, see host_idf.h */
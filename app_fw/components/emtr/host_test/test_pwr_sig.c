@@ -0,0 +1,467 @@
+/*
+ * test_pwr_sig.c
+ *
+ * Host fuzz test of the power signature receiver and decoder
+ *
+ * - Mutated and truncated metrics headers through pwrSigDecode, then
+ *   random windows and steps, up to INT_MAX, through pwrSigViewSub
+ * - Framed signature streams with random headers, lengths and damage,
+ *   read in random sizes, through handlePwrData
+ *
+ * Every view returned must lie inside its buffer. Build with
+ * "make sanitize" to run it under ASan and UBSan.
+ *
+ *   ./test_pwr_sig [iterations] [seed]
+ *
+ * With "bench" it times handlePwrData on whole signatures, read in pieces
+ * of a few fixed sizes and of random sizes up to the 256 byte buffer of
+ * pwrSigTask:
+ *
+ *   ./test_pwr_sig bench [signatures]
+ */
+
+#include <limits.h>
+#include "host_test.h"
+
+// The source is included to reach the receive state machine
+#include "../emtr_pwr_sig.c"
+
+
+static uint32_t	rndState = 1;
+
+static uint32_t rnd(void)
+{
+	// xorshift32
+	rndState ^= rndState << 13;
+	rndState ^= rndState >> 17;
+	rndState ^= rndState << 5;
+	return rndState;
+}
+
+static int rndRange(int lo, int hi)
+{
+	return lo + (int)(rnd() % (uint32_t)(hi - lo + 1));
+}
+
+
+/**
+ * \brief Check a view lies inside the buffer it was made from
+ */
+static bool viewInside(const pwrSigView_t * view, const uint8_t * data, int dataLen)
+{
+	if (view->numSamples < 0 || view->stride < 1)
+		return false;
+
+	if (0 == view->numSamples)
+		return true;
+
+	int64_t	start = view->samp - data;
+	int64_t	end   = start + (int64_t)(view->numSamples - 1) * view->stride + PWR_SIG_SMP_SZ;
+
+	return start >= PWR_METRICS_HDR_SZ && end <= dataLen;
+}
+
+
+static int subArg(int limit)
+{
+	switch (rnd() % 6)
+	{
+	case 0:		return -1;
+	case 1:		return 0;
+	case 2:		return INT_MAX - (int)(rnd() % 4);
+	case 3:		return limit + rndRange(-2, 2);
+	default:	return rndRange(0, limit + 2);
+	}
+}
+
+
+//******************************************************************************
+// pwrSigDecode and pwrSigViewSub
+//******************************************************************************
+
+static void fuzzDecode(int iterations)
+{
+	static uint8_t	data[PWR_METRICS_HDR_SZ + PWR_SIG_MAX_SIG_SZ];
+	pwrSigMeta_t	meta;
+	pwrSigHdr_t		hdr;
+	pwrSigView_t	view;
+	pwrSigView_t	sub;
+	pwrSigView_t	sub2;
+	int				accepted = 0;
+	int				it;
+	int				i;
+
+	for (it = 0; it < iterations; it++) {
+		// A valid header, then damage to it
+		memset(&meta, 0, sizeof(meta));
+		meta.reason     = rnd() % 3;
+		meta.numSamples = rndRange(0, PWR_SIG_MAX_SAMPLES);
+		meta.resolution = rnd() % (PWR_SIG_MAX_RESOLUTION + 1);
+		meta.waterLevel = rnd() % (PWR_SIG_MAX_LEVEL + 1);
+		meta.gfciLevel  = rnd() % (PWR_SIG_MAX_LEVEL + 1);
+		pwrSigPackHdr(&meta, data);
+
+		int	mutations = rnd() % 4;
+		for (i = 0; i < mutations; i++)
+			data[rnd() % PWR_METRICS_HDR_SZ] = (uint8_t)rnd();
+
+		int	dataLen = PWR_METRICS_HDR_SZ + meta.numSamples * PWR_SIG_SMP_SZ;
+		switch (rnd() % 4)
+		{
+		case 0:		dataLen = rndRange(0, dataLen); break;
+		case 1:		dataLen += rndRange(0, 8); break;
+		default:	break;
+		}
+		if (dataLen > (int)sizeof(data))
+			dataLen = sizeof(data);
+
+		if (pwrSigDecode(data, dataLen, &hdr, &view) != ESP_OK)
+			continue;
+
+		accepted += 1;
+		CHECK(hdr.numSamples == view.numSamples);
+		CHECK(viewInside(&view, data, dataLen));
+
+		for (i = 0; i < 8; i++) {
+			int	first = subArg(view.numSamples);
+			int	count = subArg(view.numSamples);
+			int	step  = subArg(view.numSamples);
+
+			if (pwrSigViewSub(&view, first, count, step, &sub) != ESP_OK)
+				continue;
+
+			CHECK(viewInside(&sub, data, dataLen));
+			CHECK(sub.sampleRate <= view.sampleRate);
+
+			// A view of a view
+			if (pwrSigViewSub(&sub, subArg(sub.numSamples), -1, subArg(sub.numSamples), &sub2) == ESP_OK)
+				CHECK(viewInside(&sub2, data, dataLen));
+		}
+	}
+
+	CHECK(accepted > 0);
+	printf("decode: %d of %d headers accepted\n", accepted, iterations);
+}
+
+
+static void testViewSub(void)
+{
+	static uint8_t	data[PWR_METRICS_HDR_SZ + 10 * PWR_SIG_SMP_SZ];
+	pwrSigView_t	view = {
+		.samp       = &data[PWR_METRICS_HDR_SZ],
+		.numSamples = 10,
+		.stride     = PWR_SIG_SMP_SZ,
+		.sampleRate = 12000
+	};
+	pwrSigView_t	sub;
+
+	// Every 3rd sample of 10: 0, 3, 6, 9
+	CHECK(pwrSigViewSub(&view, 0, -1, 3, &sub) == ESP_OK && 4 == sub.numSamples);
+	CHECK(4000 == sub.sampleRate);
+
+	CHECK(pwrSigViewSub(&view, 10, -1, 1, &sub) == ESP_OK && 0 == sub.numSamples);
+	CHECK(pwrSigViewSub(&view, 11, -1, 1, &sub) == ESP_ERR_INVALID_SIZE);
+	CHECK(pwrSigViewSub(&view, 0, 11, 1, &sub) == ESP_ERR_INVALID_SIZE);
+	CHECK(pwrSigViewSub(&view, 0, -1, 0, &sub) == ESP_ERR_INVALID_ARG);
+
+	// A step past the end leaves the first sample
+	CHECK(pwrSigViewSub(&view, 9, -1, INT_MAX, &sub) == ESP_ERR_INVALID_SIZE);
+	CHECK(pwrSigViewSub(&view, 9, -1, 1000, &sub) == ESP_OK && 1 == sub.numSamples);
+}
+
+
+//******************************************************************************
+// handlePwrData
+//******************************************************************************
+
+#define FUZZ_NUM_BUFS	(2)
+
+static taskCtrl_t * rxInit(void)
+{
+	taskCtrl_t *	pCtrl = calloc(1, sizeof(*pCtrl));
+	int				i;
+
+	pCtrl->conf.numBufs = FUZZ_NUM_BUFS;
+	pCtrl->bufPool      = calloc(FUZZ_NUM_BUFS, sizeof(sigBuf_t));
+	pCtrl->freeQueue    = xQueueCreate(FUZZ_NUM_BUFS, sizeof(sigBuf_t *));
+	pCtrl->readyQueue   = xQueueCreate(FUZZ_NUM_BUFS, sizeof(sigBuf_t *));
+	pCtrl->state        = pwrSigState_idle;
+
+	for (i = 0; i < FUZZ_NUM_BUFS; i++) {
+		sigBuf_t *	buf = &pCtrl->bufPool[i];
+		xQueueSend(pCtrl->freeQueue, &buf, 0);
+	}
+
+	return pCtrl;
+}
+
+
+static void rxFree(taskCtrl_t * pCtrl)
+{
+	vQueueDelete(pCtrl->freeQueue);
+	vQueueDelete(pCtrl->readyQueue);
+	free(pCtrl->bufPool);
+	free(pCtrl);
+}
+
+
+/**
+ * \brief Build a frame in the layout of emtr_sim.py streamSignature
+ *
+ * \return Frame length
+ */
+static int mkFrame(uint8_t * frame, int sigLen, bool valid)
+{
+	uint8_t *	p = frame;
+	uint8_t		cksum;
+	int			payloadLen = PWR_SIG_HDR_SZ + sigLen + 1;
+	int			i;
+
+	*p++ = MSG_CHAR_SOP;
+	*p++ = 'S';
+	*p++ = (uint8_t)(payloadLen >> 8);
+	*p++ = (uint8_t)payloadLen;
+
+	// Reason, pump cycles, epoch, run time, water and GFCI levels
+	*p++ = valid ? rnd() % 3 : (uint8_t)rnd();
+	for (i = 0; i < 12; i++)
+		*p++ = (uint8_t)rnd();
+	*p++ = valid ? rnd() % (PWR_SIG_MAX_LEVEL + 1) : (uint8_t)rnd();
+	*p++ = valid ? rnd() % (PWR_SIG_MAX_LEVEL + 1) : (uint8_t)rnd();
+
+	// Samples that look like mains, with noise
+	for (i = 0; i < sigLen; i++)
+		*p++ = (uint8_t)((i & 1) ? rnd() : 0x08 + (i >> 5) % 8);
+
+	cksum = 0;
+	for (i = 1; i < p - frame; i++)
+		cksum ^= frame[i];
+	*p++ = cksum;
+	*p++ = MSG_CHAR_EOP;
+
+	return p - frame;
+}
+
+
+/**
+ * \brief Hand every ready signature to a client that checks it
+ *
+ * \return Signatures taken
+ */
+static int rxDrain(taskCtrl_t * pCtrl)
+{
+	sigBuf_t *		buf;
+	pwrSigHdr_t		hdr;
+	pwrSigView_t	view;
+	pwrSigView_t	sub;
+	int				ct = 0;
+
+	while (xQueueReceive(pCtrl->readyQueue, &buf, 0) == pdTRUE) {
+		CHECK(pwrSigDecode(buf->data, buf->dataLen, &hdr, &view) == ESP_OK);
+		CHECK(viewInside(&view, buf->data, buf->dataLen));
+		CHECK(hdr.numSamples == buf->meta.numSamples);
+
+		if (pwrSigViewSub(&view, rndRange(0, view.numSamples), -1, rndRange(1, INT_MAX), &sub) == ESP_OK)
+			CHECK(viewInside(&sub, buf->data, buf->dataLen));
+
+		xQueueSend(pCtrl->freeQueue, &buf, 0);
+		ct++;
+	}
+
+	return ct;
+}
+
+
+static void fuzzStream(int iterations)
+{
+	static uint8_t	stream[4 * (PWR_SIG_MAX_SIG_SZ + 64)];
+	taskCtrl_t *	pCtrl = rxInit();
+	int				frames = 0;
+	int				sent   = 0;
+	int				taken  = 0;
+	int				it;
+
+	for (it = 0; it < iterations; it++) {
+		int	len   = 0;
+		int	whole = 0;
+		int	n;
+
+		// A few frames back to back, some damaged or with junk between
+		for (n = rndRange(1, 3); n > 0; n--) {
+			int		sigLen;
+			bool	valid = (rnd() % 4) != 0;
+
+			switch (rnd() % 8)
+			{
+			case 0:		sigLen = rndRange(0, 16); break;
+			case 1:		sigLen = PWR_SIG_MAX_SIG_SZ + rndRange(-3, 3); break;
+			default:	sigLen = rndRange(0, PWR_SIG_MAX_SAMPLES) * PWR_SIG_SMP_SZ; break;
+			}
+			if (sigLen > PWR_SIG_MAX_SIG_SZ + 3)
+				sigLen = PWR_SIG_MAX_SIG_SZ + 3;
+			if (sigLen < 0)
+				sigLen = 0;
+
+			int	fl = mkFrame(&stream[len], sigLen, valid);
+			frames++;
+
+			if (rnd() % 5 == 0) {
+				// Damage a byte, or cut the frame short
+				if (rnd() & 1)
+					stream[len + rnd() % fl] ^= 1 << (rnd() % 8);
+				else
+					fl = rndRange(1, fl);
+			} else if (valid && sigLen <= PWR_SIG_MAX_SIG_SZ && 0 == sigLen % PWR_SIG_SMP_SZ) {
+				whole++;
+			}
+			len += fl;
+
+			if (rnd() % 4 == 0) {
+				int	junk = rndRange(1, 16);
+				while (junk-- > 0)
+					stream[len++] = (uint8_t)rnd();
+			}
+		}
+
+		// Read in pieces, like the UART reads of pwrSigTask
+		int	off = 0;
+		while (off < len) {
+			int	rd = rndRange(1, sizeof(pCtrl->recvBuf));
+			if (rd > len - off)
+				rd = len - off;
+
+			handlePwrData(pCtrl, &stream[off], rd);
+			off += rd;
+
+			// Sometimes the client is slow and keeps both buffers
+			if (rnd() % 3 != 0)
+				taken += rxDrain(pCtrl);
+		}
+		taken += rxDrain(pCtrl);
+		sent  += whole;
+
+		// Start the next batch from idle, as the 500 ms timeout would
+		pCtrl->state = pwrSigState_idle;
+	}
+
+	printf("stream: %d signatures delivered, %d sent whole, %u dropped for lack of a buffer, %u bad headers\n",
+		taken, sent, pCtrl->stats.sigDropCount, pCtrl->stats.hdrErrCount);
+
+	CHECK(taken > 0);
+	CHECK(taken <= frames);
+
+	rxFree(pCtrl);
+}
+
+
+//******************************************************************************
+// Benchmark
+//******************************************************************************
+
+static void benchRun(const uint8_t * stream, int len, int frames, int rdSz)
+{
+	static int		rdLens[8 * PWR_SIG_MAX_SIG_SZ];
+	taskCtrl_t *	pCtrl = rxInit();
+	sigBuf_t *		buf;
+	int				numRd = 0;
+	int				taken = 0;
+	int				off;
+	int				i;
+
+	// Read sizes are drawn up front to keep rnd() out of the timing
+	rndState = 1;
+	for (off = 0; off < len && numRd < sizeof(rdLens) / sizeof(rdLens[0]); numRd++) {
+		rdLens[numRd] = (rdSz > 0) ? rdSz : rndRange(1, sizeof(pCtrl->recvBuf));
+		off += rdLens[numRd];
+	}
+
+	int64_t		t0 = esp_timer_get_time();
+	uint32_t	c0 = xthal_get_ccount();
+	uint64_t	cycles = 0;
+
+	for (off = 0, i = 0; off < len; off += rdSz, i++) {
+		rdSz = rdLens[i % numRd];
+		if (rdSz > len - off)
+			rdSz = len - off;
+
+		handlePwrData(pCtrl, (uint8_t *)&stream[off], rdSz);
+
+		// A client that keeps up
+		while (xQueueReceive(pCtrl->readyQueue, &buf, 0) == pdTRUE) {
+			xQueueSend(pCtrl->freeQueue, &buf, 0);
+			taken++;
+		}
+
+		// Fold the 32-bit count before it can wrap
+		if (0 == (i & 1023)) {
+			uint32_t	c1 = xthal_get_ccount();
+			cycles += (uint32_t)(c1 - c0);
+			c0 = c1;
+		}
+	}
+
+	cycles += (uint32_t)(xthal_get_ccount() - c0);
+	int64_t	us = esp_timer_get_time() - t0;
+
+	CHECK(taken == frames);
+
+	printf("%8.1f MB/s, %6.2f cycles per byte\n",
+		(double)len / (us ? us : 1),
+		(double)cycles / len
+	);
+
+	rxFree(pCtrl);
+}
+
+
+static void bench(int count)
+{
+	static const int	rdSizes[] = { 1, 16, 64, 256, 0 };
+	int					frameSz = PWR_SIG_FRAME_OVERHEAD + PWR_SIG_HDR_SZ + PWR_SIG_MAX_SIG_SZ;
+	uint8_t *			stream  = malloc((size_t)count * frameSz);
+	int					len     = 0;
+	int					i;
+
+	// Pump off signatures, so the time is that of the receiver and not of
+	// the analysis a pump on signature gets
+	for (i = 0; i < count; i++) {
+		uint8_t *	frame = &stream[len];
+		int			fl    = mkFrame(frame, PWR_SIG_MAX_SIG_SZ, true);
+		uint8_t		fix   = frame[4] ^ pwrSigReason_off;
+
+		frame[4]      ^= fix;
+		frame[fl - 2] ^= fix;
+		len += fl;
+	}
+
+	printf("handlePwrData: %d signatures of %d samples, %d bytes\n", count, PWR_SIG_MAX_SAMPLES, len);
+	for (i = 0; i < sizeof(rdSizes) / sizeof(rdSizes[0]); i++) {
+		if (rdSizes[i] > 0)
+			printf("  %3d byte reads:   ", rdSizes[i]);
+		else
+			printf("  1..256 byte reads:");
+		benchRun(stream, len, count, rdSizes[i]);
+	}
+
+	free(stream);
+}
+
+
+int main(int argc, char * argv[])
+{
+	if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+		bench((argc > 2) ? atoi(argv[2]) : 500);
+		return hostTestResult();
+	}
+
+	int	iterations = (argc > 1) ? atoi(argv[1]) : 20000;
+
+	if (argc > 2)
+		rndState = (uint32_t)strtoul(argv[2], NULL, 0) | 1;
+
+	testViewSub();
+	fuzzDecode(iterations * 20);
+	fuzzStream(iterations);
+
+	return hostTestResult();
+}
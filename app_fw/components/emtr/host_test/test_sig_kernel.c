@@ -0,0 +1,306 @@
+/*
+ * test_sig_kernel.c
+ *
+ * Host test of pwrSigAnalyze against a double precision reference
+ *
+ * The reference works in volts, amps and seconds from the definitions in
+ * emtr_sig_kernel.h, with none of the kernel's integer scaling. Results
+ * are truncated the same way and must match exactly. A reference value
+ * within rounding distance of a whole number is a tie, where a double
+ * cannot tell which side the exact value is on, and is counted but not
+ * failed.
+ *
+ *   ./test_sig_kernel [signatures] [seed]
+ *
+ * With "bench" it times the kernel on full length signatures:
+ *
+ *   ./test_sig_kernel bench [signatures]
+ */
+
+#include <math.h>
+#include "host_test.h"
+#include "emtr_sig_kernel.h"
+
+#define SMP_SZ			(4)
+#define MAX_SAMPLES		(2000)
+
+// ADC counts per volt and per amp
+#define ADC_PER_VOLT	(65.535)
+#define ADC_PER_AMP		(327.68)
+
+
+static uint32_t	rndState = 1;
+
+static uint32_t rnd(void)
+{
+	// xorshift32
+	rndState ^= rndState << 13;
+	rndState ^= rndState >> 17;
+	rndState ^= rndState << 5;
+	return rndState;
+}
+
+static double rndUnit(void)
+{
+	return (double)rnd() / 4294967296.0;
+}
+
+
+static void putAdc(uint8_t * p, double val)
+{
+	long	adc = lround(val);
+
+	if (adc > INT16_MAX)
+		adc = INT16_MAX;
+	if (adc < INT16_MIN)
+		adc = INT16_MIN;
+
+	p[0] = (uint8_t)((uint16_t)adc >> 8);
+	p[1] = (uint8_t)adc;
+}
+
+
+/**
+ * \brief Make a signature of a load switching on
+ *
+ * Mains voltage, and a current that starts at a multiple of its final
+ * value and decays to it, with some harmonics and noise
+ */
+static void mkInrush(uint8_t * samp, int numSamples, uint32_t sampleRate, uint32_t mainsHz)
+{
+	double	vPeak   = (110.0 + 20.0 * rndUnit()) * M_SQRT2;
+	double	iFinal  = 0.2 + 14.0 * rndUnit();
+	double	iStart  = iFinal * (1.0 + 7.0 * rndUnit());
+	double	tau     = 0.005 + 0.15 * rndUnit();
+	double	phase   = -0.9 * rndUnit();
+	double	h3      = 0.3 * rndUnit();
+	double	noise   = 0.02 * rndUnit();
+	double	w       = 2.0 * M_PI * mainsHz;
+	int		i;
+
+	for (i = 0; i < numSamples; i++) {
+		double	t   = (double)i / sampleRate;
+		double	amp = iFinal + (iStart - iFinal) * exp(-t / tau);
+		double	v   = vPeak * sin(w * t);
+		double	a   = amp * M_SQRT2 * (sin(w * t + phase) + h3 * sin(3.0 * w * t));
+
+		a += iFinal * noise * (2.0 * rndUnit() - 1.0);
+
+		putAdc(&samp[i * SMP_SZ], v * ADC_PER_VOLT);
+		putAdc(&samp[i * SMP_SZ + 2], a * ADC_PER_AMP);
+	}
+}
+
+
+//******************************************************************************
+// Reference
+//******************************************************************************
+
+typedef struct {
+	double		mAmpsPeak;
+	double		usToPeak;
+	double		mAmpsRms[PWR_SIG_KNL_MAX_WINDOWS];
+	double		mAmpsRmsMax;
+	double		usSettle;
+	double		mJoulesInrush;
+	int			numWindows;
+	int			windowLen;
+} refResult_t;
+
+
+static double getVolts(const uint8_t * p)
+{
+	return (int16_t)(((uint16_t)p[0] << 8) | p[1]) / ADC_PER_VOLT;
+}
+
+static double getAmps(const uint8_t * p)
+{
+	return (int16_t)(((uint16_t)p[2] << 8) | p[3]) / ADC_PER_AMP;
+}
+
+
+static void refAnalyze(const uint8_t * samp, int numSamples, uint32_t sampleRate, uint32_t mainsHz, refResult_t * ret)
+{
+	double	energy[PWR_SIG_KNL_MAX_WINDOWS];
+	double	peak = 0.0;
+	int		peakIdx = 0;
+	int		w;
+	int		i;
+
+	memset(ret, 0, sizeof(*ret));
+
+	ret->windowLen = sampleRate / mainsHz;
+	if (ret->windowLen > PWR_SIG_KNL_MAX_WINDOW_LEN)
+		ret->windowLen = PWR_SIG_KNL_MAX_WINDOW_LEN;
+	if (ret->windowLen > numSamples)
+		ret->windowLen = numSamples;
+	if (ret->windowLen < 1)
+		ret->windowLen = 1;
+
+	ret->numWindows = numSamples / ret->windowLen;
+	if (ret->numWindows > PWR_SIG_KNL_MAX_WINDOWS)
+		ret->numWindows = PWR_SIG_KNL_MAX_WINDOWS;
+
+	// Samples past the last window the kernel tracks are not looked at
+	int	last = PWR_SIG_KNL_MAX_WINDOWS * ret->windowLen;
+	if (last > numSamples)
+		last = numSamples;
+
+	for (i = 0; i < last; i++) {
+		double	a = fabs(getAmps(&samp[i * SMP_SZ]));
+		if (a > peak) {
+			peak    = a;
+			peakIdx = i;
+		}
+	}
+	ret->mAmpsPeak = peak * 1000.0;
+	ret->usToPeak  = peakIdx * 1e6 / sampleRate;
+
+	for (w = 0; w < ret->numWindows; w++) {
+		double	sumSq = 0.0;
+		double	sumVi = 0.0;
+
+		for (i = w * ret->windowLen; i < (w + 1) * ret->windowLen; i++) {
+			double	v = getVolts(&samp[i * SMP_SZ]);
+			double	a = getAmps(&samp[i * SMP_SZ]);
+
+			sumSq += a * a;
+			sumVi += v * a;
+		}
+
+		ret->mAmpsRms[w] = sqrt(sumSq / ret->windowLen) * 1000.0;
+		if (ret->mAmpsRms[w] > ret->mAmpsRmsMax)
+			ret->mAmpsRmsMax = ret->mAmpsRms[w];
+
+		// Joules of the window, in mJ
+		energy[w] = sumVi / sampleRate * 1000.0;
+	}
+
+	// The kernel compares truncated milliamps, so does the reference
+	double	final = floor(ret->mAmpsRms[ret->numWindows - 1]);
+	double	band  = floor(final * PWR_SIG_KNL_SETTLE_PCT / 100.0);
+	if (band < PWR_SIG_KNL_SETTLE_MIN_MA)
+		band = PWR_SIG_KNL_SETTLE_MIN_MA;
+
+	int	settle = ret->numWindows - 1;
+	while (settle > 0 && fabs(floor(ret->mAmpsRms[settle - 1]) - final) <= band)
+		settle -= 1;
+
+	ret->usSettle = (double)settle * ret->windowLen * 1e6 / sampleRate;
+
+	for (w = 0; w < settle; w++)
+		ret->mJoulesInrush += energy[w];
+}
+
+
+static int	tieCt;
+
+/**
+ * \brief Compare a kernel result with the reference truncated toward zero
+ */
+static bool sameTrunc(int64_t val, double ref)
+{
+	double	t = trunc(ref);
+
+	if ((double)val == t)
+		return true;
+
+	// Within rounding of a whole number, either side is right
+	double	eps = fabs(ref) * 1e-12 + 1e-9;
+	if (fabs(ref - nearbyint(ref)) <= eps && fabs((double)val - nearbyint(ref)) <= 1.0) {
+		tieCt++;
+		return true;
+	}
+
+	return false;
+}
+
+
+static void testReference(int count)
+{
+	static uint8_t		samp[MAX_SAMPLES * SMP_SZ];
+	pwrSigAnalysis_t	res;
+	refResult_t			ref;
+	int					fails = hostTestFails;
+	int					n;
+
+	for (n = 0; n < count; n++) {
+		uint32_t	mainsHz    = (rnd() & 1) ? 60 : 50;
+		uint32_t	sampleRate = pwrSigSampleRate(rnd() % 6);
+		int			numSamples = 1 + rnd() % MAX_SAMPLES;
+
+		mkInrush(samp, numSamples, sampleRate, mainsHz);
+
+		CHECK(pwrSigAnalyze(samp, numSamples, sampleRate, mainsHz, &res) == ESP_OK);
+		refAnalyze(samp, numSamples, sampleRate, mainsHz, &ref);
+
+		CHECK(res.numWindows == ref.numWindows);
+		CHECK(res.windowLen == ref.windowLen);
+		CHECK(sameTrunc(res.mAmpsPeak, ref.mAmpsPeak));
+		CHECK(sameTrunc(res.usToPeak, ref.usToPeak));
+		CHECK(sameTrunc(res.mAmpsRmsMax, ref.mAmpsRmsMax));
+		CHECK(sameTrunc(res.mAmpsRmsFinal, ref.mAmpsRms[ref.numWindows - 1]));
+		CHECK(sameTrunc(res.usSettle, ref.usSettle));
+		CHECK(sameTrunc(res.mJoulesInrush, ref.mJoulesInrush));
+
+		if (hostTestFails != fails) {
+			printf("  signature %d: %d samples at %u Hz, %u Hz mains\n", n, numSamples, sampleRate, mainsHz);
+			fails = hostTestFails;
+		}
+	}
+
+	printf("reference: %d signatures, %d ties at a whole number\n", count, tieCt);
+
+	// Arguments
+	CHECK(pwrSigAnalyze(NULL, 10, 12000, 60, &res) == ESP_ERR_INVALID_ARG);
+	CHECK(pwrSigAnalyze(samp, 0, 12000, 60, &res) == ESP_ERR_INVALID_ARG);
+	CHECK(pwrSigAnalyze(samp, 10, 0, 60, &res) == ESP_ERR_INVALID_ARG);
+}
+
+
+//******************************************************************************
+// Benchmark
+//******************************************************************************
+
+static void bench(int count)
+{
+	static uint8_t		samp[MAX_SAMPLES * SMP_SZ];
+	pwrSigAnalysis_t	res;
+	uint64_t			cycles = 0;
+	int64_t				us     = 0;
+	int					n;
+
+	mkInrush(samp, MAX_SAMPLES, 12000, 60);
+
+	for (n = 0; n < count; n++) {
+		int64_t		t0 = esp_timer_get_time();
+		uint32_t	c0 = xthal_get_ccount();
+
+		pwrSigAnalyze(samp, MAX_SAMPLES, 12000, 60, &res);
+
+		cycles += (uint32_t)(xthal_get_ccount() - c0);
+		us     += esp_timer_get_time() - t0;
+	}
+
+	printf("pwrSigAnalyze: %d signatures of %d samples, %.2f cycles and %.2f ns per sample\n",
+		count, MAX_SAMPLES,
+		(double)cycles / ((double)count * MAX_SAMPLES),
+		(double)us * 1000.0 / ((double)count * MAX_SAMPLES)
+	);
+}
+
+
+int main(int argc, char * argv[])
+{
+	if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+		bench((argc > 2) ? atoi(argv[2]) : 20000);
+		return 0;
+	}
+
+	if (argc > 2)
+		rndState = (uint32_t)strtoul(argv[2], NULL, 0) | 1;
+
+	testReference((argc > 1) ? atoi(argv[1]) : 2000);
+
+	return hostTestResult();
+}
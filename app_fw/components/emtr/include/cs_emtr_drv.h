@@ -166,6 +166,11 @@ typedef struct {
 	uint32_t	min;	//!< Minimum value
 	uint32_t	max;	//!< Maximum value
 	uint32_t	avg;	//!< Average value
+	uint32_t	twAvg;	//!< Average weighted by the time each sample was held
+	uint32_t	stdDev;	//!< Sample standard deviation
+	uint32_t	p50;	//!< Estimated median
+	uint32_t	p95;	//!< Estimated 95th percentile
+	uint32_t	p99;	//!< Estimated 99th percentile
 } csEmtrAvgEnergy_t;
 
 
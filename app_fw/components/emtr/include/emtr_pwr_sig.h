@@ -13,6 +13,7 @@
 #include "driver/uart.h"
 #include "driver/gpio.h"
 #include "cs_emtr_drv.h"
+#include "emtr_sig_kernel.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -34,6 +35,30 @@ extern "C" {
 #define PWR_SIG_MAX_SAMPLES	(2000)
 #define PWR_SIG_MAX_SIG_SZ	(PWR_SIG_MAX_SAMPLES * PWR_SIG_SMP_SZ)
 
+// Highest water and GFCI leak level
+#define PWR_SIG_MAX_LEVEL	(5)
+
+// Highest sample resolution code, see pwrSigSampleRate()
+#define PWR_SIG_MAX_RESOLUTION	(5)
+
+// The data handed to the client starts with a metrics header, all
+// multi-byte fields big-endian, followed by the samples
+//   offset  len
+//        0    1  Header version, 1
+//        1    1  Reason code
+//        2    1  Water level 0..5
+//        3    1  GFCI leak level 0..5
+//        4    2  Number of samples
+//        6    1  Sample resolution 0..5
+//        7    1  Bytes per sample, 4
+//        8    4  Pump cycles
+//       12    4  Seconds powered
+//       16    4  Seconds running
+//       20    4  Epoch
+//       24    8  Reserved, zero
+#define PWR_METRICS_HDR_SZ		(32)
+#define PWR_METRICS_HDR_VERSION	(1)
+
 /**
  * These correspond to values passed from EMTR, don't change them
  */
@@ -50,6 +75,10 @@ typedef struct {
 	pwrSigReason_t	reason;
 	uint16_t		numSamples;
 	uint8_t			resolution;
+	uint8_t			waterLevel;
+	uint8_t			gfciLevel;
+	uint32_t		pumpCycles;
+	uint32_t		epoch;
 	uint32_t		relayCycles;
 	uint32_t		timePowered;
 	uint32_t		timeRunning;
@@ -59,8 +88,89 @@ typedef struct {
 	uint8_t			pFactor;
 	uint8_t			temperature;
 	uint32_t		mAmpsInrush;
+	// Valid only on pump on
+	pwrSigAnalysis_t	inrush;
+	pwrSigFeatures_t	features;
+	pwrSigClass_t		load;
 } pwrSigMeta_t;
 
+/**
+ * \brief Metrics header fields, see \ref pwrSigDecode
+ */
+typedef struct {
+	uint8_t			version;
+	pwrSigReason_t	reason;
+	uint8_t			waterLevel;
+	uint8_t			gfciLevel;
+	uint16_t		numSamples;
+	uint8_t			resolution;
+	uint8_t			sampleSz;
+	uint32_t		pumpCycles;
+	uint32_t		timePowered;
+	uint32_t		timeRunning;
+	uint32_t		epoch;
+} pwrSigHdr_t;
+
+
+/**
+ * \brief View of the samples in a signature buffer
+ *
+ * Refers to the buffer without copying it. Sample i of the view starts
+ * stride bytes after sample i - 1.
+ */
+typedef struct {
+	const uint8_t *	samp;			// First sample of the view
+	int				numSamples;
+	int				stride;			// Bytes from one sample to the next
+	uint32_t		sampleRate;		// Samples per second of the view
+} pwrSigView_t;
+
+
+/**
+ * \brief Volts ADC value of sample i of a view
+ */
+static inline int16_t pwrSigViewVolts(const pwrSigView_t * view, int i)
+{
+	const uint8_t *	p = view->samp + i * view->stride;
+	return (int16_t)(((uint16_t)p[0] << 8) | p[1]);
+}
+
+
+/**
+ * \brief Amps ADC value of sample i of a view
+ */
+static inline int16_t pwrSigViewAmps(const pwrSigView_t * view, int i)
+{
+	const uint8_t *	p = view->samp + i * view->stride;
+	return (int16_t)(((uint16_t)p[2] << 8) | p[3]);
+}
+
+
+esp_err_t pwrSigDecode(
+	const uint8_t *	data,
+	int				dataLen,
+	pwrSigHdr_t *	hdr,
+	pwrSigView_t *	view
+);
+
+esp_err_t pwrSigViewSub(
+	const pwrSigView_t *	view,
+	int						first,
+	int						count,
+	int						step,
+	pwrSigView_t *			ret
+);
+
+
+/**
+ * \brief Function called with each received power signature
+ *
+ * Called from the driver's delivery task, not the receive task. The data
+ * stays valid until the function returns, then the buffer is reused.
+ *
+ * The data starts with the metrics header, \ref pwrSigDecode gives its
+ * fields and a view of the samples.
+ */
 typedef void (*pwrSigCallback_t)(
 	pwrSigMeta_t*	meta,
 	uint8_t*		data,
@@ -75,6 +185,10 @@ typedef struct {
 	pwrSigCallback_t	cbFunc;
 	void*				cbData;
 	UBaseType_t			taskPriority;
+	int					rxBufSz;		// UART receive buffer, 0 for one full signature
+	int					numBufs;		// Signatures that can be held, 0 for the default
+	UBaseType_t			cbTaskPriority;	// Priority of the task calling cbFunc, 0 for
+										// one below taskPriority
 } pwrSigConf_t;
 
 
@@ -84,6 +198,30 @@ esp_err_t pwrSigStart(void);
 
 esp_err_t pwrSigCount(uint32_t * ret);
 
+/**
+ * \brief Power signature parser statistics
+ *
+ * See \ref pwrSigGetStats
+ */
+typedef struct {
+	uint32_t	sigCount;		// Signatures received
+	uint32_t	byteCount;		// Bytes fed to the parser
+	uint64_t	parseCycles;	// CPU cycles spent parsing
+	uint32_t	lastSigCycles;	// CPU cycles spent on the last signature
+	uint32_t	fifoOvfCount;	// UART hardware FIFO overflows
+	uint32_t	bufFullCount;	// UART receive buffer overflows
+	uint32_t	frameErrCount;	// UART framing errors
+	uint32_t	parityErrCount;	// UART parity errors
+	uint32_t	breakCount;		// UART breaks detected
+	uint32_t	deliverCount;	// Signatures handed to the client
+	uint32_t	sigDropCount;	// Signatures dropped, no free buffer
+	uint32_t	bufsFree;		// Buffers not held by the receiver or client
+	uint32_t	hdrErrCount;	// Signatures dropped for a bad header
+	int			bufsInUseMax;	// Most buffers out of the pool at once
+} pwrSigStats_t;
+
+esp_err_t pwrSigGetStats(pwrSigStats_t * ret);
+
 void pwrSigReadHex(int maxLen);
 
 #ifdef __cplusplus
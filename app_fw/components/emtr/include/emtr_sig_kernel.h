@@ -0,0 +1,166 @@
+/*
+ * emtr_sig_kernel.h
+ *
+ *  Integer signal kernels for power signature analysis
+ */
+
+#ifndef COMPONENTS_EMTR_INCLUDE_EMTR_SIG_KERNEL_H_
+#define COMPONENTS_EMTR_INCLUDE_EMTR_SIG_KERNEL_H_
+
+#include <stdint.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Most RMS windows tracked in one signature, samples past the last
+// window are not analyzed
+#define PWR_SIG_KNL_MAX_WINDOWS		(64)
+
+// Longest RMS window, keeps the window sums within 64 bits
+#define PWR_SIG_KNL_MAX_WINDOW_LEN	(256)
+
+// Default mains frequency, sets the RMS window to one cycle
+#define PWR_SIG_KNL_MAINS_HZ		(60)
+
+// Settled once every later window is within this many percent of the
+// final RMS current, but not less than PWR_SIG_KNL_SETTLE_MIN_MA
+#define PWR_SIG_KNL_SETTLE_PCT		(10)
+#define PWR_SIG_KNL_SETTLE_MIN_MA	(50)
+
+// Harmonics measured by \ref pwrSigExtract, including the fundamental
+#define PWR_SIG_KNL_NUM_HARMONICS	(15)
+
+// Longest span used for harmonic analysis
+#define PWR_SIG_KNL_MAX_DFT_LEN		(1024)
+
+// Elements in a load fingerprint
+#define PWR_SIG_FP_LEN				(8)
+
+// Fingerprints further than this from every library entry are unknown
+#define PWR_SIG_KNL_CLASS_MAX_DIST	(4000)
+
+
+/**
+ * \brief Results of \ref pwrSigAnalyze
+ *
+ * Sample indexes are converted to microseconds from the start of the
+ * signature. Values are truncated toward zero.
+ */
+typedef struct {
+	uint32_t	mAmpsPeak;		// Largest instantaneous current magnitude
+	uint32_t	usToPeak;		// Time of the peak
+	uint32_t	mAmpsRmsMax;	// Largest RMS current over one mains cycle
+	uint32_t	mAmpsRmsFinal;	// RMS current of the last whole cycle
+	uint32_t	usSettle;		// Time the RMS current settled
+	int32_t		mJoulesInrush;	// Energy delivered before settling
+	uint16_t	numWindows;		// Whole mains cycles analyzed
+	uint16_t	windowLen;		// Samples per mains cycle
+} pwrSigAnalysis_t;
+
+
+/**
+ * \brief Load fingerprint element indexes
+ *
+ * Each element is scaled to 0..255 so that the elements weigh about the
+ * same in the distance used by \ref pwrSigClassify
+ */
+typedef enum {
+	pwrSigFp_pFactor = 0,	// Displacement power factor, 255 == 1.0
+	pwrSigFp_thd,			// Current THD, units of 0.4%
+	pwrSigFp_h3,			// 3rd harmonic, 255 == fundamental
+	pwrSigFp_h5,			// 5th harmonic, 255 == fundamental
+	pwrSigFp_h7,			// 7th harmonic, 255 == fundamental
+	pwrSigFp_crest,			// Crest factor, 64 == 1.0
+	pwrSigFp_inrush,		// Max to final RMS current, 16 == 1.0
+	pwrSigFp_settle			// Mains cycles to settle
+} pwrSigFp_t;
+
+
+/**
+ * \brief Results of \ref pwrSigExtract
+ *
+ * Measured over whole mains cycles of the settled part of the signature
+ */
+typedef struct {
+	uint16_t	numSamples;		// Samples analyzed
+	uint16_t	numHarmonics;	// Harmonics below the Nyquist frequency
+	uint32_t	mAmpsHarm[PWR_SIG_KNL_NUM_HARMONICS];	// RMS current of harmonics 1..N
+	uint16_t	thdPermille;	// Current total harmonic distortion
+	uint16_t	crestX1000;		// Current crest factor
+	int16_t		pFactorX1000;	// Displacement power factor
+	uint8_t		fp[PWR_SIG_FP_LEN];		// Fingerprint, see pwrSigFp_t
+} pwrSigFeatures_t;
+
+
+typedef enum {
+	pwrSigLoad_unknown = 0,
+	pwrSigLoad_pumpMotor,
+	pwrSigLoad_heater,
+	pwrSigLoad_compressor
+} pwrSigLoad_t;
+
+const char* pwrSigLoadStr(pwrSigLoad_t load);
+
+
+/**
+ * \brief One entry of a load library
+ */
+typedef struct {
+	pwrSigLoad_t	load;
+	uint8_t			fp[PWR_SIG_FP_LEN];
+} pwrSigLoadRef_t;
+
+
+/**
+ * \brief Results of \ref pwrSigClassify
+ */
+typedef struct {
+	pwrSigLoad_t	load;		// Nearest load, unknown if too far away
+	uint32_t		distance;	// Squared distance to the nearest entry
+} pwrSigClass_t;
+
+
+/**
+ * \brief Sample rate of a signature resolution code
+ *
+ * Codes 0..5 are 12 KHz, 6 KHz, 4 KHz, 3 KHz, 2.4 KHz and 2 KHz
+ */
+static inline uint32_t pwrSigSampleRate(uint8_t resolution)
+{
+	return 12000 / ((resolution > 5 ? 5 : resolution) + 1);
+}
+
+
+esp_err_t pwrSigAnalyze(
+	const uint8_t *		samp,
+	int					numSamples,
+	uint32_t			sampleRate,
+	uint32_t			mainsHz,
+	pwrSigAnalysis_t *	ret
+);
+
+esp_err_t pwrSigExtract(
+	const uint8_t *				samp,
+	int							numSamples,
+	uint32_t					sampleRate,
+	uint32_t					mainsHz,
+	const pwrSigAnalysis_t *	analysis,
+	pwrSigFeatures_t *			ret
+);
+
+esp_err_t pwrSigClassify(
+	const uint8_t *				fp,
+	const pwrSigLoadRef_t *		lib,
+	int							libSz,
+	pwrSigClass_t *				ret
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPONENTS_EMTR_INCLUDE_EMTR_SIG_KERNEL_H_ */
@@ -242,6 +242,7 @@ void pwrSigCallback(
 	ESP_LOGI(TAG, "  Seconds running : %u", meta->timeRunning);
 	if (pwrSigReason_on == meta->reason) {
 		ESP_LOGI(TAG, "  Inrush amps     : %0.3f", (double)meta->mAmpsInrush/1000.0);
+		ESP_LOGI(TAG, "  Load            : %s", pwrSigLoadStr(meta->load.load));
 	} else if (pwrSigReason_off == meta->reason) {
 		ESP_LOGI(TAG, "  Cycle length    : %u", meta->cycleLength);
 		ESP_LOGI(TAG, "  Average volts   : %0.2f", (double)meta->dVolts/10.0);
@@ -0,0 +1,684 @@
+#!/usr/bin/python3
+#
+# Virtual EMTR for exercising the ESP-side drivers on a Linux host
+#
+# The simulator opens a pseudo-terminal and answers the 0x1B ... 0x0A command
+# set used by pw240_fw emtr_drv.c. A second, optional pseudo-terminal carries
+# the 'S' power signature stream read by app_fw emtr_pwr_sig.c. Point the
+# UART shim of a host build, or the "bench" command below, at the printed
+# device paths.
+#
+# Simulate:
+#   python3 emtr_sim.py sim --load1 cycle:20:10:8000 --load2 const:600 --sig
+#   python3 emtr_sim.py sim --latency-ms 5 --drop-rate 0.001 --corrupt-rate 0.01
+#
+# Measure a simulated or real EMTR:
+#   python3 emtr_sim.py bench /dev/pts/5 --count 500
+#
+# While "sim" runs, lines typed on stdin control it:
+#   reset app|boot      Reset the EMTR into the application or boot loader
+#   hang <seconds>      Stop answering commands for a while
+#   load <n> <profile>  Change the load profile of socket n
+#   sig <n>             Capture a signature on socket n and stream it
+#   stats               Show counters
+#
+# Load profiles:
+#   off                       Nothing plugged in
+#   idle                      Plugged in, no load
+#   const:<dW>                Constant load, 0.1 Watt units
+#   cycle:<on>:<off>:<dW>     Load runs <on> seconds out of every <on>+<off>
+#   ramp:<period>:<dW>        Load rises from 0 to <dW> over <period> seconds
+#
+import os
+import sys
+import pty
+import tty
+import termios
+import select
+import struct
+import random
+import math
+import time
+import argparse
+
+MSG_CHAR_SOP = 0x1B
+MSG_CHAR_EOP = 0x0A
+
+CMD_GET_STATE        = 0x00
+CMD_GET_STATUS       = 0x01
+CMD_GET_KWH          = 0x02
+CMD_GET_INSTANT_PWR  = 0x03
+CMD_GET_SW_VERSION   = 0x05
+CMD_GET_SNAPSHOT     = 0x06
+CMD_GET_FW_STATUS    = 0x31
+CMD_START_XMODEM     = 0x32
+CMD_REBOOT           = 0x33
+CMD_GENERIC_RESP     = 0xF0
+
+# Per-socket command codes, socket 1 in the 0x1X range and socket 2 in 0x2X
+SOCK_CMD_OFF     = 0x0
+SOCK_CMD_ON      = 0x1
+SOCK_CMD_SIG_TS  = 0x2
+SOCK_CMD_SIG_PG  = 0x3
+SOCK_CMD_SIG_BLK = 0x4
+
+OSTATUS_SOCKET_ON   = (1 << 2)
+OSTATUS_PLUG_DETECT = (1 << 3)
+
+SIG_NUM_SAMPLES = 1536
+SIG_PAGE_SZ     = 128
+SIG_BUF_SZ      = 4 * SIG_NUM_SAMPLES
+SIG_NUM_PAGES   = SIG_BUF_SZ // SIG_PAGE_SZ
+
+# Header of the 'S' stream expected by emtr_pwr_sig.c
+PWR_SIG_HDR_SZ = 15
+
+XM_SOH = 0x01
+XM_EOT = 0x04
+XM_ACK = 0x06
+XM_NAK = 0x15
+XM_CRC = ord('C')
+
+
+def crc16Xmodem(data:bytes, crc:int=0) -> int:
+	for b in data:
+		crc ^= b << 8
+		for _ in range(8):
+			if crc & 0x8000:
+				crc = ((crc << 1) ^ 0x1021) & 0xFFFF
+			else:
+				crc = (crc << 1) & 0xFFFF
+	return crc
+
+
+def xorSum(data:bytes) -> int:
+	cs = 0
+	for b in data:
+		cs ^= b
+	return cs
+
+
+def mkFrame(cmd:int, payload:bytes=b"") -> bytes:
+	body = bytes([cmd, len(payload)]) + payload
+	return bytes([MSG_CHAR_SOP]) + body + bytes([xorSum(body), MSG_CHAR_EOP])
+
+
+def mkRequest(cmd:int, payload:bytes=b"\x00\x00\x00\x00") -> bytes:
+	body = bytes([cmd]) + payload[:4].ljust(4, b"\x00")
+	return bytes([MSG_CHAR_SOP]) + body + bytes([xorSum(body), MSG_CHAR_EOP])
+
+
+def openPty(name:str):
+	master, slave = pty.openpty()
+	tty.setraw(slave)
+	path = os.ttyname(slave)
+	print(f"{name}: {path}")
+	return master, slave
+
+
+class loadProfile():
+	def __init__(self, spec:str):
+		self.spec = spec
+		parts = spec.split(":")
+		self.kind = parts[0]
+		self.args = [float(v) for v in parts[1:]]
+
+		nArgs = {"off": 0, "idle": 0, "const": 1, "cycle": 3, "ramp": 2}
+		if self.kind not in nArgs or len(self.args) != nArgs[self.kind]:
+			raise ValueError(f"Bad load profile '{spec}'")
+
+	def isPlugged(self) -> bool:
+		return "off" != self.kind
+
+	def dWatts(self, t:float) -> float:
+		if "const" == self.kind:
+			return self.args[0]
+		elif "cycle" == self.kind:
+			on, off, dW = self.args
+			return dW if (t % (on + off)) < on else 0.0
+		elif "ramp" == self.kind:
+			period, dW = self.args
+			return dW * ((t % period) / period)
+		return 0.0
+
+
+class socketSim():
+	def __init__(self, num:int, profile:loadProfile):
+		self.num = num
+		self.profile = profile
+		self.isOn = False
+		self.relayEpoch = 0
+		self.wattHours = 0.0
+		self.inst = (0, 0, 0, 0)
+		self.sigTs = 0
+		self.sigReason = 0
+		self.sigBuf = bytes(SIG_BUF_SZ)
+
+	def flags(self) -> int:
+		f = 0
+		if self.isOn:
+			f |= OSTATUS_SOCKET_ON
+		if self.profile.isPlugged():
+			f |= OSTATUS_PLUG_DETECT
+		return f
+
+	def update(self, t:float, dt:float):
+		dVolts = int(1200 + random.gauss(0, 5))
+		if not self.isOn or not self.profile.isPlugged():
+			self.inst = (dVolts, 0, 0, 0)
+			return
+
+		dWatts = self.profile.dWatts(t)
+		if dWatts > 0:
+			dWatts = max(0.0, dWatts * (1.0 + random.gauss(0, 0.01)))
+			pf = 92
+			mAmps = (dWatts / 10.0) / (dVolts / 10.0) / (pf / 100.0) * 1000.0
+		else:
+			pf = 0
+			mAmps = 0.0
+
+		self.inst = (dVolts, min(int(mAmps), 0xFFFF), min(int(dWatts), 0xFFFF), pf)
+		self.wattHours += (dWatts / 10.0) * dt / 3600.0
+
+	def capture(self, epoch:int, reason:int):
+		# Voltage is a 60 Hz sine, current follows with an inrush on turn on
+		dWatts = self.profile.dWatts(epoch) if self.profile.isPlugged() else 0.0
+		ampsPk = (dWatts / 10.0) / 120.0 * math.sqrt(2) * 1000.0
+		smp = bytearray()
+		for n in range(SIG_NUM_SAMPLES):
+			ph = 2.0 * math.pi * 60.0 * n / 12000.0
+			inrush = 1.0 + (4.0 * math.exp(-n / 150.0) if 1 == reason else 0.0)
+			if 0 == reason:
+				inrush = math.exp(-n / 50.0)
+			v = int(1697 * math.sin(ph))
+			i = int(ampsPk * inrush * math.sin(ph - 0.4))
+			smp += struct.pack(">hh", max(-32768, min(32767, v)), max(-32768, min(32767, i)))
+
+		self.sigTs = epoch
+		self.sigReason = reason
+		self.sigBuf = bytes(smp)
+
+
+class emtrSim():
+	def __init__(self, args):
+		self.args = args
+		self.startTime = time.monotonic()
+		self.lastUpdate = self.startTime
+		self.bootMode = args.boot
+		self.fwVersion = bytes(int(v) for v in args.fw_version.split("."))
+		self.blVersion = bytes(int(v) for v in args.bl_version.split("."))
+		self.temperature = 32
+		self.hangUntil = 0.0
+		self.busyUntil = 0.0
+		self.rxBuf = bytearray()
+		self.xmActive = False
+		self.xmBuf = bytearray()
+		self.xmNext = 1
+		self.xmImage = bytearray()
+		self.xmLastPoll = 0.0
+		self.stats = {"rx": 0, "tx": 0, "badReq": 0, "dropped": 0, "corrupted": 0, "noReply": 0, "sigStreams": 0}
+
+		self.sockets = [
+			socketSim(1, loadProfile(args.load1)),
+			socketSim(2, loadProfile(args.load2))
+		]
+
+		self.cmdFd, self.cmdSlave = openPty("Command UART")
+		self.sigFd = None
+		if args.sig:
+			self.sigFd, self.sigSlave = openPty("Signature UART")
+
+	def epoch(self) -> int:
+		return int(time.monotonic() - self.startTime)
+
+	def reset(self, boot:bool):
+		print(f"Reset into {'boot loader' if boot else 'application'}")
+		self.bootMode = boot
+		self.xmActive = False
+		self.rxBuf.clear()
+		self.hangUntil = 0.0
+		termios.tcflush(self.cmdFd, termios.TCIOFLUSH)
+
+	def update(self):
+		now = time.monotonic()
+		dt = now - self.lastUpdate
+		self.lastUpdate = now
+		for s in self.sockets:
+			s.update(now - self.startTime, dt)
+
+	########################################
+	# Response payloads
+	########################################
+
+	def payloadStatus(self) -> bytes:
+		# Sockets in descending order, then temperature, epoch and device flags
+		p = bytes([self.sockets[1].flags(), self.sockets[0].flags()])
+		p += struct.pack(">HIB", self.temperature, self.epoch(), 0)
+		return p
+
+	def payloadKwh(self) -> bytes:
+		return struct.pack(">II", int(self.sockets[1].wattHours), int(self.sockets[0].wattHours))
+
+	def payloadInstant(self) -> bytes:
+		return struct.pack(">HHHH", *self.sockets[1].inst) + struct.pack(">HHHH", *self.sockets[0].inst)
+
+	def handleSocketCmd(self, sock:socketSim, op:int, payload:bytes) -> bytes:
+		if op in (SOCK_CMD_OFF, SOCK_CMD_ON):
+			isOn = (SOCK_CMD_ON == op)
+			if isOn != sock.isOn:
+				sock.isOn = isOn
+				sock.relayEpoch = self.epoch()
+				self.update()
+				sock.capture(self.epoch(), 1 if isOn else 0)
+				self.busyUntil = time.monotonic() + self.args.switch_busy_ms / 1000.0
+				self.streamSignature(sock)
+			return mkFrame(CMD_GENERIC_RESP)
+
+		if SOCK_CMD_SIG_TS == op:
+			return mkFrame(0x10 * sock.num + op, struct.pack(">IB", sock.sigTs, sock.sigReason))
+
+		if SOCK_CMD_SIG_PG == op:
+			page = payload[0]
+			if page >= SIG_NUM_PAGES:
+				return mkFrame(0x10 * sock.num + op, b"\xff")
+			data = sock.sigBuf[page * SIG_PAGE_SZ:(page + 1) * SIG_PAGE_SZ]
+			return mkFrame(0x10 * sock.num + op, struct.pack(">IB", sock.sigTs, page) + data)
+
+		if SOCK_CMD_SIG_BLK == op:
+			first = payload[0]
+			count = min(payload[1], SIG_NUM_PAGES - first) if first < SIG_NUM_PAGES else 0
+			resp = mkFrame(0x10 * sock.num + op, struct.pack(">IBBB", sock.sigTs, sock.sigReason, first, count))
+			for page in range(first, first + count):
+				rec = bytes([page]) + sock.sigBuf[page * SIG_PAGE_SZ:(page + 1) * SIG_PAGE_SZ]
+				resp += rec + struct.pack(">H", crc16Xmodem(rec))
+			return resp
+
+		return None
+
+	def handleCommand(self, cmd:int, payload:bytes) -> bytes:
+		if CMD_GET_STATE == cmd:
+			if self.bootMode:
+				return mkFrame(cmd, b"B" + self.blVersion)
+			return mkFrame(cmd, b"E" + self.fwVersion)
+
+		if self.bootMode:
+			if CMD_START_XMODEM == cmd:
+				self.xmActive = True
+				self.xmBuf.clear()
+				self.xmImage.clear()
+				self.xmNext = 1
+				self.xmLastPoll = 0.0
+				return mkFrame(CMD_GENERIC_RESP)
+			if CMD_REBOOT == cmd:
+				self.bootMode = False
+				return mkFrame(CMD_GENERIC_RESP)
+			if CMD_GET_FW_STATUS == cmd:
+				# 1: an image has been received
+				return mkFrame(cmd, bytes([1 if self.xmImage else 0]))
+			return mkFrame(cmd, b"\xff")
+
+		self.update()
+
+		if CMD_GET_STATUS == cmd:
+			return mkFrame(cmd, self.payloadStatus())
+		if CMD_GET_KWH == cmd:
+			return mkFrame(cmd, self.payloadKwh())
+		if CMD_GET_INSTANT_PWR == cmd:
+			return mkFrame(cmd, self.payloadInstant())
+		if CMD_GET_SW_VERSION == cmd:
+			return mkFrame(cmd, self.fwVersion)
+		if CMD_GET_SNAPSHOT == cmd:
+			if self.args.legacy:
+				return mkFrame(cmd, b"\xff")
+			return mkFrame(cmd, self.payloadInstant() + self.payloadKwh() + self.payloadStatus())
+
+		sNum = cmd >> 4
+		if 1 <= sNum <= len(self.sockets):
+			op = cmd & 0x0F
+			if SOCK_CMD_SIG_BLK == op and self.args.legacy:
+				return mkFrame(cmd, b"\xff")
+			resp = self.handleSocketCmd(self.sockets[sNum - 1], op, payload)
+			if resp is not None:
+				return resp
+
+		# Same as the EMTR firmware for an unknown command
+		return mkFrame(cmd, b"\xff")
+
+	########################################
+	# Channel impairments
+	########################################
+
+	def send(self, resp:bytes):
+		args = self.args
+
+		if random.random() < args.no_reply_rate:
+			self.stats["noReply"] += 1
+			return
+
+		if random.random() < args.corrupt_rate:
+			# Flip a bit in the byte before EOP, the checksum of a short frame
+			pos = random.randrange(1, len(resp) - 1)
+			resp = resp[:pos] + bytes([resp[pos] ^ 0x01]) + resp[pos + 1:]
+			self.stats["corrupted"] += 1
+
+		if args.drop_rate > 0:
+			kept = bytearray()
+			for b in resp:
+				if random.random() < args.drop_rate:
+					self.stats["dropped"] += 1
+				else:
+					kept.append(b)
+			resp = bytes(kept)
+
+		delay = args.latency_ms + (random.uniform(0, args.jitter_ms) if args.jitter_ms else 0)
+		if delay > 0:
+			time.sleep(delay / 1000.0)
+
+		# Pace the write at the configured baud rate so bulk reads take real time
+		if args.baud:
+			chunk = max(1, args.baud // 10 // 100)
+			for i in range(0, len(resp), chunk):
+				os.write(self.cmdFd, resp[i:i + chunk])
+				time.sleep(len(resp[i:i + chunk]) * 10.0 / args.baud)
+		else:
+			os.write(self.cmdFd, resp)
+
+		self.stats["tx"] += len(resp)
+
+	def streamSignature(self, sock:socketSim):
+		if self.sigFd is None:
+			return
+
+		hdr = struct.pack(">BIII", sock.sigReason, sock.relayEpoch, self.epoch(), self.epoch() - sock.relayEpoch)
+		hdr += bytes([0, 0])
+		body = hdr + sock.sigBuf
+		# Payload length counts the check digit, see emtr_pwr_sig.c
+		lenBytes = struct.pack(">H", len(body) + 1)
+		cs = xorSum(b"S" + lenBytes + body)
+
+		msg = bytes([MSG_CHAR_SOP]) + b"S" + lenBytes + body + bytes([cs, MSG_CHAR_EOP])
+		os.write(self.sigFd, msg)
+		self.stats["sigStreams"] += 1
+
+	########################################
+	# Receive paths
+	########################################
+
+	def handleRx(self, data:bytes):
+		self.stats["rx"] += len(data)
+
+		if time.monotonic() < self.hangUntil:
+			return
+
+		if self.xmActive:
+			self.handleXmodem(data)
+			return
+
+		self.rxBuf += data
+		while len(self.rxBuf) >= 8:
+			if self.rxBuf[0] != MSG_CHAR_SOP:
+				del self.rxBuf[0]
+				continue
+
+			req = bytes(self.rxBuf[:8])
+			del self.rxBuf[:8]
+
+			if req[7] != MSG_CHAR_EOP or xorSum(req[1:6]) != req[6]:
+				self.stats["badReq"] += 1
+				continue
+
+			# Commands arriving while a transition is sampled are lost
+			if time.monotonic() < self.busyUntil:
+				continue
+
+			resp = self.handleCommand(req[1], req[2:6])
+			if resp:
+				self.send(resp)
+
+	def handleXmodem(self, data:bytes):
+		self.xmBuf += data
+		while self.xmBuf:
+			if XM_EOT == self.xmBuf[0]:
+				del self.xmBuf[0]
+				os.write(self.cmdFd, bytes([XM_ACK]))
+				print(f"XMODEM received {len(self.xmImage)} bytes")
+				self.xmActive = False
+				return
+
+			if XM_SOH != self.xmBuf[0]:
+				del self.xmBuf[0]
+				continue
+
+			if len(self.xmBuf) < 3 + 128 + 2:
+				return
+
+			blk = bytes(self.xmBuf[:3 + 128 + 2])
+			del self.xmBuf[:3 + 128 + 2]
+
+			data = blk[3:3 + 128]
+			good = (blk[1] == (0xFF - blk[2])) and (struct.unpack(">H", blk[-2:])[0] == crc16Xmodem(data))
+			if good and blk[1] == (self.xmNext & 0xFF):
+				self.xmImage += data
+				self.xmNext += 1
+				os.write(self.cmdFd, bytes([XM_ACK]))
+			elif good and blk[1] == ((self.xmNext - 1) & 0xFF):
+				# Duplicate of the last block
+				os.write(self.cmdFd, bytes([XM_ACK]))
+			else:
+				os.write(self.cmdFd, bytes([XM_NAK]))
+
+	def xmodemPoll(self):
+		# The receiver asks for CRC mode until the first block arrives
+		now = time.monotonic()
+		if self.xmActive and 1 == self.xmNext and now - self.xmLastPoll >= 1.0:
+			self.xmLastPoll = now
+			os.write(self.cmdFd, bytes([XM_CRC]))
+
+	def handleConsole(self, line:str):
+		words = line.split()
+		if not words:
+			return
+		try:
+			if "reset" == words[0]:
+				self.reset(len(words) > 1 and "boot" == words[1])
+			elif "hang" == words[0]:
+				self.hangUntil = time.monotonic() + float(words[1])
+				print(f"Not answering for {words[1]} seconds")
+			elif "load" == words[0]:
+				self.sockets[int(words[1]) - 1].profile = loadProfile(words[2])
+			elif "sig" == words[0]:
+				sock = self.sockets[int(words[1]) - 1]
+				sock.capture(self.epoch(), 2)
+				self.streamSignature(sock)
+			elif "stats" == words[0]:
+				print(self.stats)
+			else:
+				print(f"Unknown command '{words[0]}'")
+		except (IndexError, ValueError) as e:
+			print(f"Error: {e}")
+
+	def run(self):
+		while True:
+			rList = [self.cmdFd, sys.stdin]
+			ready, _, _ = select.select(rList, [], [], 0.1)
+
+			if self.cmdFd in ready:
+				self.handleRx(os.read(self.cmdFd, 1024))
+
+			if sys.stdin in ready:
+				line = sys.stdin.readline()
+				if not line:
+					return
+				self.handleConsole(line)
+
+			self.xmodemPoll()
+
+
+########################################
+# Host side benchmark
+########################################
+
+class benchPort():
+	def __init__(self, path:str, baud:int):
+		self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+		tty.setraw(self.fd)
+		speed = getattr(termios, f"B{baud}", None)
+		if speed is not None:
+			attr = termios.tcgetattr(self.fd)
+			attr[4] = attr[5] = speed
+			termios.tcsetattr(self.fd, termios.TCSANOW, attr)
+		termios.tcflush(self.fd, termios.TCIOFLUSH)
+
+	def read(self, n:int, timeout:float) -> bytes:
+		buf = bytearray()
+		end = time.monotonic() + timeout
+		while len(buf) < n:
+			left = end - time.monotonic()
+			if left <= 0:
+				break
+			ready, _, _ = select.select([self.fd], [], [], left)
+			if ready:
+				buf += os.read(self.fd, n - len(buf))
+		return bytes(buf)
+
+	def command(self, cmd:int, payload:bytes, timeout:float) -> bytes:
+		os.write(self.fd, mkRequest(cmd, payload))
+
+		head = self.read(3, timeout)
+		if len(head) < 3 or MSG_CHAR_SOP != head[0]:
+			return None
+		rest = self.read(head[2] + 2, timeout)
+		if len(rest) < head[2] + 2:
+			return None
+		if rest[-1] != MSG_CHAR_EOP or xorSum(head[1:3] + rest[:-2]) != rest[-2]:
+			return None
+		return rest[:-2]
+
+	def flush(self):
+		time.sleep(0.05)
+		termios.tcflush(self.fd, termios.TCIFLUSH)
+
+
+def percentile(vals:list, p:float) -> float:
+	if not vals:
+		return 0.0
+	s = sorted(vals)
+	return s[min(len(s) - 1, int(p / 100.0 * len(s)))]
+
+
+def bench(args) -> int:
+	port = benchPort(args.port, args.baud)
+	timeout = args.timeout_ms / 1000.0
+
+	# Transaction latency of the poll commands
+	for name, cmd in (("status", CMD_GET_STATUS), ("snapshot", CMD_GET_SNAPSHOT)):
+		lat = []
+		errors = 0
+		for _ in range(args.count):
+			t0 = time.monotonic()
+			if port.command(cmd, b"", timeout) is None:
+				errors += 1
+				port.flush()
+				continue
+			lat.append((time.monotonic() - t0) * 1000.0)
+
+		print(f"{name:9s}: {len(lat)} ok, {errors} errors, "
+			f"ms min {min(lat, default=0):.2f} p50 {percentile(lat, 50):.2f} "
+			f"p95 {percentile(lat, 95):.2f} p99 {percentile(lat, 99):.2f} max {max(lat, default=0):.2f}")
+
+	# Throughput of a full bulk signature read, 8 pages per burst as the driver does
+	t0 = time.monotonic()
+	nextPage = 0
+	errors = 0
+	while nextPage < SIG_NUM_PAGES and errors <= args.count:
+		count = min(8, SIG_NUM_PAGES - nextPage)
+		hdr = port.command(0x10 | SOCK_CMD_SIG_BLK, bytes([nextPage, count]), timeout)
+		if hdr is None or len(hdr) != 7:
+			errors += 1
+			port.flush()
+			continue
+		for _ in range(count):
+			rec = port.read(1 + SIG_PAGE_SZ + 2, timeout)
+			if len(rec) != 1 + SIG_PAGE_SZ + 2 or rec[0] != nextPage or \
+					crc16Xmodem(rec[:-2]) != struct.unpack(">H", rec[-2:])[0]:
+				errors += 1
+				port.flush()
+				break
+			nextPage += 1
+	dt = time.monotonic() - t0
+	print(f"signature: {nextPage * SIG_PAGE_SZ} bytes in {dt * 1000.0:.1f} ms "
+		f"({nextPage * SIG_PAGE_SZ / dt / 1024.0:.1f} KiB/s), {errors} errors")
+
+	# Time to recover after the EMTR stops answering, use "hang" on the simulator
+	if args.recovery:
+		print("Waiting for the EMTR to stop and resume answering")
+		t0 = None
+		while True:
+			ok = port.command(CMD_GET_STATUS, b"", timeout) is not None
+			if not ok and t0 is None:
+				t0 = time.monotonic()
+				print("EMTR stopped answering")
+			elif ok and t0 is not None:
+				print(f"EMTR answering again after {(time.monotonic() - t0) * 1000.0:.0f} ms")
+				break
+			if not ok:
+				port.flush()
+			time.sleep(0.1)
+
+	return 0
+
+
+def main() -> int:
+	p = argparse.ArgumentParser(description="Virtual EMTR")
+	sub = p.add_subparsers(dest="mode", required=True)
+
+	s = sub.add_parser("sim", help="Run the simulator")
+	s.add_argument("--load1", default="const:1000", help="Load profile of socket 1")
+	s.add_argument("--load2", default="idle", help="Load profile of socket 2")
+	s.add_argument("--sig", action="store_true", help="Open the 'S' signature stream UART")
+	s.add_argument("--boot", action="store_true", help="Start in the boot loader")
+	s.add_argument("--legacy", action="store_true", help="Behave as firmware without snapshot and bulk signature commands")
+	s.add_argument("--fw-version", default="0.1.4")
+	s.add_argument("--bl-version", default="0.1.0")
+	s.add_argument("--baud", type=int, default=0, help="Pace responses at this rate, 0 for no pacing")
+	s.add_argument("--latency-ms", type=float, default=0.0, help="Delay before each response")
+	s.add_argument("--jitter-ms", type=float, default=0.0, help="Random extra delay, up to this")
+	s.add_argument("--drop-rate", type=float, default=0.0, help="Probability of losing each response byte")
+	s.add_argument("--corrupt-rate", type=float, default=0.0, help="Probability of corrupting a response")
+	s.add_argument("--no-reply-rate", type=float, default=0.0, help="Probability of ignoring a command")
+	s.add_argument("--switch-busy-ms", type=float, default=150.0, help="Commands ignored after a relay switch")
+	s.add_argument("--seed", type=int, default=None)
+
+	b = sub.add_parser("bench", help="Measure an EMTR, real or simulated")
+	b.add_argument("port", help="Serial device or simulator pseudo-terminal")
+	b.add_argument("--baud", type=int, default=921600)
+	b.add_argument("--count", type=int, default=200, help="Transactions per command")
+	b.add_argument("--timeout-ms", type=float, default=200.0)
+	b.add_argument("--recovery", action="store_true", help="Measure the time to recover from an outage")
+
+	args = p.parse_args()
+
+	if "bench" == args.mode:
+		return bench(args)
+
+	if args.seed is not None:
+		random.seed(args.seed)
+
+	try:
+		sim = emtrSim(args)
+	except ValueError as e:
+		print(e)
+		return 1
+
+	try:
+		sim.run()
+	except KeyboardInterrupt:
+		pass
+
+	print(sim.stats)
+	return 0
+
+
+if __name__ == "__main__":
+	ret = main()
+	sys.exit(ret)
@@ -0,0 +1,291 @@
+#!/usr/bin/python3
+#
+# Host side of the power signature codec in pw240_fw sig_codec.c
+#
+# The encoded format is described in pw240_fw/components/app_driver/include/sig_codec.h.
+# The encoder here produces the same bytes as the one on the ESP32.
+#
+# Decode an uploaded signature to raw samples:
+#   python3 sig_codec.py decode sig.bin sig.raw
+#
+# Encode raw samples, 4 bytes each, volts then amps, big-endian:
+#   python3 sig_codec.py encode sig.raw sig.bin
+#
+# Compression ratio of raw captures, or of simulated ones when none given:
+#   python3 sig_codec.py bench [sig.raw ...]
+#
+import sys
+import struct
+import time
+import argparse
+
+SIG_CODEC_VERSION   = 1
+SIG_CODEC_HDR_SZ    = 8
+SIG_CODEC_BLOCK_LEN = 32
+SIG_CODEC_SMP_SZ    = 4
+RICE_K_MAX          = 15
+
+
+def crc16Xmodem(data:bytes, crc:int = 0) -> int:
+	for b in data:
+		crc ^= b << 8
+		for _ in range(8):
+			crc = ((crc << 1) ^ 0x1021) if (crc & 0x8000) else (crc << 1)
+			crc &= 0xFFFF
+	return crc
+
+
+def predict(order:int, x1:int, x2:int, x3:int) -> int:
+	if 1 == order:
+		return x1
+	if 2 == order:
+		return 2 * x1 - x2
+	return 3 * x1 - 3 * x2 + x3
+
+
+def zigzag(r:int) -> int:
+	return (r << 1) if r >= 0 else ((-r << 1) - 1)
+
+
+def unzigzag(u:int) -> int:
+	return (u >> 1) if 0 == (u & 1) else -((u + 1) >> 1)
+
+
+class bitWriter():
+	def __init__(self):
+		self.out = bytearray()
+		self.acc = 0
+		self.ct = 0
+
+	def put(self, val:int, n:int):
+		self.acc = (self.acc << n) | val
+		self.ct += n
+		while self.ct >= 8:
+			self.ct -= 8
+			self.out.append((self.acc >> self.ct) & 0xFF)
+		self.acc &= (1 << self.ct) - 1
+
+	def flush(self):
+		if self.ct > 0:
+			self.put(0, 8 - self.ct)
+
+
+class bitReader():
+	def __init__(self, data:bytes):
+		self.data = data
+		self.pos = 0
+
+	def get(self, n:int) -> int:
+		val = 0
+		for _ in range(n):
+			val = (val << 1) | self.bit()
+		return val
+
+	def bit(self) -> int:
+		byte = self.pos >> 3
+		if byte >= len(self.data):
+			raise ValueError("Encoded signature truncated")
+		b = (self.data[byte] >> (7 - (self.pos & 7))) & 1
+		self.pos += 1
+		return b
+
+
+def encodeChan(bw:bitWriter, hist:list, x:list):
+	n = len(x)
+	sums = [0, 0, 0, 0]
+	x1, x2, x3 = hist
+	for v in x:
+		for order in (1, 2, 3):
+			sums[order] += zigzag(v - predict(order, x1, x2, x3))
+		x1, x2, x3 = v, x1, x2
+
+	order = 1
+	for o in (2, 3):
+		if sums[o] < sums[order]:
+			order = o
+
+	k = 0
+	while k < RICE_K_MAX and (n << (k + 1)) <= sums[order]:
+		k += 1
+
+	if n * (k + 1) + (sums[order] >> k) >= n * 16:
+		bw.put(0, 2)
+		for v in x:
+			bw.put(v & 0xFFFF, 16)
+	else:
+		bw.put(order, 2)
+		bw.put(k, 4)
+		x1, x2, x3 = hist
+		for v in x:
+			u = zigzag(v - predict(order, x1, x2, x3))
+			q = u >> k
+			while q >= 16:
+				bw.put(0xFFFF, 16)
+				q -= 16
+			bw.put(((1 << q) - 1) << 1, q + 1)
+			bw.put(u & ((1 << k) - 1), k)
+			x1, x2, x3 = v, x1, x2
+
+	for v in x[-3:]:
+		hist[:] = [v, hist[0], hist[1]]
+
+
+def splitChans(raw:bytes) -> tuple:
+	if len(raw) % SIG_CODEC_SMP_SZ:
+		raise ValueError("Raw signature is not a whole number of samples")
+	vals = struct.unpack(">%dh" % (len(raw) // 2), raw)
+	return list(vals[0::2]), list(vals[1::2])
+
+
+def encode(raw:bytes) -> bytes:
+	chans = splitChans(raw)
+	num = len(chans[0])
+	if num > 0xFFFF:
+		raise ValueError("Too many samples")
+
+	bw = bitWriter()
+	hist = [[0, 0, 0], [0, 0, 0]]
+	for start in range(0, num, SIG_CODEC_BLOCK_LEN):
+		for c in (0, 1):
+			encodeChan(bw, hist[c], chans[c][start:start + SIG_CODEC_BLOCK_LEN])
+	bw.flush()
+
+	hdr = struct.pack(">BBBBHH", ord("S"), ord("C"), SIG_CODEC_VERSION, SIG_CODEC_BLOCK_LEN,
+		num, crc16Xmodem(raw))
+	return hdr + bytes(bw.out)
+
+
+def decode(enc:bytes) -> bytes:
+	if len(enc) < SIG_CODEC_HDR_SZ:
+		raise ValueError("Encoded signature truncated")
+	magic0, magic1, ver, blkLen, num, crc = struct.unpack(">BBBBHH", enc[:SIG_CODEC_HDR_SZ])
+	if (magic0, magic1) != (ord("S"), ord("C")):
+		raise ValueError("Not an encoded signature")
+	if ver != SIG_CODEC_VERSION:
+		raise ValueError(f"Unsupported format version {ver}")
+	if 0 == blkLen:
+		raise ValueError("Bad block length")
+
+	br = bitReader(enc[SIG_CODEC_HDR_SZ:])
+	hist = [[0, 0, 0], [0, 0, 0]]
+	chans = [[], []]
+	for start in range(0, num, blkLen):
+		n = min(blkLen, num - start)
+		for c in (0, 1):
+			x = chans[c]
+			order = br.get(2)
+			if 0 == order:
+				blk = [((v ^ 0x8000) - 0x8000) for v in (br.get(16) for _ in range(n))]
+			else:
+				k = br.get(4)
+				x1, x2, x3 = hist[c]
+				blk = []
+				for _ in range(n):
+					q = 0
+					while br.bit():
+						q += 1
+					u = (q << k) | br.get(k)
+					v = predict(order, x1, x2, x3) + unzigzag(u)
+					if v < -32768 or v > 32767:
+						raise ValueError("Decoded sample out of range")
+					blk.append(v)
+					x1, x2, x3 = v, x1, x2
+			for v in blk[-3:]:
+				hist[c] = [v, hist[c][0], hist[c][1]]
+			x += blk
+
+	raw = bytearray()
+	for v, i in zip(chans[0], chans[1]):
+		raw += struct.pack(">hh", v, i)
+	raw = bytes(raw)
+
+	if crc16Xmodem(raw) != crc:
+		raise ValueError("CRC mismatch")
+	return raw
+
+
+def simCaptures(noise:float) -> list:
+	# Signatures as the EMTR simulator captures them, several loads and
+	# reasons, with ADC noise of the given standard deviation added
+	import random
+	import emtr_sim
+
+	rng = random.Random(1)
+	caps = []
+	for prof in ("const:600", "const:6000", "const:15000"):
+		sock = emtr_sim.socketSim(1, emtr_sim.loadProfile(prof))
+		for reason in (1, 0):
+			sock.capture(0, reason)
+			vals = struct.unpack(">%dh" % (len(sock.sigBuf) // 2), sock.sigBuf)
+			vals = [max(-32768, min(32767, v + int(round(rng.gauss(0.0, noise))))) for v in vals]
+			caps.append((f"sim {prof} reason {reason}", struct.pack(">%dh" % len(vals), *vals)))
+	return caps
+
+
+def bench(args) -> int:
+	if args.files:
+		caps = []
+		for name in args.files:
+			with open(name, "rb") as f:
+				caps.append((name, f.read()))
+	else:
+		caps = simCaptures(args.noise)
+
+	totRaw = 0
+	totEnc = 0
+	for name, raw in caps:
+		t0 = time.monotonic()
+		enc = encode(raw)
+		t1 = time.monotonic()
+		ok = decode(enc) == raw
+		totRaw += len(raw)
+		totEnc += len(enc)
+		print(f"{name:32s} {len(raw):6d} -> {len(enc):5d} bytes, ratio {len(raw) / len(enc):5.2f}, "
+			f"{len(enc) * 8.0 / (len(raw) // SIG_CODEC_SMP_SZ):5.2f} bits/sample, "
+			f"encode {(t1 - t0) * 1000.0:.1f} ms, {'ok' if ok else 'MISMATCH'}")
+		if not ok:
+			return 1
+
+	if totEnc:
+		print(f"total {totRaw} -> {totEnc} bytes, ratio {totRaw / totEnc:.2f}")
+	return 0
+
+
+def main() -> int:
+	p = argparse.ArgumentParser(description="Power signature codec")
+	sub = p.add_subparsers(dest="mode", required=True)
+
+	e = sub.add_parser("encode", help="Encode raw samples")
+	e.add_argument("infile")
+	e.add_argument("outfile")
+
+	d = sub.add_parser("decode", help="Decode to raw samples")
+	d.add_argument("infile")
+	d.add_argument("outfile")
+
+	b = sub.add_parser("bench", help="Compression ratio of raw captures")
+	b.add_argument("files", nargs="*", help="Raw captures, simulated ones if none given")
+	b.add_argument("--noise", type=float, default=3.0, help="ADC noise added to simulated captures, LSB")
+
+	args = p.parse_args()
+
+	if "bench" == args.mode:
+		return bench(args)
+
+	with open(args.infile, "rb") as f:
+		data = f.read()
+
+	try:
+		out = encode(data) if "encode" == args.mode else decode(data)
+	except ValueError as err:
+		print(f"{args.infile}: {err}")
+		return 1
+
+	with open(args.outfile, "wb") as f:
+		f.write(out)
+	print(f"{args.infile}: {len(data)} -> {len(out)} bytes")
+	return 0
+
+
+if __name__ == "__main__":
+	sys.exit(main())
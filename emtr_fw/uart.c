@@ -211,6 +211,72 @@ void Send0x03InstantValues(void)
 #endif
 }
 
+/*
+ * Snapshot of the values read by the host every poll cycle
+ *
+ * Payload is the concatenation of the 0x03, 0x02 and 0x01 payloads of this
+ * firmware, in that order, so the host can read all of them in a single
+ * transaction: 16 + 16 + 4 bytes.
+ *
+ * The pw240 driver reads the same command from the dual socket EMTR, whose
+ * payloads are 16 + 8 + 8-9 bytes. That firmware is built outside this tree
+ * and ships as the emtr_fw.c images, it needs its own 0x06 handler.
+ */
+void Send0x06Snapshot(void)
+{
+#ifdef CMD_DEBUG
+	MY_DEBUG("[0x06] U=%d I=%d, P=%d PF=%d wh=%u relay=%d output=%d alarm=%02X\n", inst_vals.u, inst_vals.i, inst_vals.p, inst_vals.pf, emtr_struct.wh, inst_vals.relay_status, inst_vals.output_status, inst_vals.alarm_status);
+#else
+	uint8 idx=0;
+	txBuf[idx++]=SOP;
+	txBuf[idx++]=0x06;
+	txBuf[idx++]=0x00;				// payload len
+	// Instant values
+	txBuf[idx++]=(inst_vals.u>>8)&0xff;
+	txBuf[idx++]=(inst_vals.u>>0)&0xff;
+	txBuf[idx++]=(inst_vals.i>>8)&0xff;
+	txBuf[idx++]=(inst_vals.i>>0)&0xff;
+	txBuf[idx++]=(inst_vals.p>> 8)&0xff;
+	txBuf[idx++]=(inst_vals.p>> 0)&0xff;
+	txBuf[idx++]=(inst_vals.pf>> 8)&0xff;
+	txBuf[idx++]=(inst_vals.pf>> 0)&0xff;
+	txBuf[idx++]=(inst_vals.pwrOn>>24)&0xff;
+	txBuf[idx++]=(inst_vals.pwrOn>>16)&0xff;
+	txBuf[idx++]=(inst_vals.pwrOn>> 8)&0xff;
+	txBuf[idx++]=(inst_vals.pwrOn>> 0)&0xff;
+	txBuf[idx++]=(inst_vals.relayOn>>24)&0xff;
+	txBuf[idx++]=(inst_vals.relayOn>>16)&0xff;
+	txBuf[idx++]=(inst_vals.relayOn>> 8)&0xff;
+	txBuf[idx++]=(inst_vals.relayOn>> 0)&0xff;
+	// Totals
+	txBuf[idx++]=(emtr_struct.epoch>>24)&0xff;
+	txBuf[idx++]=(emtr_struct.epoch>>16)&0xff;
+	txBuf[idx++]=(emtr_struct.epoch>> 8)&0xff;
+	txBuf[idx++]=(emtr_struct.epoch>> 0)&0xff;
+	txBuf[idx++]=(emtr_struct.relay_epoch>>24)&0xff;
+	txBuf[idx++]=(emtr_struct.relay_epoch>>16)&0xff;
+	txBuf[idx++]=(emtr_struct.relay_epoch>> 8)&0xff;
+	txBuf[idx++]=(emtr_struct.relay_epoch>> 0)&0xff;
+	txBuf[idx++]=(emtr_struct.relay_cycles>>24)&0xff;
+	txBuf[idx++]=(emtr_struct.relay_cycles>>16)&0xff;
+	txBuf[idx++]=(emtr_struct.relay_cycles>> 8)&0xff;
+	txBuf[idx++]=(emtr_struct.relay_cycles>> 0)&0xff;
+	txBuf[idx++]=(emtr_struct.wh>>24)&0xff;
+	txBuf[idx++]=(emtr_struct.wh>>16)&0xff;
+	txBuf[idx++]=(emtr_struct.wh>> 8)&0xff;
+	txBuf[idx++]=(emtr_struct.wh>> 0)&0xff;
+	// Status
+	txBuf[idx++]=inst_vals.relay_status;
+	txBuf[idx++]=inst_vals.output_status;
+	txBuf[idx++]=inst_vals.alarm_status;
+	txBuf[idx++]=inst_vals.temperature;
+	txBuf[idx++]=0x00;				// CS control sum, filled in by the interrupt code
+	txBuf[idx++]=EOP;
+
+	StartUartTX(idx);
+#endif
+}
+
 void Send0x08CycleType(void)
 {
 	uint8 idx = 0;
@@ -917,6 +983,9 @@ void uart_task_regular_cycle(void) {
 				sendPsigHeader(2, packets, rxBuf[4]); // reason 2 = on demand
 			}
 			break;
+		case 0x06:
+			Send0x06Snapshot();
+			break;
 		case 0x05:
 			if (rxBuf[2] == 0x00) {
 				relayClr();
@@ -40,6 +40,7 @@ void Send0x00id(void);
 void Send0x01Status(void);
 void Send0x02Totals(void);
 void Send0x03InstantValues(void);
+void Send0x06Snapshot(void);
 void Send0x12FactoryTest(void);
 
 void SendEpoch(void);
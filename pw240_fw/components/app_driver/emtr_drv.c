@@ -5,8 +5,12 @@
  *      Author: wesd
  */
 
+#include <math.h>
+
 #include "driver/gpio.h"
 #include "driver/uart.h"
+#include "esp_timer.h"
+#include "xtensa/hal.h"
 
 #include "cs_common.h"
 #include "cs_control.h"
@@ -16,6 +20,7 @@
 #include "xmodem.h"
 #include "emtr_fw.h"
 #include "emtr_drv.h"
+#include "sig_codec.h"
 #include "cs_self_test.h" // todo jonw remove for production
 #include "mfg_data.h"// todo jonw remove for production
 
@@ -43,6 +48,9 @@
 // Read number of seconds since boot
 #define	EMTR_TIME_SEC()				timeMgrGetUptime()
 
+// Read number of microseconds since boot
+#define	EMTR_TIME_US()				esp_timer_get_time()
+
 // Acquire and release mutex
 #define EMTR_MUTEX_GET(ctrl)		xSemaphoreTake(ctrl->mutex, portMAX_DELAY)
 #define EMTR_MUTEX_PUT(ctrl)		xSemaphoreGive(ctrl->mutex)
@@ -51,8 +59,35 @@
 // Defines
 ////////////////////////////////////////////////////////////////////////////////
 
-#define EMTR_POLL_CYCLES_PER_SEC		(10)
-#define EMTR_POLL_PERIOD_MS				(1000 / EMTR_POLL_CYCLES_PER_SEC)
+// Default poll periods, see emtrPollConf_t
+#define EMTR_POLL_STATE_MS				(100)
+#define EMTR_POLL_POWER_MS				(1000)
+#define EMTR_POLL_KWH_MS				(1000)
+#define EMTR_POLL_TEMP_MS				(1000)
+#define EMTR_POLL_BURST_MS				(50)
+#define EMTR_POLL_BURST_COUNT			(20)
+
+// Time to hold off commands after a socket switches while the EMTR
+// samples the power characteristics of the attached device
+#define EMTR_SWITCH_HOLDOFF_MS			(150)
+
+// Maximum time to wait for the requested bytes of an EMTR response
+#define EMTR_READ_TIMEOUT_MS			(200)
+
+// Link health: consecutive failed commands that take the link down, the
+// period of the heartbeat probe while it is down and the limits of the
+// back off between EMTR resets
+#define EMTR_LINK_FAIL_LIMIT			(3)
+#define EMTR_LINK_PROBE_MS				(1000)
+#define EMTR_LINK_BACKOFF_MIN_MS		(1000)
+#define EMTR_LINK_BACKOFF_MAX_MS		(60000)
+
+// UART receive buffer, holds several bulk signature records
+#define EMTR_UART_RX_BUF_SZ				(1024)
+
+// Idle time, in symbols, after which the UART driver hands received bytes
+// to a blocked reader instead of waiting for the RX FIFO threshold
+#define EMTR_UART_RX_TOUT_SYMBOLS		(2)
 
 // EMTR message framing characters
 #define MSG_CHAR_SOP					((uint8_t)0x1B)
@@ -71,21 +106,46 @@
 #define EMTR_CMD_GET_KWH				(0x02)
 #define EMTR_CMD_GET_INSTANT_PWR		(0x03)
 #define EMTR_CMD_GET_SW_VERSION			(0x05)
+#define EMTR_CMD_GET_SNAPSHOT			(0x06)
 
 #define EMTR_CMD_SET_SOCKET_1_OFF		(0x10)
 #define EMTR_CMD_SET_SOCKET_1_ON		(0x11)
 #define EMTR_CMD_GET_SOCKET_1_SIG_TS	(0x12)
 #define EMTR_CMD_GET_SOCKET_1_SIG_PG	(0x13)
+#define EMTR_CMD_GET_SOCKET_1_SIG_BULK	(0x14)
 
 #define EMTR_CMD_SET_SOCKET_2_OFF		(0x20)
 #define EMTR_CMD_SET_SOCKET_2_ON		(0x21)
 #define EMTR_CMD_GET_SOCKET_2_SIG_TS	(0x22)
 #define EMTR_CMD_GET_SOCKET_2_SIG_PG	(0x23)
+#define EMTR_CMD_GET_SOCKET_2_SIG_BULK	(0x24)
 
 #define EMTR_CMD_GET_FW_STATUS			(0x31)
 #define EMTR_CMD_START_XMODEM			(0x32)
 #define EMTR_CMD_REBOOT					(0x33)
 
+// Response payload sizes
+#define EMTR_RESP_SZ_STATUS_MIN			(8)
+#define EMTR_RESP_SZ_STATUS_MAX			(9)
+#define EMTR_RESP_SZ_KWH				(8)
+#define EMTR_RESP_SZ_INSTANT_PWR		(16)
+
+// Bulk signature read, see readSignatureChunk()
+#define EMTR_RESP_SZ_SIG_BULK			(7)
+#define EMTR_SIG_REC_SZ					(1 + PWR_SIGNATURE_PAGE_SZ + 2)
+#define EMTR_SIG_NUM_PAGES				(PWR_SIGNATURE_BUF_SZ / PWR_SIGNATURE_PAGE_SZ)
+
+// Number of pages requested per control task pass by the async read
+#define EMTR_SIG_CHUNK_PAGES			(8)
+
+// Number of failed bursts tolerated in one signature read
+#define EMTR_SIG_MAX_ERRORS				(4)
+
+// The snapshot payload is the concatenation of the instant power, KWH and
+// status payloads. Status is last so its optional flags byte stays at the end
+#define EMTR_RESP_SZ_SNAPSHOT_MIN		(EMTR_RESP_SZ_INSTANT_PWR + EMTR_RESP_SZ_KWH + EMTR_RESP_SZ_STATUS_MIN)
+#define EMTR_RESP_SZ_SNAPSHOT_MAX		(EMTR_RESP_SZ_INSTANT_PWR + EMTR_RESP_SZ_KWH + EMTR_RESP_SZ_STATUS_MAX)
+
 
 ////////////////////////////////////////////////////////////////////////////////
 // Internal data types
@@ -98,6 +158,7 @@ typedef struct {
 	uint8_t		cmdTurnOff;
 	uint8_t		cmdReadSigTs;
 	uint8_t		cmdReadSigPg;
+	uint8_t		cmdReadSigBulk;
 } const sockInfo_t;
 
 /**
@@ -120,6 +181,7 @@ typedef enum {
 	emtrMsgCode_shutDown,
 	emtrMsgCode_pause,
 	emtrMsgCode_resume,
+	emtrMsgCode_sigRead,
 } emtrMsgCode_t;
 
 
@@ -164,38 +226,94 @@ typedef struct {
 } stateChange_t;
 
 
+/**
+ * \brief Last reported energy values
+ */
 typedef struct {
 	uint32_t	dVolts;
 	uint32_t	mAmps;
 	uint32_t	dWatts;
 	uint32_t	pf;
 	uint64_t	dWattHours;
+	uint64_t	notifyMs[emtrNotifyMetric_num];	// Uptime of last report
 } oldEnergy_t;
 
 
 #define EMTR_PRE_SAMPLE_SZ	(4)
 
+// Number of markers used by the P-square quantile estimator
+#define P2_NUM_MARKERS		(5)
+
+/**
+ * \brief P-square estimator for one quantile
+ *
+ * Tracks a quantile of a stream in constant memory (Jain & Chlamtac, 1985)
+ */
+typedef struct {
+	float		p;						// Quantile to estimate, 0..1
+	uint32_t	count;					// Number of samples applied
+	float		q[P2_NUM_MARKERS];		// Marker heights
+	int32_t		n[P2_NUM_MARKERS];		// Actual marker positions
+	float		np[P2_NUM_MARKERS];		// Desired marker positions
+} p2Est_t;
+
+typedef enum {
+	accQuant_p50 = 0,
+	accQuant_p95,
+	accQuant_p99,
+	accQuant_num
+} accQuant_t;
+
 typedef struct {
 	uint32_t	min;	// Minimum value read
 	uint32_t	max;	// Maximum value read
-	uint32_t	avg;
-	uint64_t	sum;
 	uint32_t	sampleCt;
-	uint32_t	preSample[EMTR_PRE_SAMPLE_SZ];
-	int			preSamplePut;
-	int			preSampleGet;
-	int			preSampleCt;
+	float		mean;	// Running mean (Welford)
+	float		m2;		// Sum of squared differences from the mean
+	uint64_t	twSum;	// Sum of value x hold time (ms)
+	uint64_t	twStartMs;
+	uint64_t	twLastMs;
+	uint32_t	twLastValue;
+	p2Est_t		quant[accQuant_num];
 } accum_t;
 
+/**
+ * \brief One accumulator window
+ *
+ * A window with windowMs of 0 accumulates until it is read, and reading
+ * clears it. Otherwise the window rolls over every windowMs, latching the
+ * completed statistics in 'last' for the owner to read at its own pace.
+ */
 typedef struct {
-	bool		initial;
-	uint64_t	holdOffMs;
-	accum_t		dVolts;			// 0.1 volt units
-	accum_t		mAmps;			// 0.001 Amp units
-	accum_t		dWatts;			// 0.1 Watt units
-	accum_t		powerFactor;	// 0..100
+	bool				inUse;
+	bool				initial;
+	uint64_t			holdOffMs;
+	uint32_t			windowMs;
+	uint64_t			startMs;		// Start of the current window
+	uint64_t			lastSampleMs;
+	uint32_t			seq;			// Number of completed windows
+	uint32_t			readSeq;		// Last completed window returned
+	emtrAccEnergy_t		last;			// Most recent completed window
+	accum_t				dVolts;			// 0.1 volt units
+	accum_t				mAmps;			// 0.001 Amp units
+	accum_t				dWatts;			// 0.1 Watt units
+	accum_t				powerFactor;	// 0..100
 } accEnergy_t;
 
+/**
+ * \brief Delay line shared by all accumulator windows of a socket
+ *
+ * Samples are applied to the windows only after EMTR_PRE_SAMPLE_SZ newer
+ * samples have been read
+ */
+typedef struct {
+	emtrInstEnergy_t	sample[EMTR_PRE_SAMPLE_SZ];
+	uint64_t			sampleMs[EMTR_PRE_SAMPLE_SZ];
+	int					put;
+	int					get;
+	int					count;
+} accDelay_t;
+
 /**
  * \brief This structure is used internally to track the socket status
  */
@@ -206,12 +324,96 @@ typedef struct {
 	uint32_t			cosTimeRelay;
 	stateChange_t		isPlugged;
 	emtrSocketStatus_t	stat;
+	accDelay_t			accDelay;
 	accEnergy_t			eAccChan[EMTR_ACC_NUM_CHANS];
 	oldEnergy_t			oldEnergy;
 	uint32_t			oldCosTimeRelay;
 } socketCtrl_t;
 
 
+/**
+ * \brief Poll scheduler state for one item
+ */
+typedef struct {
+	int64_t		periodUs;
+	int64_t		nextDueUs;		// Absolute deadline of the next poll
+	uint32_t	runCt;
+	uint32_t	missedCt;
+	int64_t		lateSumUs;
+	int64_t		lateMaxUs;
+} pollSched_t;
+
+
+/**
+ * \brief Published copy of the device and socket status
+ *
+ * The control task writes the two copies alternately and then switches
+ * \ref emtrCtrl_t.pubIdx. The sequence count is odd while a copy is being
+ * written so a reader that overlapped a write can detect it and read again.
+ */
+typedef struct {
+	volatile uint32_t	seq;
+	emtrAllStatus_t		data;
+	uint32_t			cosTimeRelay[EMTR_DRV_MAX_SOCKETS];
+} statusPub_t;
+
+
+/**
+ * \brief EMTR support for optional commands
+ */
+typedef enum {
+	cmdSupport_unknown = 0,
+	cmdSupport_yes,
+	cmdSupport_no
+} cmdSupport_t;
+
+
+/**
+ * \brief EMTR link health
+ *
+ * Circuit breaker for the command link. While closed commands are sent
+ * normally. Enough consecutive failures open it: commands then fail at
+ * once and the poll timer instead resets the EMTR, with a back off that
+ * doubles on each attempt, and probes it with a single status command.
+ * A good probe half-opens the link, the next command closes it or opens
+ * it again.
+ */
+typedef struct {
+	volatile emtrLinkState_t	state;
+	uint32_t			failCt;			// Consecutive failed commands
+	uint32_t			backoffMs;		// Wait after the next reset
+	int64_t				nextResetUs;
+	int64_t				nextProbeUs;
+	uint32_t			tripCt;
+	uint32_t			probeCt;
+} linkHealth_t;
+
+
+/**
+ * \brief State of a bulk power signature read
+ */
+typedef struct {
+	bool				active;
+	esp_err_t			status;
+	int					sockNum;
+	uint8_t *			buf;
+	int					rdLen;
+	int					numPages;
+	int					nextPage;		// First page not yet received
+	bool				haveTs;
+	uint32_t			timestamp;
+	uint8_t				reason;
+	int					errCt;
+	emtrSigCbFunc_t		cbFunc;
+	uint32_t			cbData;
+	uint8_t *			encBuf;			// NULL to return the raw samples
+	int					encBufLen;
+	int					encLen;
+	sigEnc_t			enc;
+	uint32_t			encCycles;		// CPU cycles spent encoding
+} sigRead_t;
+
+
 /**
  * \brief States of the EMTR firmware upgrade process
  */
@@ -246,10 +448,17 @@ typedef struct {
 	socketCtrl_t *		socketCtrl;
 	uint32_t			curTime;
 	uint32_t			commDelayMs;
-	bool				holdOffCommand;
+	int64_t				notBeforeUs;
 	fwupgState_t		fwupgState;
 	bool				spyEnable;
-	unsigned int		pollSampleCt;
+	pollSched_t			sched[emtrPollItem_num];
+	uint32_t			burstRemain;
+	cmdSupport_t		snapshot;
+	cmdSupport_t		sigBulk;
+	sigRead_t			sigRead;
+	statusPub_t			pub[2];
+	volatile uint32_t	pubIdx;
+	linkHealth_t		link;
 } emtrCtrl_t;
 
 
@@ -269,15 +478,29 @@ static esp_err_t uartInit(emtrCtrl_t * pCtrl);
 
 static esp_err_t uartWrite(emtrCtrl_t * pCtrl, const uint8_t * buf, int len);
 
-static esp_err_t uartRead(emtrCtrl_t * pCtrl, uint8_t * buf, int * len);
+static esp_err_t uartRead(emtrCtrl_t * pCtrl, uint8_t * buf, int * len, TickType_t wait);
 
 static esp_err_t resetEmtrBoard(emtrCtrl_t * pCtrl, emtrRunMode_t runMode);
 
 static esp_err_t checkRequest(emtrCtrl_t * pCtrl, int sockNum, bool lock);
 
+static void linkInit(emtrCtrl_t * pCtrl);
+
+static bool linkService(emtrCtrl_t * pCtrl, int64_t nowUs);
+
 static esp_err_t readDeviceState(emtrCtrl_t * pCtrl);
 
-static void checkChangeOfState(emtrCtrl_t * pCtrl);
+static esp_err_t readSnapshot(emtrCtrl_t * pCtrl, bool accumulate);
+
+static void checkChangeOfState(emtrCtrl_t * pCtrl, bool checkTemp);
+
+static void publishStatus(emtrCtrl_t * pCtrl);
+
+static void readPublished(emtrCtrl_t * pCtrl, emtrAllStatus_t * ret);
+
+static void schedInit(emtrCtrl_t * pCtrl);
+
+static void schedArm(emtrCtrl_t * pCtrl);
 
 static void ctrlTask(void * param);
 
@@ -289,6 +512,10 @@ static void clearEmtrAccumulator(accum_t * accum, int value);
 
 static void clearEmtrAccumulators(accEnergy_t * eAccum);
 
+static void openEmtrAccumulators(accEnergy_t * eAcc, uint32_t windowMs);
+
+static void cpyAccums(emtrAccEnergy_t * dst, accEnergy_t * src);
+
 static esp_err_t getAccChan(
 	emtrCtrl_t *		pCtrl,
 	int					sockNum,
@@ -305,6 +532,16 @@ static esp_err_t readSignature(
 	int				rdLen
 );
 
+static void sigReadInit(sigRead_t * sig, int sockNum, uint8_t * buf);
+
+static esp_err_t readSignatureChunk(emtrCtrl_t * pCtrl, sigRead_t * sig, int maxPages);
+
+static void sigEncData(sigRead_t * sig, const uint8_t * data, int len);
+
+static esp_err_t sigEncDone(sigRead_t * sig);
+
+static bool handleSigRead(emtrCtrl_t * pCtrl);
+
 static esp_err_t emtrRunModeSet(
 	emtrCtrl_t *	pCtrl,
 	emtrRunMode_t	targetMode,
@@ -353,6 +590,7 @@ static sockInfo_t	sockInfo[] = {
 		.cmdTurnOff   = EMTR_CMD_SET_SOCKET_2_OFF,
 		.cmdReadSigTs = EMTR_CMD_GET_SOCKET_2_SIG_TS,
 		.cmdReadSigPg = EMTR_CMD_GET_SOCKET_2_SIG_PG,
+		.cmdReadSigBulk = EMTR_CMD_GET_SOCKET_2_SIG_BULK,
 	},
 	{
 		.sockNum      = 2,
@@ -361,6 +599,7 @@ static sockInfo_t	sockInfo[] = {
 		.cmdTurnOff   = EMTR_CMD_SET_SOCKET_1_OFF,
 		.cmdReadSigTs = EMTR_CMD_GET_SOCKET_1_SIG_TS,
 		.cmdReadSigPg = EMTR_CMD_GET_SOCKET_1_SIG_PG,
+		.cmdReadSigBulk = EMTR_CMD_GET_SOCKET_1_SIG_BULK,
 	}
 };
 #define sockCmdSz	(sizeof(sockInfo) / sizeof(sockInfo_t))
@@ -442,9 +681,28 @@ esp_err_t emtrDrvInit(const emtrDrvConf_t * conf)
 		goto exitMem;
 	}
 
+	// Apply defaults to poll rates not set by the caller
+	emtrPollConf_t *	poll = &pCtrl->conf.poll;
+
+	if (0 == poll->stateMs)
+		poll->stateMs = EMTR_POLL_STATE_MS;
+	if (0 == poll->powerMs)
+		poll->powerMs = EMTR_POLL_POWER_MS;
+	if (0 == poll->kwhMs)
+		poll->kwhMs = EMTR_POLL_KWH_MS;
+	if (0 == poll->tempMs)
+		poll->tempMs = EMTR_POLL_TEMP_MS;
+	if (0 == poll->burstMs)
+		poll->burstMs = EMTR_POLL_BURST_MS;
+	if (0 == poll->burstCount)
+		poll->burstCount = EMTR_POLL_BURST_COUNT;
+
+	schedInit(pCtrl);
+
+	// One-shot timer, re-armed for the earliest poll deadline after each pass
 	pCtrl->timer = xTimerCreate(
 		"timer-" MOD_NAME,
-		pdMS_TO_TICKS(EMTR_POLL_PERIOD_MS),
+		pdMS_TO_TICKS(poll->stateMs),
 		pdFALSE,
 		(void *)pCtrl,
 		timerCallback
@@ -459,6 +717,7 @@ esp_err_t emtrDrvInit(const emtrDrvConf_t * conf)
 		gc_err("eventRegisterCreate failed");
 		goto exitMem;
 	}
+	eventSetDataSize(pCtrl->cbDevice, sizeof(emtrEvtData_t));
 
 	// Now set up each socket control structure
 
@@ -476,12 +735,10 @@ esp_err_t emtrDrvInit(const emtrDrvConf_t * conf)
 			gc_err("eventRegisterCreate(%d) failed", i);
 			goto exitMem;
 		}
+		eventSetDataSize(sCtrl->cbHandle, sizeof(emtrEvtData_t));
 
-		// Initialize energy accumulator channels
-		int	ch;
-		for (ch = 0; ch < EMTR_ACC_NUM_CHANS; ch++) {
-			clearEmtrAccumulators(&sCtrl->eAccChan[ch]);
-		}
+		// The default accumulator channel is always open, read-and-clear
+		openEmtrAccumulators(&sCtrl->eAccChan[EMTR_ACC_CHAN_SAPIENT], 0);
 
 		// Initialize the "On" state change trackers
 		sCtrl->relayActive.curState = boolState_init;
@@ -646,6 +903,40 @@ esp_err_t emtrDrvCallbackRegister(emtrCbId_t cbId, eventCbFunc_t cbFunc, uint32_
 }
 
 
+/**
+ * \brief Register a callback function with delivery options, see
+ * \ref eventRegisterSubscriber
+ */
+esp_err_t emtrDrvCallbackSubscribe(
+	emtrCbId_t				cbId,
+	eventCbFunc_t			cbFunc,
+	uint32_t				cbData,
+	const eventSubConf_t *	conf
+)
+{
+	emtrCtrl_t *	pCtrl = emtrCtrl;
+	if (NULL == pCtrl) {
+		return ESP_FAIL;
+	}
+
+	cbHandle_t	cbHandle;
+	esp_err_t	status;
+
+	status = getCallbackHandle(pCtrl, cbId, &cbHandle);
+	if (ESP_OK != status) {
+		return status;
+	}
+
+	status = eventRegisterSubscriber(cbHandle, cbFunc, cbData, conf);
+	if (ESP_OK != status) {
+		gc_err("eventRegisterSubscriber failed");
+		return status;
+	}
+
+	return ESP_OK;
+}
+
+
 /**
  * \brief Unregister a callback function to be notified of driver events
  */
@@ -674,6 +965,7 @@ esp_err_t emtrDrvCallbackUnregister(emtrCbId_t cbId, eventCbFunc_t cbFunc)
  * \param [in] sockNum Select socket
  *
  * \return ESP_OK Message successfully sent to the control task
+ * \return ESP_ERR_INVALID_STATE EMTR link is down
  * \return ESP_FAIL
  *
  */
@@ -691,6 +983,11 @@ esp_err_t emtrDrvSetSocket(int sockNum, bool turnOn)
 		return status;
 	}
 
+	if (emtrLinkState_open == pCtrl->link.state) {
+		gc_err("EMTR link down");
+		return ESP_ERR_INVALID_STATE;
+	}
+
 	emtrMsg_t	msg;
 
 	msg.msgCode = turnOn ? emtrMsgCode_socketOn : emtrMsgCode_socketOff;
@@ -726,12 +1023,10 @@ bool emtrDrvIsSocketOn(int sockNum)
 		return false;
 	}
 
-	socketCtrl_t *	sCtrl = getSocketCtrl(pCtrl, (uint8_t)sockNum);
-	if (sCtrl) {
-		return SOCKET_IS_ON(sCtrl);
-	}
+	emtrAllStatus_t	all;
 
-	return false;
+	readPublished(pCtrl, &all);
+	return all.socket[sockNum - 1].isOn;
 }
 
 
@@ -759,12 +1054,10 @@ bool emtrDrvIsPlugInserted(int sockNum)
 		return false;
 	}
 
-	socketCtrl_t *	sCtrl = getSocketCtrl(pCtrl, (uint8_t)sockNum);
-	if (sCtrl) {
-		return SOCKET_IS_PLUGGED(sCtrl);
-	}
+	emtrAllStatus_t	all;
 
-	return false;
+	readPublished(pCtrl, &all);
+	return all.socket[sockNum - 1].isPlugged;
 }
 
 
@@ -787,22 +1080,15 @@ bool emtrDrvIsSocketActive(int sockNum)
 	int		status;
 
 	// Validate driver state and parameters
-	if ((status = checkRequest(pCtrl, sockNum, true)) != ESP_OK) {
+	if ((status = checkRequest(pCtrl, sockNum, false)) != ESP_OK) {
 		gc_err("emtrDrvIsOutletActive error %d", status);
 		return false;
 	}
 
-	// At this point mutex is locked
-
-	bool	ret = false;
-
-	socketCtrl_t *	sCtrl = getSocketCtrl(pCtrl, (uint8_t)sockNum);
-	if (sCtrl) {
-		ret = SOCKET_IS_ACTIVE(sCtrl);
-	}
+	emtrAllStatus_t	all;
 
-	EMTR_MUTEX_PUT(pCtrl);
-	return ret;
+	readPublished(pCtrl, &all);
+	return all.socket[sockNum - 1].isOn && all.socket[sockNum - 1].isPlugged;
 }
 
 
@@ -828,22 +1114,49 @@ esp_err_t emtrDrvGetSocketStatus(int sockNum, emtrSocketStatus_t * ret)
 	int		status;
 
 	// Validate driver state and parameters
-	if ((status = checkRequest(pCtrl, sockNum, true)) != ESP_OK) {
+	if ((status = checkRequest(pCtrl, sockNum, false)) != ESP_OK) {
 		gc_err("emtrDrvGetOutletStatus error %d", status);
 		return status;
 	}
 
-	// At this point mutex is locked
+	emtrAllStatus_t	all;
 
-	socketCtrl_t *	sCtrl = getSocketCtrl(pCtrl, (uint8_t)sockNum);
-	if (sCtrl) {
-		// Copy the status
-		*ret = sCtrl->stat;
+	readPublished(pCtrl, &all);
+	*ret = all.socket[sockNum - 1];
+
+	return status;
+}
+
+
+/**
+ * \brief Read device and all socket state in one consistent copy
+ *
+ * Returns the status published by the control task after its most
+ * recent poll. Does not wait for EMTR communication in progress.
+ *
+ * \param [out] ret Pointer to structure to receive the data
+ *
+ * \return ESP_OK Data was successfully read
+ * \return ESP_ERR_INVALID_ARG NULL pointer for ret
+ * \return ESP_FAIL Driver was not started
+ */
+esp_err_t emtrDrvGetAllStatus(emtrAllStatus_t * ret)
+{
+	emtrCtrl_t *	pCtrl = emtrCtrl;
+	if (NULL == pCtrl)
+		return ESP_FAIL;
+	if (NULL == ret)
+		return ESP_ERR_INVALID_ARG;
+
+	int		status;
 
-		ret->relayTime  = EMTR_TIME_SEC() - sCtrl->cosTimeRelay;
+	// Validate driver state and parameters
+	if ((status = checkRequest(pCtrl, 1, false)) != ESP_OK) {
+		gc_err("emtrDrvGetAllStatus error %d", status);
+		return status;
 	}
 
-	EMTR_MUTEX_PUT(pCtrl);
+	readPublished(pCtrl, ret);
 	return status;
 }
 
@@ -872,15 +1185,106 @@ esp_err_t emtrDrvGetDeviceStatus(emtrDeviceStatus_t * ret)
 	}
 
 	// Validate driver state and parameters
-	if ((status = checkRequest(pCtrl, 1, true)) != ESP_OK) {
+	if ((status = checkRequest(pCtrl, 1, false)) != ESP_OK) {
 		gc_err("emtrDrvGetDeviceStatus error %d", status);
 		return status;
 	}
 
-	// At this point mutex is locked
+	emtrAllStatus_t	all;
 
 	// Copy device information
-	*ret = pCtrl->curDeviceStatus;
+	readPublished(pCtrl, &all);
+	*ret = all.device;
+
+	return status;
+}
+
+
+/**
+ * \brief Read timing statistics of the poll scheduler
+ *
+ * \param [in] item Select the poll item
+ * \param [out] ret Pointer to structure to receive the statistics
+ * \param [in] reset true to clear the statistics after reading them
+ *
+ * \return ESP_OK Data was successfully read
+ * \return ESP_ERR_INVALID_ARG NULL pointer or invalid item
+ * \return ESP_FAIL Driver was not started
+ *
+ */
+esp_err_t emtrDrvGetPollStats(emtrPollItem_t item, emtrPollStats_t * ret, bool reset)
+{
+	emtrCtrl_t *	pCtrl = emtrCtrl;
+	if (NULL == pCtrl)
+		return ESP_FAIL;
+	if (NULL == ret || (unsigned int)item >= emtrPollItem_num)
+		return ESP_ERR_INVALID_ARG;
+
+	int		status;
+
+	// Validate driver state and parameters
+	if ((status = checkRequest(pCtrl, 1, true)) != ESP_OK) {
+		gc_err("emtrDrvGetPollStats error %d", status);
+		return status;
+	}
+
+	// At this point mutex is locked
+
+	pollSched_t *	sched = &pCtrl->sched[item];
+
+	ret->runCt     = sched->runCt;
+	ret->missedCt  = sched->missedCt;
+	ret->lateAvgUs = sched->runCt ? (uint32_t)(sched->lateSumUs / sched->runCt) : 0;
+	ret->lateMaxUs = (uint32_t)sched->lateMaxUs;
+
+	if (reset) {
+		sched->runCt     = 0;
+		sched->missedCt  = 0;
+		sched->lateSumUs = 0;
+		sched->lateMaxUs = 0;
+	}
+
+	EMTR_MUTEX_PUT(pCtrl);
+	return status;
+}
+
+
+/**
+ * \brief Read the EMTR link health
+ *
+ * \param [out] ret Pointer to structure to receive the link state
+ *
+ * \return ESP_OK Data was successfully read
+ * \return ESP_ERR_INVALID_ARG NULL pointer
+ * \return ESP_FAIL Driver was not started
+ *
+ */
+esp_err_t emtrDrvGetLinkStats(emtrLinkStats_t * ret)
+{
+	emtrCtrl_t *	pCtrl = emtrCtrl;
+	if (NULL == pCtrl)
+		return ESP_FAIL;
+	if (NULL == ret)
+		return ESP_ERR_INVALID_ARG;
+
+	int		status;
+
+	// Validate driver state and parameters
+	if ((status = checkRequest(pCtrl, 1, true)) != ESP_OK) {
+		gc_err("emtrDrvGetLinkStats error %d", status);
+		return status;
+	}
+
+	// At this point mutex is locked
+
+	linkHealth_t *	link = &pCtrl->link;
+
+	ret->state      = link->state;
+	ret->failCt     = link->failCt;
+	ret->tripCt     = link->tripCt;
+	ret->probeCt    = link->probeCt;
+	ret->resetCt    = pCtrl->emtrResetCount;
+	ret->backoffMs  = link->backoffMs;
 
 	EMTR_MUTEX_PUT(pCtrl);
 	return status;
@@ -945,6 +1349,11 @@ esp_err_t emtrDrvGetSignature(
 		return ESP_ERR_INVALID_STATE;
 	}
 
+	if (emtrLinkState_open == pCtrl->link.state) {
+		gc_err("EMTR link down");
+		return ESP_ERR_INVALID_STATE;
+	}
+
 	int		status;
 
 	// Validate driver state and parameters and lock access
@@ -953,63 +1362,321 @@ esp_err_t emtrDrvGetSignature(
 		return status;
 	}
 
-	status = readSignature(pCtrl, sockNum, ts, reason, buf, bufLen);
+	sigRead_t	sig;
+
+	sigReadInit(&sig, sockNum, buf);
+
+	// Stream the signature, resuming from any page that arrived damaged
+	status = ESP_OK;
+	while (sig.nextPage < sig.numPages) {
+		status = readSignatureChunk(pCtrl, &sig, sig.numPages);
+		if (ESP_ERR_NOT_SUPPORTED == status) {
+			break;
+		} else if (ESP_OK != status && ++sig.errCt > EMTR_SIG_MAX_ERRORS) {
+			gc_err("Too many errors reading signature");
+			break;
+		}
+		status = ESP_OK;
+	}
+
+	if (ESP_ERR_NOT_SUPPORTED == status) {
+		// Older EMTR firmware, read one page per command
+		status = readSignature(pCtrl, sockNum, ts, reason, buf, bufLen);
+	} else {
+		*ts     = sig.timestamp;
+		*reason = sig.reason;
+	}
 
 	EMTR_MUTEX_PUT(pCtrl);
 	return status;
 }
 
 
-const char * emtrDrvEventString(emtrEvtCode_t code)
+static esp_err_t startSigRead(
+	int					sockNum,
+	uint8_t *			buf,
+	int					bufLen,
+	uint8_t *			encBuf,
+	int					encBufLen,
+	emtrSigCbFunc_t		cbFunc,
+	uint32_t			cbData
+)
 {
-	switch (code)
-	{
-	case emtrEvtCode_socketOn:
-		return "emtrEvtCode_socketOn";
-	case emtrEvtCode_socketOff:
-		return "emtrEvtCode_socketOff";
-	case emtrEvtCode_plugInserted:
-		return "emtrEvtCode_plugInserted";
-	case emtrEvtCode_plugRemoved:
-		return "emtrEvtCode_plugRemoved";
-	case emtrEvtCode_commDown:
-		return "emtrEvtCode_commDown";
-	case emtrEvtCode_commUp:
-		return "emtrEvtCode_commUp";
-	case emtrEvtCode_reset:
-		return "emtrEvtCode_reset";
-	case emtrEvtCode_temperature:
-		return "emtrEvtCode_temperature";
-	case emtrEvtCode_epoch:
-		return "emtrEvtCode_epoch";
-	case emtrEvtCode_volts:
-		return "emtrEvtCode_volts";
-	case emtrEvtCode_amps:
-		return "emtrEvtCode_amps";
-	case emtrEvtCode_watts:
-		return "emtrEvtCode_watts";
-	case emtrEvtCode_powerFactor:
-		return "emtrEvtCode_powerFactor";
-	case emtrEvtCode_wattHours:
-		return "emtrEvtCode_wattHours";
-	case emtrEvtCode_stateTime:
-		return "emtrEvtCode_stateTime";
-	default:
-		return "emtrEvtCode_undefined";
+	if (!buf || !cbFunc) {
+		gc_err("Bad parameter");
+		return ESP_ERR_INVALID_ARG;
 	}
-}
 
+	if (bufLen < PWR_SIGNATURE_BUF_SZ) {
+		gc_err("Buffer size (%d) too small, need %d", bufLen, PWR_SIGNATURE_BUF_SZ);
+		return ESP_ERR_INVALID_ARG;
+	}
 
-esp_err_t emtrDrvGetAccEnergy(int sockNum, int chan, emtrAccEnergy_t * eAcc)
-{
-	emtrCtrl_t *	pCtrl = emtrCtrl;
-	if (NULL == pCtrl)
+	if (encBuf && encBufLen < SIG_CODEC_MAX_ENC_SZ(PWR_SIGNATURE_NUM_SAMPLES)) {
+		gc_err("Buffer size (%d) too small, need %d", encBufLen, SIG_CODEC_MAX_ENC_SZ(PWR_SIGNATURE_NUM_SAMPLES));
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	emtrCtrl_t *	pCtrl = emtrCtrl;
+	if (NULL == pCtrl) {
+		gc_err("driver not active");
+		return ESP_FAIL;
+	}
+
+	if (pCtrl->pause) {
+		gc_err("driver is paused");
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	if (emtrLinkState_open == pCtrl->link.state) {
+		gc_err("EMTR link down");
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	int		status;
+
+	// Validate driver state and parameters and lock access
+	if ((status = checkRequest(pCtrl, sockNum, true)) != ESP_OK) {
+		gc_err("emtrDrvGetSignatureAsync error %d", status);
+		return status;
+	}
+
+	sigRead_t *	sig = &pCtrl->sigRead;
+
+	if (sig->active) {
+		gc_err("Signature read already in progress");
+		status = ESP_ERR_INVALID_STATE;
+		goto exitMutex;
+	}
+
+	sigReadInit(sig, sockNum, buf);
+	sig->cbFunc = cbFunc;
+	sig->cbData = cbData;
+
+	if (encBuf) {
+		sig->encBuf    = encBuf;
+		sig->encBufLen = encBufLen;
+		sigEncInit(&sig->enc, encBuf, encBufLen);
+	}
+
+	emtrMsg_t	msg = {
+		.msgCode = emtrMsgCode_sigRead
+	};
+
+	if (xQueueSend(pCtrl->queue, &msg, pdMS_TO_TICKS(100)) != pdTRUE) {
+		gc_err("Failed to queue signature read");
+		status = ESP_FAIL;
+		goto exitMutex;
+	}
+
+	sig->active = true;
+
+exitMutex:
+	EMTR_MUTEX_PUT(pCtrl);
+	return status;
+}
+
+
+/**
+ * \brief Read the power signature of a socket in the background
+ *
+ * The control task reads the signature a few pages at a time, releasing
+ * the driver mutex between them so polling and other API calls are not
+ * held off for the whole transfer. When done, cbFunc is called from the
+ * control task, without the mutex held, with the result.
+ *
+ * \param [in] sockNum Select socket
+ * \param [in] buf Buffer to receive the signature, must remain valid until
+ * the callback
+ * \param [in] bufLen Size of the buffer, at least \ref PWR_SIGNATURE_BUF_SZ
+ * \param [in] cbFunc Function to call with the result
+ * \param [in] cbData Passed to cbFunc
+ *
+ * \return ESP_OK The read was started
+ * \return ESP_ERR_INVALID_ARG Bad parameter
+ * \return ESP_ERR_INVALID_STATE Driver paused, EMTR link down or another
+ * read in progress
+ * \return ESP_FAIL Driver not running or could not start the read
+ */
+esp_err_t emtrDrvGetSignatureAsync(
+	int					sockNum,
+	uint8_t *			buf,
+	int					bufLen,
+	emtrSigCbFunc_t		cbFunc,
+	uint32_t			cbData
+)
+{
+	return startSigRead(sockNum, buf, bufLen, NULL, 0, cbFunc, cbData);
+}
+
+
+/**
+ * \brief Read the power signature of a socket in the background, encoded
+ *
+ * As \ref emtrDrvGetSignatureAsync, but each page is passed to the
+ * signature encoder as it arrives and cbFunc gets the encoded signature,
+ * see sig_codec.h for the format.
+ *
+ * \param [in] sockNum Select socket
+ * \param [in] buf Buffer for the raw signature, at least
+ * \ref PWR_SIGNATURE_BUF_SZ
+ * \param [in] bufLen Size of the buffer
+ * \param [in] encBuf Buffer for the encoded signature, at least
+ * SIG_CODEC_MAX_ENC_SZ(PWR_SIGNATURE_NUM_SAMPLES)
+ * \param [in] encBufLen Size of encBuf
+ * \param [in] cbFunc Function to call with the result
+ * \param [in] cbData Passed to cbFunc
+ *
+ * \return As \ref emtrDrvGetSignatureAsync
+ */
+esp_err_t emtrDrvGetSignatureEncAsync(
+	int					sockNum,
+	uint8_t *			buf,
+	int					bufLen,
+	uint8_t *			encBuf,
+	int					encBufLen,
+	emtrSigCbFunc_t		cbFunc,
+	uint32_t			cbData
+)
+{
+	if (!encBuf) {
+		gc_err("Bad parameter");
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	return startSigRead(sockNum, buf, bufLen, encBuf, encBufLen, cbFunc, cbData);
+}
+
+
+const char * emtrDrvEventString(emtrEvtCode_t code)
+{
+	switch (code)
+	{
+	case emtrEvtCode_socketOn:
+		return "emtrEvtCode_socketOn";
+	case emtrEvtCode_socketOff:
+		return "emtrEvtCode_socketOff";
+	case emtrEvtCode_plugInserted:
+		return "emtrEvtCode_plugInserted";
+	case emtrEvtCode_plugRemoved:
+		return "emtrEvtCode_plugRemoved";
+	case emtrEvtCode_commDown:
+		return "emtrEvtCode_commDown";
+	case emtrEvtCode_commUp:
+		return "emtrEvtCode_commUp";
+	case emtrEvtCode_reset:
+		return "emtrEvtCode_reset";
+	case emtrEvtCode_temperature:
+		return "emtrEvtCode_temperature";
+	case emtrEvtCode_epoch:
+		return "emtrEvtCode_epoch";
+	case emtrEvtCode_volts:
+		return "emtrEvtCode_volts";
+	case emtrEvtCode_amps:
+		return "emtrEvtCode_amps";
+	case emtrEvtCode_watts:
+		return "emtrEvtCode_watts";
+	case emtrEvtCode_powerFactor:
+		return "emtrEvtCode_powerFactor";
+	case emtrEvtCode_wattHours:
+		return "emtrEvtCode_wattHours";
+	case emtrEvtCode_stateTime:
+		return "emtrEvtCode_stateTime";
+	default:
+		return "emtrEvtCode_undefined";
+	}
+}
+
+
+esp_err_t emtrDrvGetAccEnergy(int sockNum, int chan, emtrAccEnergy_t * eAcc)
+{
+	emtrCtrl_t *	pCtrl = emtrCtrl;
+	if (NULL == pCtrl)
 		return ESP_FAIL;
 
 	return getAccChan(pCtrl, sockNum, chan, eAcc);
 }
 
 
+/**
+ * \brief Open an accumulator window on a socket
+ *
+ * Each window keeps its own statistics, fed from the same samples as the
+ * others, so reading or clearing one does not disturb another
+ *
+ * \param [in] sockNum Select socket
+ * \param [in] windowMs Window length, or 0 to accumulate until read
+ * \param [out] chan Receives the channel number to pass to
+ * \ref emtrDrvGetAccEnergy and \ref emtrDrvAccWindowClose
+ *
+ * \return ESP_OK Window opened
+ * \return ESP_ERR_NO_MEM All EMTR_ACC_NUM_CHANS channels are open
+ * \return Other Driver not running or bad parameter
+ */
+esp_err_t emtrDrvAccWindowOpen(int sockNum, uint32_t windowMs, int * chan)
+{
+	emtrCtrl_t *	pCtrl = emtrCtrl;
+	if (NULL == pCtrl || NULL == chan)
+		return ESP_FAIL;
+
+	socketCtrl_t *	sCtrl = getSocketCtrl(pCtrl, (uint8_t)sockNum);
+	if (!sCtrl) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	int		status;
+
+	if ((status = checkRequest(pCtrl, sockNum, true)) != ESP_OK) {
+		return status;
+	}
+
+	int		ch;
+	status = ESP_ERR_NO_MEM;
+	for (ch = 0; ch < EMTR_ACC_NUM_CHANS; ch++) {
+		if (!sCtrl->eAccChan[ch].inUse) {
+			openEmtrAccumulators(&sCtrl->eAccChan[ch], windowMs);
+			*chan  = ch;
+			status = ESP_OK;
+			break;
+		}
+	}
+
+	EMTR_MUTEX_PUT(pCtrl);
+	return status;
+}
+
+
+/**
+ * \brief Close an accumulator window opened by \ref emtrDrvAccWindowOpen
+ */
+esp_err_t emtrDrvAccWindowClose(int sockNum, int chan)
+{
+	emtrCtrl_t *	pCtrl = emtrCtrl;
+	if (NULL == pCtrl)
+		return ESP_FAIL;
+
+	if (chan <= EMTR_ACC_CHAN_SAPIENT || chan >= EMTR_ACC_NUM_CHANS) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	socketCtrl_t *	sCtrl = getSocketCtrl(pCtrl, (uint8_t)sockNum);
+	if (!sCtrl) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	int		status;
+
+	if ((status = checkRequest(pCtrl, sockNum, true)) != ESP_OK) {
+		return status;
+	}
+
+	sCtrl->eAccChan[chan].inUse = false;
+
+	EMTR_MUTEX_PUT(pCtrl);
+	return ESP_OK;
+}
+
+
 /*
 ********************************************************************************
 ********************************************************************************
@@ -1090,7 +1757,12 @@ static esp_err_t uartInit(emtrCtrl_t * pCtrl)
 	if (ESP_OK != status)
 		return status;
 
-	return uart_driver_install(uartConf->uart, 128 * 2, 0, 0, NULL, 0);
+	status = uart_driver_install(uartConf->uart, EMTR_UART_RX_BUF_SZ, 0, 0, NULL, 0);
+	if (ESP_OK != status)
+		return status;
+
+	// Wake a blocked reader as soon as the line goes idle after a response
+	return uart_set_rx_timeout(uartConf->uart, EMTR_UART_RX_TOUT_SYMBOLS);
 }
 
 
@@ -1117,14 +1789,14 @@ static esp_err_t uartWrite(emtrCtrl_t * pCtrl, const uint8_t * buf, int len)
 }
 
 
-static esp_err_t uartRead(emtrCtrl_t * pCtrl, uint8_t * buf, int * len)
+static esp_err_t uartRead(emtrCtrl_t * pCtrl, uint8_t * buf, int * len, TickType_t wait)
 {
 	// Shorthand reference to UART configuration
 	emtrUartConf_t *	uartConf = &pCtrl->conf.uartCmd;
 
 	int		rdLen;
 
-	rdLen = uart_read_bytes(uartConf->uart, buf, *len, pdMS_TO_TICKS(100));
+	rdLen = uart_read_bytes(uartConf->uart, buf, *len, wait);
 	if (rdLen < 0)
 		return ESP_FAIL;
 
@@ -1268,10 +1940,12 @@ static esp_err_t sendEmtrCommand(emtrCtrl_t * pCtrl, uint8_t cmd, uint8_t * payl
 	int			i;
 
 	// Must hold off commands when a socket has been switched on or off
-	// because it's sampling the power characteristics when it transitions
-	if (pCtrl->holdOffCommand) {
-		pCtrl->holdOffCommand = false;
-		EMTR_SLEEP_MS(150);
+	// because it's sampling the power characteristics when it transitions.
+	// The poll scheduler never gets here early, other commands wait out
+	// whatever is left of the hold off
+	int64_t		waitUs = pCtrl->notBeforeUs - EMTR_TIME_US();
+	if (waitUs > 0) {
+		EMTR_SLEEP_MS((uint32_t)((waitUs + 999) / 1000));
 	}
 
 	memset(msg, 0, sizeof(msg));
@@ -1308,36 +1982,37 @@ static esp_err_t sendEmtrCommand(emtrCtrl_t * pCtrl, uint8_t cmd, uint8_t * payl
 
 /**
  * \brief Read a stream of bytes from EMTR
+ *
+ * Blocks in the UART driver until the requested bytes have arrived or
+ * \ref EMTR_READ_TIMEOUT_MS has elapsed, so the caller is woken as soon as
+ * the data is available rather than on the next polling tick
  */
 static esp_err_t readEmtr(emtrCtrl_t * pCtrl, uint8_t * buf, int rdLen)
 {
 	esp_err_t	status;
-	int			retryCt = 0;
 	int			rdCount = 0;
 	int			ioLen;
+	TickType_t	startTick = xTaskGetTickCount();
+	TickType_t	timeout   = pdMS_TO_TICKS(EMTR_READ_TIMEOUT_MS);
+	TickType_t	elapsed;
 
 	while (rdCount < rdLen)
 	{
+		elapsed = xTaskGetTickCount() - startTick;
+		if (elapsed >= timeout) {
+			gc_err("Timed out reading from EMTR");
+			status = ESP_FAIL;
+			goto exitError;
+		}
+
 		ioLen = rdLen - rdCount;
-		status = uartRead(pCtrl, buf + rdCount, &ioLen);
+		status = uartRead(pCtrl, buf + rdCount, &ioLen, timeout - elapsed);
 		if (ESP_OK != status) {
 			gc_err("uartRead failed");
 			goto exitError;
 		}
 
-		if (ioLen > 0) {
-			rdCount += ioLen;
-			retryCt = 0;
-		} else {
-			if (++retryCt == 10) {
-				gc_err("Timed out reading from EMTR");
-				status = ESP_FAIL;
-				goto exitError;
-			}
-
-			// Wait 10 ms and read again
-			EMTR_SLEEP_MS(10);
-		}
+		rdCount += ioLen;
 	}
 
 	if (pCtrl->spyEnable) {
@@ -1487,9 +2162,175 @@ exitError:
 }
 
 
+/**
+ * \brief Report change of EMTR communication state
+ */
+static void linkSetUp(emtrCtrl_t * pCtrl, bool isUp)
+{
+	if (pCtrl->curDeviceStatus.emtrCommUp == isUp)
+		return;
+
+	pCtrl->curDeviceStatus.emtrCommUp = isUp;
+	pCtrl->oldDeviceStatus.emtrCommUp = isUp;
+
+	notify(pCtrl, emtrCbId_device, isUp ? emtrEvtCode_commUp : emtrEvtCode_commDown, NULL);
+}
+
+
+/**
+ * \brief Start the link in the closed state
+ */
+static void linkInit(emtrCtrl_t * pCtrl)
+{
+	linkHealth_t *	link = &pCtrl->link;
+
+	link->state     = emtrLinkState_closed;
+	link->failCt    = 0;
+	link->backoffMs = EMTR_LINK_BACKOFF_MIN_MS;
+}
+
+
+/**
+ * \brief Open the link
+ *
+ * Coming from closed the EMTR is reset on the next poll timer. A failed
+ * half-open link keeps the back off of the previous reset.
+ */
+static void linkTrip(emtrCtrl_t * pCtrl)
+{
+	linkHealth_t *	link  = &pCtrl->link;
+	int64_t			nowUs = EMTR_TIME_US();
+
+	gc_err("EMTR link down after %u failures", link->failCt);
+
+	if (emtrLinkState_closed == link->state)
+		link->nextResetUs = nowUs;
+
+	link->state       = emtrLinkState_open;
+	link->tripCt     += 1;
+	link->nextProbeUs = nowUs + (EMTR_LINK_PROBE_MS * 1000);
+
+	linkSetUp(pCtrl, false);
+}
+
+
+/**
+ * \brief Record a successful command
+ */
+static void linkSuccess(emtrCtrl_t * pCtrl)
+{
+	linkHealth_t *	link = &pCtrl->link;
+
+	link->failCt = 0;
+
+	if (emtrLinkState_closed != link->state) {
+		gc_dbg("EMTR link restored");
+		linkInit(pCtrl);
+	}
+
+	linkSetUp(pCtrl, true);
+}
+
+
+/**
+ * \brief Record a failed command
+ */
+static void linkFailure(emtrCtrl_t * pCtrl)
+{
+	linkHealth_t *	link = &pCtrl->link;
+
+	link->failCt += 1;
+
+	// A half-open link gets a single chance
+	if (emtrLinkState_halfOpen == link->state || link->failCt >= EMTR_LINK_FAIL_LIMIT) {
+		linkTrip(pCtrl);
+	}
+}
+
+
+/**
+ * \brief Check the EMTR responds with a single status request
+ */
+static esp_err_t linkProbe(emtrCtrl_t * pCtrl)
+{
+	uint8_t		resp[EMTR_RESP_SZ_STATUS_MAX];
+
+	pCtrl->link.probeCt += 1;
+
+	uart_flush_input(pCtrl->conf.uartCmd.uart);
+
+	if (sendEmtrCommand(pCtrl, EMTR_CMD_GET_STATUS, NULL) != ESP_OK)
+		return ESP_FAIL;
+
+	if (readEmtrResponse(pCtrl, EMTR_CMD_GET_STATUS, resp, sizeof(resp)) < EMTR_RESP_SZ_STATUS_MIN) {
+		uart_flush_input(pCtrl->conf.uartCmd.uart);
+		return ESP_FAIL;
+	}
+
+	return ESP_OK;
+}
+
+
+/**
+ * \brief Reset and probe the EMTR while the link is open
+ *
+ * Called from the poll timer.
+ *
+ * \return true The link may be used for polling
+ * \return false The link is down
+ */
+static bool linkService(emtrCtrl_t * pCtrl, int64_t nowUs)
+{
+	linkHealth_t *	link = &pCtrl->link;
+
+	if (emtrLinkState_open != link->state)
+		return true;
+
+	// Probe first, so a reset and a probe that fall due together, as they
+	// do when the back off equals the probe period, still give the EMTR a
+	// chance to answer before it is reset again
+	if (nowUs >= link->nextProbeUs) {
+		if (linkProbe(pCtrl) == ESP_OK) {
+			// Let the regular polls confirm the link
+			gc_dbg("EMTR responding, link half-open");
+			link->state  = emtrLinkState_halfOpen;
+			link->failCt = 0;
+			schedInit(pCtrl);
+
+			return true;
+		}
+
+		nowUs = EMTR_TIME_US();
+		link->nextProbeUs = nowUs + (EMTR_LINK_PROBE_MS * 1000);
+	}
+
+	if (nowUs >= link->nextResetUs) {
+		resetEmtr(pCtrl);
+		uart_flush_input(pCtrl->conf.uartCmd.uart);
+
+		nowUs = EMTR_TIME_US();
+		link->nextResetUs = nowUs + ((int64_t)link->backoffMs * 1000);
+		link->nextProbeUs = nowUs + (EMTR_LINK_PROBE_MS * 1000);
+
+		link->backoffMs *= 2;
+		if (link->backoffMs > EMTR_LINK_BACKOFF_MAX_MS)
+			link->backoffMs = EMTR_LINK_BACKOFF_MAX_MS;
+	}
+
+	return false;
+}
+
+
 /**
  * \brief Send command and optionally read back data
  *
+ * The command is sent with one quick retry. Failures are counted by the
+ * link health breaker, see \ref linkHealth_t, and while the link is open
+ * commands fail without being sent.
+ *
+ * \return ESP_OK Success
+ * \return ESP_ERR_INVALID_STATE The link is down
+ * \return ESP_FAIL The EMTR did not respond
  */
 static esp_err_t doCommand(
 	emtrCtrl_t *	pCtrl,
@@ -1505,23 +2346,18 @@ static esp_err_t doCommand(
 	int		status;
 	int		recvLen;
 	int		bufSz    = *retLen;
-	int		maxRetry = 3;
+	int		maxRetry = 2;
 	int		retryCt  = 0;
 
 	*retLen = 0;
 
+	if (emtrLinkState_open == pCtrl->link.state)
+		return ESP_ERR_INVALID_STATE;
+
 	for (retryCt = 0; retryCt < maxRetry; retryCt++) {
 		if (retryCt > 0) {
 			gc_dbg("doCommand(%02X): retry #%d", cmd, retryCt);
 
-			if (retryCt == (maxRetry - 1)) {
-				// Last retry - try a hard reset this time
-				resetEmtr(pCtrl);
-			}
-
-			// Delay before retry
-			EMTR_SLEEP_MS(100);
-
 			// Flush UART receive FIFO
 			uart_flush_input(uartConf->uart);
 		}
@@ -1540,11 +2376,7 @@ static esp_err_t doCommand(
 			continue;
 		}
 
-		if (!pCtrl->curDeviceStatus.emtrCommUp) {
-			// EMTR communication was restored
-			pCtrl->curDeviceStatus.emtrCommUp = true;
-			notify(pCtrl, emtrCbId_device, emtrEvtCode_commUp, NULL);
-		}
+		linkSuccess(pCtrl);
 
 		if (NULL == retBuf || 0 >= bufSz) {
 			// Not expecting payload data
@@ -1558,11 +2390,7 @@ static esp_err_t doCommand(
 	// If this point is reached retries have been exhausted
 	gc_err("doCommand(%02X): exhausted retries", cmd);
 
-	if (pCtrl->curDeviceStatus.emtrCommUp) {
-		// EMTR communication was lost
-		pCtrl->curDeviceStatus.emtrCommUp = false;
-		notify(pCtrl, emtrCbId_device, emtrEvtCode_commDown, NULL);
-	}
+	linkFailure(pCtrl);
 
 	return 	ESP_FAIL;
 }
@@ -1597,7 +2425,7 @@ static esp_err_t setSocketState(emtrCtrl_t * pCtrl, int sockNum, bool turnOn)
 /**
  * \brief Check for change of states that cause notifications
  */
-static void checkChangeOfState(emtrCtrl_t * pCtrl)
+static void checkChangeOfState(emtrCtrl_t * pCtrl, bool checkTemp)
 {
 	emtrEvtCode_t	evtCode;
 	emtrEvtData_t	evtData;
@@ -1614,22 +2442,14 @@ static void checkChangeOfState(emtrCtrl_t * pCtrl)
 	}
 
 	// Check for change of temperature
-	if (pCtrl->oldDeviceStatus.temperature != pCtrl->curDeviceStatus.temperature) {
+	if (checkTemp && pCtrl->oldDeviceStatus.temperature != pCtrl->curDeviceStatus.temperature) {
 		pCtrl->oldDeviceStatus.temperature = pCtrl->curDeviceStatus.temperature;
 
 		evtData.temperature.value = pCtrl->curDeviceStatus.temperature;
 		notify(pCtrl, cbId, emtrEvtCode_temperature, &evtData);
 	}
 
-	// Check for change of communication state
-	if (pCtrl->oldDeviceStatus.emtrCommUp != pCtrl->curDeviceStatus.emtrCommUp) {
-		pCtrl->oldDeviceStatus.emtrCommUp = pCtrl->curDeviceStatus.emtrCommUp;
-
-		emtrEvtCode_t	ev =
-			pCtrl->curDeviceStatus.emtrCommUp ? emtrEvtCode_commUp : emtrEvtCode_commDown;
-
-		notify(pCtrl, cbId, ev, NULL);
-	}
+	// Change of communication state is reported by the link breaker
 
 	// Check for changes in each socket state
 	int				sIdx;
@@ -1662,7 +2482,11 @@ static void checkChangeOfState(emtrCtrl_t * pCtrl)
 			// When a socket changes state between on and off must delay
 			// the next command until the EMTR is done sampling the
 			// power characteristics of the attached device
-			pCtrl->holdOffCommand = true;
+			pCtrl->notBeforeUs = EMTR_TIME_US() + (EMTR_SWITCH_HOLDOFF_MS * 1000);
+
+			// Then follow the load settling with a burst of power reads
+			pCtrl->burstRemain = pCtrl->conf.poll.burstCount;
+			pCtrl->sched[emtrPollItem_burst].nextDueUs = pCtrl->notBeforeUs;
 		}
 
 		// Check for change of plug insertion state
@@ -1698,6 +2522,56 @@ static void checkChangeOfState(emtrCtrl_t * pCtrl)
 }
 
 
+/**
+ * \brief Decide if a change of an energy metric should be reported
+ *
+ * Applies the deadband, minimum interval and heartbeat of the notification
+ * configuration. On true the caller reports the value and updates the
+ * last reported value, this updates the report time.
+ */
+static bool energyNotifyDue(
+	emtrCtrl_t *		pCtrl,
+	emtrNotifyMetric_t	metric,
+	uint64_t			old,
+	uint64_t			cur,
+	oldEnergy_t *		oldEnergy,
+	uint64_t			curTimeMs
+)
+{
+	const emtrNotifyConf_t *	conf = pCtrl->conf.notify;
+
+	if (NULL == conf) {
+		return (old != cur);
+	}
+
+	uint64_t *	notifyMs = &oldEnergy->notifyMs[metric];
+	uint64_t	elapsed  = curTimeMs - *notifyMs;
+	bool		isDue;
+
+	if (conf->heartbeatSec > 0 && elapsed >= (uint64_t)conf->heartbeatSec * 1000) {
+		isDue = true;
+	} else if (old == cur || elapsed < conf->minIntervalMs) {
+		isDue = false;
+	} else {
+		const emtrDeadband_t *	band  = &conf->band[metric];
+		uint64_t				delta = (cur > old) ? cur - old : old - cur;
+		uint64_t				limit = band->absDelta;
+		uint64_t				rel   = (old * band->relDeltaPm) / 1000;
+
+		// Both limits must be met, so the larger one applies
+		if (rel > limit)
+			limit = rel;
+
+		isDue = (delta >= limit);
+	}
+
+	if (isDue) {
+		*notifyMs = curTimeMs;
+	}
+	return isDue;
+}
+
+
 /**
  * \brief Check for change of states that cause notifications
  */
@@ -1705,6 +2579,7 @@ static void checkChangeOfEnergy(emtrCtrl_t * pCtrl)
 {
 	int				sIdx;
 	socketCtrl_t *	sCtrl = pCtrl->socketCtrl;
+	uint64_t		curTimeMs = timeMgrGetUptimeMs();
 
 	for (sIdx = 0; sIdx < pCtrl->conf.numSockets; sIdx++, sCtrl++) {
 		sockInfo_t *	sInfo = sCtrl->info;
@@ -1718,7 +2593,7 @@ static void checkChangeOfEnergy(emtrCtrl_t * pCtrl)
 		emtrCbId_t	cbId = sInfo->callbackId;
 
 		// Check for change in volts
-		if (old->dVolts != cur->dVolts) {
+		if (energyNotifyDue(pCtrl, emtrNotifyMetric_volts, old->dVolts, cur->dVolts, old, curTimeMs)) {
 			old->dVolts = cur->dVolts;
 
 			evtData.energy.value = cur->dVolts;
@@ -1726,7 +2601,7 @@ static void checkChangeOfEnergy(emtrCtrl_t * pCtrl)
 		}
 
 		// Check for change in amps
-		if (old->mAmps != cur->mAmps) {
+		if (energyNotifyDue(pCtrl, emtrNotifyMetric_amps, old->mAmps, cur->mAmps, old, curTimeMs)) {
 			old->mAmps = cur->mAmps;
 
 			evtData.energy.value = cur->mAmps;
@@ -1734,7 +2609,7 @@ static void checkChangeOfEnergy(emtrCtrl_t * pCtrl)
 		}
 
 		// Check for change in dWatts
-		if (old->dWatts != cur->dWatts) {
+		if (energyNotifyDue(pCtrl, emtrNotifyMetric_watts, old->dWatts, cur->dWatts, old, curTimeMs)) {
 			old->dWatts = cur->dWatts;
 
 			evtData.energy.value = cur->dWatts;
@@ -1742,7 +2617,7 @@ static void checkChangeOfEnergy(emtrCtrl_t * pCtrl)
 		}
 
 		// Check for change in power factor
-		if (old->pf != cur->powerFactor) {
+		if (energyNotifyDue(pCtrl, emtrNotifyMetric_powerFactor, old->pf, cur->powerFactor, old, curTimeMs)) {
 			old->pf = cur->powerFactor;
 
 			evtData.energy.value = cur->powerFactor;
@@ -1750,7 +2625,7 @@ static void checkChangeOfEnergy(emtrCtrl_t * pCtrl)
 		}
 
 		// Check for change in Watt-Hours
-		if (old->dWattHours != sCtrl->stat.dWattHours) {
+		if (energyNotifyDue(pCtrl, emtrNotifyMetric_wattHours, old->dWattHours, sCtrl->stat.dWattHours, old, curTimeMs)) {
 			old->dWattHours = sCtrl->stat.dWattHours;
 
 			evtData.dWattHours.value = sCtrl->stat.dWattHours;
@@ -1761,22 +2636,12 @@ static void checkChangeOfEnergy(emtrCtrl_t * pCtrl)
 
 
 /**
- * \brief Read the device status
+ * \brief Unpack the device status from a response payload
  */
-static esp_err_t readDeviceState(emtrCtrl_t * pCtrl)
+static void unpackDeviceState(emtrCtrl_t * pCtrl, uint8_t * resp, int ioLen)
 {
-	uint8_t		resp[9];		// Expect 8 or 9 bytes returned
-	int			ioLen;
 	int			idx;
 
-	// Execute the Get Status command
-	ioLen = sizeof(resp);
-	if (doCommand(pCtrl, EMTR_CMD_GET_STATUS, NULL, resp, &ioLen) != ESP_OK)
-		return ESP_FAIL;
-	if (ioLen < 8) {
-		return ESP_FAIL;
-	}
-
 	// Offset  Len  Assignment
 	//      0    1  Socket 2 status
 	//      1    1  Socket 1 status
@@ -1843,34 +2708,43 @@ static esp_err_t readDeviceState(emtrCtrl_t * pCtrl)
 	idx += 4;
 
 	// If the device status byte is present, extract that
-	if (9 == ioLen) {
+	if (EMTR_RESP_SZ_STATUS_MAX == ioLen) {
 		pCtrl->curDeviceStatus.flags = resp[idx];
 		idx += 1;
 	} else {
 		pCtrl->curDeviceStatus.flags = 0;
 	}
-
-	return ESP_OK;
 }
 
 
 /**
- * \brief Read total Watt-hours for both outlets
+ * \brief Read the device status
  */
-static esp_err_t readWattHours(emtrCtrl_t * pCtrl)
+static esp_err_t readDeviceState(emtrCtrl_t * pCtrl)
 {
-	uint8_t		resp[8];		// Expect 8 bytes returned
+	uint8_t		resp[EMTR_RESP_SZ_STATUS_MAX];		// Expect 8 or 9 bytes returned
 	int			ioLen;
-	int			idx;
 
-	// Execute the Get KWH command
+	// Execute the Get Status command
 	ioLen = sizeof(resp);
-	if (doCommand(pCtrl, EMTR_CMD_GET_KWH, NULL, resp, &ioLen) != ESP_OK)
+	if (doCommand(pCtrl, EMTR_CMD_GET_STATUS, NULL, resp, &ioLen) != ESP_OK)
 		return ESP_FAIL;
-	if (ioLen != sizeof(resp)) {
+	if (ioLen < EMTR_RESP_SZ_STATUS_MIN) {
 		return ESP_FAIL;
 	}
 
+	unpackDeviceState(pCtrl, resp, ioLen);
+	return ESP_OK;
+}
+
+
+/**
+ * \brief Unpack total Watt-hours for both outlets from a response payload
+ */
+static void unpackWattHours(emtrCtrl_t * pCtrl, uint8_t * resp)
+{
+	int			idx;
+
 	// Watt-hours are stored as 4-byte big-endian values starting at offset 0
 	// Offset  Len  Assignment
 	//      0    4  Socket 2 Watt-Hours
@@ -1898,93 +2772,281 @@ static esp_err_t readWattHours(emtrCtrl_t * pCtrl)
 		;
 		idx += 4;
 	}
+}
 
+
+/**
+ * \brief Read total Watt-hours for both outlets
+ */
+static esp_err_t readWattHours(emtrCtrl_t * pCtrl)
+{
+	uint8_t		resp[EMTR_RESP_SZ_KWH];		// Expect 8 bytes returned
+	int			ioLen;
+
+	// Execute the Get KWH command
+	ioLen = sizeof(resp);
+	if (doCommand(pCtrl, EMTR_CMD_GET_KWH, NULL, resp, &ioLen) != ESP_OK)
+		return ESP_FAIL;
+	if (ioLen != sizeof(resp)) {
+		return ESP_FAIL;
+	}
+
+	unpackWattHours(pCtrl, resp);
 	return ESP_OK;
 }
 
 
+static void p2Init(p2Est_t * est, float p)
+{
+	memset(est, 0, sizeof(*est));
+	est->p = p;
+}
+
+
+static void p2Update(p2Est_t * est, float x)
+{
+	int		i;
+	int		k;
+
+	if (est->count < P2_NUM_MARKERS) {
+		// Insertion sort the first samples into the marker heights
+		for (i = est->count; i > 0 && est->q[i - 1] > x; i--) {
+			est->q[i] = est->q[i - 1];
+		}
+		est->q[i] = x;
+
+		if (++est->count == P2_NUM_MARKERS) {
+			float	p = est->p;
+
+			for (i = 0; i < P2_NUM_MARKERS; i++) {
+				est->n[i] = i;
+			}
+			est->np[0] = 0.0f;
+			est->np[1] = 2.0f * p;
+			est->np[2] = 4.0f * p;
+			est->np[3] = 2.0f + 2.0f * p;
+			est->np[4] = 4.0f;
+		}
+		return;
+	}
+
+	est->count += 1;
+
+	// Find the cell containing the sample, extending the extremes if needed
+	if (x < est->q[0]) {
+		est->q[0] = x;
+		k = 0;
+	} else if (x >= est->q[4]) {
+		est->q[4] = x;
+		k = 3;
+	} else {
+		for (k = 0; k < 3 && x >= est->q[k + 1]; k++) {
+		}
+	}
+
+	// Shift the positions of the markers above the sample
+	for (i = k + 1; i < P2_NUM_MARKERS; i++) {
+		est->n[i] += 1;
+	}
+
+	// Advance the desired positions
+	est->np[1] += est->p / 2.0f;
+	est->np[2] += est->p;
+	est->np[3] += (1.0f + est->p) / 2.0f;
+	est->np[4] += 1.0f;
+
+	// Adjust the middle markers that have drifted from their desired positions
+	for (i = 1; i < 4; i++) {
+		float	d = est->np[i] - (float)est->n[i];
+
+		if ((d >= 1.0f && est->n[i + 1] - est->n[i] > 1) ||
+			(d <= -1.0f && est->n[i - 1] - est->n[i] < -1)) {
+			int		ds = (d > 0.0f) ? 1 : -1;
+			float	qi = est->q[i];
+			float	nLo = (float)(est->n[i] - est->n[i - 1]);
+			float	nHi = (float)(est->n[i + 1] - est->n[i]);
+			float	qp;
+
+			// Piecewise-parabolic prediction
+			qp = qi + (float)ds / (nLo + nHi) * (
+				(nLo + ds) * (est->q[i + 1] - qi) / nHi +
+				(nHi - ds) * (qi - est->q[i - 1]) / nLo
+			);
+
+			if (est->q[i - 1] < qp && qp < est->q[i + 1]) {
+				est->q[i] = qp;
+			} else {
+				// Fall back to linear prediction
+				est->q[i] = qi + (float)ds * (est->q[i + ds] - qi) /
+					(float)(est->n[i + ds] - est->n[i]);
+			}
+
+			est->n[i] += ds;
+		}
+	}
+}
+
+
+static uint32_t p2Result(p2Est_t * est)
+{
+	if (0 == est->count)
+		return 0;
+
+	if (est->count < P2_NUM_MARKERS) {
+		// Still holding the raw samples, in sorted order
+		int	idx = (int)(est->p * (float)(est->count - 1) + 0.5f);
+		return (uint32_t)(est->q[idx] + 0.5f);
+	}
+
+	return (uint32_t)(est->q[2] + 0.5f);
+}
+
+
 static void initEmtrAccumulator(accum_t * eAvg)
 {
 	// Reset min/max accumulators
 	eAvg->min = 0xffffffff;
 	eAvg->max = 0;
 
-	// Initialize the average value accumulator
+	// Initialize the mean and variance
 	eAvg->sampleCt = 0;
-	eAvg->sum      = 0;
-	eAvg->avg      = 0;
+	eAvg->mean     = 0.0f;
+	eAvg->m2       = 0.0f;
+
+	// Initialize the time-weighted mean
+	eAvg->twSum = 0;
 
-	// Initialize the sample ring buffer
-	eAvg->preSampleCt  = 0;
-	eAvg->preSamplePut = 0;
-	eAvg->preSampleGet = 0;
+	p2Init(&eAvg->quant[accQuant_p50], 0.50f);
+	p2Init(&eAvg->quant[accQuant_p95], 0.95f);
+	p2Init(&eAvg->quant[accQuant_p99], 0.99f);
 }
 
 
-static void updateEmtrAccumulator(accum_t * eAvg, int32_t newSample)
+static void updateEmtrAccumulator(accum_t * eAvg, uint32_t value, uint64_t valueMs)
 {
-	// Wait for the sample ring buffer to be loaded before applying its contents
-	if (EMTR_PRE_SAMPLE_SZ == eAvg->preSampleCt) {
-		uint32_t	value;
-
-		// Read the oldest value from the ring buffer
-		value = eAvg->preSample[eAvg->preSampleGet];
-		if (++eAvg->preSampleGet == EMTR_PRE_SAMPLE_SZ) {
-			eAvg->preSampleGet = 0;
-		}
-		eAvg->preSampleCt -= 1;
-
-		// Apply the value to the min/max accumulators
-		if (value < eAvg->min)
-			eAvg->min = value;
-		if (value > eAvg->max)
-			eAvg->max = value;
-
-		// Apply the value to the average accumulator
-		eAvg->sum += (uint64_t)value;
-		eAvg->sampleCt += 1;
-
-		// Update the running average
-		eAvg->avg = (uint32_t)(eAvg->sum / (uint64_t)eAvg->sampleCt);
+	// Apply the value to the min/max accumulators
+	if (value < eAvg->min)
+		eAvg->min = value;
+	if (value > eAvg->max)
+		eAvg->max = value;
+
+	// Update the running mean and variance
+	float	delta;
+
+	eAvg->sampleCt += 1;
+	delta       = (float)value - eAvg->mean;
+	eAvg->mean += delta / (float)eAvg->sampleCt;
+	eAvg->m2   += delta * ((float)value - eAvg->mean);
+
+	// Each value holds until the next one, so a missed poll gives the
+	// previous value a longer weight rather than being ignored
+	if (1 == eAvg->sampleCt) {
+		eAvg->twStartMs = valueMs;
+	} else {
+		eAvg->twSum += (uint64_t)eAvg->twLastValue * (valueMs - eAvg->twLastMs);
 	}
+	eAvg->twLastValue = value;
+	eAvg->twLastMs    = valueMs;
 
-	// Add the newest sample to the ring buffer
-	eAvg->preSample[eAvg->preSamplePut] = newSample;
-	if (++eAvg->preSamplePut == EMTR_PRE_SAMPLE_SZ) {
-		eAvg->preSamplePut = 0;
+	int		i;
+	for (i = 0; i < accQuant_num; i++) {
+		p2Update(&eAvg->quant[i], (float)value);
 	}
-	eAvg->preSampleCt += 1;
 }
 
 
-static void updateEmtrAccumulators(accEnergy_t * eAcc, emtrInstEnergy_t * inst)
+static void startEmtrAccumulators(accEnergy_t * eAcc, uint64_t timeMs)
 {
-	uint64_t	curTimeMs = timeMgrGetUptimeMs();
+	eAcc->startMs      = timeMs;
+	eAcc->lastSampleMs = timeMs;
+
+	initEmtrAccumulator(&eAcc->dVolts);
+	initEmtrAccumulator(&eAcc->mAmps);
+	initEmtrAccumulator(&eAcc->dWatts);
+	initEmtrAccumulator(&eAcc->powerFactor);
+}
 
+
+static void updateEmtrAccumulators(accEnergy_t * eAcc, emtrInstEnergy_t * inst, uint64_t timeMs)
+{
 	if (eAcc->initial) {
 		// First pass after accumulators were reset
 		eAcc->initial   = false;
 		// Ignore first 2.000 seconds of sample data
-		eAcc->holdOffMs = 2000 + curTimeMs;
+		eAcc->holdOffMs = 2000 + timeMs;
+
+		startEmtrAccumulators(eAcc, eAcc->holdOffMs);
+		return;
+	}
+
+	if (timeMs < eAcc->holdOffMs)
+		return;
+
+	if (eAcc->windowMs > 0 && timeMs - eAcc->startMs >= eAcc->windowMs) {
+		// Latch the completed window and start the next one
+		cpyAccums(&eAcc->last, eAcc);
+		eAcc->seq += 1;
+
+		uint64_t	nextMs = eAcc->startMs + eAcc->windowMs;
+		if (timeMs - nextMs >= eAcc->windowMs) {
+			// Missed whole windows, re-align to this sample
+			nextMs = timeMs;
+		}
+		startEmtrAccumulators(eAcc, nextMs);
+	}
+
+	updateEmtrAccumulator(&eAcc->dVolts, inst->dVolts, timeMs);
+	updateEmtrAccumulator(&eAcc->mAmps, inst->mAmps, timeMs);
+	updateEmtrAccumulator(&eAcc->dWatts, inst->dWatts, timeMs);
+	updateEmtrAccumulator(&eAcc->powerFactor, inst->powerFactor, timeMs);
+	eAcc->lastSampleMs = timeMs;
+}
+
+
+/**
+ * \brief Apply a new reading to all open accumulator windows of a socket
+ *
+ * The reading goes through the socket's delay line once, and the sample
+ * it releases is applied to each open window
+ */
+static void updateSocketAccumulators(socketCtrl_t * sCtrl, emtrInstEnergy_t * inst)
+{
+	accDelay_t *	dly = &sCtrl->accDelay;
+	uint64_t		curTimeMs = timeMgrGetUptimeMs();
+
+	if (EMTR_PRE_SAMPLE_SZ == dly->count) {
+		emtrInstEnergy_t *	value   = &dly->sample[dly->get];
+		uint64_t			valueMs = dly->sampleMs[dly->get];
+
+		int				ch;
+		accEnergy_t *	eAcc = sCtrl->eAccChan;
+		for (ch = 0; ch < EMTR_ACC_NUM_CHANS; ch++, eAcc++) {
+			if (eAcc->inUse) {
+				updateEmtrAccumulators(eAcc, value, valueMs);
+			}
+		}
+
+		if (++dly->get == EMTR_PRE_SAMPLE_SZ) {
+			dly->get = 0;
+		}
+		dly->count -= 1;
+	}
 
-		initEmtrAccumulator(&eAcc->dVolts);
-		initEmtrAccumulator(&eAcc->mAmps);
-		initEmtrAccumulator(&eAcc->dWatts);
-		initEmtrAccumulator(&eAcc->powerFactor);
-	} else if (curTimeMs >= eAcc->holdOffMs) {
-		updateEmtrAccumulator(&eAcc->dVolts, inst->dVolts);
-		updateEmtrAccumulator(&eAcc->mAmps, inst->mAmps);
-		updateEmtrAccumulator(&eAcc->dWatts, inst->dWatts);
-		updateEmtrAccumulator(&eAcc->powerFactor, inst->powerFactor);
+	// Add the newest sample to the delay line
+	dly->sample[dly->put]   = *inst;
+	dly->sampleMs[dly->put] = curTimeMs;
+	if (++dly->put == EMTR_PRE_SAMPLE_SZ) {
+		dly->put = 0;
 	}
+	dly->count += 1;
 }
 
 
 static void clearEmtrAccumulator(accum_t * acc, int32_t value)
 {
-	acc->min = value;
-	acc->max = value;
-	acc->avg = 0;
+	acc->min      = value;
+	acc->max      = value;
+	acc->sampleCt = 0;
 }
 
 
@@ -2000,17 +3062,72 @@ static void clearEmtrAccumulators(accEnergy_t * eAcc)
 }
 
 
+static void openEmtrAccumulators(accEnergy_t * eAcc, uint32_t windowMs)
+{
+	memset(eAcc, 0, sizeof(*eAcc));
+
+	eAcc->inUse    = true;
+	eAcc->windowMs = windowMs;
+	clearEmtrAccumulators(eAcc);
+}
+
+
 static void cpyAccum(emtrAvgEnergy_t * dst, accum_t * src)
 {
 	dst->min      = src->min;
 	dst->max      = src->max;
-	dst->avg      = src->avg;
 	dst->sampleCt = src->sampleCt;
+
+	if (0 == src->sampleCt) {
+		dst->avg    = 0;
+		dst->twAvg  = 0;
+		dst->stdDev = 0;
+		dst->p50    = 0;
+		dst->p95    = 0;
+		dst->p99    = 0;
+		return;
+	}
+
+	dst->avg = (uint32_t)(src->mean + 0.5f);
+
+	uint64_t	spanMs = src->twLastMs - src->twStartMs;
+	if (spanMs > 0) {
+		dst->twAvg = (uint32_t)((src->twSum + spanMs / 2) / spanMs);
+	} else {
+		dst->twAvg = dst->avg;
+	}
+
+	if (src->sampleCt > 1) {
+		dst->stdDev = (uint32_t)(sqrtf(src->m2 / (float)(src->sampleCt - 1)) + 0.5f);
+	} else {
+		dst->stdDev = 0;
+	}
+
+	dst->p50 = p2Result(&src->quant[accQuant_p50]);
+	dst->p95 = p2Result(&src->quant[accQuant_p95]);
+	dst->p99 = p2Result(&src->quant[accQuant_p99]);
+}
+
+
+static void cpyAccums(emtrAccEnergy_t * dst, accEnergy_t * src)
+{
+	cpyAccum(&dst->dVolts, &src->dVolts);
+	cpyAccum(&dst->mAmps, &src->mAmps);
+	cpyAccum(&dst->dWatts, &src->dWatts);
+	cpyAccum(&dst->powerFactor, &src->powerFactor);
+
+	dst->startMs    = src->startMs;
+	dst->durationMs = (uint32_t)(src->lastSampleMs - src->startMs);
 }
 
 
 /**
- * \brief Read and clear the selected set of accumulators
+ * \brief Read the selected set of accumulators
+ *
+ * A read-and-clear channel returns the current statistics and clears them.
+ * A windowed channel returns the most recent completed window, once.
+ *
+ * \return ESP_ERR_NOT_FOUND No window has completed since the last read
  */
 static esp_err_t getAccChan(
 	emtrCtrl_t *		pCtrl,
@@ -2019,7 +3136,7 @@ static esp_err_t getAccChan(
 	emtrAccEnergy_t *	ret
 )
 {
-	if (!pCtrl || !ret || accChan >= EMTR_ACC_NUM_CHANS) {
+	if (!pCtrl || !ret || accChan < 0 || accChan >= EMTR_ACC_NUM_CHANS) {
 		return ESP_ERR_INVALID_ARG;
 	}
 
@@ -2038,14 +3155,20 @@ static esp_err_t getAccChan(
 	if ((status = checkRequest(pCtrl, sockNum, true)) == ESP_OK) {
 		// At this point mutex is locked
 
-		// Copy back current accumulator values
-		cpyAccum(&ret->dVolts, &eAcc->dVolts);
-		cpyAccum(&ret->mAmps, &eAcc->mAmps);
-		cpyAccum(&ret->dWatts, &eAcc->dWatts);
-		cpyAccum(&ret->powerFactor, &eAcc->powerFactor);
-
-		// Clear the accumulators
-		clearEmtrAccumulators(eAcc);
+		if (!eAcc->inUse) {
+			status = ESP_ERR_INVALID_ARG;
+		} else if (0 == eAcc->windowMs) {
+			// Copy back current accumulator values
+			cpyAccums(ret, eAcc);
+
+			// Clear the accumulators
+			clearEmtrAccumulators(eAcc);
+		} else if (eAcc->readSeq != eAcc->seq) {
+			*ret = eAcc->last;
+			eAcc->readSeq = eAcc->seq;
+		} else {
+			status = ESP_ERR_NOT_FOUND;
+		}
 
 		EMTR_MUTEX_PUT(pCtrl);
 	}
@@ -2055,22 +3178,16 @@ static esp_err_t getAccChan(
 
 
 /**
- * \brief Read instant power information for both sockets
+ * \brief Unpack instant power information for both sockets from a response payload
+ *
+ * \param [in] accumulate Apply the reading to the accumulators and the
+ * running total. Only readings on the regular power cadence do, the
+ * burst after a switch only updates the instant values.
  */
-static esp_err_t readPower(emtrCtrl_t * pCtrl)
+static void unpackPower(emtrCtrl_t * pCtrl, uint8_t * resp, bool accumulate)
 {
-	uint8_t			resp[16];		// Expect 16 bytes returned
-	int				ioLen;
 	int				idx;
 
-	// Execute the Get Instant power info command
-	ioLen = sizeof(resp);
-	if (doCommand(pCtrl, EMTR_CMD_GET_INSTANT_PWR, NULL, resp, &ioLen) != ESP_OK)
-		return ESP_FAIL;
-	if (ioLen != sizeof(resp)) {
-		return ESP_FAIL;
-	}
-
 	// Unpack power data
 	// Offset  Len  Assignment
 	//      0    2  Socket 2 volts x 10
@@ -2114,24 +3231,113 @@ static esp_err_t readPower(emtrCtrl_t * pCtrl)
 		;
 		idx += 2;
 
-		eInst->powerFactor =
-			((int)resp[idx + 0]) << 8 |
-			((int)resp[idx + 1]) << 0
-		;
-		idx += 2;
+		eInst->powerFactor =
+			((int)resp[idx + 0]) << 8 |
+			((int)resp[idx + 1]) << 0
+		;
+		idx += 2;
+
+		if (!accumulate)
+			continue;
+
+		// Apply instant energy reading to accumulators
+		updateSocketAccumulators(sCtrl, eInst);
+
+		// Update the running total of Watts
+		sCtrl->stat.dWattsTotal += (uint64_t)eInst->dWatts;
+	}
+}
+
+
+/**
+ * \brief Read instant power information for both sockets
+ *
+ * \param [in] accumulate See \ref unpackPower
+ */
+static esp_err_t readPower(emtrCtrl_t * pCtrl, bool accumulate)
+{
+	uint8_t			resp[EMTR_RESP_SZ_INSTANT_PWR];		// Expect 16 bytes returned
+	int				ioLen;
+
+	// Execute the Get Instant power info command
+	ioLen = sizeof(resp);
+	if (doCommand(pCtrl, EMTR_CMD_GET_INSTANT_PWR, NULL, resp, &ioLen) != ESP_OK)
+		return ESP_FAIL;
+	if (ioLen != sizeof(resp)) {
+		return ESP_FAIL;
+	}
+
+	unpackPower(pCtrl, resp, accumulate);
+	return ESP_OK;
+}
+
+
+/**
+ * \brief Read power, Watt-hours and device status in a single transaction
+ *
+ * Older EMTR firmware does not implement the snapshot command. The first
+ * request is sent once, without the retry and link handling of \ref doCommand,
+ * to find out if it is supported. Only a well-formed reply decides it: a
+ * short one, e.g. the error reply, means not supported. A timeout or a
+ * damaged reply leaves it unknown and the probe is repeated on the next
+ * poll. After that the command is either used normally or never sent
+ * again.
+ *
+ * \param [in] accumulate See \ref unpackPower
+ *
+ * \return ESP_OK Success
+ * \return ESP_ERR_NOT_SUPPORTED Use the individual commands instead
+ * \return (other) Communication error
+ */
+static esp_err_t readSnapshot(emtrCtrl_t * pCtrl, bool accumulate)
+{
+	uint8_t		resp[EMTR_RESP_SZ_SNAPSHOT_MAX];
+	int			ioLen;
+
+	if (cmdSupport_no == pCtrl->snapshot)
+		return ESP_ERR_NOT_SUPPORTED;
 
-		// Apply instant energy reading to accumulators
+	if (cmdSupport_yes == pCtrl->snapshot) {
+		ioLen = sizeof(resp);
+		if (doCommand(pCtrl, EMTR_CMD_GET_SNAPSHOT, NULL, resp, &ioLen) != ESP_OK)
+			return ESP_FAIL;
 
-		int				chNum;
-		accEnergy_t *	eAcc = sCtrl->eAccChan;
-		for (chNum = 0; chNum < EMTR_ACC_NUM_CHANS; chNum++, eAcc++) {
-			updateEmtrAccumulators(eAcc, eInst);
+		if (ioLen < EMTR_RESP_SZ_SNAPSHOT_MIN) {
+			gc_err("Snapshot response too short (%d)", ioLen);
+			return ESP_FAIL;
 		}
+	} else {
+		// Probe the EMTR with a single attempt
+		if (sendEmtrCommand(pCtrl, EMTR_CMD_GET_SNAPSHOT, NULL) != ESP_OK)
+			return ESP_FAIL;
 
-		// Update the running total of Watts
-		sCtrl->stat.dWattsTotal += (uint64_t)eInst->dWatts;
+		ioLen = readEmtrResponse(pCtrl, EMTR_CMD_GET_SNAPSHOT, resp, sizeof(resp));
+		if (ioLen < 0) {
+			// Timed out or damaged, says nothing about support, probe again
+			// on the next poll
+			uart_flush_input(pCtrl->conf.uartCmd.uart);
+			return ESP_FAIL;
+		}
+
+		if (ioLen < EMTR_RESP_SZ_SNAPSHOT_MIN) {
+			// Firmware without the command answers with a short error reply
+			gc_dbg("EMTR does not support snapshot, use individual commands");
+			pCtrl->snapshot = cmdSupport_no;
+			return ESP_ERR_NOT_SUPPORTED;
+		}
+
+		gc_dbg("EMTR supports snapshot");
+		pCtrl->snapshot = cmdSupport_yes;
 	}
 
+	unpackPower(pCtrl, &resp[0], accumulate);
+	unpackWattHours(pCtrl, &resp[EMTR_RESP_SZ_INSTANT_PWR]);
+	unpackDeviceState(
+		pCtrl,
+		&resp[EMTR_RESP_SZ_INSTANT_PWR + EMTR_RESP_SZ_KWH],
+		ioLen - (EMTR_RESP_SZ_INSTANT_PWR + EMTR_RESP_SZ_KWH)
+	);
+
 	return ESP_OK;
 }
 
@@ -2315,6 +3521,282 @@ static esp_err_t readSignature(
 }
 
 
+/**
+ * \brief Set up the state of a bulk signature read
+ */
+static void sigReadInit(sigRead_t * sig, int sockNum, uint8_t * buf)
+{
+	memset(sig, 0, sizeof(*sig));
+
+	sig->sockNum  = sockNum;
+	sig->buf      = buf;
+	sig->rdLen    = PWR_SIGNATURE_BUF_SZ;
+	sig->numPages = EMTR_SIG_NUM_PAGES;
+}
+
+
+/**
+ * \brief Read a burst of power signature pages
+ *
+ * Request payload
+ *   Byte  Content
+ *      0  First page number
+ *      1  Number of pages
+ *
+ * The response is a regular response frame with a 7-byte payload
+ *   Offset  Len  Content
+ *        0    4  Signature timestamp
+ *        4    1  Reason
+ *        5    1  First page number
+ *        6    1  Number of pages
+ *
+ * followed directly by one unframed record for each page
+ *   Offset  Len  Content
+ *        0    1  Page number
+ *        1  128  Page data
+ *      129    2  CRC-16 (XMODEM) of page number and data, big-endian
+ *
+ * Pages received intact are kept. At the first bad page the rest of the
+ * burst is discarded so the next call resumes from that page. If the EMTR
+ * captured a new signature since the read started, the read starts over.
+ *
+ * \return ESP_OK Burst received, check sig->nextPage for progress
+ * \return ESP_ERR_NOT_SUPPORTED EMTR firmware does not have the command
+ * \return ESP_FAIL Burst failed
+ */
+static esp_err_t readSignatureChunk(emtrCtrl_t * pCtrl, sigRead_t * sig, int maxPages)
+{
+	socketCtrl_t *	sCtrl = getSocketCtrl(pCtrl, (uint8_t)sig->sockNum);
+	if (!sCtrl) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	if (cmdSupport_no == pCtrl->sigBulk) {
+		return ESP_ERR_NOT_SUPPORTED;
+	}
+
+	// Shorthand reference to UART configuration
+	emtrUartConf_t *	uartConf = &pCtrl->conf.uartCmd;
+
+	uint8_t		cmdCode = sCtrl->info->cmdReadSigBulk;
+	uint8_t		payload[4];
+	uint8_t		resp[EMTR_RESP_SZ_SIG_BULK];
+	uint8_t		rec[EMTR_SIG_REC_SZ];
+	int			pageCt;
+	int			ioLen;
+	int			i;
+
+	pageCt = sig->numPages - sig->nextPage;
+	if (pageCt > maxPages)
+		pageCt = maxPages;
+
+	payload[0] = (uint8_t)sig->nextPage;
+	payload[1] = (uint8_t)pageCt;
+	payload[2] = 0;
+	payload[3] = 0;
+
+	if (sendEmtrCommand(pCtrl, cmdCode, payload) != ESP_OK) {
+		return ESP_FAIL;
+	}
+
+	ioLen = readEmtrResponse(pCtrl, cmdCode, resp, sizeof(resp));
+	if (ioLen != sizeof(resp)) {
+		uart_flush_input(uartConf->uart);
+
+		// Only a well-formed short reply, e.g. the error reply of firmware
+		// without the command, settles support. After a timeout or a
+		// damaged reply the next call asks again.
+		if (cmdSupport_unknown == pCtrl->sigBulk && ioLen >= 0) {
+			gc_dbg("EMTR does not support bulk signature read, use page reads");
+			pCtrl->sigBulk = cmdSupport_no;
+			return ESP_ERR_NOT_SUPPORTED;
+		}
+
+		gc_err("Bulk signature header failed (%d)", ioLen);
+		return ESP_FAIL;
+	}
+
+	pCtrl->sigBulk = cmdSupport_yes;
+
+	uint32_t	ts =
+		((uint32_t)resp[0]) << 24 |
+		((uint32_t)resp[1]) << 16 |
+		((uint32_t)resp[2]) <<  8 |
+		((uint32_t)resp[3]) <<  0
+	;
+
+	if (resp[5] != payload[0] || resp[6] != payload[1]) {
+		gc_err("Bulk signature pages %u+%u, expected %u+%u", resp[5], resp[6], payload[0], payload[1]);
+		flushEmtrMsg(pCtrl, resp[6] * EMTR_SIG_REC_SZ);
+		uart_flush_input(uartConf->uart);
+		return ESP_FAIL;
+	}
+
+	if (!sig->haveTs) {
+		sig->haveTs    = true;
+		sig->timestamp = ts;
+		sig->reason    = resp[4];
+	} else if (sig->timestamp != ts) {
+		// The signature was re-sampled since the read started
+		gc_dbg("Signature timestamp changed %08X -> %08X, start over", sig->timestamp, ts);
+		sig->timestamp = ts;
+		sig->reason    = resp[4];
+
+		if (sig->nextPage > 0) {
+			sig->nextPage = 0;
+			if (sig->encBuf) {
+				sigEncInit(&sig->enc, sig->encBuf, sig->encBufLen);
+				sig->encCycles = 0;
+			}
+			flushEmtrMsg(pCtrl, pageCt * EMTR_SIG_REC_SZ);
+			uart_flush_input(uartConf->uart);
+			return ESP_FAIL;
+		}
+	}
+
+	for (i = 0; i < pageCt; i++) {
+		if (readEmtr(pCtrl, rec, sizeof(rec)) < 0) {
+			uart_flush_input(uartConf->uart);
+			return ESP_FAIL;
+		}
+
+		uint16_t	crc = 0;
+		uint16_t	rxCrc;
+		int			j;
+
+		for (j = 0; j < 1 + PWR_SIGNATURE_PAGE_SZ; j++) {
+			crc = csXmCrc16(crc, rec[j]);
+		}
+		rxCrc = ((uint16_t)rec[j + 0]) << 8 | ((uint16_t)rec[j + 1]) << 0;
+
+		if (rec[0] != sig->nextPage || crc != rxCrc) {
+			gc_err("Bad signature page %d (page %u, crc %04X/%04X)", sig->nextPage, rec[0], crc, rxCrc);
+
+			// Discard the rest of the burst
+			flushEmtrMsg(pCtrl, (pageCt - i - 1) * EMTR_SIG_REC_SZ);
+			uart_flush_input(uartConf->uart);
+			return ESP_FAIL;
+		}
+
+		int		offset = sig->nextPage * PWR_SIGNATURE_PAGE_SZ;
+		int		rdSize = sig->rdLen - offset;
+
+		if (rdSize > PWR_SIGNATURE_PAGE_SZ)
+			rdSize = PWR_SIGNATURE_PAGE_SZ;
+
+		memcpy(sig->buf + offset, &rec[1], rdSize);
+		sigEncData(sig, &rec[1], rdSize);
+		sig->nextPage += 1;
+	}
+
+	return ESP_OK;
+}
+
+
+/**
+ * \brief Pass signature data to the encoder of an encoded read
+ */
+static void sigEncData(sigRead_t * sig, const uint8_t * data, int len)
+{
+	if (!sig->encBuf)
+		return;
+
+	uint32_t	t0 = xthal_get_ccount();
+
+	sigEncPut(&sig->enc, data, len);
+	sig->encCycles += xthal_get_ccount() - t0;
+}
+
+
+/**
+ * \brief Complete the encoder of an encoded read
+ */
+static esp_err_t sigEncDone(sigRead_t * sig)
+{
+	if (!sig->encBuf)
+		return ESP_OK;
+
+	uint32_t	t0 = xthal_get_ccount();
+	esp_err_t	status = sigEncFinish(&sig->enc, &sig->encLen);
+
+	sig->encCycles += xthal_get_ccount() - t0;
+
+	if (ESP_OK == status) {
+		gc_dbg("Signature encoded %d -> %d bytes, %u cycles/sample", sig->rdLen, sig->encLen,
+			sig->encCycles / PWR_SIGNATURE_NUM_SAMPLES);
+	}
+
+	return status;
+}
+
+
+/**
+ * \brief Advance the background signature read by one chunk
+ *
+ * \return true The read is finished, sigRead.status holds the result
+ * \return false More to do, or no read active
+ */
+static bool handleSigRead(emtrCtrl_t * pCtrl)
+{
+	sigRead_t *	sig = &pCtrl->sigRead;
+	esp_err_t	status;
+
+	if (!sig->active)
+		return false;
+
+	if (emtrRunMode_application != pCtrl->emtrMode || pCtrl->pause) {
+		sig->status = ESP_ERR_INVALID_STATE;
+		return true;
+	}
+
+	if (emtrLinkState_open == pCtrl->link.state) {
+		gc_err("EMTR link down");
+		sig->status = ESP_ERR_INVALID_STATE;
+		return true;
+	}
+
+	status = readSignatureChunk(pCtrl, sig, EMTR_SIG_CHUNK_PAGES);
+	if (ESP_ERR_NOT_SUPPORTED == status) {
+		// Older EMTR firmware, read one page per command in this pass
+		sig->status = readSignature(
+			pCtrl,
+			sig->sockNum,
+			&sig->timestamp,
+			&sig->reason,
+			sig->buf,
+			sig->rdLen
+		);
+		if (ESP_OK == sig->status) {
+			sigEncData(sig, sig->buf, sig->rdLen);
+			sig->status = sigEncDone(sig);
+		}
+		return true;
+	} else if (ESP_OK != status && ++sig->errCt > EMTR_SIG_MAX_ERRORS) {
+		gc_err("Too many errors reading signature");
+		sig->status = ESP_FAIL;
+		return true;
+	}
+
+	if (sig->nextPage >= sig->numPages) {
+		sig->status = sigEncDone(sig);
+		return true;
+	}
+
+	// More to read, queue behind other pending work
+	emtrMsg_t	msg = {
+		.msgCode = emtrMsgCode_sigRead
+	};
+
+	if (xQueueSend(pCtrl->queue, &msg, 0) != pdTRUE) {
+		gc_err("Failed to queue signature read");
+		sig->status = ESP_FAIL;
+		return true;
+	}
+
+	return false;
+}
+
+
 /*
  * \brief Set and verify EMTR board run mode
  */
@@ -2336,6 +3818,9 @@ static esp_err_t emtrRunModeSet(
 	// Flush the transmit FIFO
 	uart_wait_tx_done(uartConf->uart, pdMS_TO_TICKS(200));
 
+	// The board is reset here, give the link a fresh start
+	linkInit(pCtrl);
+
 	// Reset the board into the desired state
 	if ((status = resetEmtrBoard(pCtrl, targetMode)) != ESP_OK) {
 		gc_err("resetEmtrBoard error %d", status);
@@ -2357,7 +3842,7 @@ static esp_err_t emtrRunModeSet(
 		return ESP_FAIL;
 	}
 
-	pCtrl->pollSampleCt = 0;
+	schedInit(pCtrl);
 	return ESP_OK;
 }
 
@@ -2517,6 +4002,10 @@ exitBootloader:
 			version[0], version[1], version[2]
 		);
 		gc_dbg("EMTR updated to %s", pCtrl->fwVersion);
+
+		// The new firmware may differ in its support of optional commands
+		pCtrl->snapshot = cmdSupport_unknown;
+		pCtrl->sigBulk  = cmdSupport_unknown;
 	}
 
 exitUpdate:
@@ -2525,6 +4014,176 @@ exitUpdate:
 }
 
 
+/**
+ * \brief Publish the current device and socket status for readers
+ *
+ * Must be called from the control task with the mutex held
+ */
+static void publishStatus(emtrCtrl_t * pCtrl)
+{
+	uint32_t		idx = pCtrl->pubIdx ^ 1;
+	statusPub_t *	pub = &pCtrl->pub[idx];
+	socketCtrl_t *	sCtrl;
+	int				i;
+
+	// Mark the copy as being updated
+	pub->seq += 1;
+	__sync_synchronize();
+
+	pub->data.device     = pCtrl->curDeviceStatus;
+	pub->data.numSockets = pCtrl->conf.numSockets;
+
+	for (i = 0, sCtrl = pCtrl->socketCtrl; i < pCtrl->conf.numSockets; i++, sCtrl++) {
+		int		sIdx = sCtrl->info->sockNum - 1;
+
+		pub->data.socket[sIdx] = sCtrl->stat;
+		pub->cosTimeRelay[sIdx] = sCtrl->cosTimeRelay;
+	}
+
+	// Mark the copy complete, then direct readers to it
+	__sync_synchronize();
+	pub->seq += 1;
+	__sync_synchronize();
+	pCtrl->pubIdx = idx;
+}
+
+
+/**
+ * \brief Read the most recently published status without locking
+ *
+ * The copy is only retried if the control task published twice while it
+ * was being read
+ */
+static void readPublished(emtrCtrl_t * pCtrl, emtrAllStatus_t * ret)
+{
+	statusPub_t *	pub;
+	uint32_t		seq;
+	int				i;
+
+	do {
+		pub = &pCtrl->pub[pCtrl->pubIdx];
+		seq = pub->seq;
+		__sync_synchronize();
+
+		*ret = pub->data;
+		for (i = 0; i < ret->numSockets; i++) {
+			ret->socket[i].relayTime = pub->cosTimeRelay[i];
+		}
+
+		__sync_synchronize();
+	} while ((seq & 1) || seq != pub->seq);
+
+	// Convert relay change of state time to time in the current state
+	uint32_t	curTime = EMTR_TIME_SEC();
+
+	for (i = 0; i < ret->numSockets; i++) {
+		ret->socket[i].relayTime = curTime - ret->socket[i].relayTime;
+	}
+}
+
+
+/**
+ * \brief Set the poll deadlines to start from the current time
+ */
+static void schedInit(emtrCtrl_t * pCtrl)
+{
+	emtrPollConf_t *	poll  = &pCtrl->conf.poll;
+	int64_t				nowUs = EMTR_TIME_US();
+	int					i;
+
+	pCtrl->sched[emtrPollItem_state].periodUs = (int64_t)poll->stateMs * 1000;
+	pCtrl->sched[emtrPollItem_power].periodUs = (int64_t)poll->powerMs * 1000;
+	pCtrl->sched[emtrPollItem_kwh].periodUs   = (int64_t)poll->kwhMs * 1000;
+	pCtrl->sched[emtrPollItem_temp].periodUs  = (int64_t)poll->tempMs * 1000;
+	pCtrl->sched[emtrPollItem_burst].periodUs = (int64_t)poll->burstMs * 1000;
+
+	for (i = 0; i < emtrPollItem_num; i++) {
+		pCtrl->sched[i].nextDueUs = nowUs;
+	}
+
+	pCtrl->burstRemain = 0;
+}
+
+
+/**
+ * \brief Check if a poll item is due and advance its deadline
+ *
+ * Deadlines advance by whole periods from the previous deadline, not from
+ * the time of the poll, so the schedule does not drift. Periods that were
+ * entirely missed are skipped and counted.
+ */
+static bool schedIsDue(emtrCtrl_t * pCtrl, emtrPollItem_t item, int64_t nowUs)
+{
+	pollSched_t *	sched = &pCtrl->sched[item];
+
+	if (emtrPollItem_burst == item && 0 == pCtrl->burstRemain)
+		return false;
+
+	if (nowUs < sched->nextDueUs)
+		return false;
+
+	int64_t		lateUs = nowUs - sched->nextDueUs;
+
+	sched->runCt     += 1;
+	sched->lateSumUs += lateUs;
+	if (lateUs > sched->lateMaxUs)
+		sched->lateMaxUs = lateUs;
+
+	if (lateUs >= sched->periodUs) {
+		int64_t		missed = lateUs / sched->periodUs;
+
+		sched->missedCt  += (uint32_t)missed;
+		sched->nextDueUs += missed * sched->periodUs;
+	}
+	sched->nextDueUs += sched->periodUs;
+
+	if (emtrPollItem_burst == item)
+		pCtrl->burstRemain -= 1;
+
+	return true;
+}
+
+
+/**
+ * \brief Arm the poll timer for the earliest deadline
+ */
+static void schedArm(emtrCtrl_t * pCtrl)
+{
+	int64_t		nowUs  = EMTR_TIME_US();
+	int64_t		wakeUs = pCtrl->sched[emtrPollItem_state].nextDueUs;
+	int			i;
+
+	for (i = 0; i < emtrPollItem_num; i++) {
+		if (emtrPollItem_burst == i && 0 == pCtrl->burstRemain)
+			continue;
+
+		if (pCtrl->sched[i].nextDueUs < wakeUs)
+			wakeUs = pCtrl->sched[i].nextDueUs;
+	}
+
+	// While the link is down only the reset and probe are scheduled
+	if (emtrLinkState_open == pCtrl->link.state) {
+		wakeUs = pCtrl->link.nextProbeUs;
+		if (pCtrl->link.nextResetUs < wakeUs)
+			wakeUs = pCtrl->link.nextResetUs;
+	}
+
+	// Nothing is sent to the EMTR during a hold off
+	if (wakeUs < pCtrl->notBeforeUs)
+		wakeUs = pCtrl->notBeforeUs;
+
+	// Round up to the next tick so the timer never fires before the deadline
+	const int64_t	tickUs = (int64_t)portTICK_PERIOD_MS * 1000;
+	TickType_t		ticks  = 1;
+
+	if (wakeUs > nowUs) {
+		ticks = (TickType_t)((wakeUs - nowUs + tickUs - 1) / tickUs);
+	}
+
+	xTimerChangePeriod(pCtrl->timer, ticks, pdMS_TO_TICKS(10));
+}
+
+
 static esp_err_t handleTimer(emtrCtrl_t * pCtrl, bool * didReadPower, uint8_t * flags)
 {
 	*didReadPower = false;
@@ -2534,44 +4193,85 @@ static esp_err_t handleTimer(emtrCtrl_t * pCtrl, bool * didReadPower, uint8_t *
 	if (emtrRunMode_application != pCtrl->emtrMode)
 		return ESP_OK;
 
-	esp_err_t			status;
+	int64_t		nowUs = EMTR_TIME_US();
 
-	// Read device and socket status each pass
-	if ((status = readDeviceState(pCtrl)) != ESP_OK) {
-		gc_err("Error %d from readDeviceState()", status);
-		return status;
-	}
+	// Commands are held off while the EMTR samples a socket transition
+	if (nowUs < pCtrl->notBeforeUs)
+		return ESP_OK;
+
+	// Nothing is polled while the link is down
+	if (!linkService(pCtrl, nowUs))
+		return ESP_ERR_INVALID_STATE;
 
-	*flags = pCtrl->curDeviceStatus.flags;
+	esp_err_t	status;
+	bool		stateDue   = schedIsDue(pCtrl, emtrPollItem_state, nowUs);
+	bool		tempDue    = schedIsDue(pCtrl, emtrPollItem_temp, nowUs);
+	bool		powerDue   = false;
+	bool		accumulate = false;
+	bool		kwhDue     = false;
+	bool		haveState  = false;
+	bool		haveEnergy = false;
 
 	// While EMTR is in pause state don't do anything to generate data updates
-	if (pCtrl->pause)
-		return ESP_OK;
+	if (!pCtrl->pause) {
+		// Only the regular cadence feeds the accumulators, a burst read
+		// would oversample the seconds after a switch
+		accumulate = schedIsDue(pCtrl, emtrPollItem_power, nowUs);
+		powerDue   = accumulate;
+		if (schedIsDue(pCtrl, emtrPollItem_burst, nowUs))
+			powerDue = true;
+		kwhDue = schedIsDue(pCtrl, emtrPollItem_kwh, nowUs);
+	}
 
-	// Check for changes of state
-	checkChangeOfState(pCtrl);
+	if (powerDue) {
+		// Try to read everything in one transaction
+		status = readSnapshot(pCtrl, accumulate);
+		if (ESP_OK == status) {
+			haveState  = true;
+			haveEnergy = true;
+		} else if (ESP_ERR_NOT_SUPPORTED != status) {
+			gc_err("Error %d from readSnapshot()", status);
+			return status;
+		}
+	}
 
-	// Read power information once per second
-	if (++pCtrl->pollSampleCt < EMTR_POLL_CYCLES_PER_SEC)
-		return ESP_OK;
+	// Temperature is reported in the device status
+	if ((stateDue || tempDue) && !haveState) {
+		if ((status = readDeviceState(pCtrl)) != ESP_OK) {
+			gc_err("Error %d from readDeviceState()", status);
+			return status;
+		}
+		haveState = true;
+	}
 
-	// Reset the counter
-	pCtrl->pollSampleCt = 0;
+	if (haveState) {
+		*flags = pCtrl->curDeviceStatus.flags;
 
-	if ((status = readPower(pCtrl)) != ESP_OK) {
-		gc_err("Error %d from readPower()", status);
-		return status;
+		// Check for changes of state
+		if (!pCtrl->pause)
+			checkChangeOfState(pCtrl, tempDue);
 	}
 
-	if ((status = readWattHours(pCtrl)) != ESP_OK) {
-		gc_err("Error %d from readWattHours()", status);
-		return status;
+	if (!powerDue && !kwhDue)
+		return ESP_OK;
+
+	if (!haveEnergy) {
+		// Legacy EMTR firmware, read power and Watt-hours separately
+		if (powerDue && (status = readPower(pCtrl, accumulate)) != ESP_OK) {
+			gc_err("Error %d from readPower()", status);
+			return status;
+		}
+
+		if (kwhDue && (status = readWattHours(pCtrl)) != ESP_OK) {
+			gc_err("Error %d from readWattHours()", status);
+			return status;
+		}
 	}
 
 	// Check for changes and send notifications
 	checkChangeOfEnergy(pCtrl);
 
-	*didReadPower = true;
+	*didReadPower = powerDue;
 	return ESP_OK;
 }
 
@@ -2586,6 +4286,8 @@ static void ctrlTask(void * params)
 	int					oNum;
 	uint8_t				devFlags;
 	bool				didReadPower;
+	bool				sigDone;
+	sigRead_t			sigResult;
 
 	//attempt to do a single read before init
 	if (readDeviceState(pCtrl) == ESP_OK) {
@@ -2598,6 +4300,10 @@ static void ctrlTask(void * params)
 			sCtrl->stat.isPlugged = SOCKET_IS_PLUGGED(sCtrl);
 		}
 	}
+	EMTR_MUTEX_GET(pCtrl);
+	publishStatus(pCtrl);
+	EMTR_MUTEX_PUT(pCtrl);
+
 	while (1)
 	{
 		if (pCtrl->shutdown) {
@@ -2612,6 +4318,8 @@ static void ctrlTask(void * params)
 		// Lock the mutex
 		EMTR_MUTEX_GET(pCtrl);
 
+		sigDone = false;
+
 		switch (msg.msgCode)
 		{
 		case emtrtMsgCode_timer:
@@ -2627,7 +4335,7 @@ static void ctrlTask(void * params)
 				csControlFactoryReset();
 			} else {
 				// Schedule the next read
-				xTimerReset(pCtrl->timer, pdMS_TO_TICKS(10));
+				schedArm(pCtrl);
 			}
 			break;
 
@@ -2682,7 +4390,16 @@ static void ctrlTask(void * params)
 			if (pCtrl->pause) {
 				gc_dbg("Resume EMTR operation");
 				pCtrl->pause = false;
-				pCtrl->pollSampleCt = 0;
+				schedInit(pCtrl);
+			}
+			break;
+
+		case emtrMsgCode_sigRead:
+			if (handleSigRead(pCtrl)) {
+				// Hand the result to the callback once the mutex is released
+				sigResult = pCtrl->sigRead;
+				pCtrl->sigRead.active = false;
+				sigDone = true;
 			}
 			break;
 
@@ -2691,8 +4408,23 @@ static void ctrlTask(void * params)
 			break;
 		}
 
+		// Make the results of this pass visible to readers
+		publishStatus(pCtrl);
+
 		EMTR_MUTEX_PUT(pCtrl);
 
+		if (sigDone) {
+			sigResult.cbFunc(
+				sigResult.cbData,
+				sigResult.status,
+				sigResult.sockNum,
+				sigResult.timestamp,
+				sigResult.reason,
+				sigResult.encBuf ? sigResult.encBuf : sigResult.buf,
+				sigResult.encBuf ? sigResult.encLen : sigResult.rdLen
+			);
+		}
+
 		if (didReadPower) {
 			didReadPower = false;
 #if (ENA_PERIOD_REPORT)
@@ -28,7 +28,8 @@ extern "C" {
 #define PWR_SIGNATURE_BUF_SZ			(4 * PWR_SIGNATURE_NUM_SAMPLES)
 
 // EMTR energy reading accumulators
-#define	EMTR_ACC_NUM_CHANS		(1)
+// Channel 0 is always open, others are opened by emtrDrvAccWindowOpen()
+#define	EMTR_ACC_NUM_CHANS		(4)
 #define EMTR_ACC_CHAN_SAPIENT	(0)
 
 typedef struct {
@@ -39,14 +40,122 @@ typedef struct {
 } emtrUartConf_t;
 
 
+/**
+ * \brief EMTR poll rates
+ *
+ * Any period left as 0 uses the driver default
+ */
+typedef struct {
+	uint32_t		stateMs;		// Socket and device state
+	uint32_t		powerMs;		// Instant power
+	uint32_t		kwhMs;			// Watt-hours
+	uint32_t		tempMs;			// Temperature
+	uint32_t		burstMs;		// Power reads following a socket switch
+	uint32_t		burstCount;		// Number of reads in the burst
+} emtrPollConf_t;
+
+
+/**
+ * \brief Energy metrics filtered before notification
+ */
+typedef enum {
+	emtrNotifyMetric_volts = 0,
+	emtrNotifyMetric_amps,
+	emtrNotifyMetric_watts,
+	emtrNotifyMetric_powerFactor,
+	emtrNotifyMetric_wattHours,
+	emtrNotifyMetric_num			// Must be last
+} emtrNotifyMetric_t;
+
+
+/**
+ * \brief Deadband for one energy metric
+ *
+ * A change is reported when it reaches the larger of absDelta and relDeltaPm
+ * of the last reported value, e.g. 10 mA and 20 per mille give 10 mA below
+ * 500 mA and 2 % above
+ */
+typedef struct {
+	uint32_t		absDelta;		// In units of the metric
+	uint32_t		relDeltaPm;		// Per mille of the last reported value
+} emtrDeadband_t;
+
+
+/**
+ * \brief Filtering of energy change notifications
+ */
+typedef struct {
+	emtrDeadband_t	band[emtrNotifyMetric_num];
+	uint32_t		minIntervalMs;	// Minimum time between reports of a metric
+	uint32_t		heartbeatSec;	// Report even if unchanged this often, 0 for never
+} emtrNotifyConf_t;
+
+
 typedef struct {
 	emtrUartConf_t	uartCmd;
 	int8_t			gpioEmtrRst;
 	int				numSockets;
 	int				taskPrio;
+	emtrPollConf_t	poll;
+	// Read on every check so it may be changed at run time
+	// NULL reports every change
+	const emtrNotifyConf_t *	notify;
 } emtrDrvConf_t;
 
 
+/**
+ * \brief Items scheduled by the EMTR poll scheduler
+ */
+typedef enum {
+	emtrPollItem_state = 0,
+	emtrPollItem_power,
+	emtrPollItem_kwh,
+	emtrPollItem_temp,
+	emtrPollItem_burst,
+	emtrPollItem_num			// Must be last
+} emtrPollItem_t;
+
+
+/**
+ * \brief Timing statistics for one poll item
+ *
+ * See \ref emtrDrvGetPollStats
+ *
+ */
+typedef struct {
+	uint32_t	runCt;			// Number of times the item was polled
+	uint32_t	missedCt;		// Number of periods skipped because the poll ran late
+	uint32_t	lateAvgUs;		// Average time from deadline to poll
+	uint32_t	lateMaxUs;		// Maximum time from deadline to poll
+} emtrPollStats_t;
+
+
+/**
+ * \brief States of the EMTR link health breaker
+ */
+typedef enum {
+	emtrLinkState_closed = 0,	// Normal operation
+	emtrLinkState_open,			// Link down, commands fail at once
+	emtrLinkState_halfOpen		// EMTR answered a probe, on trial
+} emtrLinkState_t;
+
+
+/**
+ * \brief EMTR link health
+ *
+ * See \ref emtrDrvGetLinkStats
+ *
+ */
+typedef struct {
+	emtrLinkState_t	state;
+	uint32_t		failCt;		// Consecutive failed commands
+	uint32_t		tripCt;		// Number of times the link went down
+	uint32_t		probeCt;	// Probes sent while the link was down
+	uint32_t		resetCt;	// EMTR resets
+	uint32_t		backoffMs;	// Wait after the next reset
+} emtrLinkStats_t;
+
+
 /**
  * \brief Device-level status information
  *
@@ -75,7 +184,12 @@ typedef struct {
 typedef struct {
 	uint32_t	min;	// Minimum value read
 	uint32_t	max;	// Maximum value read
-	uint32_t	avg;
+	uint32_t	avg;	// Mean of the samples
+	uint32_t	twAvg;	// Mean weighted by the time each sample was held
+	uint32_t	stdDev;	// Sample standard deviation
+	uint32_t	p50;	// Estimated median
+	uint32_t	p95;	// Estimated 95th percentile
+	uint32_t	p99;	// Estimated 99th percentile
 	uint32_t	sampleCt;
 } emtrAvgEnergy_t;
 
@@ -88,6 +202,8 @@ typedef struct {
 	emtrAvgEnergy_t		mAmps;			// 0.001 Amp units
 	emtrAvgEnergy_t		dWatts;			// 0.1 Watt units
 	emtrAvgEnergy_t		powerFactor;	// 0..100
+	uint64_t			startMs;		// Uptime at start of accumulation
+	uint32_t			durationMs;		// Time covered by the samples
 } emtrAccEnergy_t;
 
 
@@ -107,6 +223,19 @@ typedef struct {
 } emtrSocketStatus_t;
 
 
+/**
+ * \brief Consistent copy of the device and all socket status
+ *
+ * See \ref emtrDrvGetAllStatus
+ *
+ */
+typedef struct {
+	emtrDeviceStatus_t	device;
+	int					numSockets;
+	emtrSocketStatus_t	socket[EMTR_DRV_MAX_SOCKETS];	// Index 0 is socket 1
+} emtrAllStatus_t;
+
+
 /**
  * \brief EMTR driver events that can be sent to registered callbacks
  *
@@ -171,6 +300,13 @@ typedef enum {
 
 esp_err_t emtrDrvCallbackRegister(emtrCbId_t cbId, eventCbFunc_t cbFunc, uint32_t cbData);
 
+esp_err_t emtrDrvCallbackSubscribe(
+	emtrCbId_t				cbId,
+	eventCbFunc_t			cbFunc,
+	uint32_t				cbData,
+	const eventSubConf_t *	conf
+);
+
 esp_err_t emtrDrvCallbackUnregister(emtrCbId_t cbId, eventCbFunc_t cbFunc);
 
 esp_err_t emtrDrvSetSocket(int outletNum, bool turnOn);
@@ -185,8 +321,18 @@ esp_err_t emtrDrvGetDeviceStatus(emtrDeviceStatus_t * ret);
 
 esp_err_t emtrDrvGetAccEnergy(int sockNum, int chan, emtrAccEnergy_t * eAcc);
 
+esp_err_t emtrDrvAccWindowOpen(int sockNum, uint32_t windowMs, int * chan);
+
+esp_err_t emtrDrvAccWindowClose(int sockNum, int chan);
+
 esp_err_t emtrDrvGetSocketStatus(int sockNum, emtrSocketStatus_t * ret);
 
+esp_err_t emtrDrvGetAllStatus(emtrAllStatus_t * ret);
+
+esp_err_t emtrDrvGetPollStats(emtrPollItem_t item, emtrPollStats_t * ret, bool reset);
+
+esp_err_t emtrDrvGetLinkStats(emtrLinkStats_t * ret);
+
 const char * emtrDrvGetFwVersion(void);
 
 const char * emtrDrvGetBlVersion(void);
@@ -199,6 +345,37 @@ esp_err_t emtrDrvGetSignature(
 	int				bufLen
 );
 
+/**
+ * \brief Function called with the result of \ref emtrDrvGetSignatureAsync
+ */
+typedef void (* emtrSigCbFunc_t)(
+	uint32_t	cbData,
+	esp_err_t	status,
+	int			sockNum,
+	uint32_t	ts,
+	uint8_t		reason,
+	uint8_t *	buf,
+	int			len
+);
+
+esp_err_t emtrDrvGetSignatureAsync(
+	int					sockNum,
+	uint8_t *			buf,
+	int					bufLen,
+	emtrSigCbFunc_t		cbFunc,
+	uint32_t			cbData
+);
+
+esp_err_t emtrDrvGetSignatureEncAsync(
+	int					sockNum,
+	uint8_t *			buf,
+	int					bufLen,
+	uint8_t *			encBuf,
+	int					encBufLen,
+	emtrSigCbFunc_t		cbFunc,
+	uint32_t			cbData
+);
+
 const char * emtrDrvEventString(emtrEvtCode_t code);
 
 
@@ -0,0 +1,93 @@
+/*
+ * sig_codec.h
+ *
+ *  Lossless codec for power signature samples
+ *
+ *  Encoded format, all multi-byte fields big-endian
+ *
+ *  Header
+ *    Offset  Len  Content
+ *         0    1  'S'
+ *         1    1  'C'
+ *         2    1  Format version, 1
+ *         3    1  Samples per block, 32
+ *         4    2  Number of samples
+ *         6    2  CRC-16 (XMODEM) of the raw sample bytes
+ *
+ *  A bit stream follows, most significant bit first, the last byte padded
+ *  with zero bits. Each block of samples holds the volts channel, then the
+ *  amps channel, each as
+ *    2 bits  Predictor order p
+ *    If p == 0, the samples verbatim, 16 bits each
+ *    Otherwise
+ *      4 bits  Rice parameter k
+ *      For each sample, the prediction residual r mapped to
+ *      u = (r << 1) ^ (r >> 31), coded as u >> k one bits, a zero bit,
+ *      then the low k bits of u
+ *
+ *  The predictors, from the previous samples of the same channel
+ *    p == 1: x[n-1]
+ *    p == 2: 2x[n-1] - x[n-2]
+ *    p == 3: 3x[n-1] - 3x[n-2] + x[n-3]
+ *  The history carries across blocks and starts as zero. The last block
+ *  holds the samples left over, it may be short.
+ *
+ *  The raw samples are 4 bytes each, volts then amps, each a signed 16-bit
+ *  big-endian ADC value as read from the EMTR.
+ */
+
+#ifndef COMPONENTS_APP_DRIVER_INCLUDE_SIG_CODEC_H_
+#define COMPONENTS_APP_DRIVER_INCLUDE_SIG_CODEC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SIG_CODEC_VERSION			(1)
+#define SIG_CODEC_HDR_SZ			(8)
+#define SIG_CODEC_BLOCK_LEN			(32)
+#define SIG_CODEC_NUM_CHANS			(2)
+#define SIG_CODEC_SMP_SZ			(4)
+
+// Largest encoded size of a number of samples, for sizing the output
+#define SIG_CODEC_MAX_ENC_SZ(n)		(SIG_CODEC_HDR_SZ + SIG_CODEC_SMP_SZ * (n) + (n) / SIG_CODEC_BLOCK_LEN + 2)
+
+
+/**
+ * \brief Encoder state
+ *
+ * Treat as opaque, use the sigEnc functions
+ */
+typedef struct {
+	uint8_t *	out;
+	int			outSz;
+	int			outLen;
+	bool		overflow;
+	uint32_t	bitBuf;
+	int			bitCt;
+	int16_t		hist[SIG_CODEC_NUM_CHANS][3];
+	int16_t		blk[SIG_CODEC_NUM_CHANS][SIG_CODEC_BLOCK_LEN];
+	int			blkCt;
+	uint8_t		part[SIG_CODEC_SMP_SZ];
+	int			partCt;
+	uint32_t	numSamples;
+	uint16_t	crc;
+} sigEnc_t;
+
+
+esp_err_t sigEncInit(sigEnc_t * enc, uint8_t * out, int outSz);
+
+esp_err_t sigEncPut(sigEnc_t * enc, const uint8_t * data, int len);
+
+esp_err_t sigEncFinish(sigEnc_t * enc, int * encLen);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPONENTS_APP_DRIVER_INCLUDE_SIG_CODEC_H_ */
@@ -0,0 +1,289 @@
+/*
+ * sig_codec.c
+ *
+ *  Lossless codec for power signature samples, see sig_codec.h for the
+ *  encoded format
+ *
+ *  The encoder takes the raw signature in pieces of any size, as pages
+ *  arrive from the EMTR, and codes each block of samples as soon as it
+ *  is complete. Its state is a single block per channel.
+ */
+#include <string.h>
+
+#include "cs_common.h"
+#include "xmodem.h"
+#include "sig_codec.h"
+
+#define MOD_NAME	"sig_codec"
+#include "mod_debug.h"
+
+
+// Predictor order meaning the block is stored verbatim
+#define ORDER_VERBATIM			(0)
+#define ORDER_MAX				(3)
+
+#define RICE_K_MAX				(15)
+
+
+static void putBits(sigEnc_t * enc, uint32_t val, int n)
+{
+	// n is at most 24 and fewer than 8 bits are ever pending
+	enc->bitBuf = (enc->bitBuf << n) | val;
+	enc->bitCt += n;
+
+	while (enc->bitCt >= 8) {
+		enc->bitCt -= 8;
+
+		if (enc->outLen < enc->outSz) {
+			enc->out[enc->outLen++] = (uint8_t)(enc->bitBuf >> enc->bitCt);
+		} else {
+			enc->overflow = true;
+		}
+	}
+}
+
+
+static inline int32_t predict(int order, int32_t x1, int32_t x2, int32_t x3)
+{
+	switch (order)
+	{
+	case 1:
+		return x1;
+	case 2:
+		return 2 * x1 - x2;
+	default:
+		return 3 * x1 - 3 * x2 + x3;
+	}
+}
+
+
+static inline uint32_t zigzag(int32_t r)
+{
+	return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+}
+
+
+/**
+ * \brief Code the pending samples of one channel
+ */
+static void encodeChan(sigEnc_t * enc, int chan, int n)
+{
+	int16_t *	hist = enc->hist[chan];
+	int16_t *	x    = enc->blk[chan];
+	uint32_t	sum[ORDER_MAX + 1] = {0};
+	int32_t		x1 = hist[0];
+	int32_t		x2 = hist[1];
+	int32_t		x3 = hist[2];
+	int			i;
+
+	// Size of the residuals of each predictor
+	for (i = 0; i < n; i++) {
+		sum[1] += zigzag(x[i] - x1);
+		sum[2] += zigzag(x[i] - (2 * x1 - x2));
+		sum[3] += zigzag(x[i] - (3 * x1 - 3 * x2 + x3));
+
+		x3 = x2;
+		x2 = x1;
+		x1 = x[i];
+	}
+
+	int	order = 1;
+	for (i = 2; i <= ORDER_MAX; i++) {
+		if (sum[i] < sum[order]) {
+			order = i;
+		}
+	}
+
+	// Rice parameter near log2 of the mean residual
+	int	k = 0;
+	while (k < RICE_K_MAX && ((uint32_t)n << (k + 1)) <= sum[order]) {
+		k += 1;
+	}
+
+	// Upper bound of the coded size
+	if ((uint32_t)n * (k + 1) + (sum[order] >> k) >= (uint32_t)n * 16) {
+		putBits(enc, ORDER_VERBATIM, 2);
+		for (i = 0; i < n; i++) {
+			putBits(enc, (uint16_t)x[i], 16);
+		}
+	} else {
+		putBits(enc, (uint32_t)order, 2);
+		putBits(enc, (uint32_t)k, 4);
+
+		x1 = hist[0];
+		x2 = hist[1];
+		x3 = hist[2];
+
+		for (i = 0; i < n; i++) {
+			uint32_t	u = zigzag(x[i] - predict(order, x1, x2, x3));
+			uint32_t	q = u >> k;
+
+			while (q >= 16) {
+				putBits(enc, 0xFFFF, 16);
+				q -= 16;
+			}
+
+			// q one bits, a zero bit, then k bits of u
+			putBits(enc, ((1u << q) - 1) << 1, q + 1);
+			putBits(enc, u & ((1u << k) - 1), k);
+
+			x3 = x2;
+			x2 = x1;
+			x1 = x[i];
+		}
+	}
+
+	// History for the next block
+	for (i = (n > 3) ? n - 3 : 0; i < n; i++) {
+		hist[2] = hist[1];
+		hist[1] = hist[0];
+		hist[0] = x[i];
+	}
+}
+
+
+static void encodeBlock(sigEnc_t * enc)
+{
+	int	chan;
+
+	for (chan = 0; chan < SIG_CODEC_NUM_CHANS; chan++) {
+		encodeChan(enc, chan, enc->blkCt);
+	}
+	enc->blkCt = 0;
+}
+
+
+static inline void addSample(sigEnc_t * enc, const uint8_t * smp)
+{
+	enc->blk[0][enc->blkCt] = (int16_t)(((uint16_t)smp[0] << 8) | smp[1]);
+	enc->blk[1][enc->blkCt] = (int16_t)(((uint16_t)smp[2] << 8) | smp[3]);
+	enc->numSamples += 1;
+
+	if (++enc->blkCt == SIG_CODEC_BLOCK_LEN) {
+		encodeBlock(enc);
+	}
+}
+
+
+/**
+ * \brief Start encoding a signature
+ *
+ * \param [in] enc Encoder state
+ * \param [in] out Buffer for the encoded signature, \ref SIG_CODEC_MAX_ENC_SZ
+ * is always enough
+ * \param [in] outSz Size of the buffer
+ *
+ * \return ESP_OK Success
+ * \return ESP_ERR_INVALID_ARG Bad parameter
+ */
+esp_err_t sigEncInit(sigEnc_t * enc, uint8_t * out, int outSz)
+{
+	if (!enc || !out || outSz < SIG_CODEC_HDR_SZ) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	memset(enc, 0, sizeof(*enc));
+	enc->out   = out;
+	enc->outSz = outSz;
+
+	// Sample count and CRC are filled in by sigEncFinish
+	enc->out[0] = 'S';
+	enc->out[1] = 'C';
+	enc->out[2] = SIG_CODEC_VERSION;
+	enc->out[3] = SIG_CODEC_BLOCK_LEN;
+	enc->outLen = SIG_CODEC_HDR_SZ;
+
+	return ESP_OK;
+}
+
+
+/**
+ * \brief Add raw signature bytes
+ *
+ * The bytes may split samples at any point
+ *
+ * \param [in] enc Encoder state
+ * \param [in] data Raw signature bytes
+ * \param [in] len Number of bytes
+ *
+ * \return ESP_OK Success
+ * \return ESP_ERR_INVALID_ARG Bad parameter
+ */
+esp_err_t sigEncPut(sigEnc_t * enc, const uint8_t * data, int len)
+{
+	if (!enc || !enc->out || (!data && len > 0)) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	enc->crc = csXmCrc16Buf(enc->crc, data, len);
+
+	// Finish a sample split by the previous call
+	while (enc->partCt > 0 && len > 0) {
+		enc->part[enc->partCt++] = *data++;
+		len -= 1;
+
+		if (SIG_CODEC_SMP_SZ == enc->partCt) {
+			addSample(enc, enc->part);
+			enc->partCt = 0;
+		}
+	}
+
+	// Whole samples
+	for (; len >= SIG_CODEC_SMP_SZ; len -= SIG_CODEC_SMP_SZ, data += SIG_CODEC_SMP_SZ) {
+		addSample(enc, data);
+	}
+
+	// Keep the start of a split sample
+	while (len-- > 0) {
+		enc->part[enc->partCt++] = *data++;
+	}
+
+	return ESP_OK;
+}
+
+
+/**
+ * \brief Code the last block and complete the header
+ *
+ * \param [in] enc Encoder state
+ * \param [out] encLen Size of the encoded signature
+ *
+ * \return ESP_OK Success
+ * \return ESP_ERR_INVALID_ARG Bad parameter
+ * \return ESP_ERR_INVALID_SIZE Raw data ended within a sample, or too many
+ * samples
+ * \return ESP_ERR_NO_MEM Output buffer too small
+ */
+esp_err_t sigEncFinish(sigEnc_t * enc, int * encLen)
+{
+	if (!enc || !enc->out || !encLen) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	if (enc->partCt > 0 || enc->numSamples > 0xFFFF) {
+		gc_err("Bad signature length (%u samples, %d bytes over)", enc->numSamples, enc->partCt);
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	if (enc->blkCt > 0) {
+		encodeBlock(enc);
+	}
+
+	// Pad the last byte
+	if (enc->bitCt > 0) {
+		putBits(enc, 0, 8 - enc->bitCt);
+	}
+
+	if (enc->overflow) {
+		gc_err("Encoded signature exceeds %d bytes", enc->outSz);
+		return ESP_ERR_NO_MEM;
+	}
+
+	enc->out[4] = (uint8_t)(enc->numSamples >> 8);
+	enc->out[5] = (uint8_t)(enc->numSamples >> 0);
+	enc->out[6] = (uint8_t)(enc->crc >> 8);
+	enc->out[7] = (uint8_t)(enc->crc >> 0);
+
+	*encLen = enc->outLen;
+	return ESP_OK;
+}
@@ -159,9 +159,16 @@ esp_err_t cap1298HandlerStart(void)
 		return ESP_FAIL;
 	}
 
-	// Register to receive Outlet Mgr events
-	emtrDrvCallbackRegister(emtrCbId_socket1, emtrCallback, CS_PTR2ADR(pCtrl));
-	emtrDrvCallbackRegister(emtrCbId_socket2, emtrCallback, CS_PTR2ADR(pCtrl));
+	// Register to receive the EMTR events that need re-calibration
+	eventSubConf_t	subConf = {
+		.deliver = eventDeliver_sync,
+		.evtMask = EVENT_CODE_BIT(emtrEvtCode_socketOn) |
+				   EVENT_CODE_BIT(emtrEvtCode_socketOff) |
+				   EVENT_CODE_BIT(emtrEvtCode_plugInserted) |
+				   EVENT_CODE_BIT(emtrEvtCode_plugRemoved)
+	};
+	emtrDrvCallbackSubscribe(emtrCbId_socket1, emtrCallback, CS_PTR2ADR(pCtrl), &subConf);
+	emtrDrvCallbackSubscribe(emtrCbId_socket2, emtrCallback, CS_PTR2ADR(pCtrl), &subConf);
 
 	pCtrl->isStarted = true;
 	return ESP_OK;
@@ -280,7 +287,7 @@ static void handleRelease(taskCtrl_t * pCtrl, capDrvSource_t btnId)
 
 			// If the button input is disabled, re-enable
 			if (!appParams.buttonsEnabled)
-				paramMgrSetBool(paramKey_buttonEnable, true);
+				paramMgrSetBoolRef(APP_PARAM(appParamId_buttonEnable), true);
 
 			csControlReboot(200, csRebootReason_user);
 			break;
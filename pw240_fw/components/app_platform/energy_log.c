@@ -0,0 +1,859 @@
+/*
+ * energy_log.c
+ *
+ *  Energy time-series log kept in the "energy_log" flash partition
+ *
+ *  The partition is used as a ring of 4 KB sectors. Each sector starts with
+ *  a header holding a sequence number and the UTC time of its first record,
+ *  followed by records appended one after another. When the newest sector
+ *  fills, the next sector in the ring (the oldest) is erased and becomes
+ *  the newest, so every sector is erased once per trip around the ring.
+ *
+ *  A RAM copy of the sector headers is the time index: a query reads only
+ *  the sectors whose time span overlaps the requested range.
+ *
+ *  Record framing
+ *    Offset  Len  Content
+ *         0    1  Payload length (0xFF marks erased flash)
+ *         1    n  Payload
+ *       1+n    2  CRC-16 (XMODEM) of length and payload, big-endian
+ *
+ *  Payload
+ *    Socket number, then as variable-length integers: seconds since the
+ *    previous record of the socket, then each value as a signed difference
+ *    from the previous record of the socket (V, A, W, PF, Wh). The first
+ *    record of a socket in a sector is relative to the sector start time
+ *    and zero, so each sector decodes on its own.
+ */
+
+#include <stddef.h>
+#include <esp_partition.h>
+
+#include "cs_common.h"
+#include "cs_platform.h"
+#include "cs_heap.h"
+#include "time_mgr.h"
+#include "xmodem.h"
+#include "emtr_drv.h"
+#include "energy_log.h"
+
+// Comment out the MOD_NAME line to disable debug prints from this file
+#define MOD_NAME	"energy_log"
+#include "mod_debug.h"
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Defines
+////////////////////////////////////////////////////////////////////////////////
+
+#define ELOG_PARTITION			"energy_log"
+#define ELOG_SECTOR_SZ			(4096)
+#define ELOG_MAGIC				(0x474F4C45)	// "ELOG"
+
+// Length of each logged interval
+#define ELOG_INTERVAL_MS		(60 * 1000)
+
+// How often to check for completed intervals
+#define ELOG_POLL_MS			(5 * 1000)
+
+// Number of values stored per record
+#define ELOG_NUM_VALUES			(5)
+
+// Largest payload: socket, time delta and values, 5 bytes each at most
+#define ELOG_PAYLOAD_MAX		(1 + 5 + 5 * ELOG_NUM_VALUES)
+#define ELOG_FRAME_MAX			(1 + ELOG_PAYLOAD_MAX + 2)
+
+#define ELOG_MUTEX_GET(ctrl)	xSemaphoreTake((ctrl)->mutex, portMAX_DELAY)
+#define ELOG_MUTEX_PUT(ctrl)	xSemaphoreGive((ctrl)->mutex)
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Data types
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * \brief Sector header as stored in flash
+ */
+typedef struct {
+	uint32_t	magic;
+	uint32_t	seq;
+	uint32_t	startTime;
+	uint16_t	crc;			// CRC-16 of the preceding fields
+	uint16_t	reserved;
+} secHeader_t;
+
+
+/**
+ * \brief RAM index entry for one sector
+ */
+typedef struct {
+	uint32_t	seq;			// 0 if the sector holds no valid header
+	uint32_t	startTime;
+} secIndex_t;
+
+
+/**
+ * \brief Delta coding state for one socket within a sector
+ */
+typedef struct {
+	uint32_t	time;
+	uint32_t	value[ELOG_NUM_VALUES];
+} encState_t;
+
+
+/**
+ * \brief Walks the records of one sector held in RAM
+ */
+typedef struct {
+	const uint8_t *	buf;
+	uint32_t		offset;
+	encState_t		enc[NUM_SOCKETS];
+} secReader_t;
+
+
+typedef struct {
+	int				accChan;	// Accumulator window, -1 until opened
+	bool			haveWh;
+	uint64_t		prevWh;
+} sockLog_t;
+
+
+typedef struct {
+	bool					isStarted;
+	const esp_partition_t *	part;
+	SemaphoreHandle_t		mutex;
+	TaskHandle_t			taskHandle;
+	int						numSectors;
+	secIndex_t *			index;
+	int						headSec;	// Sector being appended, -1 if none
+	uint32_t				headOffset;
+	uint32_t				headTime;	// Time of the newest record
+	uint32_t				nextSeq;
+	encState_t				enc[NUM_SOCKETS];
+	sockLog_t				sock[NUM_SOCKETS];
+	uint32_t				writeCt;
+	uint32_t				errorCt;
+} control_t;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Local functions
+////////////////////////////////////////////////////////////////////////////////
+
+static esp_err_t mountLog(control_t * pCtrl, uint8_t * secBuf);
+
+static void readerInit(secReader_t * rd, const uint8_t * buf, uint32_t startTime);
+
+static int readerNext(secReader_t * rd, energyLogRec_t * rec);
+
+static void logTask(void * param);
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Local data
+////////////////////////////////////////////////////////////////////////////////
+
+static control_t *	control;
+
+
+/**
+ * \brief Initialize the energy log
+ *
+ * Locates the partition and rebuilds the time index from the sector headers
+ */
+esp_err_t energyLogInit(void)
+{
+	control_t *		pCtrl = control;
+	if (NULL != pCtrl)
+		return ESP_OK;
+
+	const esp_partition_t *	part;
+
+	part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, ELOG_PARTITION);
+	if (NULL == part) {
+		gc_err("Partition \"%s\" not defined", ELOG_PARTITION);
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	esp_err_t	status;
+	uint8_t *	secBuf = NULL;
+
+	if ((pCtrl = cs_heap_calloc(1, sizeof(*pCtrl))) == NULL)
+		return ESP_ERR_NO_MEM;
+
+	pCtrl->part       = part;
+	pCtrl->numSectors = part->size / ELOG_SECTOR_SZ;
+	pCtrl->headSec    = -1;
+	pCtrl->nextSeq    = 1;
+
+	int		i;
+	for (i = 0; i < NUM_SOCKETS; i++) {
+		pCtrl->sock[i].accChan = -1;
+	}
+
+	pCtrl->index = cs_heap_calloc(pCtrl->numSectors, sizeof(secIndex_t));
+	secBuf       = cs_heap_malloc(ELOG_SECTOR_SZ);
+	if (NULL == pCtrl->index || NULL == secBuf) {
+		status = ESP_ERR_NO_MEM;
+		goto exitMem;
+	}
+
+	if ((pCtrl->mutex = xSemaphoreCreateMutex()) == NULL) {
+		status = ESP_FAIL;
+		goto exitMem;
+	}
+
+	if ((status = mountLog(pCtrl, secBuf)) != ESP_OK) {
+		goto exitMem;
+	}
+
+	cs_heap_free(secBuf);
+	control = pCtrl;
+	return ESP_OK;
+
+exitMem:
+	if (pCtrl->mutex)
+		vSemaphoreDelete(pCtrl->mutex);
+	if (secBuf)
+		cs_heap_free(secBuf);
+	if (pCtrl->index)
+		cs_heap_free(pCtrl->index);
+	cs_heap_free(pCtrl);
+	return status;
+}
+
+
+esp_err_t energyLogStart(void)
+{
+	control_t *		pCtrl = control;
+	if (NULL == pCtrl)
+		return ESP_FAIL;
+
+	if (pCtrl->isStarted)
+		return ESP_OK;
+
+	BaseType_t	ret;
+
+	ret = xTaskCreate(
+		logTask,
+		"energyLogTask",
+		3072,
+		(void *)pCtrl,
+		TASK_PRIO_ENERGY_LOG,
+		&pCtrl->taskHandle
+	);
+	if (pdTRUE != ret) {
+		return ESP_FAIL;
+	}
+
+	pCtrl->isStarted = true;
+	return ESP_OK;
+}
+
+
+/**
+ * \brief Read logged records for a time range
+ *
+ * Records are returned in the order they were logged. Only the sectors
+ * whose time span overlaps the range are read.
+ *
+ * \param [in] fromTime Start of the range, UTC seconds, inclusive
+ * \param [in] toTime End of the range, UTC seconds, exclusive
+ * \param [out] buf Array to receive the records
+ * \param [in] bufSz Number of entries in buf
+ * \param [out] count Receives the number of records returned
+ * \param [out] nextTime If more records match than fit in buf, receives the
+ * fromTime to pass to the next call, otherwise 0
+ *
+ * \return ESP_OK Success
+ * \return ESP_ERR_INVALID_SIZE buf is too small to hold the records of a
+ * single timestamp
+ */
+esp_err_t energyLogQuery(
+	uint32_t			fromTime,
+	uint32_t			toTime,
+	energyLogRec_t *	buf,
+	int					bufSz,
+	int *				count,
+	uint32_t *			nextTime
+)
+{
+	control_t *		pCtrl = control;
+	if (NULL == pCtrl)
+		return ESP_FAIL;
+
+	if (!buf || bufSz <= 0 || !count || !nextTime) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	*count    = 0;
+	*nextTime = 0;
+
+	uint8_t *	secBuf = cs_heap_malloc(ELOG_SECTOR_SZ);
+	if (NULL == secBuf)
+		return ESP_ERR_NO_MEM;
+
+	esp_err_t	status = ESP_OK;
+	int			numRec = 0;
+	bool		isFull = false;
+	int			i;
+
+	ELOG_MUTEX_GET(pCtrl);
+
+	// Walk the ring from the oldest sector to the newest
+	int		sec = (pCtrl->headSec < 0) ? 0 : (pCtrl->headSec + 1) % pCtrl->numSectors;
+
+	for (i = 0; i < pCtrl->numSectors && !isFull; i++, sec = (sec + 1) % pCtrl->numSectors) {
+		secIndex_t *	idx = &pCtrl->index[sec];
+		if (0 == idx->seq)
+			continue;
+
+		// The sector ends where the next one starts
+		uint32_t	endTime = UINT32_MAX;
+		if (sec != pCtrl->headSec) {
+			secIndex_t *	nxt = &pCtrl->index[(sec + 1) % pCtrl->numSectors];
+			if (nxt->seq == idx->seq + 1 && nxt->startTime >= idx->startTime) {
+				endTime = nxt->startTime;
+			}
+		}
+
+		if (endTime < fromTime || idx->startTime >= toTime)
+			continue;
+
+		uint32_t	rdLen = (sec == pCtrl->headSec) ? pCtrl->headOffset : ELOG_SECTOR_SZ;
+
+		status = esp_partition_read(pCtrl->part, sec * ELOG_SECTOR_SZ, secBuf, rdLen);
+		if (ESP_OK != status) {
+			gc_err("Sector %d read failed", sec);
+			pCtrl->errorCt += 1;
+			break;
+		}
+		if (rdLen < ELOG_SECTOR_SZ) {
+			memset(secBuf + rdLen, 0xFF, ELOG_SECTOR_SZ - rdLen);
+		}
+
+		secReader_t		rd;
+		energyLogRec_t	rec;
+
+		readerInit(&rd, secBuf, idx->startTime);
+		while (readerNext(&rd, &rec) > 0) {
+			if (rec.time < fromTime || rec.time >= toTime)
+				continue;
+
+			if (numRec < bufSz) {
+				buf[numRec++] = rec;
+				continue;
+			}
+
+			// Out of room. Drop the records sharing the time of this one so
+			// the next call can resume at that time without repeating any
+			while (numRec > 0 && buf[numRec - 1].time == rec.time) {
+				numRec -= 1;
+			}
+			if (0 == numRec) {
+				status = ESP_ERR_INVALID_SIZE;
+			}
+			*nextTime = rec.time;
+			isFull    = true;
+			break;
+		}
+	}
+
+	ELOG_MUTEX_PUT(pCtrl);
+
+	cs_heap_free(secBuf);
+	*count = numRec;
+	return status;
+}
+
+
+esp_err_t energyLogGetInfo(energyLogInfo_t * info)
+{
+	control_t *		pCtrl = control;
+	if (NULL == pCtrl)
+		return ESP_FAIL;
+
+	if (!info)
+		return ESP_ERR_INVALID_ARG;
+
+	ELOG_MUTEX_GET(pCtrl);
+
+	info->numSectors  = pCtrl->numSectors;
+	info->usedSectors = 0;
+	info->oldestTime  = 0;
+	info->writeCt     = pCtrl->writeCt;
+	info->errorCt     = pCtrl->errorCt;
+
+	uint32_t	oldestSeq = UINT32_MAX;
+	int			i;
+
+	for (i = 0; i < pCtrl->numSectors; i++) {
+		secIndex_t *	idx = &pCtrl->index[i];
+		if (0 == idx->seq)
+			continue;
+
+		info->usedSectors += 1;
+		if (idx->seq < oldestSeq) {
+			oldestSeq        = idx->seq;
+			info->oldestTime = idx->startTime;
+		}
+	}
+
+	ELOG_MUTEX_PUT(pCtrl);
+	return ESP_OK;
+}
+
+
+/**
+ * \brief Erase the whole log
+ */
+esp_err_t energyLogErase(void)
+{
+	control_t *		pCtrl = control;
+	if (NULL == pCtrl)
+		return ESP_FAIL;
+
+	esp_err_t	status;
+
+	ELOG_MUTEX_GET(pCtrl);
+
+	status = esp_partition_erase_range(pCtrl->part, 0, pCtrl->numSectors * ELOG_SECTOR_SZ);
+	if (ESP_OK != status) {
+		gc_err("Partition erase failed");
+		pCtrl->errorCt += 1;
+	}
+
+	memset(pCtrl->index, 0, pCtrl->numSectors * sizeof(secIndex_t));
+	pCtrl->headSec = -1;
+	pCtrl->nextSeq = 1;
+
+	ELOG_MUTEX_PUT(pCtrl);
+	return status;
+}
+
+
+/*
+********************************************************************************
+********************************************************************************
+** Local functions
+********************************************************************************
+********************************************************************************
+*/
+
+
+static uint16_t calcCrc(const uint8_t * data, int len)
+{
+	uint16_t	crc = 0;
+
+	while (len-- > 0) {
+		crc = csXmCrc16(crc, *data++);
+	}
+	return crc;
+}
+
+
+static int putVarint(uint8_t * buf, uint32_t value)
+{
+	int		len = 0;
+
+	while (value >= 0x80) {
+		buf[len++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	buf[len++] = (uint8_t)value;
+	return len;
+}
+
+
+/**
+ * \return Number of bytes used, 0 if the value runs past the end
+ */
+static int getVarint(const uint8_t * buf, int bufLen, uint32_t * value)
+{
+	uint32_t	result = 0;
+	int			shift  = 0;
+	int			len    = 0;
+
+	while (len < bufLen && shift < 35) {
+		uint8_t		b = buf[len++];
+
+		result |= ((uint32_t)(b & 0x7F)) << shift;
+		if (0 == (b & 0x80)) {
+			*value = result;
+			return len;
+		}
+		shift += 7;
+	}
+	return 0;
+}
+
+
+static uint32_t zigZag(int32_t value)
+{
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+
+static int32_t unZigZag(uint32_t value)
+{
+	return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+
+static void recValues(const energyLogRec_t * rec, uint32_t * value)
+{
+	value[0] = rec->dVolts;
+	value[1] = rec->mAmps;
+	value[2] = rec->dWatts;
+	value[3] = rec->powerFactor;
+	value[4] = rec->wattHours;
+}
+
+
+static void encInit(encState_t * enc, uint32_t startTime)
+{
+	int		i;
+
+	for (i = 0; i < NUM_SOCKETS; i++, enc++) {
+		memset(enc, 0, sizeof(*enc));
+		enc->time = startTime;
+	}
+}
+
+
+static void readerInit(secReader_t * rd, const uint8_t * buf, uint32_t startTime)
+{
+	rd->buf    = buf;
+	rd->offset = sizeof(secHeader_t);
+	encInit(rd->enc, startTime);
+}
+
+
+/**
+ * \brief Decode the next record of a sector
+ *
+ * \return 1 Record decoded
+ * \return 0 End of the records
+ * \return -1 Record damaged, the rest of the sector is ignored
+ */
+static int readerNext(secReader_t * rd, energyLogRec_t * rec)
+{
+	if (rd->offset + 1 > ELOG_SECTOR_SZ)
+		return 0;
+
+	const uint8_t *	frame = rd->buf + rd->offset;
+	int				pLen  = frame[0];
+
+	if (0xFF == pLen)
+		return 0;
+
+	if (0 == pLen || pLen > ELOG_PAYLOAD_MAX || rd->offset + 1 + pLen + 2 > ELOG_SECTOR_SZ)
+		return -1;
+
+	uint16_t	crc = ((uint16_t)frame[1 + pLen]) << 8 | ((uint16_t)frame[2 + pLen]) << 0;
+	if (calcCrc(frame, 1 + pLen) != crc)
+		return -1;
+
+	const uint8_t *	payload = frame + 1;
+	int				idx = 0;
+	int				len;
+	uint32_t		raw;
+	int				sIdx = payload[idx++] - 1;
+
+	if (sIdx < 0 || sIdx >= NUM_SOCKETS)
+		return -1;
+
+	encState_t *	enc = &rd->enc[sIdx];
+
+	if ((len = getVarint(payload + idx, pLen - idx, &raw)) == 0)
+		return -1;
+	idx += len;
+	enc->time += (uint32_t)unZigZag(raw);
+
+	int		i;
+	for (i = 0; i < ELOG_NUM_VALUES; i++) {
+		if ((len = getVarint(payload + idx, pLen - idx, &raw)) == 0)
+			return -1;
+		idx += len;
+		enc->value[i] += (uint32_t)unZigZag(raw);
+	}
+
+	rec->time        = enc->time;
+	rec->sockNum     = 1 + sIdx;
+	rec->dVolts      = enc->value[0];
+	rec->mAmps       = enc->value[1];
+	rec->dWatts      = enc->value[2];
+	rec->powerFactor = enc->value[3];
+	rec->wattHours   = enc->value[4];
+
+	rd->offset += 1 + pLen + 2;
+	return 1;
+}
+
+
+static bool readHeader(control_t * pCtrl, int sec, secHeader_t * hdr)
+{
+	if (esp_partition_read(pCtrl->part, sec * ELOG_SECTOR_SZ, hdr, sizeof(*hdr)) != ESP_OK)
+		return false;
+
+	if (ELOG_MAGIC != hdr->magic || 0 == hdr->seq)
+		return false;
+
+	return (calcCrc((uint8_t *)hdr, offsetof(secHeader_t, crc)) == hdr->crc);
+}
+
+
+/**
+ * \brief Rebuild the RAM index and find where to append
+ */
+static esp_err_t mountLog(control_t * pCtrl, uint8_t * secBuf)
+{
+	secHeader_t		hdr;
+	uint32_t		maxSeq = 0;
+	int				sec;
+
+	for (sec = 0; sec < pCtrl->numSectors; sec++) {
+		secIndex_t *	idx = &pCtrl->index[sec];
+
+		if (readHeader(pCtrl, sec, &hdr)) {
+			idx->seq       = hdr.seq;
+			idx->startTime = hdr.startTime;
+
+			if (hdr.seq > maxSeq) {
+				maxSeq        = hdr.seq;
+				pCtrl->headSec = sec;
+			}
+		} else {
+			idx->seq = 0;
+		}
+	}
+
+	if (pCtrl->headSec < 0) {
+		gc_dbg("Energy log is empty");
+		return ESP_OK;
+	}
+
+	pCtrl->nextSeq = maxSeq + 1;
+
+	// Find the end of the newest sector and the coding state at that point
+	sec = pCtrl->headSec;
+	if (esp_partition_read(pCtrl->part, sec * ELOG_SECTOR_SZ, secBuf, ELOG_SECTOR_SZ) != ESP_OK) {
+		gc_err("Sector %d read failed", sec);
+		pCtrl->headOffset = ELOG_SECTOR_SZ;
+		return ESP_OK;
+	}
+
+	secReader_t		rd;
+	energyLogRec_t	rec;
+	int				ret;
+	uint32_t		recCt = 0;
+
+	readerInit(&rd, secBuf, pCtrl->index[sec].startTime);
+	pCtrl->headTime = pCtrl->index[sec].startTime;
+	while ((ret = readerNext(&rd, &rec)) > 0) {
+		if (rec.time > pCtrl->headTime)
+			pCtrl->headTime = rec.time;
+		recCt += 1;
+	}
+
+	if (ret < 0) {
+		// Interrupted write, start a new sector with the next record
+		gc_err("Sector %d damaged at offset %u", sec, rd.offset);
+		pCtrl->headOffset = ELOG_SECTOR_SZ;
+	} else {
+		pCtrl->headOffset = rd.offset;
+		memcpy(pCtrl->enc, rd.enc, sizeof(pCtrl->enc));
+	}
+
+	gc_dbg("Energy log sector %d seq %u, %u records", sec, maxSeq, recCt);
+	return ESP_OK;
+}
+
+
+/**
+ * \brief Erase the oldest sector and make it the newest
+ */
+static esp_err_t openSector(control_t * pCtrl, uint32_t startTime)
+{
+	int				sec = (pCtrl->headSec + 1) % pCtrl->numSectors;
+	secIndex_t *	idx = &pCtrl->index[sec];
+	esp_err_t		status;
+
+	// The sector is gone from the index as soon as erasing starts
+	idx->seq = 0;
+
+	status = esp_partition_erase_range(pCtrl->part, sec * ELOG_SECTOR_SZ, ELOG_SECTOR_SZ);
+	if (ESP_OK != status) {
+		gc_err("Sector %d erase failed", sec);
+		goto exitError;
+	}
+
+	secHeader_t		hdr = {
+		.magic     = ELOG_MAGIC,
+		.seq       = pCtrl->nextSeq,
+		.startTime = startTime,
+		.reserved  = 0xFFFF
+	};
+	hdr.crc = calcCrc((uint8_t *)&hdr, offsetof(secHeader_t, crc));
+
+	status = esp_partition_write(pCtrl->part, sec * ELOG_SECTOR_SZ, &hdr, sizeof(hdr));
+	if (ESP_OK != status) {
+		gc_err("Sector %d header write failed", sec);
+		goto exitError;
+	}
+
+	idx->seq       = hdr.seq;
+	idx->startTime = startTime;
+
+	pCtrl->nextSeq   += 1;
+	pCtrl->headSec    = sec;
+	pCtrl->headOffset = sizeof(hdr);
+	pCtrl->headTime   = startTime;
+	encInit(pCtrl->enc, startTime);
+	return ESP_OK;
+
+exitError:
+	// Skip past the bad sector on the next attempt
+	pCtrl->errorCt   += 1;
+	pCtrl->headSec    = sec;
+	pCtrl->headOffset = ELOG_SECTOR_SZ;
+	return status;
+}
+
+
+/**
+ * \brief Append one record to the log
+ */
+static esp_err_t appendRecord(control_t * pCtrl, const energyLogRec_t * rec)
+{
+	esp_err_t	status = ESP_OK;
+
+	ELOG_MUTEX_GET(pCtrl);
+
+	// Time going backwards would break the index ordering, so it also
+	// starts a new sector
+	if (pCtrl->headSec < 0 ||
+		pCtrl->headOffset + ELOG_FRAME_MAX > ELOG_SECTOR_SZ ||
+		rec->time < pCtrl->headTime) {
+		if ((status = openSector(pCtrl, rec->time)) != ESP_OK) {
+			goto exitMutex;
+		}
+	}
+
+	uint8_t			frame[ELOG_FRAME_MAX];
+	uint8_t *		payload = frame + 1;
+	encState_t *	enc = &pCtrl->enc[rec->sockNum - 1];
+	uint32_t		value[ELOG_NUM_VALUES];
+	int				pLen = 0;
+	int				i;
+
+	payload[pLen++] = (uint8_t)rec->sockNum;
+	pLen += putVarint(payload + pLen, zigZag((int32_t)(rec->time - enc->time)));
+
+	recValues(rec, value);
+	for (i = 0; i < ELOG_NUM_VALUES; i++) {
+		pLen += putVarint(payload + pLen, zigZag((int32_t)(value[i] - enc->value[i])));
+	}
+
+	frame[0] = (uint8_t)pLen;
+
+	uint16_t	crc = calcCrc(frame, 1 + pLen);
+	frame[1 + pLen] = (uint8_t)(crc >> 8);
+	frame[2 + pLen] = (uint8_t)(crc >> 0);
+
+	status = esp_partition_write(
+		pCtrl->part,
+		pCtrl->headSec * ELOG_SECTOR_SZ + pCtrl->headOffset,
+		frame,
+		1 + pLen + 2
+	);
+	if (ESP_OK != status) {
+		gc_err("Record write failed");
+		pCtrl->errorCt   += 1;
+		pCtrl->headOffset = ELOG_SECTOR_SZ;
+		goto exitMutex;
+	}
+
+	pCtrl->headOffset += 1 + pLen + 2;
+	pCtrl->headTime    = rec->time;
+	pCtrl->writeCt    += 1;
+
+	enc->time = rec->time;
+	memcpy(enc->value, value, sizeof(value));
+
+exitMutex:
+	ELOG_MUTEX_PUT(pCtrl);
+	return status;
+}
+
+
+/**
+ * \brief Log the interval of a socket if it has completed
+ */
+static void logSocket(control_t * pCtrl, int sIdx)
+{
+	sockLog_t *		sock    = &pCtrl->sock[sIdx];
+	int				sockNum = 1 + sIdx;
+
+	if (sock->accChan < 0) {
+		if (emtrDrvAccWindowOpen(sockNum, ELOG_INTERVAL_MS, &sock->accChan) != ESP_OK) {
+			sock->accChan = -1;
+			return;
+		}
+	}
+
+	emtrAccEnergy_t		acc;
+	if (emtrDrvGetAccEnergy(sockNum, sock->accChan, &acc) != ESP_OK)
+		return;
+
+	// Energy used since the previous interval
+	emtrSocketStatus_t	stat;
+	uint32_t			wattHours = 0;
+
+	if (emtrDrvGetSocketStatus(sockNum, &stat) == ESP_OK) {
+		if (sock->haveWh) {
+			// A smaller count means the EMTR has restarted its counter
+			wattHours = (uint32_t)((stat.dWattHours >= sock->prevWh) ?
+				stat.dWattHours - sock->prevWh : stat.dWattHours);
+		}
+		sock->prevWh = stat.dWattHours;
+		sock->haveWh = true;
+	}
+
+	if (0 == acc.dWatts.sampleCt)
+		return;
+
+	// Convert the end of the interval from uptime to UTC
+	uint64_t		endMs = acc.startMs + acc.durationMs;
+	uint64_t		ageMs = timeMgrGetUptimeMs() - endMs;
+	energyLogRec_t	rec = {
+		.time        = timeMgrGetUtcTime() - (uint32_t)(ageMs / 1000),
+		.sockNum     = sockNum,
+		.dVolts      = acc.dVolts.twAvg,
+		.mAmps       = acc.mAmps.twAvg,
+		.dWatts      = acc.dWatts.twAvg,
+		.powerFactor = acc.powerFactor.twAvg,
+		.wattHours   = wattHours
+	};
+
+	appendRecord(pCtrl, &rec);
+}
+
+
+static void logTask(void * param)
+{
+	control_t *		pCtrl = (control_t *)param;
+	int				sIdx;
+
+	while (1) {
+		vTaskDelay(pdMS_TO_TICKS(ELOG_POLL_MS));
+
+		// Records are indexed by UTC time, nothing to do until it is known
+		if (!timeMgrUtcIsSet())
+			continue;
+
+		for (sIdx = 0; sIdx < NUM_SOCKETS; sIdx++) {
+			logSocket(pCtrl, sIdx);
+		}
+	}
+}
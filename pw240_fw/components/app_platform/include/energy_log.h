@@ -0,0 +1,64 @@
+/*
+ * energy_log.h
+ *
+ *  Energy time-series log kept in the "energy_log" flash partition
+ */
+
+#ifndef COMPONENTS_APP_PLATFORM_INCLUDE_ENERGY_LOG_H_
+#define COMPONENTS_APP_PLATFORM_INCLUDE_ENERGY_LOG_H_
+
+#include "cs_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief One logged interval for one socket
+ */
+typedef struct {
+	uint32_t	time;			// UTC seconds at the end of the interval
+	int			sockNum;
+	uint32_t	dVolts;			// Average, 0.1 volt units
+	uint32_t	mAmps;			// Average, 0.001 Amp units
+	uint32_t	dWatts;			// Average, 0.1 Watt units
+	uint32_t	powerFactor;	// Average, 0..100
+	uint32_t	wattHours;		// Energy used during the interval
+} energyLogRec_t;
+
+
+/**
+ * \brief Summary of the log contents
+ */
+typedef struct {
+	int			numSectors;		// Sectors in the partition
+	int			usedSectors;	// Sectors holding records
+	uint32_t	oldestTime;		// Start time of the oldest sector
+	uint32_t	writeCt;		// Records written since boot
+	uint32_t	errorCt;		// Flash errors since boot
+} energyLogInfo_t;
+
+
+esp_err_t energyLogInit(void);
+
+esp_err_t energyLogStart(void);
+
+esp_err_t energyLogQuery(
+	uint32_t			fromTime,
+	uint32_t			toTime,
+	energyLogRec_t *	buf,
+	int					bufSz,
+	int *				count,
+	uint32_t *			nextTime
+);
+
+esp_err_t energyLogGetInfo(energyLogInfo_t * info);
+
+esp_err_t energyLogErase(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPONENTS_APP_PLATFORM_INCLUDE_ENERGY_LOG_H_ */
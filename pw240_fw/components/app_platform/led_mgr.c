@@ -390,7 +390,7 @@ esp_err_t ledMgrSetBrightness(int level, callCtx_t ctx)
 
 	if (callCtx_null != ctx) {
 		// Store the parameter
-		paramMgrSetU8("brightness", (uint8_t)level);
+		paramMgrSetU8Ref(APP_PARAM(appParamId_ledBrightness), (uint8_t)level);
 	}
 
 	// Adjust the LED
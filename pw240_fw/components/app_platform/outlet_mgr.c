@@ -21,9 +21,9 @@ typedef struct {
 	csLedNum_t		ledNum;
 	emtrCbId_t		cbId;
 	eventCbFunc_t	cbFunc;
-	const char *	paramKey_on;
-	const char *	paramKey_type;
-	const char *	paramKey_name;
+	csParamTab_t *	param_on;
+	csParamTab_t *	param_type;
+	csParamTab_t *	param_name;
 } const info_t;
 
 
@@ -68,17 +68,17 @@ static info_t	socketInfo[NUM_SOCKETS] = {
 		.ledNum        = csLedNum_socket1,
 		.cbId          = emtrCbId_socket1,
 		.cbFunc        = emtrSocket1EvtCb,
-		.paramKey_on   = paramKey_socket1On,
-		.paramKey_type = paramKey_socket1Type,
-		.paramKey_name = paramKey_socket1Name
+		.param_on      = APP_PARAM(appParamId_socket1On),
+		.param_type    = APP_PARAM(appParamId_socket1Type),
+		.param_name    = APP_PARAM(appParamId_socket1Name)
 	},
 	{
 		.ledNum        = csLedNum_socket2,
 		.cbId          = emtrCbId_socket2,
 		.cbFunc        = emtrSocket2EvtCb,
-		.paramKey_on   = paramKey_socket2On,
-		.paramKey_type = paramKey_socket2Type,
-		.paramKey_name = paramKey_socket2Name
+		.param_on      = APP_PARAM(appParamId_socket2On),
+		.param_type    = APP_PARAM(appParamId_socket2Type),
+		.param_name    = APP_PARAM(appParamId_socket2Name)
 	}
 };
 
@@ -97,6 +97,7 @@ esp_err_t outletMgrInit(void)
 
 	if (eventRegisterCreate(&pCtrl->cbHandle) != ESP_OK)
 		return ESP_FAIL;
+	eventSetDataSize(pCtrl->cbHandle, sizeof(outletMgrEvtData_t));
 
 	// Attach static info to each socket control block
 	int		i;
@@ -138,11 +139,17 @@ esp_err_t outletMgrStart(void)
 	socket_t *	socket = pCtrl->socket;
 	uint32_t	cbData = CS_PTR2ADR(pCtrl);
 
+	// Only the on/off events drive the LEDs
+	eventSubConf_t	subConf = {
+		.deliver = eventDeliver_sync,
+		.evtMask = EVENT_CODE_BIT(emtrEvtCode_socketOn) | EVENT_CODE_BIT(emtrEvtCode_socketOff)
+	};
+
 	for (oIdx = 0; oIdx < NUM_SOCKETS; oIdx++, socket++) {
 		info_t *	pInfo = socket->pInfo;
 
 		// Register the callback function for this socket
-		emtrDrvCallbackRegister(pInfo->cbId, pInfo->cbFunc, cbData);
+		emtrDrvCallbackSubscribe(pInfo->cbId, pInfo->cbFunc, cbData, &subConf);
 	}
 
 	pCtrl->isStarted = true;
@@ -176,7 +183,7 @@ esp_err_t outletMgrSetSocket(int sockNum, bool value, callCtx_t ctx, appDeltaSrc
 
 	socket_t *	sock = &pCtrl->socket[oIdx];
 
-	paramMgrSetBool(sock->pInfo->paramKey_on, value);
+	paramMgrSetBoolRef(sock->pInfo->param_on, value);
 	emtrDrvSetSocket(sockNum, value);
 
 	// Notify interested parties of the event
@@ -212,7 +219,7 @@ esp_err_t outletMgrSetType(int sockNum, uint32_t value, callCtx_t ctx)
 
 	socket_t *	sock = &pCtrl->socket[oIdx];
 
-	paramMgrSetU32(sock->pInfo->paramKey_type, value);
+	paramMgrSetU32Ref(sock->pInfo->param_type, value);
 
 	// Notify interested parties of the event
 	outletMgrEvtData_t	evtData;
@@ -242,7 +249,7 @@ esp_err_t outletMgrSetName(int sockNum, const char * value, callCtx_t ctx)
 
 	socket_t *	sock = &pCtrl->socket[oIdx];
 
-	paramMgrSetStr(sock->pInfo->paramKey_name, value);
+	paramMgrSetStrRef(sock->pInfo->param_name, value);
 
 	// Notify interested parties of the event
 	outletMgrEvtData_t	evtData;
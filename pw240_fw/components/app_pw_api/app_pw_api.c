@@ -16,6 +16,7 @@
 #include "cs_rpc_proc.h"
 #include "cJSON.h"
 #include "cs_json_utils.h"
+#include "cs_json_writer.h"
 #include "cs_control.h"
 #include "outlet_mgr.h"
 #include "app_led_mgr.h"
@@ -32,6 +33,17 @@
 
 #define POLL_FREQUENCY_MINUTES (15)
 
+// Request bodies are streamed to the HTTP client through a buffer this size
+#define POST_CHUNK_SZ (256)
+
+// Redirects followed by a POST, the esp_http_client default
+#define POST_MAX_REDIRECTS (10)
+
+// Socket events that can wait for the API task, and how long the EMTR driver
+// waits for room before one is dropped
+#define PW_API_EVT_QUEUE_SZ (16)
+#define PW_API_EVT_BLOCK_MS (200)
+
 extern const uint8_t server_root_cert_pem_start[] asm("_binary_server_root_cert_pem_start");
 extern const uint8_t server_root_cert_pem_end[]   asm("_binary_server_root_cert_pem_end");
 
@@ -247,12 +259,25 @@ esp_err_t appPWApiStart(void)
 		return ESP_FAIL;
 	}
 
-	//register sockets callback
-	if (emtrDrvCallbackRegister(emtrCbId_socket1, emtrSocketEvtCb, CS_PTR2ADR(pCtrl)) != ESP_OK ){
+	//register sockets callback, delivered from its own task so that building
+	//and queuing the events does not hold up the EMTR driver. These are state
+	//changes the gateway needs every one of, so a full queue holds the driver
+	//for a while rather than dropping one
+	eventSubConf_t	subConf = EVENT_SUB_CONF_DEFAULT();
+	subConf.name     = "pwApiEmtr";
+	subConf.queueSz  = PW_API_EVT_QUEUE_SZ;
+	subConf.overflow = eventOverflow_block;
+	subConf.blockMs  = PW_API_EVT_BLOCK_MS;
+	subConf.evtMask = EVENT_CODE_BIT(emtrEvtCode_socketOn) |
+					  EVENT_CODE_BIT(emtrEvtCode_socketOff) |
+					  EVENT_CODE_BIT(emtrEvtCode_plugInserted) |
+					  EVENT_CODE_BIT(emtrEvtCode_plugRemoved);
+
+	if (emtrDrvCallbackSubscribe(emtrCbId_socket1, emtrSocketEvtCb, CS_PTR2ADR(pCtrl), &subConf) != ESP_OK ){
 		csControlCallbackUnregister(sysEventCb);
 		return ESP_FAIL;
 	}
-	if(emtrDrvCallbackRegister(emtrCbId_socket2, emtrSocketEvtCb, CS_PTR2ADR(pCtrl)) != ESP_OK ){
+	if(emtrDrvCallbackSubscribe(emtrCbId_socket2, emtrSocketEvtCb, CS_PTR2ADR(pCtrl), &subConf) != ESP_OK ){
 		csControlCallbackUnregister(sysEventCb);
 		emtrDrvCallbackUnregister(emtrCbId_socket1, emtrSocketEvtCb);
 		return ESP_FAIL;
@@ -338,6 +363,141 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt)
     return ESP_OK;
 }
 
+// Writes a request body, called twice for each request, so it must write
+// the same text each time
+typedef void (*jsonBody_t)(csJsonWriter_t * jw, const void * arg);
+
+/**
+ * \brief Take a full writer buffer, sending it to the server
+ */
+static esp_err_t httpWriteChunk(void * cbData, const char * data, int len)
+{
+	esp_http_client_handle_t	client = (esp_http_client_handle_t)cbData;
+
+	if (esp_http_client_write(client, data, len) != len) {
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+/**
+ * \brief POST a JSON body, streamed without building it in memory
+ *
+ * The body is written once to learn its length for the Content-Length
+ * header, then again to the connection. The response is collected in
+ * local_response_buffer by the event handler.
+ *
+ * Redirects and an authentication challenge are followed as
+ * esp_http_client_perform does. A 307 or 308 writes the body again to the
+ * new location, a 301, 302 or 303 fetches it with a GET and no body.
+ */
+static esp_err_t http_post_json(control_t * pCtrl, const char * url, jsonBody_t body, const void * arg)
+{
+	csJsonWriter_t	jw;
+	char			chunk[POST_CHUNK_SZ];
+	esp_err_t		err;
+	int				len = 0;
+	int				attempt;
+	bool			authSent = false;
+	bool			sendBody = true;
+
+	esp_http_client_set_url(pCtrl->client, url);
+
+	for (attempt = 0; attempt <= POST_MAX_REDIRECTS; attempt++) {
+		if (sendBody) {
+			// Measure
+			csJsonWriterInit(&jw, NULL, 0, NULL, NULL);
+			body(&jw, arg);
+			if ((err = csJsonWriterFinish(&jw)) != ESP_OK) {
+				gc_err("JSON body failed: %s", esp_err_to_name(err));
+				return err;
+			}
+			len = csJsonWriterLen(&jw);
+
+			gc_dbg("HTTP POST %d bytes to \"%s\"", len, url);
+			esp_http_client_set_method(pCtrl->client, HTTP_METHOD_POST);
+			esp_http_client_set_header(pCtrl->client, "Content-Type", "application/json");
+		} else {
+			len = 0;
+			esp_http_client_set_method(pCtrl->client, HTTP_METHOD_GET);
+			esp_http_client_delete_header(pCtrl->client, "Content-Type");
+		}
+
+		if ((err = esp_http_client_open(pCtrl->client, len)) != ESP_OK) {
+			gc_err("HTTP open failed: %s", esp_err_to_name(err));
+			return err;
+		}
+
+		if (sendBody) {
+			// Send
+			csJsonWriterInit(&jw, chunk, sizeof(chunk), httpWriteChunk, pCtrl->client);
+			body(&jw, arg);
+			err = csJsonWriterFinish(&jw);
+			if (ESP_OK == err && csJsonWriterLen(&jw) != len) {
+				gc_err("JSON body changed length");
+				err = ESP_ERR_INVALID_SIZE;
+			}
+		}
+
+		if (ESP_OK == err && esp_http_client_fetch_headers(pCtrl->client) < 0) {
+			err = ESP_FAIL;
+		}
+
+		if (ESP_OK == err) {
+			// The event handler copies the response as it is read
+			while (esp_http_client_read(pCtrl->client, chunk, sizeof(chunk)) > 0)
+				;
+		}
+
+		esp_http_client_close(pCtrl->client);
+
+		if (ESP_OK != err) {
+			gc_err("HTTP POST request failed: %s", esp_err_to_name(err));
+			return err;
+		}
+
+		switch (esp_http_client_get_status_code(pCtrl->client))
+		{
+		case 301:
+		case 302:
+		case 303:
+			// See other, the new location is read with a GET
+			sendBody = false;
+			/* fall through */
+		case 307:
+		case 308:
+			// Try again at the Location the server gave
+			if ((err = esp_http_client_set_redirection(pCtrl->client)) != ESP_OK) {
+				gc_err("HTTP redirect failed: %s", esp_err_to_name(err));
+				return err;
+			}
+			gc_dbg("HTTP POST redirected%s", sendBody ? "" : ", following with GET");
+			break;
+
+		case 401:
+			// Answer the challenge once, a second 401 goes to the caller
+			if (authSent) {
+				return ESP_OK;
+			}
+			esp_http_client_add_auth(pCtrl->client);
+			authSent = true;
+			gc_dbg("HTTP POST authenticating");
+			break;
+
+		default:
+			return ESP_OK;
+		}
+	}
+
+	gc_err("HTTP POST gave up after %d redirects", POST_MAX_REDIRECTS);
+	return ESP_FAIL;
+}
+
+static void eventBody(csJsonWriter_t * jw, const void * arg)
+{
+	(void)csJsonItem(jw, NULL, (const cJSON *)arg);
+}
+
 static void http_post_to_event(control_t *	pCtrl, cJSON * event_json){
 	if (NULL == pCtrl) {
 		return;
@@ -357,27 +517,58 @@ static void http_post_to_event(control_t *	pCtrl, cJSON * event_json){
 			mac_str);
 
     // POST
-    char * post_data = NULL;
-    post_data = cJSON_PrintUnformatted(event_json);
-
-    if(post_data != NULL){
-    	esp_http_client_set_url(pCtrl->client, target_url);
-		gc_dbg("HTTP POST \"%s\" to \"%s\"",post_data, target_url);
-		esp_http_client_set_method(pCtrl->client, HTTP_METHOD_POST);
-		esp_http_client_set_header(pCtrl->client, "Content-Type", "application/json");
-		esp_http_client_set_post_field(pCtrl->client, post_data, strlen(post_data));
-
-		esp_err_t err = esp_http_client_perform(pCtrl->client);
-		if (err == ESP_OK) {
-			gc_dbg("HTTP POST Status: %d", esp_http_client_get_status_code(pCtrl->client));
-		} else {
-			gc_err("HTTP POST request failed: %s", esp_err_to_name(err));
-		}
-
-		cJSON_free(post_data);
+    if (http_post_json(pCtrl, target_url, eventBody, event_json) == ESP_OK) {
+		gc_dbg("HTTP POST Status: %d", esp_http_client_get_status_code(pCtrl->client));
     }
 }
 
+// Values read once for the status body, which is written twice
+typedef struct {
+	int					rssi;
+	bool				emtrValid;
+	emtrAllStatus_t		emtr;
+} statusData_t;
+
+static void statusBody(csJsonWriter_t * jw, const void * arg)
+{
+	const statusData_t *	sd = (const statusData_t *)arg;
+
+	csJsonObjOpen(jw, NULL);
+	csJsonStr(jw, "fw", csCoreConf.info.fwVersion);
+	csJsonStr(jw, "hw", coreMfgData.hwVersion);
+	csJsonInt(jw, "rssi", sd->rssi);
+
+	if (sd->emtrValid) {
+		// EMTR board temperature
+		csJsonInt(jw, "temp", sd->emtr.device.temperature);
+	}
+
+	// Add socket JSON object array
+	csJsonArrOpen(jw, "socket");
+	int					sIdx;
+	for (sIdx = 0; sd->emtrValid && sIdx < NUM_SOCKETS && sIdx < sd->emtr.numSockets; sIdx++) {
+		// Status of this socket
+		const emtrSocketStatus_t *	sock = &sd->emtr.socket[sIdx];
+		// Shorthand reference to instant energy values
+		const emtrInstEnergy_t *	ie = &sock->instEnergy;
+
+		csJsonObjOpen(jw, NULL);
+		csJsonInt(jw, "socketIdx", sIdx);
+		csJsonInt(jw, "position", sock->isOn ? 1 : 0);
+		csJsonBool(jw, "occupied", sock->isPlugged);
+		csJsonUint(jw, "stateTime", sock->relayTime);
+		// Fixed point, as held by the EMTR
+		csJsonFixed(jw, "volts", ie->dVolts, 1);
+		csJsonFixed(jw, "amps", ie->mAmps, 3);
+		csJsonFixed(jw, "watts", ie->dWatts, 1);
+		csJsonUint(jw, "wattHours", sock->dWattHours);
+		csJsonUint(jw, "powerFactor", ie->powerFactor);
+		csJsonObjClose(jw);
+	}
+	csJsonArrClose(jw);
+	csJsonObjClose(jw);
+}
+
 static void http_post_to_status(control_t * pCtrl)
 {
     char target_url[62];
@@ -393,76 +584,23 @@ static void http_post_to_status(control_t * pCtrl)
     		csCoreConf.info.model,
 			mac_str);
 
-    esp_http_client_set_url(pCtrl->client, target_url);
-
     // POST
-    char post_data[2048] = {0};
+    statusData_t sd;
 
     wifi_ap_record_t wifidata;
-    sprintf(post_data, "{\"fw\":\"%s\",\"hw\":\"%s\",\"rssi\":%d",
-    		csCoreConf.info.fwVersion,
-			coreMfgData.hwVersion,
-			esp_wifi_sta_get_ap_info(&wifidata)==0?wifidata.rssi:-1000);
+    sd.rssi = esp_wifi_sta_get_ap_info(&wifidata)==0?wifidata.rssi:-1000;
 
-	emtrDeviceStatus_t	emtr;
-	if (emtrDrvGetDeviceStatus(&emtr) == ESP_OK) {
-		// EMTR board temperature
-		sprintf(post_data+strlen(post_data), ",\"temp\":%d", emtr.temperature);
-	} else {
-		gc_err("emtrDrvGetDeviceState() failed");
+	// Read device and socket status as one consistent copy
+	sd.emtrValid = (emtrDrvGetAllStatus(&sd.emtr) == ESP_OK);
+	if (!sd.emtrValid) {
+		gc_err("emtrDrvGetAllStatus() failed");
 	}
 
-	// Add socket JSON object array
-	sprintf(post_data+strlen(post_data), ",\"socket\":[");
-	int					sIdx;
-	emtrSocketStatus_t	sock;
-	for (sIdx = 0; sIdx < NUM_SOCKETS; sIdx++) {
-		int		sNum = 1 + sIdx;
-		if (emtrDrvGetSocketStatus(sNum, &sock) != ESP_OK) {
-			gc_err("Failed to read status for socket %d", sNum);
-			continue;
-		}
-		// Shorthand reference to instant energy values
-		emtrInstEnergy_t *	ie = &sock.instEnergy;
-		// start of socket object
-		if(sIdx>0)
-			sprintf(post_data+strlen(post_data), ",");
-		sprintf(post_data+strlen(post_data), "{");
-		// Socket Index
-		sprintf(post_data+strlen(post_data), "\"socketIdx\":%d", sIdx);
-		// Position
-		sprintf(post_data+strlen(post_data), ",\"position\":%d", sock.isOn?1:0);
-		// Occupied
-		sprintf(post_data+strlen(post_data), ",\"occupied\":%s", sock.isPlugged?"true":"false");
-		// State time
-		sprintf(post_data+strlen(post_data), ",\"stateTime\":%d", sock.relayTime);
-		// Volts
-		sprintf(post_data+strlen(post_data), ",\"volts\":%.1f", (float)ie->dVolts/10.0);
-		// Amps
-		sprintf(post_data+strlen(post_data), ",\"amps\":%.3f", (float)ie->mAmps/1000.0);
-		// Watts
-		sprintf(post_data+strlen(post_data), ",\"watts\":%.1f", (float)ie->dWatts/10.0);
-		// Watt-Hours
-		sprintf(post_data+strlen(post_data), ",\"wattHours\":%lld", sock.dWattHours);
-		// Power factor
-		sprintf(post_data+strlen(post_data), ",\"powerFactor\":%d", ie->powerFactor);
-		// end of socket object
-		sprintf(post_data+strlen(post_data), "}");
-	}
-	sprintf(post_data+strlen(post_data), "]");
-    sprintf(post_data+strlen(post_data), "}");
-
-    gc_dbg("HTTP POST \"%s\" to \"%s\"",post_data, target_url);
-    esp_http_client_set_method(pCtrl->client, HTTP_METHOD_POST);
-    esp_http_client_set_header(pCtrl->client, "Content-Type", "application/json");
-    esp_http_client_set_post_field(pCtrl->client, post_data, strlen(post_data));
-
-    esp_err_t err = esp_http_client_perform(pCtrl->client);
+    esp_err_t err = http_post_json(pCtrl, target_url, statusBody, &sd);
     if (err == ESP_OK) {
     	gc_dbg("HTTP POST Status: %d, content: = %s",
                 esp_http_client_get_status_code(pCtrl->client), local_response_buffer);
     } else {
-    	gc_err("HTTP POST request failed: %s", esp_err_to_name(err));
         return;
     }
     cJSON * queue_json = NULL;
@@ -115,6 +115,7 @@ esp_err_t appControlInit(void)
 	if ((status = eventRegisterCreate(&pCtrl->cbHandle)) != ESP_OK) {
 		return status;
 	}
+	eventSetDataSize(pCtrl->cbHandle, sizeof(appCtrlEvtData_t));
 
 	if ((pCtrl->queue = xQueueCreate(8, sizeof(taskMsg_t))) == NULL) {
 		return ESP_ERR_NO_MEM;
@@ -181,7 +182,7 @@ esp_err_t appControlCallbackUnregister(eventCbFunc_t cbFunc)
 
 
 static esp_err_t _enable(
-	const char *		paramKey,
+	csParamTab_t *		param,
 	bool				value,
 	appCtrlEvtCode_t	evtCode,
 	callCtx_t			ctx
@@ -194,7 +195,7 @@ static esp_err_t _enable(
 	appCtrlEvtData_t	eData;
 
 	// Store the parameter
-	paramMgrSetBool(paramKey, value);
+	paramMgrSetBoolRef(param, value);
 
 	// Notify interested parties of the change
 	eData.enabled = value;
@@ -227,7 +228,7 @@ esp_err_t appControlReportOnline(callCtx_t ctx)
 
 esp_err_t appControlButtonEnable(bool value, callCtx_t ctx)
 {
-	return _enable(paramKey_buttonEnable, value, appCtrlEvtCode_buttonEnable, ctx);
+	return _enable(APP_PARAM(appParamId_buttonEnable), value, appCtrlEvtCode_buttonEnable, ctx);
 }
 
 
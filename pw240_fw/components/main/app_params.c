@@ -23,8 +23,8 @@ const char paramKey_buttonEnable[]    = {"btn_enable"};
 /**
  * \brief Define parameters
  */
-static csParamTab_t	paramTable[] = {
-	{
+csParamTab_t	appParamTable[] = {
+	[appParamId_socket1On] = {
 		.title      = "Outlet 1 On",
 		.nvSpace    = csNvSpace_standard,
 		.nvKey      = paramKey_socket1On,
@@ -36,7 +36,7 @@ static csParamTab_t	paramTable[] = {
 		.init		= NULL,
 		.check      = NULL
 	},
-	{
+	[appParamId_socket1Type] = {
 		.title      = "Outlet 1 Type",
 		.nvSpace    = csNvSpace_standard,
 		.nvKey      = paramKey_socket1Type,
@@ -48,7 +48,7 @@ static csParamTab_t	paramTable[] = {
 		.init		= NULL,
 		.check      = NULL
 	},
-	{
+	[appParamId_socket1Name] = {
 		.title      = "Outlet 1 Name",
 		.nvSpace    = csNvSpace_standard,
 		.nvKey      = paramKey_socket1Name,
@@ -60,7 +60,7 @@ static csParamTab_t	paramTable[] = {
 		.init		= NULL,
 		.check      = NULL
 	},
-	{
+	[appParamId_socket2On] = {
 		.title      = "Outlet 2 On",
 		.nvSpace    = csNvSpace_standard,
 		.nvKey      = paramKey_socket2On,
@@ -72,7 +72,7 @@ static csParamTab_t	paramTable[] = {
 		.init		= NULL,
 		.check      = NULL
 	},
-	{
+	[appParamId_socket2Type] = {
 		.title      = "Outlet 2 Type",
 		.nvSpace    = csNvSpace_standard,
 		.nvKey      = paramKey_socket2Type,
@@ -84,7 +84,7 @@ static csParamTab_t	paramTable[] = {
 		.init		= NULL,
 		.check      = NULL
 	},
-	{
+	[appParamId_socket2Name] = {
 		.title      = "Outlet 2 Name",
 		.nvSpace    = csNvSpace_standard,
 		.nvKey      = paramKey_socket2Name,
@@ -96,7 +96,7 @@ static csParamTab_t	paramTable[] = {
 		.init		= NULL,
 		.check      = NULL
 	},
-	{
+	[appParamId_ledBrightness] = {
 		.title      = "LED brightness",
 		.nvSpace    = csNvSpace_standard,
 		.nvKey      = paramKey_ledBrightness,
@@ -108,7 +108,7 @@ static csParamTab_t	paramTable[] = {
 		.init		= NULL,
 		.check      = NULL
 	},
-	{
+	[appParamId_buttonEnable] = {
 		.title      = "Enable buttons",
 		.nvSpace    = csNvSpace_standard,
 		.nvKey      = paramKey_buttonEnable,
@@ -120,8 +120,152 @@ static csParamTab_t	paramTable[] = {
 		.init		= NULL,
 		.check      = NULL
 	},
+	{
+		.title      = "Volts deadband",
+		.nvSpace    = csNvSpace_standard,
+		.nvKey      = "ntf_v_abs",
+		.pVar       = &appParams.emtrNotify.band[emtrNotifyMetric_volts].absDelta,
+		.objTyp     = objtyp_u32,
+		.minVal     = 0,
+		.maxVal     = 65535,
+		.defVal     = "10",	// 1.0 Volts
+		.init		= NULL,
+		.check      = NULL
+	},
+	{
+		.title      = "Volts deadband (per mille)",
+		.nvSpace    = csNvSpace_standard,
+		.nvKey      = "ntf_v_rel",
+		.pVar       = &appParams.emtrNotify.band[emtrNotifyMetric_volts].relDeltaPm,
+		.objTyp     = objtyp_u32,
+		.minVal     = 0,
+		.maxVal     = 1000,
+		.defVal     = "0",
+		.init		= NULL,
+		.check      = NULL
+	},
+	{
+		.title      = "Amps deadband",
+		.nvSpace    = csNvSpace_standard,
+		.nvKey      = "ntf_a_abs",
+		.pVar       = &appParams.emtrNotify.band[emtrNotifyMetric_amps].absDelta,
+		.objTyp     = objtyp_u32,
+		.minVal     = 0,
+		.maxVal     = 65535,
+		.defVal     = "10",	// 10 mA
+		.init		= NULL,
+		.check      = NULL
+	},
+	{
+		.title      = "Amps deadband (per mille)",
+		.nvSpace    = csNvSpace_standard,
+		.nvKey      = "ntf_a_rel",
+		.pVar       = &appParams.emtrNotify.band[emtrNotifyMetric_amps].relDeltaPm,
+		.objTyp     = objtyp_u32,
+		.minVal     = 0,
+		.maxVal     = 1000,
+		.defVal     = "20",	// 2 percent
+		.init		= NULL,
+		.check      = NULL
+	},
+	{
+		.title      = "Watts deadband",
+		.nvSpace    = csNvSpace_standard,
+		.nvKey      = "ntf_w_abs",
+		.pVar       = &appParams.emtrNotify.band[emtrNotifyMetric_watts].absDelta,
+		.objTyp     = objtyp_u32,
+		.minVal     = 0,
+		.maxVal     = 65535,
+		.defVal     = "10",	// 1.0 Watts
+		.init		= NULL,
+		.check      = NULL
+	},
+	{
+		.title      = "Watts deadband (per mille)",
+		.nvSpace    = csNvSpace_standard,
+		.nvKey      = "ntf_w_rel",
+		.pVar       = &appParams.emtrNotify.band[emtrNotifyMetric_watts].relDeltaPm,
+		.objTyp     = objtyp_u32,
+		.minVal     = 0,
+		.maxVal     = 1000,
+		.defVal     = "20",	// 2 percent
+		.init		= NULL,
+		.check      = NULL
+	},
+	{
+		.title      = "PF deadband",
+		.nvSpace    = csNvSpace_standard,
+		.nvKey      = "ntf_pf_abs",
+		.pVar       = &appParams.emtrNotify.band[emtrNotifyMetric_powerFactor].absDelta,
+		.objTyp     = objtyp_u32,
+		.minVal     = 0,
+		.maxVal     = 100,
+		.defVal     = "2",
+		.init		= NULL,
+		.check      = NULL
+	},
+	{
+		.title      = "PF deadband (per mille)",
+		.nvSpace    = csNvSpace_standard,
+		.nvKey      = "ntf_pf_rel",
+		.pVar       = &appParams.emtrNotify.band[emtrNotifyMetric_powerFactor].relDeltaPm,
+		.objTyp     = objtyp_u32,
+		.minVal     = 0,
+		.maxVal     = 1000,
+		.defVal     = "0",
+		.init		= NULL,
+		.check      = NULL
+	},
+	{
+		.title      = "Wh deadband",
+		.nvSpace    = csNvSpace_standard,
+		.nvKey      = "ntf_wh_abs",
+		.pVar       = &appParams.emtrNotify.band[emtrNotifyMetric_wattHours].absDelta,
+		.objTyp     = objtyp_u32,
+		.minVal     = 0,
+		.maxVal     = 100000,
+		.defVal     = "1",	// 1 Watt-hour
+		.init		= NULL,
+		.check      = NULL
+	},
+	{
+		.title      = "Wh deadband (per mille)",
+		.nvSpace    = csNvSpace_standard,
+		.nvKey      = "ntf_wh_rel",
+		.pVar       = &appParams.emtrNotify.band[emtrNotifyMetric_wattHours].relDeltaPm,
+		.objTyp     = objtyp_u32,
+		.minVal     = 0,
+		.maxVal     = 1000,
+		.defVal     = "0",
+		.init		= NULL,
+		.check      = NULL
+	},
+	{
+		.title      = "Notify min interval",
+		.nvSpace    = csNvSpace_standard,
+		.nvKey      = "ntf_min_ms",
+		.pVar       = &appParams.emtrNotify.minIntervalMs,
+		.objTyp     = objtyp_u32,
+		.minVal     = 0,
+		.maxVal     = 60000,
+		.defVal     = "1000",	// milliseconds
+		.init		= NULL,
+		.check      = NULL
+	},
+	{
+		.title      = "Notify heartbeat",
+		.nvSpace    = csNvSpace_standard,
+		.nvKey      = "ntf_hb_sec",
+		.pVar       = &appParams.emtrNotify.heartbeatSec,
+		.objTyp     = objtyp_u32,
+		.minVal     = 0,
+		.maxVal     = 86400,
+		.defVal     = "300",	// seconds, 0 to disable
+		.init		= NULL,
+		.check      = NULL
+	},
 };
-#define paramTableSz	(sizeof(paramTable) / sizeof(csParamTab_t))
+#define appParamTableSz	(sizeof(appParamTable) / sizeof(csParamTab_t))
 
 
 // Global parameter structure
@@ -134,5 +278,5 @@ appParams_t	appParams;
 esp_err_t appParamsLoad(void)
 {
 	// Load the parameters
-	return paramMgrParamsAdd(appInfo.model, paramTable, paramTableSz);
+	return paramMgrParamsAdd(appInfo.model, appParamTable, appParamTableSz);
 }
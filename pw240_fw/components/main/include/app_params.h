@@ -10,6 +10,7 @@
 
 #include "cs_common.h"
 #include "param_mgr.h"
+#include "emtr_drv.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -38,6 +39,7 @@ typedef struct {
 	uint8_t 	detectionDelayMinutes;
 	uint8_t		rebooterMaxReboots; //maximum reboots without resolution
 	appSocket_t	socket[NUM_SOCKETS];
+	emtrNotifyConf_t	emtrNotify;	//EMTR energy change notification filtering
 } appParams_t;
 
 
@@ -55,6 +57,28 @@ extern const char paramKey_targetMcuVers[];
 extern const char paramKey_buttonEnable[];
 
 
+/**
+ * \brief Indexes of parameters in appParamTable
+ *
+ * For the paramMgrSetXRef functions, see \ref APP_PARAM
+ */
+typedef enum {
+	appParamId_socket1On = 0,
+	appParamId_socket1Type,
+	appParamId_socket1Name,
+	appParamId_socket2On,
+	appParamId_socket2Type,
+	appParamId_socket2Name,
+	appParamId_ledBrightness,
+	appParamId_buttonEnable
+} appParamId_t;
+
+extern csParamTab_t	appParamTable[];
+
+//! Table entry of a parameter, by appParamId_t
+#define APP_PARAM(id)	(&appParamTable[(id)])
+
+
 /**
  * \brief Application parameters
  */
@@ -29,6 +29,7 @@ extern "C" {
 #define TASK_PRIO_LOCAL_API			(tskIDLE_PRIORITY + 11)
 #define TASK_PRIO_REBOOTER			(tskIDLE_PRIORITY + 11)
 #define TASK_PRIO_CRON				(tskIDLE_PRIORITY + 10)
+#define TASK_PRIO_ENERGY_LOG		(tskIDLE_PRIORITY + 8)
 
 
 //******************************************************************************
@@ -17,6 +17,7 @@
 #include "app_control.h"
 #include "app_self_test.h"
 #include "outlet_mgr.h"
+#include "energy_log.h"
 #include "cap1298_handler.h"
 #include "utest_cap1298.h"
 #include "fw_file_check.h"
@@ -65,7 +66,8 @@ static const emtrDrvConf_t	emtrConf = {
 	},
 	.gpioEmtrRst  = GPIO_NUM_0,
 	.numSockets   = 2,
-	.taskPrio     = TASK_PRIO_EMTR_DRV
+	.taskPrio     = TASK_PRIO_EMTR_DRV,
+	.notify       = &appParams.emtrNotify
 };
 
 
@@ -314,6 +316,11 @@ static esp_err_t modulesInit(void)
 		gc_err("appPWApiInit error %d", status);
 	}
 
+	if ((status = energyLogInit()) != ESP_OK) {
+		// Print error, but keep going
+		gc_err("energyLogInit error %d", status);
+	}
+
 	return ESP_OK;
 }
 
@@ -345,6 +352,11 @@ static esp_err_t modulesStart(void)
 		return ESP_OK;
 	}
 
+	if ((status = energyLogStart()) != ESP_OK) {
+		// Print error, but keep going
+		gc_err("energyLogStart error %d", status);
+	}
+
 	return ESP_OK;
 }
 
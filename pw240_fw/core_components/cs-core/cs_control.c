@@ -139,6 +139,7 @@ esp_err_t csControlInit(csControlConf_t * conf)
 	if ((status = eventRegisterCreate(&pCtrl->cbHandle)) != ESP_OK) {
 		return status;
 	}
+	eventSetDataSize(pCtrl->cbHandle, sizeof(csCtrlEvtData_t));
 
 	if ((pCtrl->queue = xQueueCreate(8, sizeof(taskMsg_t))) == NULL) {
 		return ESP_ERR_NO_MEM;
@@ -603,6 +604,9 @@ static void controlTask(void * param)
 
 			vTaskDelay(pdMS_TO_TICKS(pCtrl->reboot.delayMs));
 
+			// Don't lose parameter changes still in their holdoff
+			paramMgrFlush();
+
 			esp_restart();
 
 
@@ -14,6 +14,13 @@
 #include "mod_debug.h"
 
 
+// Module lookup table, open addressed by module ID. Kept at most 3/4 full
+// so that a lookup probes few slots.
+#define MOD_TAB_BITS		(5)
+#define MOD_TAB_SZ			(1 << MOD_TAB_BITS)
+#define MOD_TAB_MAX_MODS	((MOD_TAB_SZ * 3) / 4)
+
+
 //------------------------------------------------------------------------------
 // Data type definitions
 //------------------------------------------------------------------------------
@@ -32,18 +39,27 @@ struct evtCbHandler_s {
 	const char *		cbName;		// Name of callback
 	csEvtHandler_t		cbFunc;		// Handler function
 	uint32_t			cbData;		// Data to be passed to the handler
+	eventSub_t *		sub;		// Queue and task of an asynchronous handler
+	eventSubStats_t		stats;		// Statistics of a synchronous handler
+	uint64_t			evtMask;	// Event IDs wanted
 };
 
 
 /**
- * \brief structure for building linked list of event modules
+ * \brief Event module
  */
 struct evtModule_s {
-	evtModule_t *		next;			// Next module list entry
 	csEvtModId_t		modId;			// Module ID
 	const char *		modName;		// Module name
 	evtCbHandler_t *	cbListHead;		// Head of linked list of handlers for this event set
 	evtCbHandler_t *	cbListTail;		// Tail of linked list
+	size_t				evtDataSz;		// Bytes at evtData copied for async handlers
+	int					numAsync;		// Asynchronous handlers
+	volatile uint64_t	wanted;			// Event IDs with at least one handler
+	evtCbHandler_t **	dispTab;		// Handlers of each event ID, registration order
+	int					dispLen;		// Entries used in dispTab
+	int					dispCap;		// Entries allocated
+	uint16_t			dispIdx[EVENT_NUM_CODES + 1];	// Start of each ID in dispTab
 };
 
 
@@ -52,8 +68,8 @@ struct evtModule_s {
  */
 typedef struct {
 	SemaphoreHandle_t	mutex;
-	evtModule_t *		modListHead;
-	evtModule_t *		modListTail;
+	evtModule_t *		modTab[MOD_TAB_SZ];
+	int					numMods;
 } evtControl_t;
 
 
@@ -63,8 +79,18 @@ typedef struct {
 
 static evtModule_t * findEvtMod(evtControl_t * pCtrl, csEvtModId_t modId);
 
+static esp_err_t addEvtMod(evtControl_t * pCtrl, evtModule_t * module);
+
 static evtCbHandler_t * findEvtHandler(evtModule_t * module, csEvtHandler_t cbFunc);
 
+static esp_err_t reserveDispatch(evtModule_t * module, uint64_t evtMask);
+
+static void buildDispatch(evtModule_t * module);
+
+static void deliver(evtCbHandler_t * handler, csEvtSrc_t evtSource, csEvtCode_t evtCode, csEvtData_t evtData);
+
+static void callHandler(void * arg, uint32_t src, uint32_t evtCode, uint32_t evtData);
+
 
 //------------------------------------------------------------------------------
 // Private data
@@ -120,24 +146,19 @@ esp_err_t csEventCreate(csEvtHandle_t * handle, csEvtModId_t modId, const char *
 
 	evtModule_t *	module = findEvtMod(pCtrl, modId);
 	if (NULL == module) {
-		// Add module to the list
+		// Add module to the table
 		if ((module = cs_heap_calloc(1, sizeof(*module))) != NULL) {
 
 			// Set the module identification stuff
 			module->modId   = modId;
 			module->modName = modName;
 
-			// Add it to the end of the linked list
-			module->next = NULL;
-			if (NULL == pCtrl->modListHead) {
-				// First entry
-				pCtrl->modListHead = module;
+			if ((status = addEvtMod(pCtrl, module)) == ESP_OK) {
+				*handle = (void *)module;
 			} else {
-				pCtrl->modListTail->next = module;
+				gc_err("Too many event modules");
+				cs_heap_free(module);
 			}
-			pCtrl->modListTail = module;
-			*handle = (void *)module;
-			status = ESP_OK;
 		} else {
 			status = ESP_ERR_NO_MEM;
 		}
@@ -152,6 +173,34 @@ esp_err_t csEventCreate(csEvtHandle_t * handle, csEvtModId_t modId, const char *
 }
 
 
+esp_err_t csEventSetDataSize(csEvtHandle_t handle, size_t evtDataSz)
+{
+	evtControl_t *	pCtrl = evtControl;
+	if (NULL == pCtrl) {
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	if (NULL == handle || evtDataSz > EVENT_DATA_MAX_SZ) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	evtModule_t *	module = (evtModule_t *)handle;
+	esp_err_t		status = ESP_OK;
+
+	xSemaphoreTake(pCtrl->mutex, portMAX_DELAY);
+
+	// Async handlers have already sized their queues
+	if (module->numAsync > 0) {
+		status = ESP_ERR_INVALID_STATE;
+	} else {
+		module->evtDataSz = evtDataSz;
+	}
+
+	xSemaphoreGive(pCtrl->mutex);
+	return status;
+}
+
+
 esp_err_t csEventRegister(
 	const csEvtModId_t *	evtModList,
 	unsigned int			evtModListSz,
@@ -159,13 +208,30 @@ esp_err_t csEventRegister(
 	csEvtHandler_t			cbFunc,
 	uint32_t				cbData
 )
+{
+	eventSubConf_t	conf = {
+		.deliver = eventDeliver_sync
+	};
+
+	return csEventRegisterConf(evtModList, evtModListSz, cbName, cbFunc, cbData, &conf);
+}
+
+
+esp_err_t csEventRegisterConf(
+	const csEvtModId_t *	evtModList,
+	unsigned int			evtModListSz,
+	const char *			cbName,
+	csEvtHandler_t			cbFunc,
+	uint32_t				cbData,
+	const eventSubConf_t *	conf
+)
 {
 	evtControl_t *	pCtrl = evtControl;
 	if (NULL == pCtrl) {
 		return ESP_ERR_INVALID_STATE;
 	}
 
-	if (NULL == evtModList || evtModListSz < 1 || NULL == cbFunc) {
+	if (NULL == evtModList || evtModListSz < 1 || NULL == cbFunc || NULL == conf) {
 		return ESP_ERR_INVALID_ARG;
 	}
 
@@ -207,10 +273,33 @@ esp_err_t csEventRegister(
 			break;
 		}
 
-		handler->cbName = cbName;
-		handler->cbFunc = cbFunc;
-		handler->cbData = cbData;
-		handler->next   = NULL;
+		handler->cbName  = cbName;
+		handler->cbFunc  = cbFunc;
+		handler->cbData  = cbData;
+		handler->evtMask = conf->evtMask ? conf->evtMask : EVENT_MASK_ALL;
+		handler->next    = NULL;
+
+		// Make room in the dispatch table first, nothing to undo after that
+		if ((status = reserveDispatch(module, handler->evtMask)) != ESP_OK) {
+			gc_err("Failed to allocate handler structure");
+			cs_heap_free(handler);
+			break;
+		}
+
+		if (eventDeliver_async == conf->deliver) {
+			// Each module gets its own queue and task for the handler,
+			// which owns the handler structure from here on
+			eventSubConf_t	subConf = *conf;
+			subConf.name = cbName;
+
+			status = eventSubCreate(&handler->sub, &subConf, module->evtDataSz, callHandler, handler);
+			if (ESP_OK != status) {
+				gc_err("Handler (%s) queue create failed", cbName);
+				cs_heap_free(handler);
+				break;
+			}
+			module->numAsync += 1;
+		}
 
 		// Add the structure to the list
 		if (NULL == module->cbListHead) {
@@ -221,6 +310,8 @@ esp_err_t csEventRegister(
 			module->cbListTail->next = handler;
 		}
 		module->cbListTail = handler;
+
+		buildDispatch(module);
 	}
 
 	xSemaphoreGive(pCtrl->mutex);
@@ -277,8 +368,16 @@ esp_err_t csEventUnregister(
 					module->cbListTail = prev;
 				}
 
+				buildDispatch(module);
+
 				// Release the handler memory
-				cs_heap_free(handler);
+				if (handler->sub) {
+					// The handler's task releases it
+					module->numAsync -= 1;
+					eventSubDelete(handler->sub);
+				} else {
+					cs_heap_free(handler);
+				}
 
 				// Done with this module
 				break;
@@ -317,6 +416,12 @@ void csEventNotify(
 		return;
 	}
 
+	// Nothing to do if no one wants this event
+	evtModule_t *	owner = (evtModule_t *)handle;
+	if (evtId < EVENT_NUM_CODES && 0 == (owner->wanted & EVENT_CODE_BIT(evtId))) {
+		return;
+	}
+
 	// Extract the module ID from the event code
 	csEvtModId_t	modId = CS_EVT_MOD_ID(evtCode);
 
@@ -328,10 +433,20 @@ void csEventNotify(
 		// Verify the caller is authorized to send this event
 		// (Caller must have the handle return from event creation)
 		if (module == (evtModule_t *)handle) {
-			// Call handlers registered with this module
-			evtCbHandler_t *	handler;
-			for (handler = module->cbListHead; NULL != handler; handler = handler->next) {
-				handler->cbFunc(handler->cbData, evtSource, evtCode, evtData);
+			// Call handlers registered for this event
+			if (evtId < EVENT_NUM_CODES) {
+				int	i;
+				for (i = module->dispIdx[evtId]; i < module->dispIdx[evtId + 1]; i++) {
+					deliver(module->dispTab[i], evtSource, evtCode, evtData);
+				}
+			} else {
+				// IDs past the masks go to handlers that want everything
+				evtCbHandler_t *	handler;
+				for (handler = module->cbListHead; NULL != handler; handler = handler->next) {
+					if (EVENT_MASK_ALL == handler->evtMask) {
+						deliver(handler, evtSource, evtCode, evtData);
+					}
+				}
 			}
 		} else {
 			gc_err("Caller does not own the event module (%s)", module->modName);
@@ -344,6 +459,39 @@ void csEventNotify(
 }
 
 
+esp_err_t csEventGetStats(csEvtModId_t modId, csEvtHandler_t cbFunc, eventSubStats_t * ret)
+{
+	evtControl_t *	pCtrl = evtControl;
+	if (NULL == pCtrl) {
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	if (NULL == cbFunc || NULL == ret) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	esp_err_t	status = ESP_ERR_NOT_FOUND;
+
+	xSemaphoreTake(pCtrl->mutex, portMAX_DELAY);
+
+	evtModule_t *	module = findEvtMod(pCtrl, modId);
+	if (NULL != module) {
+		evtCbHandler_t *	handler = findEvtHandler(module, cbFunc);
+		if (NULL != handler) {
+			if (handler->sub) {
+				eventSubGetStats(handler->sub, ret);
+			} else {
+				*ret = handler->stats;
+			}
+			status = ESP_OK;
+		}
+	}
+
+	xSemaphoreGive(pCtrl->mutex);
+	return status;
+}
+
+
 const char * csEventModuleName(csEvtCode_t evtCode)
 {
 	evtControl_t *	pCtrl = evtControl;
@@ -392,11 +540,28 @@ const char * csEventSourceName(csEvtSrc_t evtSource)
 //------------------------------------------------------------------------------
 
 
+/**
+ * \brief First slot to probe for a module ID
+ */
+static inline uint32_t modSlot(csEvtModId_t modId)
+{
+	// Fibonacci hashing, spreads IDs that are multiples of a stride
+	return (modId * 2654435761u) >> (32 - MOD_TAB_BITS);
+}
+
+
 static evtModule_t * findEvtMod(evtControl_t * pCtrl, csEvtModId_t modId)
 {
-	evtModule_t *	ret;
+	uint32_t	slot = modSlot(modId);
+	int			i;
 
-	for (ret = pCtrl->modListHead; NULL != ret; ret = ret->next) {
+	for (i = 0; i < MOD_TAB_SZ; i++, slot = (slot + 1) & (MOD_TAB_SZ - 1)) {
+		evtModule_t *	ret = pCtrl->modTab[slot];
+
+		if (NULL == ret) {
+			// Modules are never removed, so an empty slot ends the search
+			break;
+		}
 		if (modId == ret->modId) {
 			// Match found
 			return ret;
@@ -408,6 +573,24 @@ static evtModule_t * findEvtMod(evtControl_t * pCtrl, csEvtModId_t modId)
 }
 
 
+static esp_err_t addEvtMod(evtControl_t * pCtrl, evtModule_t * module)
+{
+	if (pCtrl->numMods >= MOD_TAB_MAX_MODS) {
+		return ESP_ERR_NO_MEM;
+	}
+
+	uint32_t	slot = modSlot(module->modId);
+
+	while (NULL != pCtrl->modTab[slot]) {
+		slot = (slot + 1) & (MOD_TAB_SZ - 1);
+	}
+
+	pCtrl->modTab[slot] = module;
+	pCtrl->numMods += 1;
+	return ESP_OK;
+}
+
+
 static evtCbHandler_t * findEvtHandler(evtModule_t * module, csEvtHandler_t cbFunc)
 {
 	evtCbHandler_t *	ret;
@@ -420,3 +603,97 @@ static evtCbHandler_t * findEvtHandler(evtModule_t * module, csEvtHandler_t cbFu
 	// No match found
 	return NULL;
 }
+
+
+/**
+ * \brief Pass an event to one handler
+ */
+static void deliver(evtCbHandler_t * handler, csEvtSrc_t evtSource, csEvtCode_t evtCode, csEvtData_t evtData)
+{
+	if (handler->sub) {
+		eventSubPost(handler->sub, (uint32_t)evtSource, evtCode, CS_PTR2ADR(evtData));
+		return;
+	}
+
+	int64_t		t0 = esp_timer_get_time();
+	handler->cbFunc(handler->cbData, evtSource, evtCode, evtData);
+	uint32_t	us = (uint32_t)(esp_timer_get_time() - t0);
+
+	handler->stats.notifyCount    += 1;
+	handler->stats.deliverCount   += 1;
+	handler->stats.handlerUsTotal += us;
+	if (us > handler->stats.handlerUsMax) {
+		handler->stats.handlerUsMax = us;
+	}
+}
+
+
+/**
+ * \brief Make room in a module's dispatch table for a new handler
+ *
+ * The table is rebuilt by \ref buildDispatch once the handler is linked
+ */
+static esp_err_t reserveDispatch(evtModule_t * module, uint64_t evtMask)
+{
+	int	need = module->dispLen + __builtin_popcountll(evtMask);
+
+	if (need <= module->dispCap) {
+		return ESP_OK;
+	}
+
+	evtCbHandler_t **	tab = cs_heap_calloc(need, sizeof(*tab));
+	if (NULL == tab) {
+		return ESP_ERR_NO_MEM;
+	}
+
+	// Keep the current table usable until it is rebuilt
+	if (module->dispLen > 0) {
+		memcpy(tab, module->dispTab, module->dispLen * sizeof(*tab));
+	}
+	cs_heap_free(module->dispTab);
+	module->dispTab = tab;
+	module->dispCap = need;
+	return ESP_OK;
+}
+
+
+/**
+ * \brief Rebuild a module's per-event dispatch table from its handler list
+ *
+ * Called with the mutex held, after \ref reserveDispatch for a new handler
+ */
+static void buildDispatch(evtModule_t * module)
+{
+	uint64_t			wanted = 0;
+	int					len    = 0;
+	uint32_t			evtId;
+	evtCbHandler_t *	handler;
+
+	for (evtId = 0; evtId < EVENT_NUM_CODES; evtId++) {
+		module->dispIdx[evtId] = (uint16_t)len;
+
+		for (handler = module->cbListHead; NULL != handler; handler = handler->next) {
+			if (handler->evtMask & EVENT_CODE_BIT(evtId)) {
+				module->dispTab[len++] = handler;
+			}
+		}
+	}
+	module->dispIdx[EVENT_NUM_CODES] = (uint16_t)len;
+	module->dispLen = len;
+
+	for (handler = module->cbListHead; NULL != handler; handler = handler->next) {
+		wanted |= handler->evtMask;
+	}
+	module->wanted = wanted;
+}
+
+
+/**
+ * \brief Call the function of an asynchronous handler
+ */
+static void callHandler(void * arg, uint32_t src, uint32_t evtCode, uint32_t evtData)
+{
+	evtCbHandler_t *	handler = (evtCbHandler_t *)arg;
+
+	handler->cbFunc(handler->cbData, (csEvtSrc_t)src, (csEvtCode_t)evtCode, CS_ADR2PTR(evtData));
+}
@@ -131,6 +131,7 @@ esp_err_t csFrameworkInit(csCoreConf_t * conf)
 	if (ESP_OK != status) {
 		return status;
 	}
+	eventSetDataSize(pCtrl->cbHandle, sizeof(frmwkEvtData_t));
 
 	int	len;
 
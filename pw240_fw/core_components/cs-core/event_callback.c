@@ -18,6 +18,9 @@ struct cbTab_s {
 	cbTab_t *		next;
 	eventCbFunc_t	cbFunc;		// Function to be called
 	uint32_t		cbData;		// Data to pass to the called function
+	eventSub_t *	sub;		// Queue and task of an asynchronous subscriber
+	eventSubStats_t	stats;		// Statistics of a synchronous subscriber
+	uint64_t		evtMask;	// Event codes wanted
 };
 
 
@@ -26,10 +29,53 @@ typedef struct {
 	SemaphoreHandle_t	tabMutex;	// Table access mutex
 	cbTab_t *			head;		// Linked list head
 	cbTab_t *			tail;		// Linked list tail
+	size_t				evtDataSz;	// Bytes at evtData copied for async subscribers
+	int					numAsync;	// Asynchronous subscribers
+	volatile uint64_t	wanted;		// Codes with at least one subscriber
+	cbTab_t **			dispTab;	// Subscribers of each code, registration order
+	int					dispLen;	// Entries used in dispTab
+	int					dispCap;	// Entries allocated
+	uint16_t			dispIdx[EVENT_NUM_CODES + 1];	// Start of each code in dispTab
 } cbCtrl_t;
 
+
+// Queued event
+typedef struct {
+	int64_t		postTime;	// When the event was queued
+	uint32_t	src;
+	uint32_t	evtCode;
+	uint32_t	evtData;
+	bool		isCopy;		// data holds the event data
+	uint32_t	data[EVENT_DATA_MAX_SZ / sizeof(uint32_t)];
+} subItem_t;
+
+
+// Asynchronous subscriber
+struct eventSub_s {
+	QueueHandle_t		queue;
+	TaskHandle_t		task;
+	size_t				dataSz;		// Bytes of event data copied
+	eventOverflow_t		overflow;
+	TickType_t			blockTicks;
+	eventSubCall_t		call;
+	void *				arg;
+	volatile bool		stop;
+	portMUX_TYPE		lock;		// Guards the statistics
+	eventSubStats_t		stats;
+};
+
 static cbTab_t * findEntry(cbTab_t * head, eventCbFunc_t func);
 
+static esp_err_t reserveDispatch(cbCtrl_t * pCtrl, uint64_t evtMask);
+
+static void buildDispatch(cbCtrl_t * pCtrl);
+
+static void deliver(cbTab_t * entry, callCtx_t ctx, uint32_t evtCode, uint32_t evtData);
+
+static void callEntry(void * arg, uint32_t src, uint32_t evtCode, uint32_t evtData);
+
+static void subTask(void * param);
+
 
 esp_err_t eventRegisterCreate(cbHandle_t * cbHandle)
 {
@@ -64,11 +110,50 @@ exitFail:
 }
 
 
+esp_err_t eventSetDataSize(cbHandle_t cbHandle, size_t evtDataSz)
+{
+	cbCtrl_t *	pCtrl = (cbCtrl_t *)cbHandle;
+
+	if (NULL == pCtrl || evtDataSz > EVENT_DATA_MAX_SZ) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	esp_err_t	status = ESP_OK;
+
+	xSemaphoreTake(pCtrl->tabMutex, portMAX_DELAY);
+
+	// Async subscribers have already sized their queues
+	if (pCtrl->numAsync > 0) {
+		status = ESP_ERR_INVALID_STATE;
+	} else {
+		pCtrl->evtDataSz = evtDataSz;
+	}
+
+	xSemaphoreGive(pCtrl->tabMutex);
+	return status;
+}
+
+
 esp_err_t eventRegisterCallback(
 	cbHandle_t		cbHandle,
 	eventCbFunc_t	cbFunc,
 	uint32_t		cbData
 )
+{
+	eventSubConf_t	conf = {
+		.deliver = eventDeliver_sync
+	};
+
+	return eventRegisterSubscriber(cbHandle, cbFunc, cbData, &conf);
+}
+
+
+esp_err_t eventRegisterSubscriber(
+	cbHandle_t				cbHandle,
+	eventCbFunc_t			cbFunc,
+	uint32_t				cbData,
+	const eventSubConf_t *	conf
+)
 {
 	if (0 == cbHandle) {
 		return ESP_ERR_INVALID_ARG;
@@ -77,7 +162,7 @@ esp_err_t eventRegisterCallback(
 	cbCtrl_t *	pCtrl  = (cbCtrl_t *)cbHandle;
 	esp_err_t	status = ESP_OK;
 
-	if (NULL == pCtrl || NULL == cbFunc) {
+	if (NULL == pCtrl || NULL == cbFunc || NULL == conf) {
 		gc_err("NULL parameter passed");
 		return ESP_ERR_INVALID_ARG;
 	}
@@ -99,9 +184,28 @@ esp_err_t eventRegisterCallback(
 		goto exitMutex;
 	}
 
-	entry->cbFunc = cbFunc;
-	entry->cbData = cbData;
-	entry->next   = NULL;
+	entry->cbFunc  = cbFunc;
+	entry->cbData  = cbData;
+	entry->evtMask = conf->evtMask ? conf->evtMask : EVENT_MASK_ALL;
+	entry->next    = NULL;
+
+	// Make room in the dispatch table first, nothing to undo after that
+	if ((status = reserveDispatch(pCtrl, entry->evtMask)) != ESP_OK) {
+		gc_err("Failed to allocate memory");
+		cs_heap_free(entry);
+		goto exitMutex;
+	}
+
+	if (eventDeliver_async == conf->deliver) {
+		// The subscriber owns the entry from here on
+		status = eventSubCreate(&entry->sub, conf, pCtrl->evtDataSz, callEntry, entry);
+		if (ESP_OK != status) {
+			gc_err("eventSubCreate failed");
+			cs_heap_free(entry);
+			goto exitMutex;
+		}
+		pCtrl->numAsync += 1;
+	}
 
 	// Add the function to the tail of the linked list
 	if (NULL == pCtrl->head) {
@@ -113,6 +217,7 @@ esp_err_t eventRegisterCallback(
 	}
 	pCtrl->tail = entry;
 
+	buildDispatch(pCtrl);
 	status = ESP_OK;
 
 exitMutex:
@@ -150,8 +255,16 @@ esp_err_t eventUnregisterCallback(cbHandle_t cbHandle, eventCbFunc_t cbFunc)
 				pCtrl->tail = prev;
 			}
 
+			buildDispatch(pCtrl);
+
 			// Success
-			cs_heap_free(entry);
+			if (entry->sub) {
+				// The subscriber's task releases the entry
+				pCtrl->numAsync -= 1;
+				eventSubDelete(entry->sub);
+			} else {
+				cs_heap_free(entry);
+			}
 			status = ESP_OK;
 			break;
 		}
@@ -175,13 +288,214 @@ void eventNotify(
 	if (NULL == pCtrl) {
 		return;
 	}
+
+	// Nothing to do if no one wants this code
+	if (evtCode < EVENT_NUM_CODES && 0 == (pCtrl->wanted & EVENT_CODE_BIT(evtCode))) {
+		return;
+	}
+
 	xSemaphoreTake(pCtrl->tabMutex, portMAX_DELAY);
 
-	cbTab_t *	entry;
-	for (entry = pCtrl->head; NULL != entry; entry = entry->next) {
-		entry->cbFunc(entry->cbData, ctx, evtCode, evtData);
+	if (evtCode < EVENT_NUM_CODES) {
+		int	i;
+		for (i = pCtrl->dispIdx[evtCode]; i < pCtrl->dispIdx[evtCode + 1]; i++) {
+			deliver(pCtrl->dispTab[i], ctx, evtCode, evtData);
+		}
+	} else {
+		// Codes past the masks go to subscribers that want everything
+		cbTab_t *	entry;
+		for (entry = pCtrl->head; NULL != entry; entry = entry->next) {
+			if (EVENT_MASK_ALL == entry->evtMask) {
+				deliver(entry, ctx, evtCode, evtData);
+			}
+		}
+	}
+
+	xSemaphoreGive(pCtrl->tabMutex);
+}
+
+
+esp_err_t eventGetStats(
+	cbHandle_t			cbHandle,
+	eventCbFunc_t		cbFunc,
+	eventSubStats_t *	ret
+)
+{
+	cbCtrl_t *	pCtrl = (cbCtrl_t *)cbHandle;
+
+	if (NULL == pCtrl || NULL == cbFunc || NULL == ret) {
+		return ESP_ERR_INVALID_ARG;
 	}
+
+	esp_err_t	status = ESP_OK;
+
+	xSemaphoreTake(pCtrl->tabMutex, portMAX_DELAY);
+
+	cbTab_t *	entry = findEntry(pCtrl->head, cbFunc);
+	if (NULL == entry) {
+		status = ESP_ERR_NOT_FOUND;
+	} else if (entry->sub) {
+		eventSubGetStats(entry->sub, ret);
+	} else {
+		*ret = entry->stats;
+	}
+
 	xSemaphoreGive(pCtrl->tabMutex);
+	return status;
+}
+
+
+esp_err_t eventSubCreate(
+	eventSub_t **			ret,
+	const eventSubConf_t *	conf,
+	size_t					dataSz,
+	eventSubCall_t			call,
+	void *					arg
+)
+{
+	if (NULL == ret || NULL == conf || NULL == call || dataSz > EVENT_DATA_MAX_SZ) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	if (conf->queueSz < 1 || conf->stackSz < 1024) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	eventSub_t *	sub = cs_heap_calloc(1, sizeof(*sub));
+	if (NULL == sub) {
+		return ESP_ERR_NO_MEM;
+	}
+
+	esp_err_t	status;
+
+	sub->dataSz     = dataSz;
+	sub->overflow   = conf->overflow;
+	sub->blockTicks = pdMS_TO_TICKS(conf->blockMs);
+	sub->call       = call;
+	sub->arg        = arg;
+	sub->lock       = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+
+	// Queue items hold only as much event data as is copied
+	sub->queue = xQueueCreate(conf->queueSz, offsetof(subItem_t, data) + dataSz);
+	if (NULL == sub->queue) {
+		status = ESP_ERR_NO_MEM;
+		goto exitMem;
+	}
+
+	BaseType_t	xStatus = xTaskCreate(
+		subTask,
+		conf->name ? conf->name : "evtSub",
+		conf->stackSz,
+		(void *)sub,
+		conf->priority,
+		&sub->task
+	);
+	if (pdPASS != xStatus) {
+		status = ESP_ERR_NO_MEM;
+		goto exitQueue;
+	}
+
+	*ret = sub;
+	return ESP_OK;
+
+exitQueue:
+	vQueueDelete(sub->queue);
+exitMem:
+	cs_heap_free(sub);
+	return status;
+}
+
+
+void eventSubPost(eventSub_t * sub, uint32_t src, uint32_t evtCode, uint32_t evtData)
+{
+	if (NULL == sub) {
+		return;
+	}
+
+	subItem_t	item;
+
+	item.postTime = esp_timer_get_time();
+	item.src      = src;
+	item.evtCode  = evtCode;
+	item.evtData  = evtData;
+	item.isCopy   = (sub->dataSz > 0 && 0 != evtData);
+	if (item.isCopy) {
+		memcpy(item.data, CS_ADR2PTR(evtData), sub->dataSz);
+	}
+
+	BaseType_t	sent;
+	uint32_t	dropped = 0;
+
+	switch (sub->overflow)
+	{
+	case eventOverflow_block:
+		sent = xQueueSendToBack(sub->queue, &item, sub->blockTicks);
+		break;
+
+	case eventOverflow_dropOldest:
+		sent = xQueueSendToBack(sub->queue, &item, 0);
+		if (pdTRUE != sent) {
+			subItem_t	old;
+
+			// Make room, the task may have emptied a slot meanwhile
+			if (xQueueReceive(sub->queue, &old, 0) == pdTRUE) {
+				dropped += 1;
+			}
+			sent = xQueueSendToBack(sub->queue, &item, 0);
+		}
+		break;
+
+	default:
+		sent = xQueueSendToBack(sub->queue, &item, 0);
+		break;
+	}
+
+	if (pdTRUE != sent) {
+		dropped += 1;
+	}
+
+	if (dropped > 0) {
+		gc_err("Event %u dropped, subscriber queue full", evtCode);
+	}
+
+	int	depth = (int)uxQueueMessagesWaiting(sub->queue);
+
+	portENTER_CRITICAL(&sub->lock);
+	sub->stats.notifyCount += 1;
+	sub->stats.dropCount   += dropped;
+	sub->stats.queueDepth   = depth;
+	if (depth > sub->stats.queueDepthMax) {
+		sub->stats.queueDepthMax = depth;
+	}
+	portEXIT_CRITICAL(&sub->lock);
+}
+
+
+void eventSubDelete(eventSub_t * sub)
+{
+	if (NULL == sub) {
+		return;
+	}
+
+	sub->stop = true;
+
+	// Wake the task if it is waiting, a full queue means it is not
+	subItem_t	item = {0};
+	xQueueSendToBack(sub->queue, &item, 0);
+}
+
+
+void eventSubGetStats(eventSub_t * sub, eventSubStats_t * ret)
+{
+	if (NULL == sub || NULL == ret) {
+		return;
+	}
+
+	portENTER_CRITICAL(&sub->lock);
+	*ret = sub->stats;
+	portEXIT_CRITICAL(&sub->lock);
+
+	ret->queueDepth = (int)uxQueueMessagesWaiting(sub->queue);
 }
 
 
@@ -203,6 +517,145 @@ const char * eventCtxName(callCtx_t ctx)
 }
 
 
+/**
+ * \brief Pass an event to one subscriber
+ */
+static void deliver(cbTab_t * entry, callCtx_t ctx, uint32_t evtCode, uint32_t evtData)
+{
+	if (entry->sub) {
+		eventSubPost(entry->sub, (uint32_t)ctx, evtCode, evtData);
+		return;
+	}
+
+	int64_t		t0 = esp_timer_get_time();
+	entry->cbFunc(entry->cbData, ctx, evtCode, evtData);
+	uint32_t	us = (uint32_t)(esp_timer_get_time() - t0);
+
+	entry->stats.notifyCount    += 1;
+	entry->stats.deliverCount   += 1;
+	entry->stats.handlerUsTotal += us;
+	if (us > entry->stats.handlerUsMax) {
+		entry->stats.handlerUsMax = us;
+	}
+}
+
+
+/**
+ * \brief Make room in the dispatch table for a new subscriber
+ *
+ * The table is rebuilt by \ref buildDispatch once the subscriber is linked
+ */
+static esp_err_t reserveDispatch(cbCtrl_t * pCtrl, uint64_t evtMask)
+{
+	int	need = pCtrl->dispLen + __builtin_popcountll(evtMask);
+
+	if (need <= pCtrl->dispCap) {
+		return ESP_OK;
+	}
+
+	cbTab_t **	tab = cs_heap_calloc(need, sizeof(*tab));
+	if (NULL == tab) {
+		return ESP_ERR_NO_MEM;
+	}
+
+	// Keep the current table usable until it is rebuilt
+	if (pCtrl->dispLen > 0) {
+		memcpy(tab, pCtrl->dispTab, pCtrl->dispLen * sizeof(*tab));
+	}
+	cs_heap_free(pCtrl->dispTab);
+	pCtrl->dispTab = tab;
+	pCtrl->dispCap = need;
+	return ESP_OK;
+}
+
+
+/**
+ * \brief Rebuild the per-code dispatch table from the subscriber list
+ *
+ * Called with the list mutex held, after \ref reserveDispatch for a new
+ * subscriber. Never needs more room than was reserved.
+ */
+static void buildDispatch(cbCtrl_t * pCtrl)
+{
+	uint64_t	wanted = 0;
+	int			len    = 0;
+	uint32_t	code;
+	cbTab_t *	entry;
+
+	for (code = 0; code < EVENT_NUM_CODES; code++) {
+		pCtrl->dispIdx[code] = (uint16_t)len;
+
+		for (entry = pCtrl->head; NULL != entry; entry = entry->next) {
+			if (entry->evtMask & EVENT_CODE_BIT(code)) {
+				pCtrl->dispTab[len++] = entry;
+			}
+		}
+	}
+	pCtrl->dispIdx[EVENT_NUM_CODES] = (uint16_t)len;
+	pCtrl->dispLen = len;
+
+	for (entry = pCtrl->head; NULL != entry; entry = entry->next) {
+		wanted |= entry->evtMask;
+	}
+	pCtrl->wanted = wanted;
+}
+
+
+/**
+ * \brief Call the function of an asynchronous table entry
+ */
+static void callEntry(void * arg, uint32_t src, uint32_t evtCode, uint32_t evtData)
+{
+	cbTab_t *	entry = (cbTab_t *)arg;
+
+	entry->cbFunc(entry->cbData, (callCtx_t)src, evtCode, evtData);
+}
+
+
+/**
+ * \brief Task calling an asynchronous subscriber with its queued events
+ */
+static void subTask(void * param)
+{
+	eventSub_t *	sub = (eventSub_t *)param;
+	subItem_t		item;
+
+	while (true) {
+		if (xQueueReceive(sub->queue, &item, portMAX_DELAY) != pdTRUE) {
+			continue;
+		}
+
+		if (sub->stop) {
+			break;
+		}
+
+		int64_t		t0 = esp_timer_get_time();
+		uint32_t	evtData = item.isCopy ? CS_PTR2ADR(item.data) : item.evtData;
+
+		sub->call(sub->arg, item.src, item.evtCode, evtData);
+
+		uint32_t	us      = (uint32_t)(esp_timer_get_time() - t0);
+		uint32_t	latency = (uint32_t)(t0 - item.postTime);
+
+		portENTER_CRITICAL(&sub->lock);
+		sub->stats.deliverCount   += 1;
+		sub->stats.handlerUsTotal += us;
+		if (us > sub->stats.handlerUsMax) {
+			sub->stats.handlerUsMax = us;
+		}
+		if (latency > sub->stats.latencyUsMax) {
+			sub->stats.latencyUsMax = latency;
+		}
+		portEXIT_CRITICAL(&sub->lock);
+	}
+
+	vQueueDelete(sub->queue);
+	cs_heap_free(sub->arg);
+	cs_heap_free(sub);
+	vTaskDelete(NULL);
+}
+
+
 /**
  * \brief Find the table entry for the given callback function
  */
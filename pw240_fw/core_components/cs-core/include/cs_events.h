@@ -11,6 +11,8 @@
 #include <stdint.h>
 #include <esp_err.h>
 
+#include "event_callback.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -105,7 +107,7 @@ esp_err_t csEventInit(void);
  * \return ESP_OK Success
  * \return ESP_ERR_INVALID_ARG NULL passed for handle
  * \return ESP_ERR_INVALID_STATE Event support was not initialized
- * \return ESP_ERR_NO_MEM Insufficient memory
+ * \return ESP_ERR_NO_MEM Insufficient memory, or too many modules
  * \return ESP_FAIL The event set is already owned by another subsystem
  */
 esp_err_t csEventCreate(csEvtHandle_t * handle, csEvtModId_t modId, const char * modName);
@@ -135,6 +137,57 @@ esp_err_t csEventRegister(
 );
 
 
+/**
+ * \brief Register to receive events with delivery options
+ *
+ * As \ref csEventRegister, with the handler called as configured, see
+ * \ref eventSubConf_t. An asynchronous handler gets a queue and task for
+ * each module in the list.
+ *
+ * The bits of the event mask in conf are event IDs within each module,
+ * see \ref CS_EVT_EVT_ID.
+ *
+ * \param [in] evtModList Pointer to array of one or more module ids
+ * \param [in] evtModListSz Size of the module array
+ * \param [in] cbName Name of callback, names the handler's tasks
+ * \param [in] cbFunc Pointer to the event handler function
+ * \param [in] cbData Data to be passed to the event handler
+ * \param [in] conf Delivery options
+ *
+ * \return ESP_OK success
+ * \return ESP_ERR_INVALID_ARG NULL passed for evtSetList, cbFunc or conf
+ * \return ESP_ERR_INVALID_STATE Event support was not initialized
+ * \return ESP_ERR_NO_MEM Insufficient memory
+ * \return ESP_FAIL Other error
+ *
+ */
+esp_err_t csEventRegisterConf(
+	const csEvtModId_t *	evtModList,
+	unsigned int			evtModListSz,
+	const char *			cbName,
+	csEvtHandler_t			cbFunc,
+	uint32_t				cbData,
+	const eventSubConf_t *	conf
+);
+
+
+/**
+ * \brief Set the size of the data that evtData points to
+ *
+ * Asynchronous handlers are given a copy of this many bytes. With the
+ * default size of 0 they get the evtData pointer itself, which must then
+ * stay valid after \ref csEventNotify returns.
+ *
+ * \param [in] handle Obtained from \ref csEventCreate
+ * \param [in] evtDataSz Size of the event data, up to \ref EVENT_DATA_MAX_SZ
+ *
+ * \return ESP_OK success
+ * \return ESP_ERR_INVALID_ARG Bad handle or size
+ * \return ESP_ERR_INVALID_STATE Asynchronous handlers are registered
+ */
+esp_err_t csEventSetDataSize(csEvtHandle_t handle, size_t evtDataSz);
+
+
 /**
  * \brief Remove registration for one or more sources
  *
@@ -174,6 +227,17 @@ void csEventNotify(
 );
 
 
+/**
+ * \brief Read the statistics of a handler registered with a module
+ *
+ * \return ESP_OK success
+ * \return ESP_ERR_INVALID_STATE Event support was not initialized
+ * \return ESP_ERR_INVALID_ARG NULL passed for cbFunc or ret
+ * \return ESP_ERR_NOT_FOUND cbFunc is not registered with the module
+ */
+esp_err_t csEventGetStats(csEvtModId_t modId, csEvtHandler_t cbFunc, eventSubStats_t * ret);
+
+
 /**
  * \brief For the given event code return the name of the related module
  */
@@ -13,6 +13,7 @@ extern "C" {
 #endif
 
 #include "esp_system.h"
+#include <freertos/FreeRTOS.h>
 
 /**
  * \brief Context of a callback function
@@ -47,6 +48,100 @@ typedef void (* eventCbFunc_t)(
 typedef uint32_t	cbHandle_t;
 
 
+// Event codes covered by subscriber masks, codes from here up go only to
+// subscribers that want every code
+#define EVENT_NUM_CODES			(64)
+
+// Mask bit of an event code, see eventSubConf_t
+#define EVENT_CODE_BIT(code)	(((uint64_t)1) << (code))
+#define EVENT_MASK_ALL			(~((uint64_t)0))
+
+// Largest event data copied for asynchronous subscribers, see \ref eventSetDataSize
+#define EVENT_DATA_MAX_SZ		(32)
+
+
+/**
+ * \brief How a subscriber is called
+ */
+typedef enum {
+	eventDeliver_sync = 0,	// Called by the notifying task, under the list mutex
+	eventDeliver_async		// Queued, called by the subscriber's own task
+} eventDeliver_t;
+
+
+/**
+ * \brief What to do when an asynchronous subscriber's queue is full
+ */
+typedef enum {
+	eventOverflow_dropNewest = 0,	// Discard the new event
+	eventOverflow_dropOldest,		// Discard the oldest queued event
+	eventOverflow_block				// Make the notifier wait, up to blockMs
+} eventOverflow_t;
+
+
+/**
+ * \brief Subscriber configuration
+ *
+ * The task fields apply to asynchronous delivery only
+ */
+typedef struct {
+	eventDeliver_t		deliver;
+	const char *		name;		// Task name
+	UBaseType_t			priority;	// Task priority
+	uint32_t			stackSz;	// Task stack size
+	int					queueSz;	// Events that can be queued
+	eventOverflow_t		overflow;
+	uint32_t			blockMs;	// Longest wait with eventOverflow_block
+	uint64_t			evtMask;	// Event codes wanted, see EVENT_CODE_BIT, 0 for all
+} eventSubConf_t;
+
+#define EVENT_SUB_CONF_DEFAULT() {				\
+	.deliver  = eventDeliver_async,				\
+	.name     = "evtSub",						\
+	.priority = (tskIDLE_PRIORITY + 5),			\
+	.stackSz  = 3072,							\
+	.queueSz  = 8,								\
+	.overflow = eventOverflow_dropOldest,		\
+	.blockMs  = 0,								\
+	.evtMask  = EVENT_MASK_ALL					\
+}
+
+
+/**
+ * \brief Subscriber statistics, see \ref eventGetStats
+ */
+typedef struct {
+	uint32_t	notifyCount;	// Events offered to the subscriber
+	uint32_t	deliverCount;	// Handler calls
+	uint32_t	dropCount;		// Events lost to a full queue
+	int			queueDepth;		// Events queued now
+	int			queueDepthMax;	// Most events queued at once
+	uint32_t	handlerUsMax;	// Longest handler call
+	uint64_t	handlerUsTotal;	// Time spent in the handler
+	uint32_t	latencyUsMax;	// Longest wait from notify to handler call
+} eventSubStats_t;
+
+
+// Asynchronous subscriber, used by the event modules
+typedef struct eventSub_s	eventSub_t;
+
+/**
+ * \brief Called by an asynchronous subscriber's task with each event
+ *
+ * \param [in] arg Passed to \ref eventSubCreate
+ * \param [in] src Context or source of the event
+ * \param [in] evtCode Event code
+ * \param [in] evtData Event data, points to the subscriber's copy of it
+ * if the data size is not zero
+ */
+typedef void (* eventSubCall_t)(
+	void *		arg,
+	uint32_t	src,
+	uint32_t	evtCode,
+	uint32_t	evtData
+);
+
+
 /**
  * \brief Create an event callback
  *
@@ -79,6 +174,55 @@ esp_err_t eventRegisterCallback(
 );
 
 
+/**
+ * \brief Set the size of the data that evtData points to
+ *
+ * Asynchronous subscribers are called after \ref eventNotify returns, so
+ * they are given a copy of this many bytes at evtData. Pointers within the
+ * data are copied as they are. With the default size of 0, evtData is
+ * passed as a value.
+ *
+ * \param [in] cbHandle Handle previously allocated by \ref eventRegisterCreate
+ * \param [in] evtDataSz Size of the event data, up to \ref EVENT_DATA_MAX_SZ
+ *
+ * \return ESP_OK On Success
+ * \return ESP_ERR_INVALID_ARG If cbHandle is 0 or the size is too large
+ * \return ESP_ERR_INVALID_STATE If asynchronous subscribers are registered
+ *
+ */
+esp_err_t eventSetDataSize(cbHandle_t cbHandle, size_t evtDataSz);
+
+
+/**
+ * \brief Register a callback with delivery options
+ *
+ * An asynchronous subscriber gets a bounded queue and a task that calls
+ * cbFunc, so a slow function does not hold up the notifier. Use synchronous
+ * delivery for functions that must see the event before \ref eventNotify
+ * returns. \ref eventRegisterCallback registers a synchronous subscriber.
+ *
+ * The event mask in conf limits the codes cbFunc is called for. Codes with
+ * no subscriber cost the notifier a single check.
+ *
+ * \param [in] cbHandle Handle previously allocated by \ref eventRegisterCreate
+ * \param [in] cbFunc Reference to callback function (see \ref eventCbFunc_t)
+ * \param [in] cbData Data to be passed to the callback function
+ * \param [in] conf Delivery options, see \ref EVENT_SUB_CONF_DEFAULT
+ *
+ * \return ESP_OK On Success
+ * \return ESP_ERR_INVALID_ARG If a parameter is bad
+ * \return ESP_ERR_NO_MEM If the queue or task could not be allocated
+ * \return ESP_FAIL If cbFunc is already registered
+ *
+ */
+esp_err_t eventRegisterSubscriber(
+	cbHandle_t				cbHandle,
+	eventCbFunc_t			cbFunc,
+	uint32_t				cbData,
+	const eventSubConf_t *	conf
+);
+
+
 /**
  * \brief Unregister a callback function
  *
@@ -111,6 +255,69 @@ void eventNotify(
 	uint32_t		evtData
 );
 
+/**
+ * \brief Read the statistics of a registered callback
+ *
+ * \param [in] cbHandle Handle previously allocated by \ref eventRegisterCreate
+ * \param [in] cbFunc Registered callback function
+ * \param [out] ret Statistics
+ *
+ * \return ESP_OK On Success
+ * \return ESP_ERR_INVALID_ARG If a parameter is NULL
+ * \return ESP_ERR_NOT_FOUND If cbFunc is not registered
+ *
+ */
+esp_err_t eventGetStats(
+	cbHandle_t			cbHandle,
+	eventCbFunc_t		cbFunc,
+	eventSubStats_t *	ret
+);
+
+
+/**
+ * \brief Create an asynchronous subscriber
+ *
+ * \param [out] ret The subscriber
+ * \param [in] conf Delivery options
+ * \param [in] dataSz Bytes of event data copied by \ref eventSubPost
+ * \param [in] call Function called by the subscriber's task
+ * \param [in] arg Passed to call, allocated with cs_heap_calloc, it is
+ * released by \ref eventSubDelete
+ *
+ * \return ESP_OK On Success
+ * \return ESP_ERR_INVALID_ARG If a parameter is bad
+ * \return ESP_ERR_NO_MEM If the queue or task could not be allocated
+ *
+ */
+esp_err_t eventSubCreate(
+	eventSub_t **			ret,
+	const eventSubConf_t *	conf,
+	size_t					dataSz,
+	eventSubCall_t			call,
+	void *					arg
+);
+
+
+/**
+ * \brief Queue an event for an asynchronous subscriber
+ *
+ * The caller serializes posts to one subscriber
+ */
+void eventSubPost(eventSub_t * sub, uint32_t src, uint32_t evtCode, uint32_t evtData);
+
+
+/**
+ * \brief Stop an asynchronous subscriber
+ *
+ * Events still queued are discarded. A call in progress completes after
+ * this returns, then the task releases the subscriber and its arg.
+ */
+void eventSubDelete(eventSub_t * sub);
+
+
+void eventSubGetStats(eventSub_t * sub, eventSubStats_t * ret);
+
+
 /**
  * \brief Provide a name string for the event context
  *
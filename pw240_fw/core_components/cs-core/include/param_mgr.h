@@ -57,6 +57,21 @@ struct csParamTab_s {
 };
 
 
+/**
+ * \brief Counters of parameter writes to flash
+ *
+ * See \ref paramMgrGetFlushStats
+ */
+typedef struct {
+	uint32_t	flushCount;		// Times the changes were written
+	uint32_t	paramsWritten;	// Parameters written
+	uint32_t	commitCount;	// Commits, at most one per namespace per flush
+	uint32_t	commitsSaved;	// Commits avoided by batching the writes
+	uint32_t	errCount;		// Failed writes and commits
+	uint32_t	stackFree;		// Least free stack of the write task, in bytes
+} paramMgrFlushStats_t;
+
+
 esp_err_t paramMgrInit(void);
 
 esp_err_t paramMgrParamsAdd(const char * src, csParamTab_t * pTab, int tabSz);
@@ -65,6 +80,12 @@ esp_err_t paramMgrStart(void);
 
 void paramMgrSettingsDump(void);
 
+esp_err_t paramMgrLookupBench(void);
+
+esp_err_t paramMgrFlush(void);
+
+esp_err_t paramMgrGetFlushStats(paramMgrFlushStats_t * ret);
+
 esp_err_t paramMgrReset(void);
 
 //esp_err_t paramMgrResetParam(const char * pKey);
@@ -79,6 +100,17 @@ esp_err_t paramMgrSetU32(const char * pName, uint32_t value);
 
 esp_err_t paramMgrSetStr(const char * pName, const char *);
 
+// Set a parameter by its table entry, which skips the name lookup
+esp_err_t paramMgrSetBoolRef(csParamTab_t * param, bool value);
+
+esp_err_t paramMgrSetU8Ref(csParamTab_t * param, uint8_t value);
+
+esp_err_t paramMgrSetI32Ref(csParamTab_t * param, int32_t value);
+
+esp_err_t paramMgrSetU32Ref(csParamTab_t * param, uint32_t value);
+
+esp_err_t paramMgrSetStrRef(csParamTab_t * param, const char * value);
+
 const csParamTab_t * paramMgrLookupParam(const char * name);
 
 esp_err_t paramMgrSetBlob(const char * pKey, void * value, size_t len);
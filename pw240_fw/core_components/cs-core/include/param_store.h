@@ -0,0 +1,105 @@
+/**
+ * \file param_store.h
+ *
+ * \brief Storage backends for the parameter manager
+ *
+ * The parameter manager keeps the values of its table parameters through
+ * one of these. Values pass in the type of the parameter's RAM copy: bool,
+ * uint8_t, int32_t, uint32_t or a string.
+ *
+ * Sets are staged until the next commit, which makes every staged set
+ * durable. A backend may make the sets of one commit atomic.
+ *
+ * Blobs and custom parameter initializers always use NVS.
+ */
+#ifndef __CS_CORE_PARAM_STORE_H__
+#define __CS_CORE_PARAM_STORE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "cs_common.h"
+#include "param_mgr.h"
+
+
+/**
+ * \brief Storage backend operations
+ */
+typedef struct {
+	const char *	name;
+
+	/**
+	 * \brief Prepare the store, called once by paramMgrInit
+	 */
+	esp_err_t	(* open)(void);
+
+	/**
+	 * \brief Read a value
+	 *
+	 * For strings, len holds the buffer size on entry and the length read,
+	 * including the terminator, on exit. It is not used for other types.
+	 *
+	 * \return ESP_OK Success
+	 * \return ESP_ERR_NVS_NOT_FOUND No value stored for the key
+	 * \return (other) Error code
+	 */
+	esp_err_t	(* get)(csNvSpace_t space, const char * key, objtype_t typ, void * value, size_t * len);
+
+	/**
+	 * \brief Stage a value to be written by the next commit
+	 */
+	esp_err_t	(* set)(csNvSpace_t space, const char * key, objtype_t typ, const void * value);
+
+	/**
+	 * \brief Write the staged values
+	 */
+	esp_err_t	(* commit)(csNvSpace_t space);
+
+	/**
+	 * \brief Remove every value of a space, takes effect at once
+	 */
+	esp_err_t	(* erase)(csNvSpace_t space);
+} paramStore_t;
+
+
+/**
+ * \brief One NVS key per parameter in the "cs_param" and "cs_sticky"
+ * namespaces, the default
+ */
+extern const paramStore_t	paramStoreNvs;
+
+/**
+ * \brief Append-only journal in the "cs_journal" partition, see
+ * param_store_journal.c
+ */
+extern const paramStore_t	paramStoreJournal;
+
+
+/**
+ * \brief Journal statistics
+ *
+ * See \ref paramStoreJournalGetStats
+ */
+typedef struct {
+	uint32_t	numKeys;		// Values held
+	uint32_t	areaSz;			// Bytes in each of the two areas
+	uint32_t	usedSz;			// Bytes used in the active area
+	uint32_t	liveSz;			// Bytes a compacted area would use
+	uint32_t	loadUs;			// Time taken to read the journal at boot
+	uint32_t	commitCount;	// Transactions written
+	uint32_t	bytesWritten;	// Bytes written, including compaction
+	uint32_t	compactCount;	// Compactions
+	uint32_t	errCount;		// Failed flash operations and bad records
+} paramStoreJournalStats_t;
+
+esp_err_t paramStoreJournalGetStats(paramStoreJournalStats_t * ret);
+
+esp_err_t paramStoreJournalCompact(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CS_CORE_PARAM_STORE_H__ */
@@ -6,7 +6,10 @@
 #include "cs_common.h"
 #include "cs_heap.h"
 #include "include/param_mgr.h"
+#include "include/param_store.h"
+#include "param_store_priv.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "assert.h"
 #include "nvs.h"
 #include "nvs_flash.h"
@@ -21,24 +24,78 @@
 //******************************************************************************
 
 // Apply a holdoff writing to flash when parameters change
+#ifdef CONFIG_PARAM_MGR_HOLDOFF_MS
+#define FLASH_UPDATE_TIMER_MS		(CONFIG_PARAM_MGR_HOLDOFF_MS)
+#else
 #define FLASH_UPDATE_TIMER_MS		(500)
+#endif
+
+// Longest a change waits for flash while further changes keep restarting
+// the holdoff
+#ifdef CONFIG_PARAM_MGR_MAX_DELAY_MS
+#define FLASH_UPDATE_MAX_DELAY_MS	(CONFIG_PARAM_MGR_MAX_DELAY_MS)
+#else
+#define FLASH_UPDATE_MAX_DELAY_MS	(5000)
+#endif
+
+// Longest paramMgrFlush waits for a write in progress
+#define FLUSH_WAIT_MS				(2000)
+
+// Where table parameters are kept
+#if defined(CONFIG_PARAM_MGR_STORE_JOURNAL)
+#define PARAM_STORE					(&paramStoreJournal)
+#else
+#define PARAM_STORE					(&paramStoreNvs)
+#endif
+
+// Smallest parameter index, it is kept at most half full
+#define INDEX_MIN_SLOTS				(16)
 
 
 //******************************************************************************
 // type definitions
 //******************************************************************************
 
+// State of one parameter
+typedef struct {
+	bool				isChanged;		// RAM copy to be written to flash
+	bool				shadowValid;	// The shadow holds the value in flash
+	bool				inCommit;		// Written, the shadow is valid once committed
+	union {
+		int32_t			i32;
+		uint32_t		u32;
+		char *			str;
+	} shadow;							// Last value written to or read from flash
+} paramState_t;
+
+
 // For constructing a linked list of parameter table entries
 typedef struct tableListEntry_s {
 	struct tableListEntry_s *	next;
 	const char *				tabName;
 	csParamTab_t *				table;
 	int							tableSz;
-	// Variable number of flags allocated, per table size
-	bool						ischanged[];
+	// Variable number of states allocated, per table size
+	paramState_t				state[];
 } tableListEntry_t;
 
 
+// One slot of the parameter index
+typedef struct {
+	uint32_t			hash;		// Hash of the key
+	csParamTab_t *		pTab;		// NULL for an empty slot
+	paramState_t *		state;
+} paramSlot_t;
+
+
+// Open addressed hash index of every registered parameter
+typedef struct {
+	paramSlot_t *		slot;
+	uint32_t			mask;		// Number of slots - 1
+	int					count;		// Parameters indexed
+} paramIndex_t;
+
+
 /**
 * \brief The task control structure
 */
@@ -47,10 +104,14 @@ typedef struct {
 	SemaphoreHandle_t	mutex;
 	TaskHandle_t		taskHandle;
 	TimerHandle_t		timer;
-	nvs_handle			nvStandard;
-	nvs_handle			nvSticky;
+	const paramStore_t *	store;		// Holds the table parameters
 	tableListEntry_t *	listHead;
 	tableListEntry_t *	listTail;
+	paramIndex_t		index;
+	SemaphoreHandle_t	flushMutex;		// Serializes writes to flash
+	bool				writePending;
+	TickType_t			pendingSince;	// Time of the oldest unwritten change
+	paramMgrFlushStats_t	stats;
 } taskCtrl_t;
 
 
@@ -58,14 +119,28 @@ typedef struct {
 // Local functions
 //******************************************************************************
 static esp_err_t findEntry(
-	tableListEntry_t *	pList,
+	taskCtrl_t *		pCtrl,
 	const char *		key,
 	csParamTab_t **		tab,
-	bool **				isChanged
+	paramState_t **		state
+);
+static esp_err_t findRef(taskCtrl_t * pCtrl, csParamTab_t * pTab, paramState_t ** state);
+static esp_err_t indexBuild(
+	paramIndex_t *		index,
+	tableListEntry_t *	pList,
+	tableListEntry_t *	pExtra,
+	int					numParams
 );
+static paramSlot_t * indexFind(const paramIndex_t * index, const char * key);
+
+static esp_err_t setBool(taskCtrl_t * pCtrl, csParamTab_t * pTab, paramState_t * state, bool value);
+static esp_err_t setU8(taskCtrl_t * pCtrl, csParamTab_t * pTab, paramState_t * state, uint8_t value);
+static esp_err_t setI32(taskCtrl_t * pCtrl, csParamTab_t * pTab, paramState_t * state, int32_t value);
+static esp_err_t setU32(taskCtrl_t * pCtrl, csParamTab_t * pTab, paramState_t * state, uint32_t value);
+static esp_err_t setStr(taskCtrl_t * pCtrl, csParamTab_t * pTab, paramState_t * state, const char * value);
 static esp_err_t resetConfig(taskCtrl_t * pCtrl);
-static esp_err_t loadParamTable(taskCtrl_t * pCtrl, csParamTab_t * pTab, int tabSz);
-static esp_err_t initParam(taskCtrl_t * pCtrl, csParamTab_t * pTab);
+static esp_err_t loadParamTable(taskCtrl_t * pCtrl, tableListEntry_t * pList);
+static esp_err_t initParam(taskCtrl_t * pCtrl, csParamTab_t * pTab, paramState_t * state);
 
 static nvs_handle csNvHandle(taskCtrl_t * pCtrl, csParamTab_t * pItem);
 
@@ -76,19 +151,12 @@ static esp_err_t checkU32Range(csParamTab_t * pTab, void * pValue);
 static esp_err_t checkStrLen(csParamTab_t * pTab, void * pValue);
 //static esp_err_t checkStrNum(gcParamTab_t * pTab, void * pValue);
 
+static void scheduleWrite(taskCtrl_t * pCtrl);
+static esp_err_t flushChanges(taskCtrl_t * pCtrl);
 static void nvTask(void * taskParam);
 static void timerCallback(TimerHandle_t tmr);
 
 
-//******************************************************************************
-// Constant data
-//******************************************************************************
-
-// Namespace in nvs for ConnectSense parameters
-static const char	nvSpaceStandard[] = {"cs_param"};
-static const char	nvSpaceSticky[]   = {"cs_sticky"};
-
-
 //******************************************************************************
 // Local data
 //******************************************************************************
@@ -114,27 +182,32 @@ esp_err_t paramMgrInit(void)
 	if ((pCtrl = cs_heap_calloc(1, sizeof(*pCtrl))) == NULL)
 		return ESP_ERR_NO_MEM;
 
-	// Open the name spaces for parameters
-
-	// Standard space
-	status = nvs_open(nvSpaceStandard, NVS_READWRITE, &pCtrl->nvStandard);
+	// Blobs and custom initializers always use the NVS store, table
+	// parameters the configured one
+	status = paramStoreNvs.open();
 	if (ESP_OK != status) {
-		gc_err("nvs_open \"%s\" failed", nvSpaceStandard);
+		gc_err("Parameter store \"%s\" open failed", paramStoreNvs.name);
 		return status;
 	}
 
-	// Sticky space - persists over factory resets
-	status = nvs_open(nvSpaceSticky, NVS_READWRITE, &pCtrl->nvSticky);
-	if (ESP_OK != status) {
-		gc_err("nvs_open \"%s\" failed", nvSpaceSticky);
-		return status;
+	pCtrl->store = PARAM_STORE;
+
+	if (&paramStoreNvs != pCtrl->store && (status = pCtrl->store->open()) != ESP_OK) {
+		// e.g. the partition is missing from the table, keep working from NVS
+		gc_err("Parameter store \"%s\" open failed (%d), using \"%s\"",
+			pCtrl->store->name, status, paramStoreNvs.name);
+		pCtrl->store = &paramStoreNvs;
 	}
 
-	// Create the mutex
+	// Create the mutexes
 	if ((pCtrl->mutex = xSemaphoreCreateMutex()) == NULL) {
 		gc_err("Mutex create failed");
 		return ESP_FAIL;
 	}
+	if ((pCtrl->flushMutex = xSemaphoreCreateMutex()) == NULL) {
+		gc_err("Mutex create failed");
+		return ESP_FAIL;
+	}
 
 	// Create the one-shot update timer
 	pCtrl->timer = xTimerCreate(
@@ -149,11 +222,12 @@ esp_err_t paramMgrInit(void)
 		return ESP_FAIL;
 	}
 
-	// Create the update task
+	// Create the update task, the journal store writes and compacts the
+	// partition from it so it gets the same stack as the energy log task
 	status = xTaskCreate(
 		nvTask,
 		"param_mgr",
-		1400,
+		3072,
 		(void *)pCtrl,
 		CS_TASK_PRIO_PARAM_MGR,
 		&pCtrl->taskHandle
@@ -189,8 +263,6 @@ esp_err_t paramMgrParamsAdd(const char * tabName, csParamTab_t * pTab, int tabSz
 		return ESP_FAIL;
 
 	esp_err_t		status;
-	csParamTab_t *	check;
-	int				i;
 
 	if (!pCtrl->isRunning)
 		return ESP_FAIL;
@@ -203,28 +275,12 @@ esp_err_t paramMgrParamsAdd(const char * tabName, csParamTab_t * pTab, int tabSz
 		return ESP_ERR_TIMEOUT;
 	}
 
-	// Make sure no conflicting parameter names in the existing list
-	//gc_dbg("check for conflicts");
-	for (i = 0, check = pTab; i < tabSz; i++, check++) {
-		// Check existing entries for match of check->nvKey
-		status = findEntry(pCtrl->listHead, check->nvKey, NULL, NULL);
-		if (ESP_OK == status) {
-			gc_err("Conflicting parameter \"%s\" found", check->nvKey);
-			status = ESP_FAIL;
-			goto exitMutex;
-		} else if (ESP_ERR_NOT_FOUND != status) {
-			gc_err("findEntry failed");
-			status = ESP_FAIL;
-			goto exitMutex;
-		}
-	}
-
 	// Allocate a table entry structure
 	int					memSz;
 	tableListEntry_t *	entry;
 
 	// Allocate space for the entry
-	memSz = sizeof(tableListEntry_t) + (sizeof(entry->ischanged[0]) * tabSz);
+	memSz = sizeof(tableListEntry_t) + (sizeof(entry->state[0]) * tabSz);
 	//gc_dbg("Allocate %d bytes", memSz);
 	if ((entry = cs_heap_calloc(1, memSz)) == NULL) {
 		status = ESP_ERR_NO_MEM;
@@ -237,6 +293,19 @@ esp_err_t paramMgrParamsAdd(const char * tabName, csParamTab_t * pTab, int tabSz
 	entry->table   = pTab;
 	entry->tableSz = tabSz;
 
+	// Index the registered parameters together with the new ones, this
+	// also finds conflicting parameter names
+	paramIndex_t	index;
+
+	status = indexBuild(&index, pCtrl->listHead, entry, pCtrl->index.count + tabSz);
+	if (ESP_OK != status) {
+		cs_heap_free(entry);
+		goto exitMutex;
+	}
+
+	cs_heap_free(pCtrl->index.slot);
+	pCtrl->index = index;
+
 	// Add the entry to the tail of linked list
 	if (NULL == pCtrl->listHead) {
 		// First entry
@@ -248,7 +317,7 @@ esp_err_t paramMgrParamsAdd(const char * tabName, csParamTab_t * pTab, int tabSz
 	pCtrl->listTail = entry;
 
 	// Load the parameters to memory
-	status = loadParamTable(pCtrl, pTab, tabSz);
+	status = loadParamTable(pCtrl, entry);
 
 exitMutex:
 	//gc_dbg("release mutex");
@@ -268,7 +337,7 @@ const csParamTab_t * paramMgrLookupParam(const char * name)
 
 	csParamTab_t *	entry;
 
-	if (findEntry(pCtrl->listHead, name, &entry, NULL) == ESP_OK)
+	if (findEntry(pCtrl, name, &entry, NULL) == ESP_OK)
 		return entry;
 
 	return NULL;
@@ -350,6 +419,210 @@ void paramMgrSettingsDump(void)
 }
 
 
+#if CONFIG_IOT8020_DEBUG
+// Parameters per table of the lookup benchmark
+#define BENCH_TAB_SZ	(10)
+#define BENCH_REPS		(10)
+
+/**
+ * \brief Find a named parameter by walking the tables, for comparison
+ */
+static csParamTab_t * benchScan(tableListEntry_t * pList, const char * key)
+{
+	for (; NULL != pList; pList = pList->next) {
+		csParamTab_t *	pTab = pList->table;
+		int				i;
+
+		for (i = 0; i < pList->tableSz; i++, pTab++) {
+			if (strcmp(key, pTab->nvKey) == 0) {
+				return pTab;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+
+/**
+ * \brief Time lookups in a set of synthetic parameters
+ */
+static esp_err_t benchRun(int numParams)
+{
+	esp_err_t			status = ESP_ERR_NO_MEM;
+	int					numTabs = (numParams + BENCH_TAB_SZ - 1) / BENCH_TAB_SZ;
+	struct csParamTab_s *	tab = cs_heap_calloc(numParams, sizeof(csParamTab_t));
+	char *				keys = cs_heap_calloc(numParams, 12);
+	tableListEntry_t **	list = cs_heap_calloc(numTabs, sizeof(tableListEntry_t *));
+	paramIndex_t		index = {0};
+	int					i;
+
+	if (NULL == tab || NULL == keys || NULL == list) {
+		goto exit;
+	}
+
+	for (i = 0; i < numParams; i++) {
+		snprintf(&keys[i * 12], 12, "bench_%04d", i);
+		tab[i].nvKey  = &keys[i * 12];
+		tab[i].objTyp = objtyp_u32;
+	}
+
+	for (i = 0; i < numTabs; i++) {
+		int	tabSz = (i < numTabs - 1) ? BENCH_TAB_SZ : numParams - i * BENCH_TAB_SZ;
+
+		list[i] = cs_heap_calloc(1, sizeof(tableListEntry_t) + tabSz * sizeof(paramState_t));
+		if (NULL == list[i]) {
+			goto exit;
+		}
+		list[i]->tabName = "bench";
+		list[i]->table   = &tab[i * BENCH_TAB_SZ];
+		list[i]->tableSz = tabSz;
+		if (i > 0) {
+			list[i - 1]->next = list[i];
+		}
+	}
+
+	if ((status = indexBuild(&index, list[0], NULL, numParams)) != ESP_OK) {
+		goto exit;
+	}
+
+	int64_t		t0;
+	uint32_t	usScan;
+	uint32_t	usIndex;
+	int			miss = 0;
+	int			rep;
+
+	t0 = esp_timer_get_time();
+	for (rep = 0; rep < BENCH_REPS; rep++) {
+		for (i = 0; i < numParams; i++) {
+			miss += (benchScan(list[0], tab[i].nvKey) != &tab[i]);
+		}
+	}
+	usScan = (uint32_t)(esp_timer_get_time() - t0);
+
+	t0 = esp_timer_get_time();
+	for (rep = 0; rep < BENCH_REPS; rep++) {
+		for (i = 0; i < numParams; i++) {
+			paramSlot_t *	slot = indexFind(&index, tab[i].nvKey);
+			miss += (NULL == slot || slot->pTab != &tab[i]);
+		}
+	}
+	usIndex = (uint32_t)(esp_timer_get_time() - t0);
+
+	gc_dbg("%4d parameters: scan %lu ns, index %lu ns per lookup (%lu slots)%s",
+		numParams,
+		(uint32_t)((uint64_t)usScan * 1000 / (numParams * BENCH_REPS)),
+		(uint32_t)((uint64_t)usIndex * 1000 / (numParams * BENCH_REPS)),
+		index.mask + 1,
+		(miss > 0) ? ", LOOKUP ERRORS" : ""
+	);
+
+	status = (miss > 0) ? ESP_FAIL : ESP_OK;
+
+exit:
+	if (NULL != list) {
+		for (i = 0; i < numTabs; i++) {
+			cs_heap_free(list[i]);
+		}
+	}
+	cs_heap_free(list);
+	cs_heap_free(index.slot);
+	cs_heap_free(keys);
+	cs_heap_free(tab);
+	return status;
+}
+#endif
+
+
+/**
+ * \brief Compare the time to look up a parameter by walking the tables
+ * with that of the hashed index
+ *
+ * Uses synthetic sets of 50, 200 and 1000 parameters in tables of 10,
+ * the registered parameters are not touched
+ *
+ * \return ESP_OK Success
+ * \return ESP_ERR_NO_MEM Not enough memory for the synthetic parameters
+ * \return ESP_ERR_NOT_SUPPORTED Not a debug build
+ */
+esp_err_t paramMgrLookupBench(void)
+{
+#if CONFIG_IOT8020_DEBUG
+	static const int	numParams[] = {50, 200, 1000};
+	esp_err_t			status = ESP_OK;
+	int					i;
+
+	for (i = 0; i < sizeof(numParams) / sizeof(numParams[0]) && ESP_OK == status; i++) {
+		status = benchRun(numParams[i]);
+	}
+
+	return status;
+#else
+	return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+
+/**
+ * \brief Write parameter changes to flash now
+ *
+ * Call before a reboot or a firmware update, so that no change is left
+ * waiting for the holdoff. Returns once the changes are written.
+ *
+ * \return ESP_OK Success
+ * \return ESP_ERR_TIMEOUT A write in progress did not finish
+ * \return (other) Error code of a failed write
+ */
+esp_err_t paramMgrFlush(void)
+{
+	taskCtrl_t *	pCtrl = taskCtrl;
+	if (NULL == pCtrl)
+		return ESP_FAIL;
+
+	esp_err_t	status;
+
+	if (!pCtrl->isRunning)
+		return ESP_OK;
+
+	xTimerStop(pCtrl->timer, 0);
+
+	if (xSemaphoreTake(pCtrl->flushMutex, pdMS_TO_TICKS(FLUSH_WAIT_MS)) != pdTRUE) {
+		gc_err("Could not acquire flush mutex");
+		return ESP_ERR_TIMEOUT;
+	}
+
+	status = flushChanges(pCtrl);
+
+	xSemaphoreGive(pCtrl->flushMutex);
+	return status;
+}
+
+
+/**
+ * \brief Read the counters of writes to flash
+ *
+ * \param [out] ret Counters
+ *
+ * \return ESP_OK Success
+ * \return ESP_ERR_INVALID_ARG ret is NULL
+ */
+esp_err_t paramMgrGetFlushStats(paramMgrFlushStats_t * ret)
+{
+	taskCtrl_t *	pCtrl = taskCtrl;
+	if (NULL == pCtrl)
+		return ESP_FAIL;
+
+	if (NULL == ret)
+		return ESP_ERR_INVALID_ARG;
+
+	xSemaphoreTake(pCtrl->flushMutex, portMAX_DELAY);
+	*ret = pCtrl->stats;
+	xSemaphoreGive(pCtrl->flushMutex);
+
+	return ESP_OK;
+}
+
+
 /*!
  * \brief Reset the configuration to factory defaults
  *
@@ -396,14 +669,15 @@ esp_err_t paramMgrResetParam(const char * pKey)
 
 	esp_err_t		status;
 	csParamTab_t *	pTab;
+	paramState_t *	state;
 
-	status = findEntry(pCtrl->listHead, pKey, &pTab, NULL);
+	status = findEntry(pCtrl, pKey, &pTab, &state);
 	if (ESP_OK != status) {
 		return ESP_FAIL;
 	}
 
 	if (pdPASS == xSemaphoreTake(pCtrl->mutex, pdMS_TO_TICKS(100))) {
-		status = initParam(pCtrl, pTab);
+		status = initParam(pCtrl, pTab, state);
 		xSemaphoreGive(pCtrl->mutex);
 	} else {
 		status = ESP_FAIL;
@@ -432,50 +706,50 @@ esp_err_t paramMgrSetBool(const char * pKey, bool value)
 
 	csParamTab_t *	pTab;
 	esp_err_t		status;
-	bool *			isChanged;
-	int8_t			storedVal;
+	paramState_t *	state;
 
 	if (NULL == pKey) {
 		return ESP_ERR_INVALID_ARG;
 	}
 
-	status = findEntry(pCtrl->listHead, pKey, &pTab, &isChanged);
+	status = findEntry(pCtrl, pKey, &pTab, &state);
 	if (ESP_OK != status) {
 		return status;
 	}
 
-	// Make sure the parameter is registered as type bool
-	if (objtyp_bool != pTab->objTyp) {
-		gc_err("Attempted to set %s as boolean", pKey);
-		return ESP_ERR_INVALID_ARG;
-	}
+	return setBool(pCtrl, pTab, state, value);
+}
 
-	// Validate the value
-	if (value != true && value != false) {
-		return ESP_ERR_INVALID_ARG;
-	}
 
-	if (xSemaphoreTake(pCtrl->mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
-		gc_err("Could not acquire mutex");
+/*!
+ * \brief Set the value of a boolean parameter by reference
+ *
+ * As \ref paramMgrSetBool, for a parameter given by its table entry, which
+ * avoids looking up the name
+ *
+ * \param [in] param Table entry of the parameter, as registered with
+ * \ref paramMgrParamsAdd
+ * \param [in] value : true (1) or false (0)
+ *
+ * \return ESP_OK Success
+ * \return ESP_ERR_NOT_FOUND The entry is not in a registered table
+ * \return (other) Error code
+ *
+ */
+esp_err_t paramMgrSetBoolRef(csParamTab_t * param, bool value)
+{
+	taskCtrl_t *	pCtrl = taskCtrl;
+	if (NULL == pCtrl)
 		return ESP_FAIL;
-	}
 
-	// Apply the new value to the RAM copy
-	*(bool *)pTab->pVar = (bool)value;
+	esp_err_t		status;
+	paramState_t *	state;
 
-	// Compare the new value with that stored in flash
-	status = nvs_get_i8(csNvHandle(pCtrl, pTab), pTab->nvKey, &storedVal);
-	if (ESP_OK == status && storedVal == value) {
-		// No change, do not schedule a flash write
-		*isChanged = false;
-	} else {
-		// Schedule a write to flash
-		*isChanged = true;
-		xTimerReset(pCtrl->timer, 0);
+	if ((status = findRef(pCtrl, param, &state)) != ESP_OK) {
+		return status;
 	}
 
-	xSemaphoreGive(pCtrl->mutex);
-	return ESP_OK;
+	return setBool(pCtrl, param, state, value);
 }
 
 
@@ -497,51 +771,40 @@ esp_err_t paramMgrSetU8(const char * pKey, uint8_t value)
 
 	esp_err_t		status;
 	csParamTab_t *	pTab;
-	bool *			isChanged;
-	uint8_t			storedVal;
+	paramState_t *	state;
 
 	if (NULL == pKey) {
 		return ESP_ERR_INVALID_ARG;
 	}
 
-	status = findEntry(pCtrl->listHead, pKey, &pTab, &isChanged);
+	status = findEntry(pCtrl, pKey, &pTab, &state);
 	if (ESP_OK != status) {
 		return status;
 	}
 
-	// Name matches, see if the type matches
-	if (objtyp_u8 != pTab->objTyp) {
-		gc_err("Attempted to set %s as u8", pKey);
-		return ESP_ERR_INVALID_ARG;
-	}
+	return setU8(pCtrl, pTab, state, value);
+}
 
-	// Validate the value
-	status = (pTab->check) ? pTab->check(pTab, &value) : checkU8Range(pTab, &value);
-	if (ESP_OK != status) {
-		return ESP_ERR_INVALID_ARG;
-	}
 
-	// Lock access to the parameter block
-	if (pdTRUE != xSemaphoreTake(pCtrl->mutex, pdMS_TO_TICKS(100))) {
-		gc_err("Could not acquire mutex");
+/*!
+ * \brief Set the value of an unsigned 8-bit parameter by reference
+ *
+ * See \ref paramMgrSetBoolRef
+ */
+esp_err_t paramMgrSetU8Ref(csParamTab_t * param, uint8_t value)
+{
+	taskCtrl_t *	pCtrl = taskCtrl;
+	if (NULL == pCtrl)
 		return ESP_FAIL;
-	}
 
-	// Apply the new value to the RAM copy
-	*(uint8_t *)pTab->pVar = value;
+	esp_err_t		status;
+	paramState_t *	state;
 
-	// Compare the new value with that stored in flash
-	status = nvs_get_u8(csNvHandle(pCtrl, pTab), pTab->nvKey, &storedVal);
-	if (ESP_OK == status && storedVal == value) {
-		*isChanged = false;
-	} else {
-		// Schedule a write to flash
-		*isChanged = true;
-		xTimerReset(pCtrl->timer, 0);
+	if ((status = findRef(pCtrl, param, &state)) != ESP_OK) {
+		return status;
 	}
 
-	xSemaphoreGive(pCtrl->mutex);
-	return ESP_OK;
+	return setU8(pCtrl, param, state, value);
 }
 
 
@@ -563,51 +826,40 @@ esp_err_t paramMgrSetI32(const char * pKey, int32_t value)
 
 	esp_err_t		status;
 	csParamTab_t *	pTab;
-	bool *			isChanged;
-	int32_t			storedVal;
+	paramState_t *	state;
 
 	if (NULL == pKey) {
 		return ESP_ERR_INVALID_ARG;
 	}
 
-	status = findEntry(pCtrl->listHead, pKey, &pTab, &isChanged);
+	status = findEntry(pCtrl, pKey, &pTab, &state);
 	if (ESP_OK != status) {
 		return status;
 	}
 
-	// Name matches, see if the type matches
-	if (objtyp_i32 != pTab->objTyp) {
-		gc_err("Attempted to set %s as i32", pKey);
-		return ESP_ERR_INVALID_ARG;
-	}
+	return setI32(pCtrl, pTab, state, value);
+}
 
-	// Validate the value
-	status = (pTab->check) ? pTab->check(pTab, &value) : checkI32Range(pTab, &value);
-	if (ESP_OK != status) {
-		return ESP_ERR_INVALID_ARG;
-	}
 
-	// Lock access to the parameter block
-	if (pdTRUE != xSemaphoreTake(pCtrl->mutex, pdMS_TO_TICKS(100))) {
-		gc_err("Could not acquire mutex");
+/*!
+ * \brief Set the value of a signed 32-bit parameter by reference
+ *
+ * See \ref paramMgrSetBoolRef
+ */
+esp_err_t paramMgrSetI32Ref(csParamTab_t * param, int32_t value)
+{
+	taskCtrl_t *	pCtrl = taskCtrl;
+	if (NULL == pCtrl)
 		return ESP_FAIL;
-	}
 
-	// Apply the new value to the RAM copy
-	*(int32_t *)pTab->pVar = value;
+	esp_err_t		status;
+	paramState_t *	state;
 
-	// Compare the new value with that stored in flash
-	status = nvs_get_i32(csNvHandle(pCtrl, pTab), pTab->nvKey, &storedVal);
-	if (ESP_OK == status && storedVal == value) {
-		*isChanged = false;
-	} else {
-		// Schedule a write to flash
-		*isChanged = true;
-		xTimerReset(pCtrl->timer, 0);
+	if ((status = findRef(pCtrl, param, &state)) != ESP_OK) {
+		return status;
 	}
 
-	xSemaphoreGive(pCtrl->mutex);
-	return ESP_OK;
+	return setI32(pCtrl, param, state, value);
 }
 
 
@@ -629,51 +881,40 @@ esp_err_t paramMgrSetU32(const char * pKey, uint32_t value)
 
 	esp_err_t		status;
 	csParamTab_t *	pTab;
-	bool *			isChanged;
-	uint32_t		storedVal;
+	paramState_t *	state;
 
 	if (NULL == pKey) {
 		return ESP_ERR_INVALID_ARG;
 	}
 
-	status = findEntry(pCtrl->listHead, pKey, &pTab, &isChanged);
+	status = findEntry(pCtrl, pKey, &pTab, &state);
 	if (ESP_OK != status) {
 		return status;
 	}
 
-	// Name matches, see if the type matches
-	if (objtyp_u32 != pTab->objTyp) {
-		gc_err("Attempted to set %s as u32", pKey);
-		return ESP_ERR_INVALID_ARG;
-	}
+	return setU32(pCtrl, pTab, state, value);
+}
 
-	// Validate the value
-	status = (pTab->check) ? pTab->check(pTab, &value) : checkU32Range(pTab, &value);
-	if (ESP_OK != status) {
-		return ESP_ERR_INVALID_ARG;
-	}
 
-	// Lock access to the parameter block
-	if (pdTRUE != xSemaphoreTake(pCtrl->mutex, pdMS_TO_TICKS(100))) {
-		gc_err("Could not acquire mutex");
+/*!
+ * \brief Set the value of an unsigned 32-bit parameter by reference
+ *
+ * See \ref paramMgrSetBoolRef
+ */
+esp_err_t paramMgrSetU32Ref(csParamTab_t * param, uint32_t value)
+{
+	taskCtrl_t *	pCtrl = taskCtrl;
+	if (NULL == pCtrl)
 		return ESP_FAIL;
-	}
 
-	// Apply the new value to the RAM copy
-	*(uint32_t *)pTab->pVar = value;
+	esp_err_t		status;
+	paramState_t *	state;
 
-	// Compare the new value with that stored in flash
-	status = nvs_get_u32(csNvHandle(pCtrl, pTab), pTab->nvKey, &storedVal);
-	if (ESP_OK == status && storedVal == value) {
-		*isChanged = false;
-	} else {
-		// Schedule a write to flash
-		*isChanged = true;
-		xTimerReset(pCtrl->timer, 0);
+	if ((status = findRef(pCtrl, param, &state)) != ESP_OK) {
+		return status;
 	}
 
-	xSemaphoreGive(pCtrl->mutex);
-	return ESP_OK;
+	return setU32(pCtrl, param, state, value);
 }
 
 
@@ -695,58 +936,40 @@ esp_err_t paramMgrSetStr(const char * pKey, const char * value)
 
 	esp_err_t		status;
 	csParamTab_t *	pTab;
-	bool *			isChanged;
-	size_t			bufLen;
+	paramState_t *	state;
 
 	if (NULL == pKey) {
 		return ESP_ERR_INVALID_ARG;
 	}
 
-	status = findEntry(pCtrl->listHead, pKey, &pTab, &isChanged);
+	status = findEntry(pCtrl, pKey, &pTab, &state);
 	if (ESP_OK != status) {
 		return status;
 	}
 
-	// Name matches, see if the type matches
-	if (objtyp_str != pTab->objTyp) {
-		gc_err("Attempted to set %s as string", pKey);
-		return ESP_ERR_INVALID_ARG;
-	}
+	return setStr(pCtrl, pTab, state, value);
+}
 
-	// Validate the value
-	if (pTab->check)
-		status = pTab->check(pTab, (void *)value);
-	else
-		status = checkStrLen(pTab, (void *)value);
-	if (ESP_OK != status) {
-		return ESP_ERR_INVALID_ARG;
-	}
 
-	// Lock access to the parameter block
-	if (pdTRUE != xSemaphoreTake(pCtrl->mutex, pdMS_TO_TICKS(100))) {
-		gc_err("Could not acquire mutex");
+/*!
+ * \brief Set the value of a string parameter by reference
+ *
+ * See \ref paramMgrSetBoolRef
+ */
+esp_err_t paramMgrSetStrRef(csParamTab_t * param, const char * value)
+{
+	taskCtrl_t *	pCtrl = taskCtrl;
+	if (NULL == pCtrl)
 		return ESP_FAIL;
-	}
 
-	// Apply the new value to the RAM copy
-	strlcpy((char *)pTab->pVar, value, pTab->maxVal);
-
-	// Compare the new value with that stored in flash
-	char	buf[100];
+	esp_err_t		status;
+	paramState_t *	state;
 
-	bufLen = sizeof(buf);
-	status = nvs_get_str(csNvHandle(pCtrl, pTab), pTab->nvKey, buf, &bufLen);
-	if (ESP_OK == status && strcmp(buf, (char *)pTab->pVar) == 0) {
-		// No change to the stored value
-		*isChanged = false;
-	} else {
-		// Schedule a write to flash
-		*isChanged = true;
-		xTimerReset(pCtrl->timer, 0);
+	if ((status = findRef(pCtrl, param, &state)) != ESP_OK) {
+		return status;
 	}
 
-	xSemaphoreGive(pCtrl->mutex);
-	return ESP_OK;
+	return setStr(pCtrl, param, state, value);
 }
 
 
@@ -783,7 +1006,7 @@ esp_err_t paramMgrSetBlob(const char * pKey, void * value, size_t len)
 		return ESP_FAIL;
 	}
 
-	nvs_handle	nvsHandle = pCtrl->nvStandard;
+	nvs_handle	nvsHandle = paramStoreNvsHandle(csNvSpace_standard);
 
 	status = nvs_set_blob(nvsHandle, pKey, value, len);
 	if (ESP_OK == status)
@@ -827,7 +1050,7 @@ esp_err_t paramMgrGetBlob(const char * pKey, void * value, size_t * len)
 		return ESP_FAIL;
 	}
 
-	status = nvs_get_blob(pCtrl->nvStandard, pKey, value, len);
+	status = nvs_get_blob(paramStoreNvsHandle(csNvSpace_standard), pKey, value, len);
 
 	xSemaphoreGive(pCtrl->mutex);
 	return status;
@@ -863,7 +1086,7 @@ esp_err_t paramMgrGetBlobSize(const char * pKey, size_t * len)
 	}
 
 	// Read the blob size
-	status = nvs_get_blob(pCtrl->nvStandard, pKey, NULL, len);
+	status = nvs_get_blob(paramStoreNvsHandle(csNvSpace_standard), pKey, NULL, len);
 
 	xSemaphoreGive(pCtrl->mutex);
 	return status;
@@ -897,9 +1120,11 @@ esp_err_t paramMgrDeleteBlob(const char * pKey)
 		return ESP_FAIL;
 	}
 
-	status = nvs_erase_key(pCtrl->nvStandard, pKey);
+	nvs_handle	nvsHandle = paramStoreNvsHandle(csNvSpace_standard);
+
+	status = nvs_erase_key(nvsHandle, pKey);
 	if (ESP_OK == status) {
-		status = nvs_commit(pCtrl->nvStandard);
+		status = nvs_commit(nvsHandle);
 	} else if (ESP_ERR_NVS_NOT_FOUND == status) {
 		status = ESP_OK;
 	}
@@ -916,41 +1141,195 @@ esp_err_t paramMgrDeleteBlob(const char * pKey)
 ////////////////////////////////////////////////////////////////////////////////
 
 
+/**
+ * \brief Hash of a parameter key, FNV-1a
+ */
+static uint32_t keyHash(const char * key)
+{
+	uint32_t	hash = 2166136261u;
+
+	while (*key) {
+		hash ^= (uint8_t)*key++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+
+/**
+ * \brief Find the index slot of a named parameter
+ *
+ * \return Slot of the parameter
+ * \return NULL The parameter is not indexed
+ */
+static paramSlot_t * indexFind(const paramIndex_t * index, const char * key)
+{
+	if (NULL == index->slot) {
+		return NULL;
+	}
+
+	uint32_t	hash = keyHash(key);
+	uint32_t	i    = hash & index->mask;
+
+	// The index is never full, so the probe ends at an empty slot
+	for (; NULL != index->slot[i].pTab; i = (i + 1) & index->mask) {
+		paramSlot_t *	slot = &index->slot[i];
+
+		if (hash == slot->hash && strcmp(key, slot->pTab->nvKey) == 0) {
+			return slot;
+		}
+	}
+
+	return NULL;
+}
+
+
+/**
+ * \brief Add the parameters of a table to an index
+ *
+ * \return ESP_OK Success
+ * \return ESP_FAIL A parameter name is already indexed
+ */
+static esp_err_t indexAddTable(paramIndex_t * index, tableListEntry_t * pList)
+{
+	csParamTab_t *	pTab = pList->table;
+	int				idx;
+
+	for (idx = 0; idx < pList->tableSz; idx++, pTab++) {
+		if (indexFind(index, pTab->nvKey) != NULL) {
+			gc_err("Conflicting parameter \"%s\" found", pTab->nvKey);
+			return ESP_FAIL;
+		}
+
+		uint32_t	hash = keyHash(pTab->nvKey);
+		uint32_t	i;
+
+		for (i = hash & index->mask; NULL != index->slot[i].pTab; i = (i + 1) & index->mask) {
+		}
+
+		index->slot[i].hash      = hash;
+		index->slot[i].pTab      = pTab;
+		index->slot[i].state     = &pList->state[idx];
+		index->count += 1;
+	}
+
+	return ESP_OK;
+}
+
+
+/**
+ * \brief Build an index of the parameters in a list of tables, and one more
+ *
+ * \param [out] index The new index
+ * \param [in] pList Head of the list of tables
+ * \param [in] pExtra A table not in the list yet, may be NULL
+ * \param [in] numParams Number of parameters in all the tables
+ *
+ * \return ESP_OK Success
+ * \return ESP_FAIL Two parameters have the same name
+ * \return ESP_ERR_NO_MEM Index allocation failed
+ */
+static esp_err_t indexBuild(
+	paramIndex_t *		index,
+	tableListEntry_t *	pList,
+	tableListEntry_t *	pExtra,
+	int					numParams
+)
+{
+	uint32_t	numSlots = INDEX_MIN_SLOTS;
+
+	// At most half full keeps the probes short
+	while (numSlots < 2 * (uint32_t)numParams) {
+		numSlots <<= 1;
+	}
+
+	index->slot  = cs_heap_calloc(numSlots, sizeof(paramSlot_t));
+	index->mask  = numSlots - 1;
+	index->count = 0;
+	if (NULL == index->slot) {
+		return ESP_ERR_NO_MEM;
+	}
+
+	esp_err_t	status = ESP_OK;
+
+	for (; NULL != pList && ESP_OK == status; pList = pList->next) {
+		status = indexAddTable(index, pList);
+	}
+	if (ESP_OK == status && NULL != pExtra) {
+		status = indexAddTable(index, pExtra);
+	}
+
+	if (ESP_OK != status) {
+		cs_heap_free(index->slot);
+		index->slot = NULL;
+	}
+
+	return status;
+}
+
+
 /**
 * \brief Find named parameter in the table
 *
+* Holds the mutex for the lookup, paramMgrParamsAdd replaces the index. The
+* table entry and state found stay valid after, they are never freed.
+*
 */
 static esp_err_t findEntry(
-	tableListEntry_t *	pList,
+	taskCtrl_t *		pCtrl,
 	const char *		key,
 	csParamTab_t **		tab,
-	bool **				isChanged
+	paramState_t **		state
 )
 {
-	csParamTab_t *		pTab;
-	int					idx;
-
 	if (NULL == key) {
 		return ESP_ERR_INVALID_ARG;
 	}
 
-	// Step through the linked list of parameter tables
-	for (; NULL != pList; pList = pList->next) {
-		pTab = pList->table;
+	if (xSemaphoreTake(pCtrl->mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+		gc_err("Could not acquire mutex");
+		return ESP_ERR_TIMEOUT;
+	}
 
-		for (idx = 0; idx < pList->tableSz; idx++, pTab++) {
-			if (strcmp(key, pTab->nvKey) == 0) {
-				// Found a match
-				if (NULL != tab) {
-					// Caller is requesting the reference to the table entry
-					*tab = pTab;
-				}
-				if (NULL != isChanged) {
-					// Caller is requesting the reference to isChanged flag
-					*isChanged = &pList->ischanged[idx];
-				}
-				return ESP_OK;
-			}
+	esp_err_t		status = ESP_OK;
+	paramSlot_t *	slot   = indexFind(&pCtrl->index, key);
+
+	if (NULL == slot) {
+		status = ESP_ERR_NOT_FOUND;
+	} else {
+		if (NULL != tab) {
+			// Caller is requesting the reference to the table entry
+			*tab = slot->pTab;
+		}
+		if (NULL != state) {
+			// Caller is requesting the reference to the parameter state
+			*state = slot->state;
+		}
+	}
+
+	xSemaphoreGive(pCtrl->mutex);
+	return status;
+}
+
+
+/**
+ * \brief Find the state of a table entry
+ *
+ * The tables are few, so this is cheaper than hashing the name
+ */
+static esp_err_t findRef(taskCtrl_t * pCtrl, csParamTab_t * pTab, paramState_t ** state)
+{
+	tableListEntry_t *	pList;
+
+	if (NULL == pTab) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	for (pList = pCtrl->listHead; NULL != pList; pList = pList->next) {
+		if (pTab >= pList->table && pTab < pList->table + pList->tableSz) {
+			*state = &pList->state[pTab - pList->table];
+			return ESP_OK;
 		}
 	}
 
@@ -958,6 +1337,267 @@ static esp_err_t findEntry(
 }
 
 
+/**
+ * \brief Record a value as the one in flash
+ *
+ * \param [in] state State of the parameter
+ * \param [in] pTab Table entry of the parameter
+ * \param [in] value Value in the type of the RAM copy
+ */
+static void shadowSet(paramState_t * state, csParamTab_t * pTab, const void * value)
+{
+	switch (pTab->objTyp)
+	{
+	case objtyp_bool:
+		state->shadow.u32 = *(bool *)value ? 1 : 0;
+		break;
+
+	case objtyp_u8:
+		state->shadow.u32 = *(uint8_t *)value;
+		break;
+
+	case objtyp_i32:
+		state->shadow.i32 = *(int32_t *)value;
+		break;
+
+	case objtyp_u32:
+		state->shadow.u32 = *(uint32_t *)value;
+		break;
+
+	case objtyp_str:
+		// Allocated once at the longest length, from SPIRAM
+		if (NULL == state->shadow.str) {
+			state->shadow.str = cs_heap_malloc(pTab->maxVal);
+			if (NULL == state->shadow.str) {
+				state->shadowValid = false;
+				return;
+			}
+		}
+		strlcpy(state->shadow.str, (const char *)value, pTab->maxVal);
+		break;
+
+	default:
+		state->shadowValid = false;
+		return;
+	}
+
+	state->shadowValid = true;
+}
+
+
+/**
+ * \brief Compare the RAM copy of a parameter with the value in flash
+ */
+static bool shadowMatches(paramState_t * state, csParamTab_t * pTab)
+{
+	if (!state->shadowValid) {
+		return false;
+	}
+
+	switch (pTab->objTyp)
+	{
+	case objtyp_bool:
+		return state->shadow.u32 == (*(bool *)pTab->pVar ? 1 : 0);
+
+	case objtyp_u8:
+		return state->shadow.u32 == *(uint8_t *)pTab->pVar;
+
+	case objtyp_i32:
+		return state->shadow.i32 == *(int32_t *)pTab->pVar;
+
+	case objtyp_u32:
+		return state->shadow.u32 == *(uint32_t *)pTab->pVar;
+
+	case objtyp_str:
+		return strcmp(state->shadow.str, (char *)pTab->pVar) == 0;
+
+	default:
+		return false;
+	}
+}
+
+
+/**
+ * \brief Schedule a write to flash if the RAM copy differs from flash
+ *
+ * Must be called with the mutex held
+ */
+static void markChanged(taskCtrl_t * pCtrl, csParamTab_t * pTab, paramState_t * state)
+{
+	if (shadowMatches(state, pTab)) {
+		// No change, do not schedule a flash write
+		state->isChanged = false;
+	} else {
+		state->isChanged = true;
+		scheduleWrite(pCtrl);
+	}
+}
+
+
+static esp_err_t setBool(taskCtrl_t * pCtrl, csParamTab_t * pTab, paramState_t * state, bool value)
+{
+	// Make sure the parameter is registered as type bool
+	if (objtyp_bool != pTab->objTyp) {
+		gc_err("Attempted to set %s as boolean", pTab->nvKey);
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	// Validate the value
+	if (value != true && value != false) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	if (xSemaphoreTake(pCtrl->mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+		gc_err("Could not acquire mutex");
+		return ESP_FAIL;
+	}
+
+	// Apply the new value to the RAM copy
+	*(bool *)pTab->pVar = (bool)value;
+
+	// Compare the new value with that stored in flash
+	markChanged(pCtrl, pTab, state);
+
+	xSemaphoreGive(pCtrl->mutex);
+	return ESP_OK;
+}
+
+
+static esp_err_t setU8(taskCtrl_t * pCtrl, csParamTab_t * pTab, paramState_t * state, uint8_t value)
+{
+	esp_err_t	status;
+
+	// Name matches, see if the type matches
+	if (objtyp_u8 != pTab->objTyp) {
+		gc_err("Attempted to set %s as u8", pTab->nvKey);
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	// Validate the value
+	status = (pTab->check) ? pTab->check(pTab, &value) : checkU8Range(pTab, &value);
+	if (ESP_OK != status) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	// Lock access to the parameter block
+	if (pdTRUE != xSemaphoreTake(pCtrl->mutex, pdMS_TO_TICKS(100))) {
+		gc_err("Could not acquire mutex");
+		return ESP_FAIL;
+	}
+
+	// Apply the new value to the RAM copy
+	*(uint8_t *)pTab->pVar = value;
+
+	// Compare the new value with that stored in flash
+	markChanged(pCtrl, pTab, state);
+
+	xSemaphoreGive(pCtrl->mutex);
+	return ESP_OK;
+}
+
+
+static esp_err_t setI32(taskCtrl_t * pCtrl, csParamTab_t * pTab, paramState_t * state, int32_t value)
+{
+	esp_err_t	status;
+
+	// Name matches, see if the type matches
+	if (objtyp_i32 != pTab->objTyp) {
+		gc_err("Attempted to set %s as i32", pTab->nvKey);
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	// Validate the value
+	status = (pTab->check) ? pTab->check(pTab, &value) : checkI32Range(pTab, &value);
+	if (ESP_OK != status) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	// Lock access to the parameter block
+	if (pdTRUE != xSemaphoreTake(pCtrl->mutex, pdMS_TO_TICKS(100))) {
+		gc_err("Could not acquire mutex");
+		return ESP_FAIL;
+	}
+
+	// Apply the new value to the RAM copy
+	*(int32_t *)pTab->pVar = value;
+
+	// Compare the new value with that stored in flash
+	markChanged(pCtrl, pTab, state);
+
+	xSemaphoreGive(pCtrl->mutex);
+	return ESP_OK;
+}
+
+
+static esp_err_t setU32(taskCtrl_t * pCtrl, csParamTab_t * pTab, paramState_t * state, uint32_t value)
+{
+	esp_err_t	status;
+
+	// Name matches, see if the type matches
+	if (objtyp_u32 != pTab->objTyp) {
+		gc_err("Attempted to set %s as u32", pTab->nvKey);
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	// Validate the value
+	status = (pTab->check) ? pTab->check(pTab, &value) : checkU32Range(pTab, &value);
+	if (ESP_OK != status) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	// Lock access to the parameter block
+	if (pdTRUE != xSemaphoreTake(pCtrl->mutex, pdMS_TO_TICKS(100))) {
+		gc_err("Could not acquire mutex");
+		return ESP_FAIL;
+	}
+
+	// Apply the new value to the RAM copy
+	*(uint32_t *)pTab->pVar = value;
+
+	// Compare the new value with that stored in flash
+	markChanged(pCtrl, pTab, state);
+
+	xSemaphoreGive(pCtrl->mutex);
+	return ESP_OK;
+}
+
+
+static esp_err_t setStr(taskCtrl_t * pCtrl, csParamTab_t * pTab, paramState_t * state, const char * value)
+{
+	esp_err_t	status;
+
+	// Name matches, see if the type matches
+	if (objtyp_str != pTab->objTyp) {
+		gc_err("Attempted to set %s as string", pTab->nvKey);
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	// Validate the value
+	if (pTab->check)
+		status = pTab->check(pTab, (void *)value);
+	else
+		status = checkStrLen(pTab, (void *)value);
+	if (ESP_OK != status) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	// Lock access to the parameter block
+	if (pdTRUE != xSemaphoreTake(pCtrl->mutex, pdMS_TO_TICKS(100))) {
+		gc_err("Could not acquire mutex");
+		return ESP_FAIL;
+	}
+
+	// Apply the new value to the RAM copy
+	strlcpy((char *)pTab->pVar, value, pTab->maxVal);
+
+	// Compare the new value with that stored in flash
+	markChanged(pCtrl, pTab, state);
+
+	xSemaphoreGive(pCtrl->mutex);
+	return ESP_OK;
+}
+
+
 #if 0
 static void setFlag(taskCtrl_t * pCtrl, const char * name, bool value)
 {
@@ -997,21 +1637,22 @@ static bool getFlag(taskCtrl_t * pCtrl, const char * name)
  * \param [in] pTab Pointer to table entry for parameter
  *
  */
-static esp_err_t initParam(taskCtrl_t * pCtrl, csParamTab_t * pTab)
+static esp_err_t initParam(taskCtrl_t * pCtrl, csParamTab_t * pTab, paramState_t * state)
 {
-	// Shorthand reference to NVS handle for this item
-	nvs_handle	nvs = csNvHandle(pCtrl, pTab);
-
 	esp_err_t	status;
-	uint8_t		i8Val;
+	bool		bVal;
 	uint8_t		u8Val;
 	uint32_t	u32Val;
 	int32_t		i32Val;
 	char *		next;
 
+	// The value in flash is unknown until written
+	state->shadowValid = false;
+
 	if (pTab->init) {
-		// Call the custom initialization function
-		status = pTab->init(nvs, pTab);
+		// Call the custom initialization function, the first set of the
+		// parameter will write it again
+		status = pTab->init(csNvHandle(pCtrl, pTab), pTab);
 
 	} else if (pTab->defVal) {
 		//gc_dbg("Initialize %s to %s", pTab->nvKey, pTab->defVal);
@@ -1019,43 +1660,50 @@ static esp_err_t initParam(taskCtrl_t * pCtrl, csParamTab_t * pTab)
 		switch (pTab->objTyp)
 		{
 		case objtyp_bool:
-			i8Val = strcmp(pTab->defVal, "0") == 0 ? 0 : 1;
-			status = nvs_set_i8(nvs, pTab->nvKey, i8Val);
+			bVal = strcmp(pTab->defVal, "0") == 0 ? false : true;
+			status = pCtrl->store->set(pTab->nvSpace, pTab->nvKey, objtyp_bool, &bVal);
 			if (ESP_OK == status) {
 				// Update RAM copy
-				*(bool *)pTab->pVar = i8Val ? true : false;
+				*(bool *)pTab->pVar = bVal;
+				shadowSet(state, pTab, pTab->pVar);
 			}
 			break;
 
 		case objtyp_u8:
 			u8Val = (uint8_t)strtoul(pTab->defVal, &next, 10);
-			status = nvs_set_u8(nvs, pTab->nvKey, u8Val);
+			status = pCtrl->store->set(pTab->nvSpace, pTab->nvKey, objtyp_u8, &u8Val);
 			if (ESP_OK == status) {
 				// Update RAM copy
 				*(uint8_t *)pTab->pVar = u8Val;
+				shadowSet(state, pTab, pTab->pVar);
 			}
 			break;
 
 		case objtyp_i32:
 			i32Val = strtol(pTab->defVal, &next, 10);
-			status = nvs_set_i32(nvs, pTab->nvKey, i32Val);
+			status = pCtrl->store->set(pTab->nvSpace, pTab->nvKey, objtyp_i32, &i32Val);
 			if (ESP_OK == status) {
 				// Update RAM copy
 				*(int32_t *)pTab->pVar = i32Val;
+				shadowSet(state, pTab, pTab->pVar);
 			}
 			break;
 
 		case objtyp_u32:
 			u32Val = strtoul(pTab->defVal, &next, 10);
-			status = nvs_set_u32(nvs, pTab->nvKey, u32Val);
+			status = pCtrl->store->set(pTab->nvSpace, pTab->nvKey, objtyp_u32, &u32Val);
 			if (ESP_OK == status) {
 				// Update RAM copy
 				*(uint32_t *)pTab->pVar = u32Val;
+				shadowSet(state, pTab, pTab->pVar);
 			}
 			break;
 
 		case objtyp_str:
-			status = nvs_set_str(nvs, pTab->nvKey, pTab->defVal);
+			status = pCtrl->store->set(pTab->nvSpace, pTab->nvKey, objtyp_str, pTab->defVal);
+			if (ESP_OK == status) {
+				shadowSet(state, pTab, pTab->defVal);
+			}
 			break;
 
 		default:
@@ -1064,7 +1712,7 @@ static esp_err_t initParam(taskCtrl_t * pCtrl, csParamTab_t * pTab)
 		}
 
 		if (ESP_OK == status) {
-			status = nvs_commit(nvs);
+			status = pCtrl->store->commit(pTab->nvSpace);
 			if (ESP_OK != status) {
 				gc_err("Failed to commit change to %s", pTab->nvKey);
 			}
@@ -1094,8 +1742,11 @@ static esp_err_t initParam(taskCtrl_t * pCtrl, csParamTab_t * pTab)
 static esp_err_t resetConfig(taskCtrl_t * pCtrl)
 {
 	// Erase the param storage block
-	nvs_erase_all(pCtrl->nvStandard);
-	nvs_commit(pCtrl->nvStandard);
+	(void)paramStoreNvs.erase(csNvSpace_standard);
+
+	if (&paramStoreNvs != pCtrl->store) {
+		(void)pCtrl->store->erase(csNvSpace_standard);
+	}
 
 	// Set default values for parameters
 	int					errCount = 0;
@@ -1109,7 +1760,7 @@ static esp_err_t resetConfig(taskCtrl_t * pCtrl)
 			if (csNvSpace_sticky == pTab->nvSpace)
 				continue;
 
-			if (initParam(pCtrl, pTab) != ESP_OK) {
+			if (initParam(pCtrl, pTab, &pList->state[idx]) != ESP_OK) {
 				errCount += 1;
 			}
 		}
@@ -1119,60 +1770,37 @@ static esp_err_t resetConfig(taskCtrl_t * pCtrl)
 }
 
 
-static esp_err_t loadParamTable(taskCtrl_t * pCtrl, csParamTab_t * pTab, int tabSz)
+static esp_err_t loadParamTable(taskCtrl_t * pCtrl, tableListEntry_t * pList)
 {
+	csParamTab_t *	pTab = pList->table;
 	int			idx;
 	esp_err_t	status;
-	int8_t		i8Val;
-	uint8_t		u8Val;
-	int32_t		i32Val;
-	uint32_t	u32Val;
 	size_t		bufLen;
 	int			errCt  = 0;
+	int			migrateCt = 0;
 
-	for (idx = 0; idx < tabSz; idx++, pTab++) {
-		// Get the namespace handle for this parameter
-		nvs_handle	nvs = csNvHandle(pCtrl, pTab);
-
+	for (idx = 0; idx < pList->tableSz; idx++, pTab++) {
 		switch (pTab->objTyp)
 		{
 		case objtyp_bool:
-			status = nvs_get_i8(nvs, pTab->nvKey, &i8Val);
-			if (ESP_OK == status) {
-				*(bool *)pTab->pVar = i8Val ? true : false;
-				//gc_dbg("Param: %s = %s", pTab->nvKey, i8Val ? "true" : "false");
-			}
-			break;
-
 		case objtyp_u8:
-			status = nvs_get_u8(nvs, pTab->nvKey, &u8Val);
-			if (ESP_OK == status) {
-				*(uint8_t *)pTab->pVar = u8Val;
-				//gc_dbg("Param: %s = %u", pTab->nvKey, u8Val);
-			}
-			break;
-
 		case objtyp_i32:
-			status = nvs_get_i32(nvs, pTab->nvKey, &i32Val);
-			if (ESP_OK == status) {
-				*(int32_t *)pTab->pVar = i32Val;
-				//gc_dbg("Param: %s = %ld", pTab->nvKey, i32Val);
-			}
-			break;
-
 		case objtyp_u32:
-			status = nvs_get_u32(nvs, pTab->nvKey, &u32Val);
-			if (ESP_OK == status) {
-				*(uint32_t *)pTab->pVar = u32Val;
-				//gc_dbg("Param: %s = %lu", pTab->nvKey, u32Val);
-			}
-			break;
-
 		case objtyp_str:
+			// Read straight into the RAM copy
 			bufLen = pTab->maxVal;
-			status = nvs_get_str(nvs, pTab->nvKey, (char *)pTab->pVar, &bufLen);
-			if (ESP_OK == status) {
-				//gc_dbg("Param: %s = %s", pTab->nvKey, (char *)pTab->pVar);
+			status = pCtrl->store->get(pTab->nvSpace, pTab->nvKey, pTab->objTyp, pTab->pVar, &bufLen);
+
+			if (ESP_ERR_NVS_NOT_FOUND == status && &paramStoreNvs != pCtrl->store) {
+				// Carry over a value kept in NVS before the store was changed
+				bufLen = pTab->maxVal;
+				status = paramStoreNvs.get(pTab->nvSpace, pTab->nvKey, pTab->objTyp, pTab->pVar, &bufLen);
+				if (ESP_OK == status) {
+					status = pCtrl->store->set(pTab->nvSpace, pTab->nvKey, pTab->objTyp, pTab->pVar);
+					if (ESP_OK == status) {
+						migrateCt += 1;
+					}
+				}
 			}
 			break;
 
@@ -1182,9 +1810,12 @@ static esp_err_t loadParamTable(taskCtrl_t * pCtrl, csParamTab_t * pTab, int tab
 			break;
 		}
 
-		if (ESP_ERR_NVS_NOT_FOUND == status) {
+		if (ESP_OK == status) {
+			// The RAM copy now holds the value in flash
+			shadowSet(&pList->state[idx], pTab, pTab->pVar);
+		} else if (ESP_ERR_NVS_NOT_FOUND == status) {
 			// Initialize this parameter
-			if (initParam(pCtrl, pTab) != ESP_OK) {
+			if (initParam(pCtrl, pTab, &pList->state[idx]) != ESP_OK) {
 				errCt++;
 			}
 		} else if (ESP_OK != status) {
@@ -1193,19 +1824,25 @@ static esp_err_t loadParamTable(taskCtrl_t * pCtrl, csParamTab_t * pTab, int tab
 		}
 	}
 
+	if (migrateCt > 0) {
+		gc_dbg("Copied %d parameters from NVS to \"%s\"", migrateCt, pCtrl->store->name);
+
+		// Values of both spaces were staged
+		if (pCtrl->store->commit(csNvSpace_standard) != ESP_OK ||
+			pCtrl->store->commit(csNvSpace_sticky) != ESP_OK
+		) {
+			gc_err("Failed to commit parameters copied from NVS");
+			errCt++;
+		}
+	}
+
 	return (errCt == 0) ? ESP_OK : ESP_FAIL;
 }
 
 
 static nvs_handle csNvHandle(taskCtrl_t * pCtrl, csParamTab_t * pItem)
 {
-	switch (pItem->nvSpace)
-	{
-	case csNvSpace_sticky:
-		return pCtrl->nvSticky;
-	default:
-		return pCtrl->nvStandard;
-	}
+	return paramStoreNvsHandle(pItem->nvSpace);
 }
 
 
@@ -1327,18 +1964,112 @@ static esp_err_t checkStrLen(csParamTab_t * pTab, void * pValue)
 }
 
 
-static void nvTask(void * taskParam)
+/**
+ * \brief Start or restart the holdoff before writing changes to flash
+ *
+ * Must be called with the mutex held
+ */
+static void scheduleWrite(taskCtrl_t * pCtrl)
 {
-	taskCtrl_t *		pCtrl = (taskCtrl_t *)taskParam;
+	TickType_t	now = xTaskGetTickCount();
+
+	if (!pCtrl->writePending) {
+		pCtrl->writePending = true;
+		pCtrl->pendingSince = now;
+	}
+
+	if ((now - pCtrl->pendingSince) >= pdMS_TO_TICKS(FLASH_UPDATE_MAX_DELAY_MS)) {
+		// Changes keep coming, write those so far without waiting for a pause
+		xTimerStop(pCtrl->timer, 0);
+		xTaskNotifyGive(pCtrl->taskHandle);
+	} else {
+		xTimerReset(pCtrl->timer, 0);
+	}
+}
+
+
+/**
+ * \brief Stage the RAM copy of a parameter in the store
+ *
+ * Must be called with the mutex held
+ */
+static esp_err_t writeParam(taskCtrl_t * pCtrl, csParamTab_t * pTab)
+{
+	switch (pTab->objTyp)
+	{
+	case objtyp_bool:
+	case objtyp_u8:
+	case objtyp_i32:
+	case objtyp_u32:
+	case objtyp_str:
+		return pCtrl->store->set(pTab->nvSpace, pTab->nvKey, pTab->objTyp, pTab->pVar);
+
+	default:
+		gc_err("Unsupported data type for %s", pTab->nvKey);
+		return ESP_FAIL;
+	}
+}
+
+
+/**
+ * \brief Mark the parameters written to a namespace as committed, or not
+ *
+ * On success the shadows taken when the parameters were written become
+ * valid. On failure the parameters are marked changed again and another
+ * flush is scheduled. Must be called with the mutex held.
+ */
+static void commitDone(taskCtrl_t * pCtrl, csNvSpace_t space, bool committed)
+{
+	tableListEntry_t *	pList;
+	int					i;
+
+	for (pList = pCtrl->listHead; NULL != pList; pList = pList->next) {
+		for (i = 0; i < pList->tableSz; i++) {
+			paramState_t *	state = &pList->state[i];
+
+			if (!state->inCommit || pList->table[i].nvSpace != space)
+				continue;
+
+			state->inCommit = false;
+			if (committed) {
+				state->shadowValid = true;
+			} else {
+				state->isChanged = true;
+			}
+		}
+	}
+
+	if (!committed) {
+		scheduleWrite(pCtrl);
+	}
+}
+
+
+/**
+ * \brief Write all changed parameters to flash
+ *
+ * The changes to each namespace are written as one transaction, with a
+ * single commit. The shadows only count as the value in flash once the
+ * commit succeeds. Must be called with the flush mutex held.
+ */
+static esp_err_t flushChanges(taskCtrl_t * pCtrl)
+{
+	csNvSpace_t			spaceList[] = {csNvSpace_standard, csNvSpace_sticky};
+	esp_err_t			ret = ESP_OK;
 	esp_err_t			status;
+	int					n;
 	int					i;
 	tableListEntry_t *	pList;
 	csParamTab_t *		pTab;
 
-	while (1)
-	{
-		// Wait for signal to update flash
-		(void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	// Changes made from here on start a new holdoff
+	xSemaphoreTake(pCtrl->mutex, portMAX_DELAY);
+	pCtrl->writePending = false;
+	xSemaphoreGive(pCtrl->mutex);
+
+	for (n = 0; n < sizeof(spaceList) / sizeof(spaceList[0]); n++) {
+		csNvSpace_t	space = spaceList[n];
+		uint32_t	numWritten = 0;
 
 		// Step through the linked list of tables
 		for (pList = pCtrl->listHead; NULL != pList; pList = pList->next) {
@@ -1346,66 +2077,74 @@ static void nvTask(void * taskParam)
 			// Step through the entries in the current table
 			for (i = 0, pTab = pList->table; i < pList->tableSz; i++, pTab++) {
 
-				// Skip over unchanged entries
-				if (!pList->ischanged[i])
+				// Skip over unchanged entries and those of other namespaces
+				if (!pList->state[i].isChanged || pTab->nvSpace != space)
 					continue;
 
-				// Get the namespace handle for this item
-				nvs_handle	nvs = csNvHandle(pCtrl, pTab);
-
 				xSemaphoreTake(pCtrl->mutex, portMAX_DELAY);
 
-				// Write the object to flash
-				switch (pTab->objTyp)
-				{
-				case objtyp_bool:
-					// Translate bool to int8_t having either 0 or 1
-					//gc_dbg("Flash update \"%s\": %s", pTab->nvKey, *(bool *)pTab->pVar ? "true" : "false");
-					status = nvs_set_i8(nvs, pTab->nvKey, *(bool *)pTab->pVar ? 1 : 0);
-					break;
-
-				case objtyp_u8:
-					//gc_dbg("Flash update \"%s\": %u", pTab->nvKey, *(uint8)t *)pTab->pVar);
-					status = nvs_set_u8(nvs, pTab->nvKey, *(uint8_t *)pTab->pVar);
-					break;
-
-				case objtyp_i32:
-					//gc_dbg("Flash update \"%s\" %d:", pTab->nvKey, *(int32)t *)pTab->pVar);
-					status = nvs_set_i32(nvs, pTab->nvKey, *(int32_t *)pTab->pVar);
-					break;
-
-				case objtyp_u32:
-					//gc_dbg("Flash update \"%s\": %u", pTab->nvKey, *(uint32)t *)pTab->pVar);
-					status = nvs_set_u32(nvs, pTab->nvKey, *(uint32_t *)pTab->pVar);
-					break;
-
-				case objtyp_str:
-					//gc_dbg("Flash update \"%s\": %s", pTab->nvKey, (char *)pTab->pVar);
-					status = nvs_set_str(nvs, pTab->nvKey, (const char *)pTab->pVar);
-					break;
-
-				default:
-					gc_err("Unsupported data type for %s", pTab->nvKey);
-					status = ESP_FAIL;
-					break;
+				status = writeParam(pCtrl, pTab);
+				if (ESP_OK == status) {
+					// Keep the value written, it is in flash after the commit
+					shadowSet(&pList->state[i], pTab, pTab->pVar);
+					pList->state[i].inCommit = true;
 				}
+				pList->state[i].shadowValid = false;
 
 				// Clear the 'changed' flag
-				pList->ischanged[i] = false;
+				pList->state[i].isChanged = false;
+
+				xSemaphoreGive(pCtrl->mutex);
 
 				if (ESP_OK == status) {
-					// Commit this change
-					status = nvs_commit(nvs);
-					if (ESP_OK != status) {
-						gc_err("Failed to commit change to %s", pTab->nvKey);
-					}
+					numWritten += 1;
 				} else {
 					gc_err("Failed to update %s", pTab->nvKey);
+					pCtrl->stats.errCount += 1;
+					ret = status;
 				}
-
-				xSemaphoreGive(pCtrl->mutex);
 			}
 		}
+
+		if (0 == numWritten)
+			continue;
+
+		// One commit for all the changes to this namespace
+		status = pCtrl->store->commit(space);
+
+		xSemaphoreTake(pCtrl->mutex, portMAX_DELAY);
+		commitDone(pCtrl, space, (ESP_OK == status));
+		xSemaphoreGive(pCtrl->mutex);
+
+		if (ESP_OK != status) {
+			gc_err("Failed to commit %u changes", numWritten);
+			pCtrl->stats.errCount += 1;
+			ret = status;
+		}
+
+		pCtrl->stats.paramsWritten += numWritten;
+		pCtrl->stats.commitCount   += 1;
+		pCtrl->stats.commitsSaved  += numWritten - 1;
+	}
+
+	pCtrl->stats.flushCount += 1;
+	return ret;
+}
+
+
+static void nvTask(void * taskParam)
+{
+	taskCtrl_t *	pCtrl = (taskCtrl_t *)taskParam;
+
+	while (1)
+	{
+		// Wait for signal to update flash
+		(void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		xSemaphoreTake(pCtrl->flushMutex, portMAX_DELAY);
+		(void)flushChanges(pCtrl);
+		pCtrl->stats.stackFree = uxTaskGetStackHighWaterMark(NULL);
+		xSemaphoreGive(pCtrl->flushMutex);
 	}
 }
 
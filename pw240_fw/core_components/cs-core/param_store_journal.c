@@ -0,0 +1,945 @@
+/*! \file param_store_journal.c
+ *
+ * Parameter store kept as an append-only journal in the "cs_journal"
+ * flash partition
+ *
+ * The partition is split into two areas of whole sectors. One area is
+ * active: a header, then transactions appended one after another. Each
+ * commit appends one transaction holding every value staged since the
+ * previous commit, so the values of a commit are written together or not
+ * at all. A RAM copy of the current values answers every read, it is
+ * rebuilt at boot from one read of the active area.
+ *
+ * When a transaction does not fit, the other area is erased and the
+ * current values are written to it as a snapshot, then its header. The
+ * header is written last, so until it is the old area stays the one in
+ * use. At boot an area that is mostly superseded values is compacted
+ * the same way.
+ *
+ * All multi-byte fields are little-endian.
+ *
+ * Area header
+ *   Offset  Len  Content
+ *        0    4  Magic "PJRN"
+ *        4    2  Format version, 1
+ *        6    2  0xFFFF
+ *        8    4  Sequence number, the higher valid area is active
+ *       12    4  CRC-32 of bytes 0..11
+ *
+ * Transaction, padded with 0xFF to a multiple of 4 bytes
+ *   Offset  Len  Content
+ *        0    2  Magic "TX" (0xFFFF marks erased flash, the end)
+ *        2    2  Payload length n
+ *        4    4  CRC-32 of bytes 0..3 and the payload
+ *        8    n  Records
+ *
+ * Record
+ *   Offset  Len  Content
+ *        0    1  Operation, 1 set a value, 2 erase a space
+ *        1    1  Space, csNvSpace_t
+ *        2    1  Type, objtype_t
+ *        3    1  Key length k, 15 at most
+ *        4    2  Value length v
+ *        6    k  Key
+ *      6+k    v  Value: 1 byte for bool and u8, 4 for i32 and u32, the
+ *                characters without terminator for a string
+ */
+#include <string.h>
+#include <esp_partition.h>
+#include "nvs.h"
+#include "esp32/rom/crc.h"
+#include "esp_timer.h"
+
+#include "cs_common.h"
+#include "cs_heap.h"
+#include "param_mgr.h"
+#include "param_store.h"
+
+// Comment out the MOD_NAME line to disable debug prints from this file
+#define MOD_NAME	"param_journal"
+#include "mod_debug.h"
+
+
+//******************************************************************************
+// Defines
+//******************************************************************************
+
+#define JRN_PARTITION			"cs_journal"
+#define JRN_SECTOR_SZ			(4096)
+#define JRN_MAGIC				(0x4E524A50)	// "PJRN"
+#define JRN_VERSION				(1)
+#define JRN_HDR_SZ				(16)
+
+#define JRN_TXN_MAGIC			(0x5854)		// "TX"
+#define JRN_TXN_HDR_SZ			(8)
+#define JRN_TXN_MAX				(0xFFFF)
+
+#define JRN_REC_HDR_SZ			(6)
+#define JRN_KEY_MAX				(15)
+
+#define JRN_OP_SET				(1)
+#define JRN_OP_ERASE			(2)
+
+// Payload of each snapshot transaction written by a compaction
+#define JRN_SNAPSHOT_MAX		(2048)
+
+// Compact at boot once the area is this full and at most half of it live
+#define JRN_COMPACT_PCT			(75)
+
+#define JRN_ALIGN(n)			(((n) + 3) & ~3)
+
+#define JRN_MUTEX_GET(ctrl)		xSemaphoreTake((ctrl)->mutex, portMAX_DELAY)
+#define JRN_MUTEX_PUT(ctrl)		xSemaphoreGive((ctrl)->mutex)
+
+
+//******************************************************************************
+// Data types
+//******************************************************************************
+
+/**
+ * \brief Current value of one key
+ */
+typedef struct {
+	uint8_t		space;
+	uint8_t		typ;
+	uint16_t	valLen;
+	char		key[JRN_KEY_MAX + 1];
+	uint8_t *	val;
+} jrnKey_t;
+
+
+/**
+ * \brief Bytes being put together for a transaction
+ *
+ * The transaction header is reserved at the start
+ */
+typedef struct {
+	uint8_t *	buf;
+	uint32_t	len;
+	uint32_t	size;
+} txnBuf_t;
+
+
+typedef struct {
+	const esp_partition_t *	part;
+	SemaphoreHandle_t		mutex;
+	uint32_t				areaSz;
+	int						active;		// Area in use, 0 or 1
+	uint32_t				seq;		// Sequence number of the active area
+	uint32_t				writeOff;	// Where the next transaction goes
+	jrnKey_t *				keys;
+	int						numKeys;
+	int						maxKeys;
+	txnBuf_t				staged;		// Sets since the last commit
+	paramStoreJournalStats_t	stats;
+} control_t;
+
+
+//******************************************************************************
+// Local functions
+//******************************************************************************
+
+static esp_err_t compact(control_t * pCtrl);
+
+
+//******************************************************************************
+// Local data
+//******************************************************************************
+
+static control_t *	control;
+
+
+static inline void putU16(uint8_t * p, uint16_t val)
+{
+	p[0] = (uint8_t)(val >> 0);
+	p[1] = (uint8_t)(val >> 8);
+}
+
+
+static inline void putU32(uint8_t * p, uint32_t val)
+{
+	p[0] = (uint8_t)(val >> 0);
+	p[1] = (uint8_t)(val >> 8);
+	p[2] = (uint8_t)(val >> 16);
+	p[3] = (uint8_t)(val >> 24);
+}
+
+
+static inline uint16_t getU16(const uint8_t * p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+
+static inline uint32_t getU32(const uint8_t * p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+/**
+ * \brief Size of a value as stored
+ */
+static int valueLen(objtype_t typ, const void * value)
+{
+	switch (typ)
+	{
+	case objtyp_bool:
+	case objtyp_u8:
+		return 1;
+
+	case objtyp_i32:
+	case objtyp_u32:
+		return 4;
+
+	case objtyp_str:
+		return strlen((const char *)value);
+
+	default:
+		return -1;
+	}
+}
+
+
+static jrnKey_t * keyFind(control_t * pCtrl, uint8_t space, const char * key, int keyLen)
+{
+	int	i;
+
+	for (i = 0; i < pCtrl->numKeys; i++) {
+		jrnKey_t *	k = &pCtrl->keys[i];
+
+		if (k->space == space && strncmp(k->key, key, keyLen) == 0 && '\0' == k->key[keyLen]) {
+			return k;
+		}
+	}
+
+	return NULL;
+}
+
+
+/**
+ * \brief Apply one record to the RAM copy
+ */
+static esp_err_t keyApply(
+	control_t *		pCtrl,
+	uint8_t			op,
+	uint8_t			space,
+	uint8_t			typ,
+	const char *	key,
+	int				keyLen,
+	const uint8_t *	val,
+	int				valLen
+)
+{
+	int	i;
+
+	if (JRN_OP_ERASE == op) {
+		for (i = 0; i < pCtrl->numKeys; ) {
+			if (pCtrl->keys[i].space == space) {
+				cs_heap_free(pCtrl->keys[i].val);
+				pCtrl->keys[i] = pCtrl->keys[--pCtrl->numKeys];
+			} else {
+				i++;
+			}
+		}
+		return ESP_OK;
+	}
+
+	jrnKey_t *	k = keyFind(pCtrl, space, key, keyLen);
+
+	if (NULL == k) {
+		if (pCtrl->numKeys == pCtrl->maxKeys) {
+			int			maxKeys = (pCtrl->maxKeys > 0) ? pCtrl->maxKeys * 2 : 32;
+			jrnKey_t *	keys    = cs_heap_realloc(pCtrl->keys, maxKeys * sizeof(jrnKey_t));
+
+			if (NULL == keys) {
+				return ESP_ERR_NO_MEM;
+			}
+			pCtrl->keys    = keys;
+			pCtrl->maxKeys = maxKeys;
+		}
+
+		k = &pCtrl->keys[pCtrl->numKeys++];
+		memset(k, 0, sizeof(*k));
+		k->space = space;
+		memcpy(k->key, key, keyLen);
+	}
+
+	if (k->valLen != valLen || NULL == k->val) {
+		uint8_t *	buf = cs_heap_malloc(valLen > 0 ? valLen : 1);
+
+		if (NULL == buf) {
+			return ESP_ERR_NO_MEM;
+		}
+		cs_heap_free(k->val);
+		k->val = buf;
+	}
+
+	k->typ    = typ;
+	k->valLen = valLen;
+	memcpy(k->val, val, valLen);
+	return ESP_OK;
+}
+
+
+/**
+ * \brief Apply the records of a transaction payload to the RAM copy
+ */
+static esp_err_t txnApply(control_t * pCtrl, const uint8_t * rec, uint32_t len)
+{
+	esp_err_t	status;
+
+	while (len > 0) {
+		if (len < JRN_REC_HDR_SZ) {
+			return ESP_ERR_INVALID_SIZE;
+		}
+
+		uint8_t		op     = rec[0];
+		uint8_t		keyLen = rec[3];
+		uint16_t	valLen = getU16(&rec[4]);
+		uint32_t	recLen = JRN_REC_HDR_SZ + keyLen + valLen;
+
+		if (recLen > len || keyLen > JRN_KEY_MAX || (JRN_OP_SET != op && JRN_OP_ERASE != op)) {
+			return ESP_ERR_INVALID_SIZE;
+		}
+
+		status = keyApply(
+			pCtrl,
+			op,
+			rec[1],
+			rec[2],
+			(const char *)&rec[JRN_REC_HDR_SZ],
+			keyLen,
+			&rec[JRN_REC_HDR_SZ + keyLen],
+			valLen
+		);
+		if (ESP_OK != status) {
+			return status;
+		}
+
+		rec += recLen;
+		len -= recLen;
+	}
+
+	return ESP_OK;
+}
+
+
+/**
+ * \brief Make room for more bytes in a transaction buffer
+ */
+static esp_err_t txnReserve(txnBuf_t * txn, uint32_t len)
+{
+	if (0 == txn->len) {
+		txn->len = JRN_TXN_HDR_SZ;
+	}
+
+	// The padding is added in place
+	uint32_t	need = JRN_ALIGN(txn->len + len);
+
+	if (need - JRN_TXN_HDR_SZ > JRN_TXN_MAX) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	if (need > txn->size) {
+		uint32_t	size = (txn->size > 0) ? txn->size : 256;
+		uint8_t *	buf;
+
+		while (size < need) {
+			size *= 2;
+		}
+		if ((buf = cs_heap_realloc(txn->buf, size)) == NULL) {
+			return ESP_ERR_NO_MEM;
+		}
+		txn->buf  = buf;
+		txn->size = size;
+	}
+
+	return ESP_OK;
+}
+
+
+static esp_err_t txnAddRecord(
+	txnBuf_t *		txn,
+	uint8_t			op,
+	uint8_t			space,
+	uint8_t			typ,
+	const char *	key,
+	int				keyLen,
+	const void *	val,
+	int				valLen
+)
+{
+	esp_err_t	status;
+
+	if ((status = txnReserve(txn, JRN_REC_HDR_SZ + keyLen + valLen)) != ESP_OK) {
+		return status;
+	}
+
+	uint8_t *	p = &txn->buf[txn->len];
+
+	p[0] = op;
+	p[1] = space;
+	p[2] = typ;
+	p[3] = (uint8_t)keyLen;
+	putU16(&p[4], (uint16_t)valLen);
+	memcpy(&p[JRN_REC_HDR_SZ], key, keyLen);
+	if (valLen > 0) {
+		memcpy(&p[JRN_REC_HDR_SZ + keyLen], val, valLen);
+	}
+
+	txn->len += JRN_REC_HDR_SZ + keyLen + valLen;
+	return ESP_OK;
+}
+
+
+/**
+ * \brief Fill in the transaction header and pad the end
+ *
+ * \return Bytes to write
+ */
+static uint32_t txnSeal(txnBuf_t * txn)
+{
+	uint32_t	payloadLen = txn->len - JRN_TXN_HDR_SZ;
+	uint32_t	txnLen     = JRN_ALIGN(txn->len);
+
+	putU16(&txn->buf[0], JRN_TXN_MAGIC);
+	putU16(&txn->buf[2], (uint16_t)payloadLen);
+
+	uint32_t	crc = crc32_le(0, txn->buf, 4);
+	crc = crc32_le(crc, &txn->buf[JRN_TXN_HDR_SZ], payloadLen);
+	putU32(&txn->buf[4], crc);
+
+	memset(&txn->buf[txn->len], 0xFF, txnLen - txn->len);
+	return txnLen;
+}
+
+
+static esp_err_t areaWrite(control_t * pCtrl, int area, uint32_t offset, const void * data, uint32_t len)
+{
+	esp_err_t	status;
+
+	status = esp_partition_write(pCtrl->part, area * pCtrl->areaSz + offset, data, len);
+	if (ESP_OK == status) {
+		pCtrl->stats.bytesWritten += len;
+	} else {
+		gc_err("Write of %u bytes at %u failed (%d)", len, offset, status);
+		pCtrl->stats.errCount += 1;
+	}
+
+	return status;
+}
+
+
+/**
+ * \brief Write the header that makes an area the active one
+ */
+static esp_err_t areaWriteHeader(control_t * pCtrl, int area, uint32_t seq)
+{
+	uint8_t	hdr[JRN_HDR_SZ];
+
+	putU32(&hdr[0], JRN_MAGIC);
+	putU16(&hdr[4], JRN_VERSION);
+	putU16(&hdr[6], 0xFFFF);
+	putU32(&hdr[8], seq);
+	putU32(&hdr[12], crc32_le(0, hdr, 12));
+
+	return areaWrite(pCtrl, area, 0, hdr, sizeof(hdr));
+}
+
+
+/**
+ * \brief Read the sequence number of an area
+ *
+ * \return 0 The area holds no valid header
+ */
+static uint32_t areaSeq(control_t * pCtrl, int area)
+{
+	uint8_t	hdr[JRN_HDR_SZ];
+
+	if (esp_partition_read(pCtrl->part, area * pCtrl->areaSz, hdr, sizeof(hdr)) != ESP_OK) {
+		return 0;
+	}
+
+	if (getU32(&hdr[0]) != JRN_MAGIC || getU16(&hdr[4]) != JRN_VERSION) {
+		return 0;
+	}
+
+	if (getU32(&hdr[12]) != crc32_le(0, hdr, 12)) {
+		return 0;
+	}
+
+	return getU32(&hdr[8]);
+}
+
+
+/**
+ * \brief Bytes the current values take in a compacted area
+ */
+static uint32_t liveSize(control_t * pCtrl)
+{
+	uint32_t	size    = JRN_HDR_SZ;
+	uint32_t	payload = 0;
+	int			i;
+
+	for (i = 0; i < pCtrl->numKeys; i++) {
+		uint32_t	recLen = JRN_REC_HDR_SZ + strlen(pCtrl->keys[i].key) + pCtrl->keys[i].valLen;
+
+		if (payload + recLen > JRN_SNAPSHOT_MAX) {
+			size   += JRN_ALIGN(JRN_TXN_HDR_SZ + payload);
+			payload = 0;
+		}
+		payload += recLen;
+	}
+
+	if (payload > 0) {
+		size += JRN_ALIGN(JRN_TXN_HDR_SZ + payload);
+	}
+
+	return size;
+}
+
+
+/**
+ * \brief Rebuild the RAM copy from the active area
+ */
+static esp_err_t loadArea(control_t * pCtrl)
+{
+	esp_err_t	status;
+	uint8_t *	buf;
+	uint32_t	off = JRN_HDR_SZ;
+
+	// One read of the whole area
+	if ((buf = cs_heap_malloc(pCtrl->areaSz)) == NULL) {
+		return ESP_ERR_NO_MEM;
+	}
+
+	status = esp_partition_read(pCtrl->part, pCtrl->active * pCtrl->areaSz, buf, pCtrl->areaSz);
+	if (ESP_OK != status) {
+		gc_err("Read failed (%d)", status);
+		goto exit;
+	}
+
+	while (off + JRN_TXN_HDR_SZ <= pCtrl->areaSz) {
+		uint8_t *	txn = &buf[off];
+		uint16_t	magic = getU16(&txn[0]);
+		uint32_t	len   = getU16(&txn[2]);
+
+		if (0xFFFF == magic) {
+			// Erased flash, the end of the journal
+			break;
+		}
+
+		if (JRN_TXN_MAGIC != magic || off + JRN_TXN_HDR_SZ + len > pCtrl->areaSz) {
+			gc_err("Bad transaction at %u", off);
+			pCtrl->stats.errCount += 1;
+			off = pCtrl->areaSz;
+			break;
+		}
+
+		uint32_t	crc = crc32_le(0, txn, 4);
+		crc = crc32_le(crc, &txn[JRN_TXN_HDR_SZ], len);
+
+		if (crc != getU32(&txn[4])) {
+			// A write cut short, nothing follows it
+			gc_err("Transaction at %u failed CRC check", off);
+			pCtrl->stats.errCount += 1;
+			off = pCtrl->areaSz;
+			break;
+		}
+
+		if (txnApply(pCtrl, &txn[JRN_TXN_HDR_SZ], len) != ESP_OK) {
+			gc_err("Bad record in transaction at %u", off);
+			pCtrl->stats.errCount += 1;
+		}
+
+		off += JRN_ALIGN(JRN_TXN_HDR_SZ + len);
+	}
+
+	// After a bad transaction the area is full, the next commit compacts
+	pCtrl->writeOff = off;
+
+exit:
+	cs_heap_free(buf);
+	return status;
+}
+
+
+/**
+ * \brief Write the current values to the other area and make it active
+ */
+static esp_err_t compact(control_t * pCtrl)
+{
+	esp_err_t	status;
+	int			area = 1 - pCtrl->active;
+	uint32_t	off  = JRN_HDR_SZ;
+	txnBuf_t	txn  = {0};
+	int			i;
+
+	if (liveSize(pCtrl) > pCtrl->areaSz) {
+		gc_err("Values exceed the area size");
+		return ESP_ERR_NO_MEM;
+	}
+
+	status = esp_partition_erase_range(pCtrl->part, area * pCtrl->areaSz, pCtrl->areaSz);
+	if (ESP_OK != status) {
+		gc_err("Erase failed (%d)", status);
+		pCtrl->stats.errCount += 1;
+		return status;
+	}
+
+	for (i = 0; i <= pCtrl->numKeys; i++) {
+		jrnKey_t *	k = (i < pCtrl->numKeys) ? &pCtrl->keys[i] : NULL;
+		int			keyLen = (NULL != k) ? strlen(k->key) : 0;
+
+		// Write the snapshot so far when full, and after the last key
+		if (txn.len > JRN_TXN_HDR_SZ &&
+			(NULL == k || txn.len + JRN_REC_HDR_SZ + keyLen + k->valLen > JRN_TXN_HDR_SZ + JRN_SNAPSHOT_MAX)
+		) {
+			uint32_t	txnLen = txnSeal(&txn);
+
+			if ((status = areaWrite(pCtrl, area, off, txn.buf, txnLen)) != ESP_OK) {
+				goto exit;
+			}
+			off     += txnLen;
+			txn.len  = 0;
+		}
+
+		if (NULL == k)
+			break;
+
+		status = txnAddRecord(&txn, JRN_OP_SET, k->space, k->typ, k->key, keyLen, k->val, k->valLen);
+		if (ESP_OK != status) {
+			goto exit;
+		}
+	}
+
+	// The new area takes over once its header is written
+	if ((status = areaWriteHeader(pCtrl, area, pCtrl->seq + 1)) != ESP_OK) {
+		goto exit;
+	}
+
+	pCtrl->active   = area;
+	pCtrl->seq     += 1;
+	pCtrl->writeOff = off;
+	pCtrl->stats.compactCount += 1;
+
+	gc_dbg("Compacted %d values into %u bytes", pCtrl->numKeys, off);
+
+exit:
+	cs_heap_free(txn.buf);
+	return status;
+}
+
+
+static esp_err_t storeOpen(void)
+{
+	control_t *		pCtrl = control;
+	if (NULL != pCtrl)
+		return ESP_OK;
+
+	const esp_partition_t *	part;
+
+	part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, JRN_PARTITION);
+	if (NULL == part) {
+		gc_err("Partition \"%s\" not defined", JRN_PARTITION);
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	esp_err_t	status;
+	int64_t		t0 = esp_timer_get_time();
+
+	if ((pCtrl = cs_heap_calloc(1, sizeof(*pCtrl))) == NULL)
+		return ESP_ERR_NO_MEM;
+
+	pCtrl->part   = part;
+	pCtrl->areaSz = (part->size / 2) & ~(JRN_SECTOR_SZ - 1);
+
+	if (pCtrl->areaSz < JRN_SECTOR_SZ) {
+		gc_err("Partition \"%s\" too small", JRN_PARTITION);
+		status = ESP_ERR_INVALID_SIZE;
+		goto exitMem;
+	}
+
+	if ((pCtrl->mutex = xSemaphoreCreateMutex()) == NULL) {
+		status = ESP_FAIL;
+		goto exitMem;
+	}
+
+	uint32_t	seq0 = areaSeq(pCtrl, 0);
+	uint32_t	seq1 = areaSeq(pCtrl, 1);
+
+	if (0 == seq0 && 0 == seq1) {
+		// New journal
+		gc_dbg("Format partition \"%s\"", JRN_PARTITION);
+
+		status = esp_partition_erase_range(part, 0, pCtrl->areaSz);
+		if (ESP_OK == status) {
+			status = areaWriteHeader(pCtrl, 0, 1);
+		}
+		if (ESP_OK != status) {
+			goto exitMem;
+		}
+
+		pCtrl->active   = 0;
+		pCtrl->seq      = 1;
+		pCtrl->writeOff = JRN_HDR_SZ;
+	} else {
+		pCtrl->active = (seq1 > seq0) ? 1 : 0;
+		pCtrl->seq    = (seq1 > seq0) ? seq1 : seq0;
+
+		if ((status = loadArea(pCtrl)) != ESP_OK) {
+			goto exitMem;
+		}
+	}
+
+	pCtrl->stats.loadUs = (uint32_t)(esp_timer_get_time() - t0);
+
+	gc_dbg("Loaded %d values from area %d, %u of %u bytes used, %u us",
+		pCtrl->numKeys,
+		pCtrl->active,
+		pCtrl->writeOff,
+		pCtrl->areaSz,
+		pCtrl->stats.loadUs
+	);
+
+	// Compact now if mostly superseded values, rather than on a commit
+	if (pCtrl->writeOff > pCtrl->areaSz / 100 * JRN_COMPACT_PCT && liveSize(pCtrl) < pCtrl->writeOff / 2) {
+		(void)compact(pCtrl);
+	}
+
+	control = pCtrl;
+	return ESP_OK;
+
+exitMem:
+	if (pCtrl->mutex)
+		vSemaphoreDelete(pCtrl->mutex);
+	cs_heap_free(pCtrl->keys);
+	cs_heap_free(pCtrl);
+	return status;
+}
+
+
+static esp_err_t storeGet(csNvSpace_t space, const char * key, objtype_t typ, void * value, size_t * len)
+{
+	control_t *		pCtrl = control;
+	if (NULL == pCtrl)
+		return ESP_FAIL;
+
+	esp_err_t	status = ESP_OK;
+	jrnKey_t *	k;
+
+	JRN_MUTEX_GET(pCtrl);
+
+	k = keyFind(pCtrl, (uint8_t)space, key, strlen(key));
+
+	if (NULL == k || k->typ != typ) {
+		// A type change reads as a new parameter
+		status = ESP_ERR_NVS_NOT_FOUND;
+		goto exit;
+	}
+
+	switch (typ)
+	{
+	case objtyp_bool:
+		*(bool *)value = k->val[0] ? true : false;
+		break;
+
+	case objtyp_u8:
+		*(uint8_t *)value = k->val[0];
+		break;
+
+	case objtyp_i32:
+	case objtyp_u32:
+		putU32(value, getU32(k->val));
+		break;
+
+	case objtyp_str:
+		if (*len < k->valLen + 1) {
+			status = ESP_ERR_NVS_INVALID_LENGTH;
+			break;
+		}
+		memcpy(value, k->val, k->valLen);
+		((char *)value)[k->valLen] = '\0';
+		*len = k->valLen + 1;
+		break;
+
+	default:
+		status = ESP_ERR_NOT_SUPPORTED;
+		break;
+	}
+
+exit:
+	JRN_MUTEX_PUT(pCtrl);
+	return status;
+}
+
+
+static esp_err_t storeSet(csNvSpace_t space, const char * key, objtype_t typ, const void * value)
+{
+	control_t *		pCtrl = control;
+	if (NULL == pCtrl)
+		return ESP_FAIL;
+
+	int		keyLen = strlen(key);
+	int		valLen = valueLen(typ, value);
+
+	if (keyLen > JRN_KEY_MAX || valLen < 0) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	esp_err_t	status;
+	uint8_t		num[4];
+	const void *	val = value;
+
+	// Integers are stored little-endian
+	if (objtyp_bool == typ) {
+		num[0] = *(bool *)value ? 1 : 0;
+		val    = num;
+	} else if (objtyp_i32 == typ || objtyp_u32 == typ) {
+		putU32(num, *(uint32_t *)value);
+		val = num;
+	}
+
+	JRN_MUTEX_GET(pCtrl);
+	status = txnAddRecord(&pCtrl->staged, JRN_OP_SET, (uint8_t)space, (uint8_t)typ, key, keyLen, val, valLen);
+	JRN_MUTEX_PUT(pCtrl);
+
+	return status;
+}
+
+
+/**
+ * \brief Write the staged records as one transaction
+ *
+ * Commits the values staged for every space
+ */
+static esp_err_t storeCommit(csNvSpace_t space)
+{
+	control_t *		pCtrl = control;
+	if (NULL == pCtrl)
+		return ESP_FAIL;
+
+	esp_err_t	status = ESP_OK;
+	txnBuf_t *	txn    = &pCtrl->staged;
+
+	JRN_MUTEX_GET(pCtrl);
+
+	if (txn->len <= JRN_TXN_HDR_SZ) {
+		goto exit;
+	}
+
+	uint32_t	txnLen = txnSeal(txn);
+
+	if (pCtrl->writeOff + txnLen <= pCtrl->areaSz) {
+		status = areaWrite(pCtrl, pCtrl->active, pCtrl->writeOff, txn->buf, txnLen);
+		if (ESP_OK != status) {
+			// Whatever was written is a bad transaction, start a new area
+			// on the next commit
+			pCtrl->writeOff = pCtrl->areaSz;
+			goto exit;
+		}
+		pCtrl->writeOff += txnLen;
+
+		status = txnApply(pCtrl, &txn->buf[JRN_TXN_HDR_SZ], txn->len - JRN_TXN_HDR_SZ);
+	} else {
+		// The snapshot written by the compaction holds the staged values
+		status = txnApply(pCtrl, &txn->buf[JRN_TXN_HDR_SZ], txn->len - JRN_TXN_HDR_SZ);
+		if (ESP_OK == status) {
+			status = compact(pCtrl);
+		}
+		if (ESP_OK != status) {
+			goto exit;
+		}
+	}
+
+	pCtrl->stats.commitCount += 1;
+	txn->len = 0;
+
+exit:
+	JRN_MUTEX_PUT(pCtrl);
+	return status;
+}
+
+
+static esp_err_t storeErase(csNvSpace_t space)
+{
+	control_t *		pCtrl = control;
+	if (NULL == pCtrl)
+		return ESP_FAIL;
+
+	esp_err_t	status;
+
+	JRN_MUTEX_GET(pCtrl);
+	status = txnAddRecord(&pCtrl->staged, JRN_OP_ERASE, (uint8_t)space, 0, "", 0, NULL, 0);
+	JRN_MUTEX_PUT(pCtrl);
+
+	if (ESP_OK != status) {
+		return status;
+	}
+
+	return storeCommit(space);
+}
+
+
+/**
+ * \brief Read the journal statistics
+ *
+ * \param [out] ret Statistics
+ *
+ * \return ESP_OK Success
+ * \return ESP_FAIL The journal is not in use
+ */
+esp_err_t paramStoreJournalGetStats(paramStoreJournalStats_t * ret)
+{
+	control_t *		pCtrl = control;
+	if (NULL == pCtrl)
+		return ESP_FAIL;
+
+	if (NULL == ret)
+		return ESP_ERR_INVALID_ARG;
+
+	JRN_MUTEX_GET(pCtrl);
+
+	*ret = pCtrl->stats;
+	ret->numKeys = pCtrl->numKeys;
+	ret->areaSz  = pCtrl->areaSz;
+	ret->usedSz  = pCtrl->writeOff;
+	ret->liveSz  = liveSize(pCtrl);
+
+	JRN_MUTEX_PUT(pCtrl);
+	return ESP_OK;
+}
+
+
+/**
+ * \brief Rewrite the current values to the other area
+ *
+ * \return ESP_OK Success
+ * \return ESP_FAIL The journal is not in use
+ * \return (other) Error code
+ */
+esp_err_t paramStoreJournalCompact(void)
+{
+	control_t *		pCtrl = control;
+	if (NULL == pCtrl)
+		return ESP_FAIL;
+
+	esp_err_t	status;
+
+	JRN_MUTEX_GET(pCtrl);
+	status = compact(pCtrl);
+	JRN_MUTEX_PUT(pCtrl);
+
+	return status;
+}
+
+
+const paramStore_t	paramStoreJournal = {
+	.name   = "journal",
+	.open   = storeOpen,
+	.get    = storeGet,
+	.set    = storeSet,
+	.commit = storeCommit,
+	.erase  = storeErase
+};
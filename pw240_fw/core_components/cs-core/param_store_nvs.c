@@ -0,0 +1,142 @@
+/*! \file param_store_nvs.c
+ *
+ * Parameter store keeping each parameter in its own NVS key
+ *
+ */
+#include "cs_common.h"
+#include "param_mgr.h"
+#include "param_store.h"
+#include "param_store_priv.h"
+#include "nvs.h"
+
+// Comment out the MOD_NAME line to disable debug prints from this file
+#define MOD_NAME	"param_store_nvs"
+#include "mod_debug.h"
+
+
+static nvs_handle	nvStandard;
+static nvs_handle	nvSticky;
+static bool			isOpen;
+
+
+nvs_handle paramStoreNvsHandle(csNvSpace_t space)
+{
+	return (csNvSpace_sticky == space) ? nvSticky : nvStandard;
+}
+
+
+static esp_err_t storeOpen(void)
+{
+	esp_err_t	status;
+
+	if (isOpen)
+		return ESP_OK;
+
+	// Standard space
+	status = nvs_open(PARAM_NVS_SPACE_STANDARD, NVS_READWRITE, &nvStandard);
+	if (ESP_OK != status) {
+		gc_err("nvs_open \"%s\" failed", PARAM_NVS_SPACE_STANDARD);
+		return status;
+	}
+
+	// Sticky space - persists over factory resets
+	status = nvs_open(PARAM_NVS_SPACE_STICKY, NVS_READWRITE, &nvSticky);
+	if (ESP_OK != status) {
+		gc_err("nvs_open \"%s\" failed", PARAM_NVS_SPACE_STICKY);
+		nvs_close(nvStandard);
+		return status;
+	}
+
+	isOpen = true;
+	return ESP_OK;
+}
+
+
+static esp_err_t storeGet(csNvSpace_t space, const char * key, objtype_t typ, void * value, size_t * len)
+{
+	nvs_handle	nvs = paramStoreNvsHandle(space);
+	esp_err_t	status;
+	int8_t		i8Val;
+
+	switch (typ)
+	{
+	case objtyp_bool:
+		// Stored as int8_t having either 0 or 1
+		status = nvs_get_i8(nvs, key, &i8Val);
+		if (ESP_OK == status) {
+			*(bool *)value = i8Val ? true : false;
+		}
+		return status;
+
+	case objtyp_u8:
+		return nvs_get_u8(nvs, key, (uint8_t *)value);
+
+	case objtyp_i32:
+		return nvs_get_i32(nvs, key, (int32_t *)value);
+
+	case objtyp_u32:
+		return nvs_get_u32(nvs, key, (uint32_t *)value);
+
+	case objtyp_str:
+		return nvs_get_str(nvs, key, (char *)value, len);
+
+	default:
+		return ESP_ERR_NOT_SUPPORTED;
+	}
+}
+
+
+static esp_err_t storeSet(csNvSpace_t space, const char * key, objtype_t typ, const void * value)
+{
+	nvs_handle	nvs = paramStoreNvsHandle(space);
+
+	switch (typ)
+	{
+	case objtyp_bool:
+		return nvs_set_i8(nvs, key, *(bool *)value ? 1 : 0);
+
+	case objtyp_u8:
+		return nvs_set_u8(nvs, key, *(uint8_t *)value);
+
+	case objtyp_i32:
+		return nvs_set_i32(nvs, key, *(int32_t *)value);
+
+	case objtyp_u32:
+		return nvs_set_u32(nvs, key, *(uint32_t *)value);
+
+	case objtyp_str:
+		return nvs_set_str(nvs, key, (const char *)value);
+
+	default:
+		return ESP_ERR_NOT_SUPPORTED;
+	}
+}
+
+
+static esp_err_t storeCommit(csNvSpace_t space)
+{
+	return nvs_commit(paramStoreNvsHandle(space));
+}
+
+
+static esp_err_t storeErase(csNvSpace_t space)
+{
+	nvs_handle	nvs = paramStoreNvsHandle(space);
+	esp_err_t	status;
+
+	if ((status = nvs_erase_all(nvs)) != ESP_OK) {
+		return status;
+	}
+
+	return nvs_commit(nvs);
+}
+
+
+const paramStore_t	paramStoreNvs = {
+	.name   = "nvs",
+	.open   = storeOpen,
+	.get    = storeGet,
+	.set    = storeSet,
+	.commit = storeCommit,
+	.erase  = storeErase
+};
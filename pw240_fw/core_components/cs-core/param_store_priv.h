@@ -0,0 +1,35 @@
+/**
+ * \file param_store_priv.h
+ *
+ * \brief Parameter store internals shared by the parameter manager and
+ * the stores, not for use outside cs-core
+ */
+#ifndef __CS_CORE_PARAM_STORE_PRIV_H__
+#define __CS_CORE_PARAM_STORE_PRIV_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "param_store.h"
+#include "nvs.h"
+
+
+// Namespaces in nvs for ConnectSense parameters
+#define PARAM_NVS_SPACE_STANDARD	"cs_param"
+#define PARAM_NVS_SPACE_STICKY		"cs_sticky"
+
+
+/**
+ * \brief Handle of the NVS namespace for a space, owned by \ref paramStoreNvs
+ *
+ * Valid once paramStoreNvs.open has succeeded
+ */
+nvs_handle paramStoreNvsHandle(csNvSpace_t space);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CS_CORE_PARAM_STORE_PRIV_H__ */
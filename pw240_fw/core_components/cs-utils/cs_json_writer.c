@@ -0,0 +1,473 @@
+/*
+ * cs_json_writer.c
+ *
+ * Streaming JSON writer, see cs_json_writer.h
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include "cs_common.h"
+#include "cs_json_writer.h"
+
+// Comment out the MOD_NAME line to disable debug prints from this file
+#define MOD_NAME	"cs_json_writer"
+#include "mod_debug.h"
+
+
+/**
+ * \brief Append bytes to the output
+ *
+ * Copies as much as fits in one step, flushing the buffer between steps
+ */
+static esp_err_t _put(csJsonWriter_t * jw, const char * data, int len)
+{
+	if (ESP_OK != jw->status) {
+		return jw->status;
+	}
+
+	jw->total += len;
+
+	if (NULL == jw->buf) {
+		// Counting only
+		return ESP_OK;
+	}
+
+	// Without a flush function keep a byte for the terminator
+	int	room = (NULL == jw->flush) ? jw->bufSz - 1 : jw->bufSz;
+
+	while (len > 0) {
+		if (jw->idx == room) {
+			if (NULL == jw->flush) {
+				gc_err("Output exceeds %d bytes", room);
+				jw->status = ESP_ERR_NO_MEM;
+				return jw->status;
+			}
+
+			if ((jw->status = jw->flush(jw->cbData, jw->buf, jw->idx)) != ESP_OK) {
+				return jw->status;
+			}
+			jw->idx = 0;
+		}
+
+		int	ct = room - jw->idx;
+		if (ct > len) {
+			ct = len;
+		}
+
+		memcpy(&jw->buf[jw->idx], data, ct);
+		jw->idx += ct;
+		data    += ct;
+		len     -= ct;
+	}
+
+	return ESP_OK;
+}
+
+
+static esp_err_t _putStr(csJsonWriter_t * jw, const char * str)
+{
+	return _put(jw, str, strlen(str));
+}
+
+
+/**
+ * \brief Write a quoted string, escaped the way cJSON does
+ */
+static esp_err_t _putQuoted(csJsonWriter_t * jw, const char * str)
+{
+	const char *	run = str;
+	char			esc[8];
+
+	_put(jw, "\"", 1);
+
+	for (; '\0' != *str; str++) {
+		unsigned char	c = (unsigned char)*str;
+
+		if (c >= 0x20 && '"' != c && '\\' != c) {
+			continue;
+		}
+
+		// Write the run of plain characters before this one
+		_put(jw, run, str - run);
+		run = str + 1;
+
+		switch (c)
+		{
+		case '"':	_put(jw, "\\\"", 2); break;
+		case '\\':	_put(jw, "\\\\", 2); break;
+		case '\b':	_put(jw, "\\b", 2); break;
+		case '\f':	_put(jw, "\\f", 2); break;
+		case '\n':	_put(jw, "\\n", 2); break;
+		case '\r':	_put(jw, "\\r", 2); break;
+		case '\t':	_put(jw, "\\t", 2); break;
+		default:
+			snprintf(esc, sizeof(esc), "\\u%04x", c);
+			_put(jw, esc, 6);
+			break;
+		}
+	}
+
+	_put(jw, run, str - run);
+	return _put(jw, "\"", 1);
+}
+
+
+/**
+ * \brief Write the separator and member name that go before a value
+ */
+static esp_err_t _beginValue(csJsonWriter_t * jw, const char * name)
+{
+	if (ESP_OK != jw->status) {
+		return jw->status;
+	}
+
+	uint32_t	bit = 1UL << jw->depth;
+
+	if (jw->hasItem & bit) {
+		_put(jw, ",", 1);
+	}
+	jw->hasItem |= bit;
+
+	if (NULL != name) {
+		_putQuoted(jw, name);
+		_put(jw, ":", 1);
+	}
+
+	return jw->status;
+}
+
+
+static esp_err_t _open(csJsonWriter_t * jw, const char * name, char c)
+{
+	if (!jw) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	if (_beginValue(jw, name) != ESP_OK) {
+		return jw->status;
+	}
+
+	if (jw->depth + 1 >= CS_JSON_MAX_DEPTH) {
+		gc_err("Nested deeper than %d", CS_JSON_MAX_DEPTH);
+		jw->status = ESP_ERR_INVALID_STATE;
+		return jw->status;
+	}
+
+	jw->depth   += 1;
+	jw->hasItem &= ~(1UL << jw->depth);
+
+	return _put(jw, &c, 1);
+}
+
+
+static esp_err_t _close(csJsonWriter_t * jw, char c)
+{
+	if (!jw) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	if (ESP_OK != jw->status) {
+		return jw->status;
+	}
+
+	if (0 == jw->depth) {
+		gc_err("Close without open");
+		jw->status = ESP_ERR_INVALID_STATE;
+		return jw->status;
+	}
+
+	jw->depth -= 1;
+	return _put(jw, &c, 1);
+}
+
+
+/**
+ * \brief Format an unsigned number, filling the buffer from the end
+ *
+ * \return Pointer to the first digit
+ */
+static char * _fmtU64(char * end, uint64_t value)
+{
+	*end = '\0';
+
+	do {
+		*--end = '0' + (value % 10);
+		value /= 10;
+	} while (value != 0);
+
+	return end;
+}
+
+
+esp_err_t csJsonWriterInit(
+	csJsonWriter_t *	jw,
+	char *				buf,
+	int					bufSz,
+	csJsonFlush_t		flush,
+	void *				cbData
+)
+{
+	if (!jw || (buf && bufSz < 2)) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	memset(jw, 0, sizeof(*jw));
+	jw->buf    = buf;
+	jw->bufSz  = buf ? bufSz : 0;
+	jw->status = ESP_OK;
+	jw->flush  = flush;
+	jw->cbData = cbData;
+
+	return ESP_OK;
+}
+
+
+esp_err_t csJsonWriterFinish(csJsonWriter_t * jw)
+{
+	if (!jw) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	if (ESP_OK != jw->status) {
+		return jw->status;
+	}
+
+	if (0 != jw->depth) {
+		gc_err("%d objects or arrays not closed", jw->depth);
+		jw->status = ESP_ERR_INVALID_STATE;
+		return jw->status;
+	}
+
+	if (NULL == jw->buf) {
+		return ESP_OK;
+	}
+
+	if (NULL == jw->flush) {
+		jw->buf[jw->idx] = '\0';
+	} else if (jw->idx > 0) {
+		jw->status = jw->flush(jw->cbData, jw->buf, jw->idx);
+		jw->idx    = 0;
+	}
+
+	return jw->status;
+}
+
+
+esp_err_t csJsonWriterStatus(csJsonWriter_t * jw)
+{
+	if (!jw) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	return jw->status;
+}
+
+
+int csJsonWriterLen(csJsonWriter_t * jw)
+{
+	if (!jw) {
+		return -1;
+	}
+	return jw->total;
+}
+
+
+esp_err_t csJsonObjOpen(csJsonWriter_t * jw, const char * name)
+{
+	return _open(jw, name, '{');
+}
+
+
+esp_err_t csJsonObjClose(csJsonWriter_t * jw)
+{
+	return _close(jw, '}');
+}
+
+
+esp_err_t csJsonArrOpen(csJsonWriter_t * jw, const char * name)
+{
+	return _open(jw, name, '[');
+}
+
+
+esp_err_t csJsonArrClose(csJsonWriter_t * jw)
+{
+	return _close(jw, ']');
+}
+
+
+esp_err_t csJsonStr(csJsonWriter_t * jw, const char * name, const char * value)
+{
+	if (!jw || !value) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	if (_beginValue(jw, name) != ESP_OK) {
+		return jw->status;
+	}
+
+	return _putQuoted(jw, value);
+}
+
+
+esp_err_t csJsonInt(csJsonWriter_t * jw, const char * name, int64_t value)
+{
+	return csJsonFixed(jw, name, value, 0);
+}
+
+
+esp_err_t csJsonUint(csJsonWriter_t * jw, const char * name, uint64_t value)
+{
+	if (!jw) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	if (_beginValue(jw, name) != ESP_OK) {
+		return jw->status;
+	}
+
+	// Largest 64-bit value has 20 digits
+	char	valStr[24];
+
+	return _putStr(jw, _fmtU64(&valStr[sizeof(valStr) - 1], value));
+}
+
+
+esp_err_t csJsonBool(csJsonWriter_t * jw, const char * name, bool value)
+{
+	return csJsonRaw(jw, name, value ? "true" : "false");
+}
+
+
+esp_err_t csJsonFixed(csJsonWriter_t * jw, const char * name, int64_t value, int decimals)
+{
+	if (!jw || decimals < 0 || decimals > 9) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	if (_beginValue(jw, name) != ESP_OK) {
+		return jw->status;
+	}
+
+	// Sign, 20 digits and the point
+	char		valStr[28];
+	char *		p   = &valStr[sizeof(valStr) - 1];
+	uint64_t	mag = (value < 0) ? -(uint64_t)value : (uint64_t)value;
+	int			i;
+
+	*p = '\0';
+
+	// Fraction digits, from the last
+	for (i = 0; i < decimals; i++) {
+		*--p = '0' + (mag % 10);
+		mag /= 10;
+	}
+	if (decimals > 0) {
+		*--p = '.';
+	}
+
+	// Integer digits, at least one
+	do {
+		*--p = '0' + (mag % 10);
+		mag /= 10;
+	} while (mag != 0);
+
+	if (value < 0) {
+		*--p = '-';
+	}
+
+	return _putStr(jw, p);
+}
+
+
+esp_err_t csJsonRaw(csJsonWriter_t * jw, const char * name, const char * json)
+{
+	if (!jw || !json) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	if (_beginValue(jw, name) != ESP_OK) {
+		return jw->status;
+	}
+
+	return _putStr(jw, json);
+}
+
+
+/**
+ * \brief Write a cJSON number as cJSON_PrintUnformatted does
+ */
+static esp_err_t _putNumber(csJsonWriter_t * jw, const char * name, const cJSON * item)
+{
+	double	d = item->valuedouble;
+	char	valStr[32];
+	double	test;
+
+	if (isnan(d) || isinf(d)) {
+		return csJsonRaw(jw, name, "null");
+	}
+
+	if (d == (double)item->valueint) {
+		// Integers, the usual case, without floating point formatting
+		return csJsonInt(jw, name, item->valueint);
+	}
+
+	// The precision of a cJSON double is not known here, so it takes the
+	// shortest of 15 or 17 digits that reads back the same. Values of known
+	// precision should be written with csJsonFixed instead.
+	snprintf(valStr, sizeof(valStr), "%1.15g", d);
+	if (sscanf(valStr, "%lg", &test) != 1 || test != d) {
+		snprintf(valStr, sizeof(valStr), "%1.17g", d);
+	}
+
+	return csJsonRaw(jw, name, valStr);
+}
+
+
+esp_err_t csJsonItem(csJsonWriter_t * jw, const char * name, const cJSON * item)
+{
+	if (!jw || !item) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	const cJSON *	child;
+
+	switch (item->type & 0xFF)
+	{
+	case cJSON_False:
+		return csJsonBool(jw, name, false);
+
+	case cJSON_True:
+		return csJsonBool(jw, name, true);
+
+	case cJSON_NULL:
+		return csJsonRaw(jw, name, "null");
+
+	case cJSON_Number:
+		return _putNumber(jw, name, item);
+
+	case cJSON_String:
+		return csJsonStr(jw, name, item->valuestring ? item->valuestring : "");
+
+	case cJSON_Raw:
+		return csJsonRaw(jw, name, item->valuestring ? item->valuestring : "");
+
+	case cJSON_Array:
+		csJsonArrOpen(jw, name);
+		for (child = item->child; NULL != child; child = child->next) {
+			csJsonItem(jw, NULL, child);
+		}
+		return csJsonArrClose(jw);
+
+	case cJSON_Object:
+		csJsonObjOpen(jw, name);
+		for (child = item->child; NULL != child; child = child->next) {
+			csJsonItem(jw, child->string ? child->string : "", child);
+		}
+		return csJsonObjClose(jw);
+
+	default:
+		gc_err("cJSON type %d not supported", item->type);
+		jw->status = ESP_ERR_NOT_SUPPORTED;
+		return jw->status;
+	}
+}
@@ -0,0 +1,160 @@
+/*
+ * cs_json_writer.h
+ *
+ * Streaming JSON writer
+ *
+ * Text goes into a caller's buffer. When the buffer is full it is handed
+ * to a flush function, e.g. one writing to a socket, and reused, so
+ * output of any length passes through a small buffer. Without a flush
+ * function, output that does not fit fails with ESP_ERR_NO_MEM.
+ *
+ * Without a buffer the writer only counts, giving the length of output
+ * before it is produced, e.g. for a Content-Length header.
+ *
+ * The first error is kept and makes the later calls do nothing, so a
+ * document can be written with the status checked once at the end.
+ */
+
+#ifndef COMPONENTS_CS_UTILS_INCLUDE_CS_JSON_WRITER_H_
+#define COMPONENTS_CS_UTILS_INCLUDE_CS_JSON_WRITER_H_
+
+#include "cs_common.h"
+#include "cJSON.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Deepest nesting of objects and arrays
+#define CS_JSON_MAX_DEPTH	(32)
+
+
+/**
+ * \brief Function taking the contents of a full writer buffer
+ *
+ * \return ESP_OK The data was taken, the buffer is reused
+ * \return (other) Error code, kept as the writer status
+ */
+typedef esp_err_t (*csJsonFlush_t)(void * cbData, const char * data, int len);
+
+
+typedef struct {
+	char *			buf;
+	int				bufSz;
+	int				idx;		// Bytes in the buffer
+	int				total;		// Bytes written, including those flushed
+	esp_err_t		status;
+	csJsonFlush_t	flush;
+	void *			cbData;
+	int				depth;
+	uint32_t		hasItem;	// Bit per depth, a value was written there
+} csJsonWriter_t;
+
+
+/**
+ * \brief Initialize a writer
+ *
+ * \param [in] jw Pointer to a writer control structure
+ * \param [in] buf Buffer for the output, NULL to only count bytes
+ * \param [in] bufSz Size of the buffer
+ * \param [in] flush Function taking the buffer when full, or NULL
+ * \param [in] cbData Passed to the flush function
+ *
+ * Without a flush function one byte of the buffer is kept for the
+ * terminator added by \ref csJsonWriterFinish
+ *
+ * \return ESP_OK Success
+ * \return ESP_ERR_INVALID_ARG NULL writer, or buffer too small
+ */
+esp_err_t csJsonWriterInit(
+	csJsonWriter_t *	jw,
+	char *				buf,
+	int					bufSz,
+	csJsonFlush_t		flush,
+	void *				cbData
+);
+
+
+/**
+ * \brief End the output
+ *
+ * Checks that every object and array was closed, then hands what is
+ * left in the buffer to the flush function, or terminates the string
+ *
+ * \return ESP_OK Success
+ * \return ESP_ERR_NO_MEM The output did not fit in the buffer
+ * \return ESP_ERR_INVALID_STATE Unbalanced open and close calls
+ * \return (other) Error from the flush function
+ */
+esp_err_t csJsonWriterFinish(csJsonWriter_t * jw);
+
+
+/**
+ * \brief Return the status of the writer
+ */
+esp_err_t csJsonWriterStatus(csJsonWriter_t * jw);
+
+
+/**
+ * \brief Return the number of bytes written, not counting the terminator
+ */
+int csJsonWriterLen(csJsonWriter_t * jw);
+
+
+/**
+ * \brief Write values
+ *
+ * \param [in] jw Pointer to a writer control structure
+ * \param [in] name Member name inside an object, NULL inside an array or
+ * for the top-level value
+ *
+ * \return ESP_OK Success
+ * \return ESP_ERR_NO_MEM The output does not fit in the buffer
+ * \return ESP_ERR_INVALID_STATE Too deep, or close without open
+ * \return (other) Error from the flush function
+ */
+esp_err_t csJsonObjOpen(csJsonWriter_t * jw, const char * name);
+
+esp_err_t csJsonObjClose(csJsonWriter_t * jw);
+
+esp_err_t csJsonArrOpen(csJsonWriter_t * jw, const char * name);
+
+esp_err_t csJsonArrClose(csJsonWriter_t * jw);
+
+esp_err_t csJsonStr(csJsonWriter_t * jw, const char * name, const char * value);
+
+esp_err_t csJsonInt(csJsonWriter_t * jw, const char * name, int64_t value);
+
+esp_err_t csJsonUint(csJsonWriter_t * jw, const char * name, uint64_t value);
+
+esp_err_t csJsonBool(csJsonWriter_t * jw, const char * name, bool value);
+
+/**
+ * \brief Write a value held in fixed point, without floating point
+ *
+ * \param [in] value Value times 10 to the power decimals, e.g. 1234 with 1
+ * decimal for 123.4 volts held in 0.1 volt units
+ * \param [in] decimals Digits after the decimal point, 0..9
+ */
+esp_err_t csJsonFixed(csJsonWriter_t * jw, const char * name, int64_t value, int decimals);
+
+/**
+ * \brief Write text that is already JSON, as is
+ */
+esp_err_t csJsonRaw(csJsonWriter_t * jw, const char * name, const char * json);
+
+/**
+ * \brief Write a cJSON item and everything under it
+ *
+ * Gives the same text as cJSON_PrintUnformatted, without building it in
+ * memory first
+ */
+esp_err_t csJsonItem(csJsonWriter_t * jw, const char * name, const cJSON * item);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPONENTS_CS_UTILS_INCLUDE_CS_JSON_WRITER_H_ */
@@ -12,6 +12,7 @@
 #include "esp_ota_ops.h"
 #include "esp_https_ota.h"
 #include "cs_ota_rollback.h"
+#include "param_mgr.h"
 
 // Comment out the MOD_NAME line to disable debug prints from this file
 #define MOD_NAME	"fw_upgrade"
@@ -91,6 +92,9 @@ esp_err_t csFwUpdate(esp_http_client_config_t * configIn)
 	pConf->timeout_ms = 3000;
 	pConf->keep_alive_enable = true;
 
+	// Write pending parameter changes ahead of the image
+	paramMgrFlush();
+
 	gc_dbg("Performing update");
 	// Perform the update
 	if ((status = esp_https_ota(pConf)) == ESP_OK) {
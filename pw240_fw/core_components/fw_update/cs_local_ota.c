@@ -240,6 +240,7 @@ static esp_err_t handleUpdateStart(httpd_req_t * req)
 	#endif
 
 			gc_dbg("Begin OTA update");
+			paramMgrFlush();
 			status = esp_ota_begin(pCtrl->otaPart, OTA_SIZE_UNKNOWN, &pCtrl->otaHandle);
 			if (ESP_OK == status) {
 				gc_dbg("Ready to receive data");
@@ -0,0 +1,178 @@
+/*
+ * host_idf.c
+ *
+ * Host versions of the IDF functions declared in host_idf.h
+ */
+
+#include <time.h>
+#include "host_idf.h"
+#include "cs_heap.h"
+#include "host_test.h"
+
+#define HOST_SECTOR_SZ	(4096)
+
+
+static esp_partition_t	hostPart;
+static uint8_t *		hostFlashData;
+static hostFlash_t		hostFlash;
+
+
+hostFlash_t * hostFlashInit(const char * label, uint32_t size)
+{
+	free(hostFlashData);
+	hostFlashData = malloc(size);
+	memset(hostFlashData, 0xFF, size);
+
+	memset(&hostPart, 0, sizeof(hostPart));
+	hostPart.type = ESP_PARTITION_TYPE_DATA;
+	hostPart.size = size;
+	snprintf(hostPart.label, sizeof(hostPart.label), "%s", label);
+
+	memset(&hostFlash, 0, sizeof(hostFlash));
+	hostFlash.cutAfter = -1;
+
+	return &hostFlash;
+}
+
+
+const esp_partition_t * esp_partition_find_first(
+	esp_partition_type_t	type,
+	esp_partition_subtype_t	subtype,
+	const char *			label
+)
+{
+	if (!hostFlashData || type != hostPart.type || strcmp(label, hostPart.label) != 0)
+		return NULL;
+	return &hostPart;
+}
+
+
+esp_err_t esp_partition_read(const esp_partition_t * part, size_t offset, void * dst, size_t len)
+{
+	if (offset + len > part->size)
+		return ESP_ERR_INVALID_SIZE;
+
+	memcpy(dst, &hostFlashData[offset], len);
+	hostFlash.readOps   += 1;
+	hostFlash.readBytes += len;
+	return ESP_OK;
+}
+
+
+/**
+ * \brief Program bytes the way NOR flash does, clearing bits only
+ *
+ * After hostFlash_t.cutAfter bytes the write fails part way, as if power
+ * was lost
+ */
+esp_err_t esp_partition_write(const esp_partition_t * part, size_t offset, const void * src, size_t len)
+{
+	const uint8_t *	data = src;
+	size_t			i;
+
+	if (offset + len > part->size || (offset & 3) != 0)
+		return ESP_ERR_INVALID_ARG;
+
+	for (i = 0; i < len; i++) {
+		if (0 == hostFlash.cutAfter)
+			return ESP_FAIL;
+		if (hostFlash.cutAfter > 0)
+			hostFlash.cutAfter -= 1;
+
+		hostFlashData[offset + i] &= data[i];
+		hostFlash.programmed += 1;
+	}
+
+	return ESP_OK;
+}
+
+
+esp_err_t esp_partition_erase_range(const esp_partition_t * part, size_t offset, size_t len)
+{
+	if (offset + len > part->size || (offset % HOST_SECTOR_SZ) != 0 || (len % HOST_SECTOR_SZ) != 0)
+		return ESP_ERR_INVALID_ARG;
+
+	memset(&hostFlashData[offset], 0xFF, len);
+	hostFlash.erased += len / HOST_SECTOR_SZ;
+	return ESP_OK;
+}
+
+
+/**
+ * \brief CRC-32 as computed by crc32_le() in the ESP32 ROM
+ */
+uint32_t crc32_le(uint32_t crc, const uint8_t * buf, uint32_t len)
+{
+	int		i;
+
+	crc = ~crc;
+	while (len--) {
+		crc ^= *buf++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+	}
+
+	return ~crc;
+}
+
+
+int64_t esp_timer_get_time(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+// Single task on the host, the mutex is never contended
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+	return malloc(1);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t wait)
+{
+	return 1;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex)
+{
+	return 1;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t mutex)
+{
+	free(mutex);
+}
+
+
+void * cs_heap_malloc(size_t siz)
+{
+	return malloc(siz);
+}
+
+void * cs_heap_calloc(size_t num, size_t siz)
+{
+	return calloc(num, siz);
+}
+
+void * cs_heap_realloc(void * old, size_t siz)
+{
+	return realloc(old, siz);
+}
+
+void cs_heap_free(void * ptr)
+{
+	free(ptr);
+}
+
+
+int	hostTestChecks;
+int	hostTestFails;
+
+int hostTestResult(void)
+{
+	printf("%d checks, %d failed\n", hostTestChecks, hostTestFails);
+	return (0 == hostTestFails) ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+/*
+ * host_idf.h
+ *
+ * Just enough of ESP-IDF and FreeRTOS to build cs-core and cs-utils
+ * sources on the development host, see Makefile. Included ahead of every
+ * source, it stands in for cs_common.h, whose IDF headers are not
+ * available here.
+ */
+
+#ifndef HOST_TEST_HOST_IDF_H_
+#define HOST_TEST_HOST_IDF_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Skip the target cs_common.h
+#define COMPONENTS_CS_CORE_INCLUDE_CS_COMMON_H_
+
+#define IRAM_ATTR
+
+typedef int esp_err_t;
+
+#define ESP_OK						(0)
+#define ESP_FAIL					(-1)
+#define ESP_ERR_NO_MEM				(0x101)
+#define ESP_ERR_INVALID_ARG			(0x102)
+#define ESP_ERR_INVALID_STATE		(0x103)
+#define ESP_ERR_INVALID_SIZE		(0x104)
+#define ESP_ERR_NOT_FOUND			(0x105)
+#define ESP_ERR_NOT_SUPPORTED		(0x106)
+#define ESP_ERR_NVS_NOT_FOUND		(0x1102)
+#define ESP_ERR_NVS_INVALID_LENGTH	(0x110c)
+
+typedef uint32_t	TickType_t;
+typedef int			BaseType_t;
+typedef void *		SemaphoreHandle_t;
+
+#define portMAX_DELAY				(0xFFFFFFFF)
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex);
+void vSemaphoreDelete(SemaphoreHandle_t mutex);
+
+int64_t esp_timer_get_time(void);
+
+typedef uint32_t	nvs_handle;
+
+uint32_t crc32_le(uint32_t crc, const uint8_t * buf, uint32_t len);
+
+
+//******************************************************************************
+// Flash partition held in RAM, see host_idf.c
+//******************************************************************************
+
+typedef int esp_partition_type_t;
+typedef int esp_partition_subtype_t;
+
+typedef struct {
+	esp_partition_type_t	type;
+	esp_partition_subtype_t	subtype;
+	uint32_t				address;
+	uint32_t				size;
+	char					label[17];
+	bool					encrypted;
+} esp_partition_t;
+
+#define ESP_PARTITION_TYPE_DATA		(1)
+#define ESP_PARTITION_SUBTYPE_ANY	(0xFF)
+
+const esp_partition_t * esp_partition_find_first(
+	esp_partition_type_t	type,
+	esp_partition_subtype_t	subtype,
+	const char *			label
+);
+esp_err_t esp_partition_read(const esp_partition_t * part, size_t offset, void * dst, size_t len);
+esp_err_t esp_partition_write(const esp_partition_t * part, size_t offset, const void * src, size_t len);
+esp_err_t esp_partition_erase_range(const esp_partition_t * part, size_t offset, size_t len);
+
+typedef struct {
+	long	readOps;
+	long	readBytes;
+	long	programmed;		// Bytes written
+	long	erased;			// Sectors erased
+	long	cutAfter;		// Bytes written before a power cut, < 0 for none
+} hostFlash_t;
+
+// Create the partition erased, returns its counters
+hostFlash_t * hostFlashInit(const char * label, uint32_t size);
+
+
+//******************************************************************************
+// cJSON, the item only, for cs_json_writer
+//******************************************************************************
+
+#define cJSON_Invalid	(0)
+#define cJSON_False		(1 << 0)
+#define cJSON_True		(1 << 1)
+#define cJSON_NULL		(1 << 2)
+#define cJSON_Number	(1 << 3)
+#define cJSON_String	(1 << 4)
+#define cJSON_Array		(1 << 5)
+#define cJSON_Object	(1 << 6)
+#define cJSON_Raw		(1 << 7)
+
+typedef struct cJSON {
+	struct cJSON *	next;
+	struct cJSON *	prev;
+	struct cJSON *	child;
+	int				type;
+	char *			valuestring;
+	int				valueint;
+	double			valuedouble;
+	char *			string;
+} cJSON;
+
+
+#endif /* HOST_TEST_HOST_IDF_H_ */
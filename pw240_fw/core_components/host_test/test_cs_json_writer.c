@@ -0,0 +1,352 @@
+/*
+ * test_cs_json_writer.c
+ *
+ * Host test of the streaming JSON writer
+ *
+ * A document is written counting only, into one buffer, and through a
+ * flush function with every small buffer size, and must come out the
+ * same each time. cJSON items must come out as cJSON_PrintUnformatted
+ * writes them.
+ *
+ *   make test_cs_json_writer && ./test_cs_json_writer
+ *
+ * With "bench" it times the status body of app_pw_api against the
+ * sprintf(p + strlen(p)) way it was built before:
+ *
+ *   ./test_cs_json_writer bench [bodies]
+ */
+
+#include <math.h>
+#include "host_test.h"
+
+// The source is included, the Makefile builds each test from one file
+#include "../cs-utils/cs_json_writer.c"
+
+
+static char	sinkBuf[4096];
+static int	sinkLen;
+static int	sinkCalls;
+
+/**
+ * \brief Flush function collecting the output, fails if cbData is set
+ */
+static esp_err_t sink(void * cbData, const char * data, int len)
+{
+	CHECK(len > 0 && sinkLen + len <= sizeof(sinkBuf));
+	if (len > 0 && sinkLen + len <= sizeof(sinkBuf)) {
+		memcpy(&sinkBuf[sinkLen], data, len);
+		sinkLen += len;
+	}
+	sinkCalls++;
+
+	return cbData ? ESP_FAIL : ESP_OK;
+}
+
+
+static const char	docText[] =
+	"{\"fw\":\"1.2.3\",\"esc\":\"a\\\"b\\\\c\\n\\t\\u0001\",\"rssi\":-1000,"
+	"\"socket\":["
+	"{\"socketIdx\":0,\"occupied\":false,\"volts\":120.3,\"amps\":0.005,\"watts\":0.0,\"wattHours\":18446744073709551615},"
+	"{\"socketIdx\":1,\"occupied\":true,\"volts\":120.4,\"amps\":2.005,\"watts\":0.0,\"wattHours\":18446744073709551615}"
+	"],\"e\":[],\"o\":{},\"neg\":-0.05,\"min\":-9223372036854775808,\"raw\":[1,2]}";
+
+static void writeDoc(csJsonWriter_t * jw)
+{
+	int	i;
+
+	csJsonObjOpen(jw, NULL);
+	csJsonStr(jw, "fw", "1.2.3");
+	csJsonStr(jw, "esc", "a\"b\\c\n\t\x01");
+	csJsonInt(jw, "rssi", -1000);
+
+	csJsonArrOpen(jw, "socket");
+	for (i = 0; i < 2; i++) {
+		csJsonObjOpen(jw, NULL);
+		csJsonInt(jw, "socketIdx", i);
+		csJsonBool(jw, "occupied", i);
+		csJsonFixed(jw, "volts", 1203 + i, 1);
+		csJsonFixed(jw, "amps", 5 + i * 2000, 3);
+		csJsonFixed(jw, "watts", 0, 1);
+		csJsonUint(jw, "wattHours", UINT64_MAX);
+		csJsonObjClose(jw);
+	}
+	csJsonArrClose(jw);
+
+	csJsonArrOpen(jw, "e");
+	csJsonArrClose(jw);
+	csJsonObjOpen(jw, "o");
+	csJsonObjClose(jw);
+	csJsonFixed(jw, "neg", -5, 2);
+	csJsonFixed(jw, "min", INT64_MIN, 0);
+	csJsonRaw(jw, "raw", "[1,2]");
+	csJsonObjClose(jw);
+}
+
+
+static void testDoc(void)
+{
+	csJsonWriter_t	jw;
+	char			buf[512];
+	char			small[64];
+	int				len = strlen(docText);
+	int				sz;
+
+	// Counting only
+	CHECK(csJsonWriterInit(&jw, NULL, 0, NULL, NULL) == ESP_OK);
+	writeDoc(&jw);
+	CHECK(csJsonWriterFinish(&jw) == ESP_OK);
+	CHECK(csJsonWriterLen(&jw) == len);
+
+	// One buffer
+	CHECK(csJsonWriterInit(&jw, buf, sizeof(buf), NULL, NULL) == ESP_OK);
+	writeDoc(&jw);
+	CHECK(csJsonWriterFinish(&jw) == ESP_OK);
+	CHECK(strcmp(buf, docText) == 0);
+
+	// Exactly the length and the terminator fits, one byte less does not
+	CHECK(csJsonWriterInit(&jw, buf, len + 1, NULL, NULL) == ESP_OK);
+	writeDoc(&jw);
+	CHECK(csJsonWriterFinish(&jw) == ESP_OK);
+	CHECK(strcmp(buf, docText) == 0);
+
+	CHECK(csJsonWriterInit(&jw, buf, len, NULL, NULL) == ESP_OK);
+	writeDoc(&jw);
+	CHECK(csJsonWriterFinish(&jw) == ESP_ERR_NO_MEM);
+
+	// Through a flush function, every small buffer size
+	for (sz = 2; sz < sizeof(small); sz++) {
+		sinkLen   = 0;
+		sinkCalls = 0;
+
+		CHECK(csJsonWriterInit(&jw, small, sz, sink, NULL) == ESP_OK);
+		writeDoc(&jw);
+		CHECK(csJsonWriterFinish(&jw) == ESP_OK);
+		CHECK(csJsonWriterLen(&jw) == len);
+		CHECK(sinkLen == len && memcmp(sinkBuf, docText, len) == 0);
+		CHECK(sinkCalls == (len + sz - 1) / sz);
+	}
+}
+
+
+static void testErrors(void)
+{
+	csJsonWriter_t	jw;
+	char			buf[64];
+	int				i;
+
+	CHECK(csJsonWriterInit(NULL, buf, sizeof(buf), NULL, NULL) == ESP_ERR_INVALID_ARG);
+	CHECK(csJsonWriterInit(&jw, buf, 1, NULL, NULL) == ESP_ERR_INVALID_ARG);
+
+	// The first error is kept
+	CHECK(csJsonWriterInit(&jw, buf, sizeof(buf), NULL, NULL) == ESP_OK);
+	writeDoc(&jw);
+	CHECK(csJsonWriterStatus(&jw) == ESP_ERR_NO_MEM);
+	CHECK(csJsonInt(&jw, "x", 1) == ESP_ERR_NO_MEM);
+	CHECK(csJsonWriterFinish(&jw) == ESP_ERR_NO_MEM);
+
+	// An error from the flush function is kept, and it is not called again
+	sinkLen   = 0;
+	sinkCalls = 0;
+	CHECK(csJsonWriterInit(&jw, buf, 16, sink, (void *)1) == ESP_OK);
+	writeDoc(&jw);
+	CHECK(csJsonWriterFinish(&jw) == ESP_FAIL);
+	CHECK(1 == sinkCalls);
+
+	// Unbalanced
+	CHECK(csJsonWriterInit(&jw, buf, sizeof(buf), NULL, NULL) == ESP_OK);
+	csJsonObjOpen(&jw, NULL);
+	CHECK(csJsonWriterFinish(&jw) == ESP_ERR_INVALID_STATE);
+
+	CHECK(csJsonWriterInit(&jw, buf, sizeof(buf), NULL, NULL) == ESP_OK);
+	CHECK(csJsonObjClose(&jw) == ESP_ERR_INVALID_STATE);
+
+	// Too deep
+	CHECK(csJsonWriterInit(&jw, NULL, 0, NULL, NULL) == ESP_OK);
+	for (i = 0; i < CS_JSON_MAX_DEPTH - 1; i++)
+		CHECK(csJsonArrOpen(&jw, NULL) == ESP_OK);
+	CHECK(csJsonArrOpen(&jw, NULL) == ESP_ERR_INVALID_STATE);
+
+	// Arguments
+	CHECK(csJsonWriterInit(&jw, buf, sizeof(buf), NULL, NULL) == ESP_OK);
+	CHECK(csJsonFixed(&jw, NULL, 1, 10) == ESP_ERR_INVALID_ARG);
+	CHECK(csJsonFixed(&jw, NULL, 1, -1) == ESP_ERR_INVALID_ARG);
+	CHECK(csJsonStr(&jw, NULL, NULL) == ESP_ERR_INVALID_ARG);
+	CHECK(csJsonItem(&jw, NULL, NULL) == ESP_ERR_INVALID_ARG);
+	CHECK(csJsonObjOpen(NULL, NULL) == ESP_ERR_INVALID_ARG);
+	CHECK(csJsonWriterLen(NULL) < 0);
+	CHECK(csJsonWriterStatus(&jw) == ESP_OK);
+}
+
+
+/**
+ * \brief Write one number item on its own and compare the text
+ */
+static bool numberIs(double value, const char * want)
+{
+	cJSON			item = { .type = cJSON_Number, .valuedouble = value };
+	csJsonWriter_t	jw;
+	char			buf[64];
+
+	// valueint as cJSON sets it, saturated
+	if (value >= INT32_MAX)
+		item.valueint = INT32_MAX;
+	else if (value <= (double)INT32_MIN)
+		item.valueint = INT32_MIN;
+	else if (!isnan(value))
+		item.valueint = (int)value;
+
+	csJsonWriterInit(&jw, buf, sizeof(buf), NULL, NULL);
+	csJsonItem(&jw, NULL, &item);
+	if (csJsonWriterFinish(&jw) != ESP_OK || strcmp(buf, want) != 0) {
+		printf("  %.17g written as %s, expected %s\n", value, buf, want);
+		return false;
+	}
+	return true;
+}
+
+
+static void testItem(void)
+{
+	csJsonWriter_t	jw;
+	char			buf[256];
+
+	// {"event":"socket","data":{"socketIdx":3,"st\"ate":"on","x":1.5,"t":true,"n":null,"a":[false,"r"]}}
+	cJSON	r1   = { .type = cJSON_Raw, .valuestring = "\"r\"" };
+	cJSON	f2   = { .type = cJSON_False, .next = &r1 };
+	cJSON	a1   = { .type = cJSON_Array, .child = &f2, .string = "a" };
+	cJSON	n2   = { .type = cJSON_NULL, .string = "n", .next = &a1 };
+	cJSON	t1   = { .type = cJSON_True, .string = "t", .next = &n2 };
+	cJSON	f1   = { .type = cJSON_Number, .valueint = 1, .valuedouble = 1.5, .string = "x", .next = &t1 };
+	cJSON	s1   = { .type = cJSON_String, .valuestring = "on", .string = "st\"ate", .next = &f1 };
+	cJSON	n1   = { .type = cJSON_Number, .valueint = 3, .valuedouble = 3, .string = "socketIdx", .next = &s1 };
+	cJSON	data = { .type = cJSON_Object, .child = &n1, .string = "data" };
+	cJSON	ev   = { .type = cJSON_String, .valuestring = "socket", .string = "event", .next = &data };
+	cJSON	root = { .type = cJSON_Object, .child = &ev };
+
+	CHECK(csJsonWriterInit(&jw, buf, sizeof(buf), NULL, NULL) == ESP_OK);
+	CHECK(csJsonItem(&jw, NULL, &root) == ESP_OK);
+	CHECK(csJsonWriterFinish(&jw) == ESP_OK);
+	CHECK(strcmp(buf,
+		"{\"event\":\"socket\",\"data\":{\"socketIdx\":3,\"st\\\"ate\":\"on\",\"x\":1.5,"
+		"\"t\":true,\"n\":null,\"a\":[false,\"r\"]}}") == 0);
+
+	// Numbers as cJSON_PrintUnformatted gives them
+	CHECK(numberIs(0, "0"));
+	CHECK(numberIs(-42, "-42"));
+	CHECK(numberIs(0.1, "0.1"));
+	CHECK(numberIs(-2.5, "-2.5"));
+	CHECK(numberIs(1.0 / 3.0, "0.33333333333333331"));
+	CHECK(numberIs(1e300, "1e+300"));
+	CHECK(numberIs(0.1 + 0.2, "0.30000000000000004"));
+	CHECK(numberIs(4294967296.0, "4294967296"));
+	CHECK(numberIs(NAN, "null"));
+	CHECK(numberIs(INFINITY, "null"));
+
+	// Types it does not know
+	cJSON	bad = { .type = cJSON_Invalid };
+	CHECK(csJsonWriterInit(&jw, buf, sizeof(buf), NULL, NULL) == ESP_OK);
+	CHECK(csJsonItem(&jw, NULL, &bad) == ESP_ERR_NOT_SUPPORTED);
+}
+
+
+//******************************************************************************
+// Benchmark
+//******************************************************************************
+
+// POST_CHUNK_SZ of app_pw_api
+#define BENCH_CHUNK_SZ	(256)
+
+static void writeStatus(csJsonWriter_t * jw, int n)
+{
+	int	i;
+
+	csJsonObjOpen(jw, NULL);
+	csJsonStr(jw, "fw", "1.2.3");
+	csJsonInt(jw, "rssi", -60 - n % 20);
+
+	csJsonArrOpen(jw, "socket");
+	for (i = 0; i < 2; i++) {
+		csJsonObjOpen(jw, NULL);
+		csJsonInt(jw, "socketIdx", i);
+		csJsonBool(jw, "occupied", i);
+		csJsonFixed(jw, "volts", 1203 + n % 10, 1);
+		csJsonFixed(jw, "amps", 5 + i * 2000, 3);
+		csJsonFixed(jw, "watts", 2406 * i, 1);
+		csJsonUint(jw, "wattHours", 123456 + n);
+		csJsonObjClose(jw);
+	}
+	csJsonArrClose(jw);
+	csJsonObjClose(jw);
+}
+
+
+static void sprintStatus(char * p, int n)
+{
+	int	i;
+
+	sprintf(p, "{\"fw\":\"%s\",\"rssi\":%d", "1.2.3", -60 - n % 20);
+	sprintf(p + strlen(p), ",\"socket\":[");
+	for (i = 0; i < 2; i++) {
+		if (i)
+			sprintf(p + strlen(p), ",");
+		sprintf(p + strlen(p), "{\"socketIdx\":%d", i);
+		sprintf(p + strlen(p), ",\"occupied\":%s", i ? "true" : "false");
+		sprintf(p + strlen(p), ",\"volts\":%.1f", (float)(1203 + n % 10) / 10.0);
+		sprintf(p + strlen(p), ",\"amps\":%.3f", (float)(5 + i * 2000) / 1000.0);
+		sprintf(p + strlen(p), ",\"watts\":%.1f", (float)(2406 * i) / 10.0);
+		sprintf(p + strlen(p), ",\"wattHours\":%llu", 123456ULL + n);
+		sprintf(p + strlen(p), "}");
+	}
+	sprintf(p + strlen(p), "]}");
+}
+
+
+static void bench(int count)
+{
+	static char		buf[2048];
+	csJsonWriter_t	jw;
+	int64_t			t0;
+	double			writerNs;
+	double			sprintNs;
+	int				n;
+
+	// Both give the same text
+	csJsonWriterInit(&jw, buf, sizeof(buf), NULL, NULL);
+	writeStatus(&jw, 7);
+	CHECK(csJsonWriterFinish(&jw) == ESP_OK);
+	sprintStatus(sinkBuf, 7);
+	CHECK(strcmp(buf, sinkBuf) == 0);
+
+	t0 = esp_timer_get_time();
+	for (n = 0; n < count; n++) {
+		sinkLen = 0;
+		csJsonWriterInit(&jw, buf, BENCH_CHUNK_SZ, sink, NULL);
+		writeStatus(&jw, n);
+		csJsonWriterFinish(&jw);
+	}
+	writerNs = (double)(esp_timer_get_time() - t0) * 1000.0 / count;
+
+	t0 = esp_timer_get_time();
+	for (n = 0; n < count; n++) {
+		buf[0] = '\0';
+		sprintStatus(buf, n);
+	}
+	sprintNs = (double)(esp_timer_get_time() - t0) * 1000.0 / count;
+
+	printf("status body, %d bytes: writer %.0f ns, sprintf %.0f ns\n", csJsonWriterLen(&jw), writerNs, sprintNs);
+}
+
+
+int main(int argc, char * argv[])
+{
+	if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+		bench((argc > 2) ? atoi(argv[2]) : 200000);
+		return hostTestResult();
+	}
+
+	testDoc();
+	testErrors();
+	testItem();
+
+	return hostTestResult();
+}
@@ -0,0 +1,299 @@
+/*
+ * test_param_store_journal.c
+ *
+ * Host test of the journal parameter store, run against a partition held
+ * in RAM that programs and erases like NOR flash and can lose power part
+ * way through a write, see host_idf.c
+ *
+ *   make test_param_store_journal && ./test_param_store_journal
+ *
+ * With "bench" it runs the workloads of "param_journal.py bench" through
+ * the real store and prints the flash traffic they cause:
+ *
+ *   ./test_param_store_journal bench [commits]
+ */
+
+#include "host_test.h"
+
+// The source is included to reach its state, a reboot drops it
+#include "../cs-core/param_store_journal.c"
+
+#define PART_SZ		(0x10000)
+
+
+static hostFlash_t *	flash;
+
+
+/**
+ * \brief Drop the RAM state and open the store again, as after a reboot
+ */
+static esp_err_t reboot(void)
+{
+	control_t *	pCtrl = control;
+	int			i;
+
+	if (pCtrl) {
+		for (i = 0; i < pCtrl->numKeys; i++)
+			cs_heap_free(pCtrl->keys[i].val);
+		cs_heap_free(pCtrl->keys);
+		cs_heap_free(pCtrl->staged.buf);
+		vSemaphoreDelete(pCtrl->mutex);
+		cs_heap_free(pCtrl);
+	}
+	control = NULL;
+
+	return paramStoreJournal.open();
+}
+
+
+static uint32_t getU32Val(csNvSpace_t space, const char * key)
+{
+	uint32_t	val = 0xDEAD;
+
+	if (paramStoreJournal.get(space, key, objtyp_u32, &val, NULL) != ESP_OK)
+		return 0xDEAD;
+	return val;
+}
+
+
+static void setU32Val(csNvSpace_t space, const char * key, uint32_t val)
+{
+	CHECK(paramStoreJournal.set(space, key, objtyp_u32, &val) == ESP_OK);
+}
+
+
+static void testBasic(void)
+{
+	const paramStore_t *	st = &paramStoreJournal;
+	uint32_t	u32 = 0;
+	bool		b   = true;
+	char		str[32];
+	size_t		len;
+
+	flash = hostFlashInit("cs_journal", PART_SZ);
+	CHECK(reboot() == ESP_OK);
+
+	CHECK(st->get(csNvSpace_standard, "a", objtyp_u32, &u32, NULL) == ESP_ERR_NVS_NOT_FOUND);
+
+	setU32Val(csNvSpace_standard, "a", 5);
+	CHECK(st->set(csNvSpace_standard, "b", objtyp_bool, &b) == ESP_OK);
+	CHECK(st->set(csNvSpace_sticky, "a", objtyp_str, "hello") == ESP_OK);
+	CHECK(st->commit(csNvSpace_standard) == ESP_OK);
+
+	// Keys longer than the record allows
+	CHECK(st->set(csNvSpace_standard, "0123456789abcdef", objtyp_u32, &u32) == ESP_ERR_INVALID_ARG);
+
+	CHECK(reboot() == ESP_OK);
+	CHECK(getU32Val(csNvSpace_standard, "a") == 5);
+
+	len = sizeof(str);
+	CHECK(st->get(csNvSpace_sticky, "a", objtyp_str, str, &len) == ESP_OK);
+	CHECK(strcmp(str, "hello") == 0 && 6 == len);
+
+	b = false;
+	CHECK(st->get(csNvSpace_standard, "b", objtyp_bool, &b, NULL) == ESP_OK && b);
+
+	// A type change reads as a new parameter
+	CHECK(st->get(csNvSpace_standard, "b", objtyp_u8, &b, NULL) == ESP_ERR_NVS_NOT_FOUND);
+
+	len = 3;
+	CHECK(st->get(csNvSpace_sticky, "a", objtyp_str, str, &len) == ESP_ERR_NVS_INVALID_LENGTH);
+
+	// Erasing a space keeps the other
+	CHECK(st->erase(csNvSpace_standard) == ESP_OK);
+	CHECK(reboot() == ESP_OK);
+	CHECK(getU32Val(csNvSpace_standard, "a") == 0xDEAD);
+	len = sizeof(str);
+	CHECK(st->get(csNvSpace_sticky, "a", objtyp_str, str, &len) == ESP_OK);
+}
+
+
+static void testPowerCut(void)
+{
+	const paramStore_t *	st = &paramStoreJournal;
+	int		i;
+
+	flash = hostFlashInit("cs_journal", PART_SZ);
+	CHECK(reboot() == ESP_OK);
+
+	setU32Val(csNvSpace_standard, "a", 5);
+	CHECK(st->commit(csNvSpace_standard) == ESP_OK);
+
+	// Cut part way through a two-key commit, neither value lands
+	setU32Val(csNvSpace_standard, "a", 6);
+	setU32Val(csNvSpace_standard, "c", 7);
+	flash->cutAfter = 10;
+	CHECK(st->commit(csNvSpace_standard) != ESP_OK);
+	flash->cutAfter = -1;
+
+	CHECK(reboot() == ESP_OK);
+	CHECK(getU32Val(csNvSpace_standard, "a") == 5);
+	CHECK(getU32Val(csNvSpace_standard, "c") == 0xDEAD);
+
+	// The next commit goes past the torn transaction into a new area
+	setU32Val(csNvSpace_standard, "c", 8);
+	CHECK(st->commit(csNvSpace_standard) == ESP_OK);
+	CHECK(1 == control->stats.compactCount);
+
+	CHECK(reboot() == ESP_OK);
+	CHECK(getU32Val(csNvSpace_standard, "a") == 5);
+	CHECK(getU32Val(csNvSpace_standard, "c") == 8);
+
+	// Cut at every point of a compaction, the old area stays in use
+	for (i = 0; i < 200; i += 7) {
+		flash->cutAfter = i;
+		(void)paramStoreJournalCompact();
+		flash->cutAfter = -1;
+
+		CHECK(reboot() == ESP_OK);
+		CHECK(getU32Val(csNvSpace_standard, "a") == 5);
+		CHECK(getU32Val(csNvSpace_standard, "c") == 8);
+	}
+}
+
+
+static void testChurn(void)
+{
+	const paramStore_t *	st = &paramStoreJournal;
+	paramStoreJournalStats_t	stats;
+	char	key[8];
+	int		i;
+
+	flash = hostFlashInit("cs_journal", PART_SZ);
+	CHECK(reboot() == ESP_OK);
+
+	// Enough commits to wrap both areas several times
+	for (i = 0; i < 5000; i++) {
+		snprintf(key, sizeof(key), "k%d", i % 40);
+		setU32Val(csNvSpace_standard, key, i);
+		if (3 == i % 4)
+			CHECK(st->commit(csNvSpace_standard) == ESP_OK);
+	}
+
+	CHECK(paramStoreJournalGetStats(&stats) == ESP_OK);
+	CHECK(stats.compactCount >= 2);
+	CHECK(40 == stats.numKeys);
+
+	CHECK(reboot() == ESP_OK);
+	for (i = 0; i < 40; i++) {
+		snprintf(key, sizeof(key), "k%d", i);
+		CHECK(getU32Val(csNvSpace_standard, key) == (uint32_t)(4960 + i));
+	}
+}
+
+
+//******************************************************************************
+// Benchmark
+//******************************************************************************
+
+// The parameter set of simParams() in param_journal.py
+#define BENCH_NUMS		(24)
+#define BENCH_FLAGS		(12)
+#define BENCH_STRS		(14)
+#define BENCH_PARAMS	(BENCH_NUMS + BENCH_FLAGS + BENCH_STRS)
+
+static void benchSet(int idx, uint32_t rnd)
+{
+	const paramStore_t *	st = &paramStoreJournal;
+	csNvSpace_t	space = csNvSpace_standard;
+	char		key[8];
+	char		str[48];
+	bool		b;
+	int			i;
+
+	if (idx < BENCH_NUMS) {
+		snprintf(key, sizeof(key), "num%d", idx);
+		setU32Val(space, key, rnd % 1000000);
+	} else if (idx < BENCH_NUMS + BENCH_FLAGS) {
+		snprintf(key, sizeof(key), "flag%d", idx - BENCH_NUMS);
+		b = rnd & 1;
+		CHECK(st->set(space, key, objtyp_bool, &b) == ESP_OK);
+	} else {
+		idx -= BENCH_NUMS + BENCH_FLAGS;
+		if (idx >= 10)
+			space = csNvSpace_sticky;
+		snprintf(key, sizeof(key), "str%d", idx);
+
+		int	len = 4 + rnd % 37;
+		for (i = 0; i < len; i++)
+			str[i] = 'a' + (rnd >> (i % 24)) % 26;
+		str[len] = '\0';
+		CHECK(st->set(space, key, objtyp_str, str) == ESP_OK);
+	}
+}
+
+
+static void benchRun(const char * name, int commits, int perCommit)
+{
+	paramStoreJournalStats_t	stats;
+	uint32_t	rnd = 1;
+	long		prog0;
+	long		erase0;
+	int64_t		t0;
+	int64_t		commitUs = 0;
+	int			i;
+	int			j;
+
+	flash = hostFlashInit("cs_journal", PART_SZ);
+	CHECK(reboot() == ESP_OK);
+
+	// Defaults written on the first boot
+	for (i = 0; i < BENCH_PARAMS; i++)
+		benchSet(i, rnd = rnd * 1103515245 + 12345);
+	CHECK(paramStoreJournal.commit(csNvSpace_standard) == ESP_OK);
+
+	prog0  = flash->programmed;
+	erase0 = flash->erased;
+
+	for (i = 0; i < commits; i++) {
+		for (j = 0; j < perCommit; j++) {
+			rnd = rnd * 1103515245 + 12345;
+			if (1 == perCommit)
+				benchSet(BENCH_NUMS + (rnd >> 16) % BENCH_FLAGS, rnd >> 8);
+			else
+				benchSet((rnd >> 16) % BENCH_PARAMS, rnd >> 8);
+		}
+
+		t0 = esp_timer_get_time();
+		CHECK(paramStoreJournal.commit(csNvSpace_standard) == ESP_OK);
+		commitUs += esp_timer_get_time() - t0;
+	}
+
+	CHECK(paramStoreJournalGetStats(&stats) == ESP_OK);
+
+	printf("%s: %d commits of %d parameter(s)\n", name, commits, perCommit);
+	printf("  %9ld bytes programmed, %5ld sectors erased, %u compactions, %.2f us per commit\n",
+		flash->programmed - prog0,
+		flash->erased - erase0,
+		stats.compactCount,
+		(double)commitUs / commits
+	);
+
+	flash->readOps   = 0;
+	flash->readBytes = 0;
+	t0 = esp_timer_get_time();
+	CHECK(reboot() == ESP_OK);
+	printf("  boot %ld reads of %ld bytes, %lld us on the host\n",
+		flash->readOps,
+		flash->readBytes,
+		(long long)(esp_timer_get_time() - t0)
+	);
+}
+
+
+int main(int argc, char * argv[])
+{
+	if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+		int	commits = (argc > 2) ? atoi(argv[2]) : 2000;
+
+		benchRun("config push", commits, 10);
+		benchRun("single toggle", commits, 1);
+		return hostTestResult();
+	}
+
+	testBasic();
+	testPowerCut();
+	testChurn();
+
+	return hostTestResult();
+}
@@ -104,6 +104,14 @@ esp_err_t	csXmSendClose(csXmHandle_t xmHandle, bool abortFlag);
  */
 uint16_t    csXmCrc16(uint16_t crc, uint8_t data);
 
+/**
+ * \brief xmodem CRC of a block of bytes
+ *
+ * Same result as \ref csXmCrc16 applied to each byte in turn
+ *
+ */
+uint16_t    csXmCrc16Buf(uint16_t crc, const uint8_t * data, int len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,347 @@
+#!/usr/bin/python3
+#
+# Host side of the parameter journal in cs-core param_store_journal.c
+#
+# The on-flash format is described at the top of param_store_journal.c.
+#
+# List the values in a journal partition read from a device:
+#   esptool.py read_flash 0x40000 0x10000 journal.bin
+#   python3 param_journal.py dump journal.bin
+#
+# Compare flash writes, erases and boot reads of the journal with those of
+# one NVS key per parameter, for simulated parameter changes:
+#   python3 param_journal.py bench
+#
+# The journal side of the bench runs through the real store on the host
+# with "make bench" in core_components/host_test.
+#
+import sys
+import struct
+import zlib
+import random
+import argparse
+
+SECTOR_SZ      = 4096
+JRN_MAGIC      = 0x4E524A50
+JRN_VERSION    = 1
+JRN_HDR_SZ     = 16
+JRN_TXN_MAGIC  = 0x5854
+JRN_TXN_HDR_SZ = 8
+JRN_REC_HDR_SZ = 6
+JRN_SNAPSHOT   = 2048
+JRN_OP_SET     = 1
+JRN_OP_ERASE   = 2
+
+# objtype_t in param_mgr.h
+OBJ_U8, OBJ_I32, OBJ_U32, OBJ_STR, OBJ_BOOL = range(5)
+OBJ_NAMES = {OBJ_U8: "u8", OBJ_I32: "i32", OBJ_U32: "u32", OBJ_STR: "str", OBJ_BOOL: "bool"}
+SPACE_NAMES = {0: "cs_param", 1: "cs_sticky"}
+
+# NVS page layout, see the ESP-IDF NVS documentation
+NVS_ENTRY_SZ   = 32
+NVS_PAGE_HDR   = 64			# Page header and entry state bitmap
+NVS_PAGE_ITEMS = 126
+
+
+def align4(n:int) -> int:
+	return (n + 3) & ~3
+
+
+def crc32(data:bytes, crc:int = 0) -> int:
+	# Same as crc32_le() in the ESP32 ROM
+	return zlib.crc32(data, crc) & 0xFFFFFFFF
+
+
+def encodeValue(typ:int, val) -> bytes:
+	if typ in (OBJ_U8, OBJ_BOOL):
+		return struct.pack("<B", int(val))
+	if OBJ_I32 == typ:
+		return struct.pack("<i", val)
+	if OBJ_U32 == typ:
+		return struct.pack("<I", val)
+	return val.encode()
+
+
+def decodeValue(typ:int, data:bytes):
+	if typ in (OBJ_U8, OBJ_BOOL):
+		return data[0]
+	if OBJ_I32 == typ:
+		return struct.unpack("<i", data)[0]
+	if OBJ_U32 == typ:
+		return struct.unpack("<I", data)[0]
+	return data.decode(errors="replace")
+
+
+def record(op:int, space:int, typ:int, key:str, val:bytes) -> bytes:
+	k = key.encode()
+	return struct.pack("<BBBBH", op, space, typ, len(k), len(val)) + k + val
+
+
+def transaction(payload:bytes) -> bytes:
+	hdr = struct.pack("<HH", JRN_TXN_MAGIC, len(payload))
+	txn = hdr + struct.pack("<I", crc32(payload, crc32(hdr))) + payload
+	return txn + b"\xff" * (align4(len(txn)) - len(txn))
+
+
+def readArea(area:bytes) -> tuple:
+	# Returns the sequence number, values and bytes used, sequence 0 for
+	# an area without a valid header
+	magic, ver, _, seq, crc = struct.unpack("<IHHII", area[:JRN_HDR_SZ])
+	if magic != JRN_MAGIC or ver != JRN_VERSION or crc != crc32(area[:12]):
+		return 0, {}, 0
+
+	vals = {}
+	off = JRN_HDR_SZ
+	while off + JRN_TXN_HDR_SZ <= len(area):
+		magic, n, crc = struct.unpack("<HHI", area[off:off + JRN_TXN_HDR_SZ])
+		if 0xFFFF == magic:
+			break
+		payload = area[off + JRN_TXN_HDR_SZ:off + JRN_TXN_HDR_SZ + n]
+		if magic != JRN_TXN_MAGIC or len(payload) != n or crc != crc32(payload, crc32(area[off:off + 4])):
+			print(f"Bad transaction at {off}, rest of area ignored")
+			off = len(area)
+			break
+
+		pos = 0
+		while pos + JRN_REC_HDR_SZ <= n:
+			op, space, typ, keyLen, valLen = struct.unpack("<BBBBH", payload[pos:pos + JRN_REC_HDR_SZ])
+			pos += JRN_REC_HDR_SZ
+			key = payload[pos:pos + keyLen].decode(errors="replace")
+			val = payload[pos + keyLen:pos + keyLen + valLen]
+			pos += keyLen + valLen
+			if JRN_OP_ERASE == op:
+				vals = {k: v for k, v in vals.items() if k[0] != space}
+			else:
+				vals[(space, key)] = (typ, val)
+
+		off += align4(JRN_TXN_HDR_SZ + n)
+
+	return seq, vals, off
+
+
+def dump(args) -> int:
+	with open(args.infile, "rb") as f:
+		image = f.read()
+
+	areaSz = (len(image) // 2) & ~(SECTOR_SZ - 1)
+	areas = [readArea(image[i * areaSz:(i + 1) * areaSz]) for i in (0, 1)]
+	active = 1 if areas[1][0] > areas[0][0] else 0
+	seq, vals, used = areas[active]
+	if 0 == seq:
+		print(f"{args.infile}: no valid journal")
+		return 1
+
+	print(f"{args.infile}: area {active} of {areaSz} bytes, sequence {seq}, {used} bytes used, {len(vals)} values")
+	for (space, key), (typ, val) in sorted(vals.items()):
+		print(f"  {SPACE_NAMES.get(space, space):10s} {key:16s} {OBJ_NAMES.get(typ, typ):5s} {decodeValue(typ, val)!r}")
+	return 0
+
+
+class journalSim():
+	# The journal of param_store_journal.c on a simulated partition
+	def __init__(self, partSz:int):
+		self.areaSz = (partSz // 2) & ~(SECTOR_SZ - 1)
+		self.vals = {}
+		self.seq = 1
+		self.writeOff = JRN_HDR_SZ
+		self.programmed = JRN_HDR_SZ
+		self.erases = self.areaSz // SECTOR_SZ
+		self.compactions = 0
+
+	def commit(self, changes:list):
+		payload = b"".join(record(JRN_OP_SET, s, t, k, encodeValue(t, v)) for s, k, t, v in changes)
+		txn = transaction(payload)
+		for s, k, t, v in changes:
+			self.vals[(s, k)] = (t, encodeValue(t, v))
+
+		if self.writeOff + len(txn) <= self.areaSz:
+			self.writeOff += len(txn)
+			self.programmed += len(txn)
+		else:
+			self.compact()
+
+	def compact(self):
+		self.erases += self.areaSz // SECTOR_SZ
+		off = JRN_HDR_SZ
+		payload = b""
+		for (s, k), (t, v) in self.vals.items():
+			rec = record(JRN_OP_SET, s, t, k, v)
+			if len(payload) + len(rec) > JRN_SNAPSHOT:
+				off += len(transaction(payload))
+				payload = b""
+			payload += rec
+		if payload:
+			off += len(transaction(payload))
+		self.programmed += off
+		self.writeOff = off
+		self.seq += 1
+		self.compactions += 1
+
+	def loadReads(self) -> tuple:
+		# Both area headers, then the active area in one read
+		return 3, 2 * JRN_HDR_SZ + self.areaSz
+
+
+class nvsSim():
+	# One NVS key per parameter. Each write programs the new entries and
+	# their state bits and marks the old entries erased. A full page moves
+	# on to a free one, the last free page is kept to move the live entries
+	# of the oldest page to before erasing it.
+	def __init__(self, partSz:int):
+		self.numPages = partSz // SECTOR_SZ
+		self.pages = [[]]			# Entries of each page in use, oldest first
+		self.where = {}				# Key to its page list and span
+		self.programmed = 0
+		self.erases = 0
+		self.gcs = 0
+
+	@staticmethod
+	def span(typ:int, val) -> int:
+		if OBJ_STR == typ:
+			return 1 + (len(val.encode()) + 1 + NVS_ENTRY_SZ - 1) // NVS_ENTRY_SZ
+		return 1
+
+	def used(self, page:list) -> int:
+		return sum(e[1] for e in page)
+
+	def place(self, key, span:int):
+		tries = 0
+		while self.used(self.pages[-1]) + span > NVS_PAGE_ITEMS:
+			if len(self.pages) < self.numPages - 1:
+				self.pages.append([])
+			elif tries < self.numPages:
+				self.collect()
+				tries += 1
+			else:
+				raise RuntimeError("NVS partition full of live entries")
+		entry = [key, span, True]
+		self.pages[-1].append(entry)
+		# Entries, then two state updates of the bitmap word
+		self.programmed += span * NVS_ENTRY_SZ + 2 * 4
+		return entry
+
+	def collect(self):
+		# Move the live entries of the oldest page to the reserved free
+		# page, which becomes the active page, then erase the oldest page
+		# to be the new reserved page
+		old = self.pages.pop(0)
+		moved = [e for e in old if e[2]]
+		page = []
+		self.pages.append(page)
+		for e in moved:
+			entry = [e[0], e[1], True]
+			page.append(entry)
+			self.where[e[0]] = entry
+			self.programmed += e[1] * NVS_ENTRY_SZ + 2 * 4
+		self.erases += 1
+		self.gcs += 1
+
+	def commit(self, changes:list):
+		for s, k, t, v in changes:
+			key = (s, k)
+			old = self.where.get(key)
+			if old is not None:
+				old[2] = False
+				self.programmed += 4
+			self.where[key] = self.place(key, self.span(t, v))
+
+	def loadReads(self) -> tuple:
+		# Init reads each page header and bitmap, then each written entry
+		# to build its hash list. Each get reads the entry again, a string
+		# also its data.
+		ops = 0
+		nbytes = 0
+		for page in self.pages:
+			ops += 2 + sum(e[1] for e in page)
+			nbytes += NVS_PAGE_HDR + sum(e[1] for e in page) * NVS_ENTRY_SZ
+		for e in self.where.values():
+			ops += 1 if 1 == e[1] else 2
+			nbytes += e[1] * NVS_ENTRY_SZ
+		return ops, nbytes
+
+
+def simParams() -> list:
+	# A parameter set the size of the core and app tables: numbers, flags
+	# and strings such as names, URLs and credentials
+	params = []
+	for i in range(24):
+		params.append((0, f"num{i}", OBJ_U32 if i % 3 else OBJ_I32))
+	for i in range(12):
+		params.append((0, f"flag{i}", OBJ_BOOL))
+	for i in range(14):
+		params.append((0 if i < 10 else 1, f"str{i}", OBJ_STR))
+	return params
+
+
+def simValue(rng:random.Random, typ:int):
+	if OBJ_BOOL == typ:
+		return rng.randint(0, 1)
+	if OBJ_U8 == typ:
+		return rng.randint(0, 255)
+	if OBJ_I32 == typ:
+		return rng.randint(-100000, 100000)
+	if OBJ_U32 == typ:
+		return rng.randint(0, 1000000)
+	return "".join(rng.choice("abcdefghijklmnopqrstuvwxyz") for _ in range(rng.randint(4, 40)))
+
+
+def runWorkload(name:str, params:list, count:int, perCommit:int, args) -> None:
+	rng = random.Random(1)
+	jrn = journalSim(args.journal_size)
+	nvs = nvsSim(args.nvs_size)
+
+	# Defaults written on the first boot
+	first = [(s, k, t, simValue(rng, t)) for s, k, t in params]
+	jrn.commit(first)
+	nvs.commit(first)
+	jrn0, nvs0 = jrn.programmed, nvs.programmed
+	jrnE0, nvsE0 = jrn.erases, nvs.erases
+
+	logical = 0
+	for _ in range(count):
+		if 1 == perCommit:
+			s, k, t = rng.choice([p for p in params if OBJ_BOOL == p[2]])
+			changes = [(s, k, t, rng.randint(0, 1))]
+		else:
+			changes = [(s, k, t, simValue(rng, t)) for s, k, t in rng.sample(params, perCommit)]
+		logical += sum(len(k) + len(encodeValue(t, v)) for s, k, t, v in changes)
+		jrn.commit(changes)
+		nvs.commit(changes)
+
+	print(f"{name}: {count} commits of {perCommit} parameter(s), {logical} bytes of keys and values")
+	for label, sim, p0, e0 in (("nvs", nvs, nvs0, nvsE0), ("journal", jrn, jrn0, jrnE0)):
+		prog = sim.programmed - p0
+		ops, nbytes = sim.loadReads()
+		print(f"  {label:8s} {prog:9d} bytes programmed, write amplification {prog / logical:5.2f}, "
+			f"{sim.erases - e0:5d} sectors erased, boot {ops:5d} reads of {nbytes:6d} bytes")
+
+
+def bench(args) -> int:
+	params = simParams()
+	runWorkload("config push", params, args.count, args.push, args)
+	runWorkload("single toggle", params, args.count, 1, args)
+	return 0
+
+
+def main() -> int:
+	p = argparse.ArgumentParser(description="Parameter journal")
+	sub = p.add_subparsers(dest="mode", required=True)
+
+	d = sub.add_parser("dump", help="List the values in a journal partition image")
+	d.add_argument("infile")
+
+	b = sub.add_parser("bench", help="Compare the journal with NVS")
+	b.add_argument("--count", type=int, default=2000, help="Commits to simulate")
+	b.add_argument("--push", type=int, default=10, help="Parameters changed by a config push")
+	b.add_argument("--journal-size", type=lambda x: int(x, 0), default=0x10000, help="Journal partition size")
+	b.add_argument("--nvs-size", type=lambda x: int(x, 0), default=0x20000, help="NVS partition size")
+
+	args = p.parse_args()
+
+	if "bench" == args.mode:
+		return bench(args)
+	return dump(args)
+
+
+if __name__ == "__main__":
+	sys.exit(main())